@@ -0,0 +1,577 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "node.hpp"
+#include "folder.hpp"
+#include "mangler.hpp"
+using namespace std;
+using namespace fbjs;
+
+//
+// Parses, optionally folds and mangles, and renders JavaScript files, several at a time.
+//
+//   fbjs [-j threads] [-e] [-p] [-f] [-m] [-o dir | -s suffix] [-l list] [-r report] [path...]
+//
+// Paths can be files or directories, which are searched for .js files; -l reads more paths from a
+// file, one per line ("-" for stdin). With -o the output for a.js goes to dir/a.js (directories
+// keep their layout under it), with -s to a.js<suffix>. Outputs are written to a temporary file
+// beside their destination and renamed over it, so nothing ever sees half a file. With no paths
+// this filters stdin to stdout, parsing it as it's read.
+//
+// -e parses E4X, -p renders pretty, -f folds constants and -m mangles local identifiers. Files are
+// dealt to the threads biggest first, and a thread which runs out takes work from the others.
+// Errors go to stderr as they happen; -r writes every file's timings as tab-separated values. The
+// last line on stderr is the throughput of the whole run. The exit status is 1 if any file failed.
+
+namespace {
+
+  struct options_t {
+    size_t threads;
+    node_parse_enum parse_opts;
+    int render_opts;
+    bool fold;
+    bool mangle;
+    string output_dir;
+    string suffix;
+  };
+
+  struct job_t {
+    string path;
+    string output;
+    size_t bytes;
+    double read, parse, transform, render, write; // seconds
+    string error;
+  };
+
+  // The deepest trees the parsers accept render in 256KB of stack when optimized, and an unoptimized
+  // build needs about twice that. Stack that's never touched is never faulted in, so this only costs
+  // address space.
+  const size_t worker_stack_size = 64 * 1024 * 1024;
+
+  double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+  string errorMessage(const string& what) {
+    return what + ": " + strerror(errno);
+  }
+
+  //
+  // WorkQueue: a deque of jobs per thread. A thread takes from the front of its own and, once that's
+  // empty, from the back of everyone else's. Jobs are all added before the threads start.
+  class WorkQueue {
+    protected:
+      struct queue_t {
+        pthread_mutex_t mutex;
+        deque<size_t> jobs;
+      };
+      vector<queue_t*> queues;
+
+    private:
+      WorkQueue(const WorkQueue&);
+      WorkQueue& operator=(const WorkQueue&);
+
+    public:
+      WorkQueue(size_t threads) : queues(threads) {
+        for (size_t ii = 0; ii < threads; ++ii) {
+          queues[ii] = new queue_t;
+          pthread_mutex_init(&queues[ii]->mutex, NULL);
+        }
+      }
+
+      ~WorkQueue() {
+        for (size_t ii = 0; ii < queues.size(); ++ii) {
+          pthread_mutex_destroy(&queues[ii]->mutex);
+          delete queues[ii];
+        }
+      }
+
+      void push(size_t thread, size_t job) {
+        queues[thread]->jobs.push_back(job);
+      }
+
+      bool pop(size_t thread, size_t& job) {
+        for (size_t ii = 0; ii < queues.size(); ++ii) {
+          queue_t& queue = *queues[(thread + ii) % queues.size()];
+          pthread_mutex_lock(&queue.mutex);
+          bool found = !queue.jobs.empty();
+          if (found) {
+            if (ii == 0) {
+              job = queue.jobs.front();
+              queue.jobs.pop_front();
+            } else {
+              job = queue.jobs.back();
+              queue.jobs.pop_back();
+            }
+          }
+          pthread_mutex_unlock(&queue.mutex);
+          if (found) {
+            return true;
+          }
+        }
+        return false;
+      }
+  };
+
+  struct batch_t {
+    const options_t* options;
+    mode_t mode; // for new files
+    vector<job_t>* jobs;
+    WorkQueue* queue;
+    pthread_mutex_t stderr_mutex;
+  };
+
+  struct worker_t {
+    batch_t* batch;
+    size_t thread;
+  };
+
+  bool readFile(FILE* file, string& text) {
+    char buf[64 * 1024];
+    size_t read;
+    while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+      text.append(buf, read);
+    }
+    return !ferror(file);
+  }
+
+  bool makeParents(const string& path) {
+    for (size_t slash = path.find('/', 1); slash != string::npos; slash = path.find('/', slash + 1)) {
+      if (mkdir(path.substr(0, slash).c_str(), 0777) != 0 && errno != EEXIST) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //
+  // Writes `text` to a temporary file next to `path` and renames it into place
+  bool writeAtomically(const string& path, const string& text, mode_t mode, string& error) {
+    string temp = path + ".XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if (fd < 0) {
+      error = errorMessage(path);
+      return false;
+    }
+    const char* data = text.data();
+    size_t left = text.size();
+    while (left > 0) {
+      ssize_t wrote = write(fd, data, left);
+      if (wrote < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      data += wrote;
+      left -= wrote;
+    }
+    bool written = left == 0 && fchmod(fd, mode) == 0;
+    int saved = errno;
+    if (close(fd) != 0 && written) {
+      written = false;
+      saved = errno;
+    }
+    if (!written) {
+      errno = saved;
+      error = errorMessage(path);
+      unlink(temp.c_str());
+      return false;
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+      error = errorMessage(path);
+      unlink(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Transforms and renders a tree it takes ownership of, timing each step into `job`
+  string transformTree(Node* parsed, const options_t& options, job_t& job) {
+    auto_ptr<Node> root(parsed);
+    double start = now();
+    if (options.fold) {
+      NodePipeline folder;
+      folder.add(new ConstantFolder);
+      root.reset(folder.run(root.release()));
+    }
+    if (options.mangle) {
+      mangleIdentifiers(root.get());
+    }
+    job.transform = now() - start;
+
+    start = now();
+    string output = root->renderString(options.render_opts);
+    job.render = now() - start;
+    return output;
+  }
+
+  // Parses, transforms and renders `code`
+  string transform(Parser& parser, const options_t& options, const string& code, job_t& job) {
+    double start = now();
+    Node* root = parser.parse(code.data(), code.size());
+    job.parse = now() - start;
+    return transformTree(root, options, job);
+  }
+
+  void runJob(Parser& parser, const options_t& options, mode_t mode, job_t& job) {
+    double start = now();
+    FILE* file = fopen(job.path.c_str(), "r");
+    string code;
+    if (file == NULL || !readFile(file, code)) {
+      job.error = errorMessage(job.path);
+      if (file != NULL) {
+        fclose(file);
+      }
+      return;
+    }
+    fclose(file);
+    job.bytes = code.size();
+    job.read = now() - start;
+
+    string output;
+    try {
+      output = transform(parser, options, code, job);
+    } catch (exception& ex) {
+      job.error = job.path + ": " + ex.what();
+      return;
+    }
+
+    start = now();
+    if (!options.output_dir.empty() && !makeParents(job.output)) {
+      job.error = errorMessage(job.output);
+      return;
+    }
+    writeAtomically(job.output, output, mode, job.error);
+    job.write = now() - start;
+  }
+
+  void* workerThread(void* ptr) {
+    worker_t* worker = static_cast<worker_t*>(ptr);
+    batch_t& batch = *worker->batch;
+    Parser parser(batch.options->parse_opts);
+    size_t index;
+    while (batch.queue->pop(worker->thread, index)) {
+      job_t& job = (*batch.jobs)[index];
+      runJob(parser, *batch.options, batch.mode, job);
+      if (!job.error.empty()) {
+        pthread_mutex_lock(&batch.stderr_mutex);
+        fprintf(stderr, "%s\n", job.error.c_str());
+        pthread_mutex_unlock(&batch.stderr_mutex);
+      }
+    }
+    return NULL;
+  }
+
+  bool hasSuffix(const string& str, const char* suffix) {
+    size_t length = strlen(suffix);
+    return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+  }
+
+  //
+  // Adds the .js files under `dir`, in sorted order. `relative` is what's kept of their path under
+  // the output directory.
+  bool addDirectory(const string& dir, const string& relative, vector<job_t>& jobs) {
+    DIR* handle = opendir(dir.c_str());
+    if (handle == NULL) {
+      perror(dir.c_str());
+      return false;
+    }
+    vector<string> names;
+    while (struct dirent* entry = readdir(handle)) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+        names.push_back(entry->d_name);
+      }
+    }
+    closedir(handle);
+    sort(names.begin(), names.end());
+
+    bool ok = true;
+    for (size_t ii = 0; ii < names.size(); ++ii) {
+      string path = dir + "/" + names[ii];
+      string sub = relative.empty() ? names[ii] : relative + "/" + names[ii];
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0) {
+        perror(path.c_str());
+        ok = false;
+      } else if (S_ISDIR(st.st_mode)) {
+        ok = addDirectory(path, sub, jobs) && ok;
+      } else if (S_ISREG(st.st_mode) && hasSuffix(names[ii], ".js")) {
+        jobs.push_back(job_t());
+        jobs.back().path = path;
+        jobs.back().output = sub;
+        jobs.back().bytes = st.st_size;
+      }
+    }
+    return ok;
+  }
+
+  bool addPath(const string& path, vector<job_t>& jobs) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      perror(path.c_str());
+      return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      return addDirectory(path, "", jobs);
+    }
+    // Kept under the output directory, even if it was given as ../a.js or /a.js
+    string output = path;
+    while (true) {
+      if (output.compare(0, 1, "/") == 0) {
+        output.erase(0, 1);
+      } else if (output.compare(0, 2, "./") == 0) {
+        output.erase(0, 2);
+      } else if (output.compare(0, 3, "../") == 0) {
+        output.erase(0, 3);
+      } else {
+        break;
+      }
+    }
+    jobs.push_back(job_t());
+    jobs.back().path = path;
+    jobs.back().output = output;
+    jobs.back().bytes = st.st_size;
+    return true;
+  }
+
+  bool addList(const char* list, vector<job_t>& jobs) {
+    FILE* file = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    string text;
+    if (file == NULL || !readFile(file, text)) {
+      perror(list);
+      return false;
+    }
+    if (file != stdin) {
+      fclose(file);
+    }
+    bool ok = true;
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      if (end == string::npos) {
+        end = text.size();
+      }
+      if (end > pos) {
+        ok = addPath(text.substr(pos, end - pos), jobs) && ok;
+      }
+      pos = end + 1;
+    }
+    return ok;
+  }
+
+  bool biggerJob(const pair<size_t, size_t>& left, const pair<size_t, size_t>& right) {
+    return left.first > right.first;
+  }
+
+  bool writeReport(const char* path, const vector<job_t>& jobs) {
+    FILE* report = fopen(path, "w");
+    if (report == NULL) {
+      perror(path);
+      return false;
+    }
+    fprintf(report, "path\tbytes\tread_ms\tparse_ms\ttransform_ms\trender_ms\twrite_ms\terror\n");
+    for (size_t ii = 0; ii < jobs.size(); ++ii) {
+      const job_t& job = jobs[ii];
+      fprintf(report, "%s\t%lu\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%s\n",
+        job.path.c_str(), (unsigned long)job.bytes, job.read * 1e3, job.parse * 1e3,
+        job.transform * 1e3, job.render * 1e3, job.write * 1e3, job.error.c_str());
+    }
+    return fclose(report) == 0;
+  }
+
+  void usage(const char* name) {
+    fprintf(stderr,
+      "usage: %s [-j threads] [-e] [-p] [-f] [-m] [-o dir | -s suffix] [-l list] [-r report] [path...]\n",
+      name);
+    exit(2);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  options_t options;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  options.threads = cpus > 0 ? cpus : 1;
+  options.parse_opts = PARSE_NONE;
+  options.render_opts = RENDER_NONE;
+  options.fold = false;
+  options.mangle = false;
+  const char* report = NULL;
+  vector<job_t> jobs;
+  bool listed = false;
+  bool ok = true;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:epfmo:s:l:r:")) != -1) {
+    switch (opt) {
+      case 'j':
+        options.threads = max(1, atoi(optarg));
+        break;
+      case 'e':
+        options.parse_opts = static_cast<node_parse_enum>(options.parse_opts | PARSE_E4X);
+        break;
+      case 'p':
+        options.render_opts |= RENDER_PRETTY;
+        break;
+      case 'f':
+        options.fold = true;
+        break;
+      case 'm':
+        options.mangle = true;
+        break;
+      case 'o':
+        options.output_dir = optarg;
+        break;
+      case 's':
+        options.suffix = optarg;
+        break;
+      case 'l':
+        ok = addList(optarg, jobs) && ok;
+        listed = true;
+        break;
+      case 'r':
+        report = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  for (int ii = optind; ii < argc; ++ii) {
+    ok = addPath(argv[ii], jobs) && ok;
+  }
+
+  if (jobs.empty()) {
+    if (!ok) {
+      return 1;
+    } else if (optind < argc || listed) {
+      return 0; // only empty directories
+    }
+    // Parsed as it arrives, so a slow pipe costs little more than reading it
+    PushParser parser(options.parse_opts);
+    job_t job;
+    try {
+      char buf[64 * 1024];
+      ssize_t got;
+      while ((got = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+        parser.feed(buf, got);
+      }
+      if (got < 0) {
+        perror("stdin");
+        return 1;
+      }
+      string output = transformTree(parser.finish(), options, job);
+      fwrite(output.data(), 1, output.size(), stdout);
+    } catch (exception& ex) {
+      fprintf(stderr, "%s\n", ex.what());
+      return 1;
+    }
+    return 0;
+  }
+  if (options.output_dir.empty() == options.suffix.empty()) {
+    fprintf(stderr, "%s: give either -o or -s for where outputs go\n", argv[0]);
+    return 2;
+  }
+  for (size_t ii = 0; ii < jobs.size(); ++ii) {
+    job_t& job = jobs[ii];
+    job.output = options.output_dir.empty() ? job.path + options.suffix :
+      options.output_dir + "/" + job.output;
+    job.read = job.parse = job.transform = job.render = job.write = 0;
+  }
+
+  // Biggest first, dealt out like cards so that every thread starts with a share of the big ones
+  options.threads = min(options.threads, jobs.size());
+  vector<pair<size_t, size_t> > order;
+  for (size_t ii = 0; ii < jobs.size(); ++ii) {
+    order.push_back(make_pair(jobs[ii].bytes, ii));
+  }
+  stable_sort(order.begin(), order.end(), biggerJob);
+  WorkQueue queue(options.threads);
+  for (size_t ii = 0; ii < order.size(); ++ii) {
+    queue.push(ii % options.threads, order[ii].second);
+  }
+
+  // New files get the permissions open() would have given them
+  mode_t mask = umask(0);
+  umask(mask);
+
+  batch_t batch;
+  batch.options = &options;
+  batch.mode = 0666 & ~mask;
+  batch.jobs = &jobs;
+  batch.queue = &queue;
+  pthread_mutex_init(&batch.stderr_mutex, NULL);
+  vector<worker_t> workers(options.threads);
+  vector<pthread_t> threads(options.threads);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, worker_stack_size);
+  double start = now();
+  for (size_t ii = 0; ii < options.threads; ++ii) {
+    workers[ii].batch = &batch;
+    workers[ii].thread = ii;
+    if (pthread_create(&threads[ii], &attr, workerThread, &workers[ii]) != 0) {
+      // The threads which did start will pick up this one's share
+      perror("pthread_create");
+      threads.resize(ii);
+      break;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  if (threads.empty()) {
+    return 1;
+  }
+  for (size_t ii = 0; ii < threads.size(); ++ii) {
+    pthread_join(threads[ii], NULL);
+  }
+  double elapsed = now() - start;
+  pthread_mutex_destroy(&batch.stderr_mutex);
+
+  size_t failed = 0, bytes = 0;
+  for (size_t ii = 0; ii < jobs.size(); ++ii) {
+    if (!jobs[ii].error.empty()) {
+      ++failed;
+    } else {
+      bytes += jobs[ii].bytes;
+    }
+  }
+  if (report != NULL) {
+    ok = writeReport(report, jobs) && ok;
+  }
+  fprintf(stderr, "%lu files, %lu failed, %.2f MB in %.3f s, %.2f MB/s on %lu threads\n",
+    (unsigned long)jobs.size(), (unsigned long)failed, bytes / 1e6, elapsed,
+    elapsed > 0 ? bytes / 1e6 / elapsed : 0, (unsigned long)threads.size());
+  return failed || !ok ? 1 : 0;
+}
@@ -0,0 +1,474 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "node.hpp"
+#include "folder.hpp"
+#include "mangler.hpp"
+#include "pipeline.hpp"
+using namespace std;
+using namespace fbjs;
+
+//
+// Looks for inputs whose parse, walk or render time grows faster than n log n. Each input file
+// describes a family of programs in five parts separated by lines of "%%": a prefix, a unit
+// repeated k times, a middle, a unit repeated k times and a suffix. For example, nested parens:
+//
+//   x =
+//   %%
+//   (
+//   %%
+//   a
+//   %%
+//   )
+//   %%
+//   ;
+//
+// k is doubled until the program reaches max_bytes. Every operation is timed at each size (the
+// fastest of a few runs) and the slope of log(time) against log(bytes) is compared to that of
+// n log n over the same range. Operations which are steeper by more than the margin are reported,
+// and the exit status is 1 if any were. Each family runs in a child process on the ordinary stack:
+// nothing is supposed to run out of it on a tree the parser accepts, so a family which crashes is
+// reported too, with the size it got to.
+//
+//   complexity_fuzz [-b max_bytes] [-m margin] [-v] complexity_corpus/*
+//
+// Built with `make LIBFUZZER=1` (which needs clang) this is a libFuzzer target instead. It mutates
+// the families in the corpus and aborts on any which grow too fast; a stack overflow is a crash
+// libFuzzer reports like any other.
+
+namespace {
+
+  struct family_t {
+    string name;
+    string prefix, open, middle, close, suffix;
+
+    string program(size_t k) const {
+      string code(prefix);
+      code.reserve(prefix.size() + k * (open.size() + close.size()) + middle.size() + suffix.size());
+      for (size_t ii = 0; ii < k; ++ii) {
+        code += open;
+      }
+      code += middle;
+      for (size_t ii = 0; ii < k; ++ii) {
+        code += close;
+      }
+      code += suffix;
+      return code;
+    }
+  };
+
+  enum op_enum {
+    OP_PARSE,
+    OP_DESCENT,
+    OP_CLONE,
+    OP_FOLD,
+    OP_PIPELINE,
+    OP_MANGLE,
+    OP_RENDER,
+    OP_PRETTY,
+    OP_FREE,
+    OP_COUNT,
+  };
+
+  const char* const op_names[OP_COUNT] = {
+    "parse", "descent", "clone", "fold", "pipeline", "mangle", "render", "pretty", "free",
+  };
+
+  struct sample_t {
+    size_t bytes[OP_COUNT]; // what the operation's cost is measured against
+    double seconds[OP_COUNT];
+  };
+
+  struct options_t {
+    size_t min_bytes;
+    size_t max_bytes;
+    double margin;
+    double min_seconds; // samples faster than this are too noisy to fit
+    bool verbose; // print every sample
+    bool quiet; // only print families which were flagged
+  };
+
+  // Visits every node; a pass which does nothing still pays for the walk
+  class CountingPass: public NodePass {
+    public:
+      size_t count;
+      CountingPass() : count(0) {}
+      virtual void enter(Node& node) {
+        ++count;
+      }
+  };
+
+  double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+  //
+  // parseFamily: splits a corpus file into its five parts. A part's lines are joined with newlines,
+  // so a unit which ends in a newline is followed by an empty line.
+  bool parseFamily(const string& name, const string& text, family_t& family) {
+    vector<vector<string> > lines(1);
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      if (end == string::npos) {
+        end = text.size();
+      }
+      string line(text, pos, end - pos);
+      pos = end + 1;
+      if (line == "%%") {
+        lines.push_back(vector<string>());
+      } else {
+        lines.back().push_back(line);
+      }
+    }
+    vector<string> parts(lines.size());
+    for (size_t ii = 0; ii < lines.size(); ++ii) {
+      for (size_t jj = 0; jj < lines[ii].size(); ++jj) {
+        parts[ii] += jj ? "\n" + lines[ii][jj] : lines[ii][jj];
+      }
+    }
+    if (parts.size() != 5) {
+      return false;
+    }
+    family.name = name;
+    family.prefix = parts[0];
+    family.open = parts[1];
+    family.middle = parts[2];
+    family.close = parts[3];
+    family.suffix = parts[4];
+    return !family.open.empty() || !family.close.empty();
+  }
+
+  // Whether both parsers take `code`
+  bool parses(const string& code) {
+    try {
+      delete new NodeProgram(code.c_str(), PARSE_E4X);
+      delete new NodeProgram(code.c_str(), (node_parse_enum)(PARSE_E4X | PARSE_DESCENT));
+      return true;
+    } catch (exception& ex) {
+      return false;
+    }
+  }
+
+  //
+  // measureOnce: runs every operation once over `code`. Returns false if it doesn't parse.
+  bool measureOnce(const string& code, sample_t& sample) {
+    double* seconds = sample.seconds;
+    auto_ptr<Node> root;
+    double start = now();
+    try {
+      root.reset(new NodeProgram(code.c_str(), PARSE_E4X));
+      seconds[OP_PARSE] = now() - start;
+      start = now();
+      delete new NodeProgram(code.c_str(), (node_parse_enum)(PARSE_E4X | PARSE_DESCENT));
+      seconds[OP_DESCENT] = now() - start;
+    } catch (exception& ex) {
+      return false;
+    }
+
+    start = now();
+    auto_ptr<Node> copy(root->clone());
+    seconds[OP_CLONE] = now() - start;
+
+    start = now();
+    NodePipeline folder;
+    folder.add(new ConstantFolder);
+    copy.reset(folder.run(copy.release()));
+    seconds[OP_FOLD] = now() - start;
+
+    NodePipeline pipeline;
+    pipeline.add(new CountingPass);
+    start = now();
+    copy.reset(pipeline.run(copy.release()));
+    seconds[OP_PIPELINE] = now() - start;
+
+    copy.reset(root->clone());
+    start = now();
+    mangleIdentifiers(copy.get());
+    seconds[OP_MANGLE] = now() - start;
+
+    // Pretty output can be quadratic in the input (indentation of deeply nested blocks), so
+    // rendering is measured against the larger of the two
+    for (int op = 0; op < OP_COUNT; ++op) {
+      sample.bytes[op] = code.size();
+    }
+    start = now();
+    size_t bytes = root->renderString().size();
+    seconds[OP_RENDER] = now() - start;
+    sample.bytes[OP_RENDER] = max(code.size(), bytes);
+
+    start = now();
+    bytes = root->renderString(RENDER_PRETTY).size();
+    seconds[OP_PRETTY] = now() - start;
+    sample.bytes[OP_PRETTY] = max(code.size(), bytes);
+
+    start = now();
+    copy.reset();
+    seconds[OP_FREE] = now() - start;
+    return true;
+  }
+
+  //
+  // measure: keeps the fastest of several runs of each operation, so that noise from the rest of
+  // the machine can only push a sample up towards the truth instead of past it.
+  bool measure(const string& code, sample_t& sample) {
+    for (int op = 0; op < OP_COUNT; ++op) {
+      sample.seconds[op] = HUGE_VAL;
+    }
+    sample_t run_sample;
+    double start = now();
+    for (int run = 0; run < 50 && (run < 3 || now() - start < 0.05); ++run) {
+      if (!measureOnce(code, run_sample)) {
+        return false;
+      }
+      for (int op = 0; op < OP_COUNT; ++op) {
+        sample.bytes[op] = run_sample.bytes[op];
+        if (run_sample.seconds[op] < sample.seconds[op]) {
+          sample.seconds[op] = run_sample.seconds[op];
+        }
+      }
+    }
+    return true;
+  }
+
+  //
+  // slope: least-squares slope of log(seconds) against log(bytes), skipping samples too fast to
+  // time. Returns NAN if there aren't enough left.
+  double slope(const vector<sample_t>& samples, int op, double min_seconds, size_t& from, size_t& to) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    size_t n = 0;
+    for (size_t ii = 0; ii < samples.size(); ++ii) {
+      if (samples[ii].seconds[op] < min_seconds) {
+        continue;
+      }
+      double x = log((double)samples[ii].bytes[op]);
+      double y = log(samples[ii].seconds[op]);
+      if (n == 0) {
+        from = samples[ii].bytes[op];
+      }
+      to = samples[ii].bytes[op];
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+      ++n;
+    }
+    if (n < 3) {
+      return NAN;
+    }
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+  }
+
+  // The slope n log n would have between two sizes
+  double nlognSlope(size_t from, size_t to) {
+    return log((to * log((double)to)) / (from * log((double)from))) / log((double)to / from);
+  }
+
+  //
+  // check: grows a family and returns how many operations grew too fast. The size being measured
+  // is kept in `progress`, if there is one, so that a crash can say where it happened.
+  int check(const family_t& family, const options_t& options, size_t* progress = NULL) {
+    size_t k = 1;
+    while (family.program(k).size() < options.min_bytes) {
+      k *= 2;
+    }
+    // Some families nest past the parsers' limit before they're that big
+    while (k > 1 && !parses(family.program(k))) {
+      k /= 2;
+    }
+    vector<sample_t> samples;
+    string stopped;
+    for (; ; k *= 2) {
+      string code(family.program(k));
+      if (code.size() > options.max_bytes) {
+        break;
+      }
+      if (progress != NULL) {
+        *progress = code.size();
+      }
+      sample_t sample;
+      if (!measure(code, sample)) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), " (stopped parsing at %lu bytes)", (unsigned long)code.size());
+        stopped = buf;
+        break;
+      }
+      samples.push_back(sample);
+      if (options.verbose) {
+        printf("%-24s %8lu", family.name.c_str(), (unsigned long)code.size());
+        for (int op = 0; op < OP_COUNT; ++op) {
+          printf(" %s=%.0fus", op_names[op], sample.seconds[op] * 1e6);
+        }
+        printf("\n");
+      }
+    }
+    if (samples.empty()) {
+      if (!options.quiet) {
+        printf("%-24s doesn't parse\n", family.name.c_str());
+      }
+      return 0;
+    }
+
+    int flagged = 0;
+    string report;
+    for (int op = 0; op < OP_COUNT; ++op) {
+      size_t from = 0, to = 0;
+      double actual = slope(samples, op, options.min_seconds, from, to);
+      char buf[64];
+      if (isnan(actual)) {
+        snprintf(buf, sizeof(buf), " %s=-", op_names[op]);
+      } else if (actual > nlognSlope(from, to) + options.margin) {
+        snprintf(buf, sizeof(buf), " %s=%.2f(!)", op_names[op], actual);
+        ++flagged;
+      } else {
+        snprintf(buf, sizeof(buf), " %s=%.2f", op_names[op], actual);
+      }
+      report += buf;
+    }
+    if (flagged || !options.quiet) {
+      printf("%-24s %s%s%s\n",
+        family.name.c_str(), flagged ? "SUPERLINEAR" : "ok", report.c_str(), stopped.c_str());
+    }
+    return flagged;
+  }
+
+  //
+  // checkInChild: runs check() in a child process, on the stack any program gets, so that running
+  // out of it is reported like any other finding instead of ending the whole run.
+  int checkInChild(const family_t& family, const options_t& options) {
+    void* shared = mmap(NULL, sizeof(size_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+      perror("mmap");
+      abort();
+    }
+    size_t* progress = static_cast<size_t*>(shared);
+    *progress = 0;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      abort();
+    } else if (pid == 0) {
+      int flagged = check(family, options, progress);
+      fflush(stdout);
+      _exit(flagged);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    int flagged;
+    if (WIFEXITED(status)) {
+      flagged = WEXITSTATUS(status);
+    } else {
+      printf("%-24s CRASHED (%s at %lu bytes)\n", family.name.c_str(),
+        WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "unknown status", (unsigned long)*progress);
+      flagged = 1;
+    }
+    munmap(shared, sizeof(size_t));
+    return flagged;
+  }
+}
+
+#ifdef FBJS_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  family_t family;
+  if (!parseFamily("input", string((const char*)data, size), family) ||
+      family.prefix.size() + family.open.size() + family.middle.size() +
+      family.close.size() + family.suffix.size() > 256) {
+    return 0;
+  }
+  // Smaller sizes keep each input fast. They're noisier, so anything flagged is measured again
+  // before it counts.
+  options_t options = { 512, 64 * 1024, 0.3, 20e-6, false, true };
+  if (check(family, options) && check(family, options)) {
+    fprintf(stderr, "prefix: %s\nopen: %s\nmiddle: %s\nclose: %s\nsuffix: %s\n",
+      family.prefix.c_str(), family.open.c_str(), family.middle.c_str(),
+      family.close.c_str(), family.suffix.c_str());
+    abort();
+  }
+  return 0;
+}
+
+#else
+
+static bool readFile(const char* path, string& text) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  char buf[4096];
+  size_t read;
+  while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+    text.append(buf, read);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  options_t options = { 1024, 256 * 1024, 0.3, 20e-6, false, false };
+  int ii = 1;
+  for (; ii < argc && argv[ii][0] == '-'; ++ii) {
+    if (strcmp(argv[ii], "-v") == 0) {
+      options.verbose = true;
+    } else if (strcmp(argv[ii], "-b") == 0 && ii + 1 < argc) {
+      options.max_bytes = strtoul(argv[++ii], NULL, 10);
+    } else if (strcmp(argv[ii], "-m") == 0 && ii + 1 < argc) {
+      options.margin = strtod(argv[++ii], NULL);
+    } else {
+      fprintf(stderr, "usage: %s [-b max_bytes] [-m margin] [-v] family...\n", argv[0]);
+      return 2;
+    }
+  }
+
+  int flagged = 0;
+  for (; ii < argc; ++ii) {
+    string text;
+    if (!readFile(argv[ii], text)) {
+      perror(argv[ii]);
+      return 2;
+    }
+    const char* name = strrchr(argv[ii], '/');
+    family_t family;
+    if (!parseFamily(name ? name + 1 : argv[ii], text, family)) {
+      fprintf(stderr, "%s: expected five parts separated by %%%% lines\n", argv[ii]);
+      return 2;
+    }
+    flagged += checkInChild(family, options);
+  }
+  return flagged ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,802 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+#include "daemon.hpp"
+#include "folder.hpp"
+#include "mangler.hpp"
+#include "node.hpp"
+using namespace std;
+using namespace fbjs;
+
+namespace fbjs {
+
+  //
+  // daemon_cache_t: parsed trees, least recently used first out. Entries are keyed by a hash of the
+  // source and the parse options, and keep the source itself to rule out collisions. Trees are
+  // shared with the requests rendering them, so an evicted tree lives until they're done with it.
+  // Guarded by DaemonServer::mutex.
+  struct daemon_cache_t {
+    typedef boost::shared_ptr<const NodeProgram> program_ptr;
+
+    struct key_t {
+      uint64_t hash;
+      uint32_t opts;
+      bool operator<(const key_t& that) const {
+        return hash < that.hash || (hash == that.hash && opts < that.opts);
+      }
+    };
+
+    struct entry_t {
+      key_t key;
+      string source;
+      program_ptr program;
+      size_t bytes;
+    };
+
+    typedef list<entry_t> entry_list_t; // most recently used first
+    entry_list_t entries;
+    map<key_t, entry_list_t::iterator> index;
+    size_t bytes;
+    size_t capacity;
+
+    daemon_cache_t(size_t capacity) : bytes(0), capacity(capacity) {}
+
+    program_ptr find(const key_t& key, const char* code, size_t length) {
+      map<key_t, entry_list_t::iterator>::iterator ii = index.find(key);
+      if (ii == index.end()) {
+        return program_ptr();
+      }
+      const string& source = ii->second->source;
+      if (source.size() != length || memcmp(source.data(), code, length) != 0) {
+        return program_ptr();
+      }
+      entries.splice(entries.begin(), entries, ii->second);
+      return ii->second->program;
+    }
+
+    // Returns the tree to use, which is an earlier one if another worker got there first
+    program_ptr insert(const key_t& key, const char* code, size_t length, program_ptr program, size_t tree_bytes) {
+      program_ptr found = find(key, code, length);
+      if (found) {
+        return found;
+      }
+      size_t entry_bytes = tree_bytes + length + sizeof(entry_t);
+      if (entry_bytes > capacity) {
+        return program;
+      }
+      map<key_t, entry_list_t::iterator>::iterator ii = index.find(key);
+      if (ii != index.end()) {
+        erase(ii->second);
+      }
+      while (bytes + entry_bytes > capacity) {
+        erase(--entries.end());
+      }
+      entries.push_front(entry_t());
+      entry_t& entry = entries.front();
+      entry.key = key;
+      entry.source.assign(code, length);
+      entry.program = program;
+      entry.bytes = entry_bytes;
+      index[key] = entries.begin();
+      bytes += entry_bytes;
+      return program;
+    }
+
+    void erase(entry_list_t::iterator entry) {
+      bytes -= entry->bytes;
+      index.erase(entry->key);
+      entries.erase(entry);
+    }
+  };
+
+  //
+  // daemon_worker_t: what a worker keeps warm between requests, a Parser for each set of parse
+  // options it has seen.
+  struct daemon_worker_t {
+    map<uint32_t, Parser*> parsers;
+
+    ~daemon_worker_t() {
+      for (map<uint32_t, Parser*>::iterator ii = parsers.begin(); ii != parsers.end(); ++ii) {
+        delete ii->second;
+      }
+    }
+
+    Parser& parser(uint32_t opts) {
+      Parser*& parser = parsers[opts];
+      if (parser == NULL) {
+        parser = new Parser(static_cast<node_parse_enum>(opts));
+      }
+      return *parser;
+    }
+  };
+}
+
+namespace {
+
+  const uint32_t max_frame = 1 << 30;
+  const size_t frame_chunk = 64 * 1024;
+  const size_t request_size = 4 * sizeof(uint32_t);
+  const size_t response_size = 2 * sizeof(uint32_t);
+  const uint32_t parse_opts_mask = PARSE_TYPEHINT | PARSE_OBJECT_LITERAL_ELISON | PARSE_E4X |
+    PARSE_RECOVER | PARSE_DESCENT;
+  const uint32_t render_opts_mask = RENDER_PRETTY | RENDER_MAINTAIN_LINENO | RENDER_MINIMAL_PARENS;
+
+  // The deepest trees the parsers accept take a couple of MB of stack to render, more than a thread
+  // gets by default under a small `ulimit -s`. Stack that's never touched is never faulted in.
+  const size_t worker_stack_size = 64 * 1024 * 1024;
+
+  double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+  // FNV-1a
+  uint64_t hashSource(const char* code, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t ii = 0; ii < length; ++ii) {
+      hash = (hash ^ static_cast<unsigned char>(code[ii])) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  void putWord(string& buf, uint32_t word) {
+    word = htonl(word);
+    buf.append(reinterpret_cast<const char*>(&word), sizeof(word));
+  }
+
+  uint32_t getWord(const char* buf) {
+    uint32_t word;
+    memcpy(&word, buf, sizeof(word));
+    return ntohl(word);
+  }
+
+  string errorMessage(const string& what) {
+    return what + ": " + strerror(errno);
+  }
+
+  // Reads and writes on `fd` fail rather than block for longer than `seconds`
+  void setTimeouts(int fd, double seconds) {
+    if (seconds <= 0) {
+      return;
+    }
+    struct timeval tv;
+    tv.tv_sec = static_cast<time_t>(seconds);
+    tv.tv_usec = static_cast<suseconds_t>((seconds - tv.tv_sec) * 1e6);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+
+  bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+      ssize_t wrote = send(fd, data, length, MSG_NOSIGNAL);
+      if (wrote < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += wrote;
+      length -= wrote;
+    }
+    return true;
+  }
+
+  bool readAll(int fd, char* data, size_t length) {
+    while (length > 0) {
+      ssize_t got = read(fd, data, length);
+      if (got <= 0) {
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += got;
+      length -= got;
+    }
+    return true;
+  }
+
+  //
+  // Sends `data`, with `pass_fd` attached to its first byte
+  bool sendWithDescriptor(int fd, const char* data, size_t length, int pass_fd) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data);
+    iov.iov_len = length;
+    union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    ssize_t sent;
+    do {
+      sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent >= 0 && writeAll(fd, data + sent, length - sent);
+  }
+
+  //
+  // Reads one frame. A descriptor sent with it is returned in source_fd, otherwise that's -1.
+  bool readFrame(int fd, vector<char>& frame, int& source_fd) {
+    source_fd = -1;
+    char header[sizeof(uint32_t)];
+    struct iovec iov;
+    iov.iov_base = header;
+    iov.iov_len = sizeof(header);
+    union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(4 * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t got;
+    do {
+      got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+      return false;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t ii = 0; ii < count; ++ii) {
+        int passed;
+        memcpy(&passed, CMSG_DATA(cmsg) + ii * sizeof(int), sizeof(int));
+        if (source_fd == -1) {
+          source_fd = passed;
+        } else {
+          close(passed);
+        }
+      }
+    }
+    uint32_t length;
+    if (!readAll(fd, header + got, sizeof(header) - got) ||
+        (length = getWord(header)) > max_frame) {
+      if (source_fd != -1) {
+        close(source_fd);
+      }
+      return false;
+    }
+
+    // Grown as the bytes arrive, so a header on its own can't make us allocate max_frame
+    frame.clear();
+    while (frame.size() < length) {
+      size_t have = frame.size();
+      size_t chunk = min<size_t>(length - have, max(have, frame_chunk));
+      frame.resize(have + chunk);
+      if (!readAll(fd, &frame[have], chunk)) {
+        if (source_fd != -1) {
+          close(source_fd);
+        }
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //
+  // The contents of a descriptor passed with a request. A memfd which is sealed against shrinking is
+  // mapped. Anything else is copied: the client could truncate a file under the mapping, and reading
+  // a page past its new end is SIGBUS. Files are read from the start without moving their offset.
+  class PassedSource {
+    protected:
+      int fd;
+      void* mapped;
+      size_t mapped_length;
+      string copy;
+
+    public:
+      const char* data;
+      size_t length;
+
+      PassedSource(int fd) : fd(fd), mapped(NULL), mapped_length(0), data(""), length(0) {}
+
+      ~PassedSource() {
+        if (mapped != NULL) {
+          munmap(mapped, mapped_length);
+        }
+        close(fd);
+      }
+
+      bool load() {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+          return false;
+        }
+        bool regular = S_ISREG(st.st_mode);
+        if (regular && sealed()) {
+          if (st.st_size == 0) {
+            return true;
+          }
+          mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (mapped != MAP_FAILED) {
+            mapped_length = st.st_size;
+            data = static_cast<const char*>(mapped);
+            length = mapped_length;
+            return true;
+          }
+          mapped = NULL;
+        }
+        if (regular) {
+          copy.reserve(st.st_size);
+        }
+        char buf[64 * 1024];
+        off_t offset = 0;
+        ssize_t got;
+        while ((got = regular ? pread(fd, buf, sizeof(buf), offset) : read(fd, buf, sizeof(buf))) != 0) {
+          if (got < 0) {
+            if (errno == EINTR) {
+              continue;
+            }
+            return false;
+          }
+          copy.append(buf, got);
+          offset += got;
+        }
+        data = copy.data();
+        length = copy.size();
+        return true;
+      }
+
+    protected:
+      bool sealed() const {
+#ifdef F_GET_SEALS
+        int seals = fcntl(fd, F_GET_SEALS);
+        return seals != -1 && (seals & F_SEAL_SHRINK);
+#else
+        return false;
+#endif
+      }
+  };
+
+  bool sendResponse(int fd, const daemon_response_t& response) {
+    string header;
+    putWord(header, response_size + response.body.size());
+    putWord(header, response.status);
+    putWord(header, response.flags);
+    return writeAll(fd, header.data(), header.size()) &&
+      writeAll(fd, response.body.data(), response.body.size());
+  }
+}
+
+DaemonServer::DaemonServer(const string& path, const daemon_options_t& options) :
+    path(path), options(options), listener(-1), stopping(false), cache(NULL) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw runtime_error(path + ": socket path is too long");
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  // Only a socket is replaced, a typo shouldn't delete someone's file
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path.c_str());
+  }
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    throw runtime_error(errorMessage("socket"));
+  }
+  if (bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(listener, 128) != 0) {
+    string message(errorMessage(path));
+    close(listener);
+    throw runtime_error(message);
+  }
+  if (pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+    string message(errorMessage("pipe"));
+    close(listener);
+    unlink(path.c_str());
+    throw runtime_error(message);
+  }
+  memset(&stats, 0, sizeof(stats));
+  cache = new daemon_cache_t(options.cache_bytes);
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&ready, NULL);
+}
+
+DaemonServer::~DaemonServer() {
+  close(listener);
+  close(wake[0]);
+  close(wake[1]);
+  unlink(path.c_str());
+  for (deque<int>::iterator ii = pending.begin(); ii != pending.end(); ++ii) {
+    close(*ii);
+  }
+  delete cache;
+  pthread_cond_destroy(&ready);
+  pthread_mutex_destroy(&mutex);
+}
+
+//
+// Watches the listener and every connection between requests. Connections with something to read
+// go to the workers; the ones which have been quiet for options.idle_timeout are closed.
+void DaemonServer::serve() {
+  vector<pthread_t> workers(options.workers > 0 ? options.workers : 1);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, worker_stack_size);
+  for (size_t ii = 0; ii < workers.size(); ++ii) {
+    if (pthread_create(&workers[ii], &attr, workerThread, this) != 0) {
+      stop();
+      workers.resize(ii);
+      break;
+    }
+  }
+  pthread_attr_destroy(&attr);
+
+  map<int, double> idle; // waiting for their next request, since when
+  vector<struct pollfd> fds;
+  while (true) {
+    pthread_mutex_lock(&mutex);
+    if (stopping) {
+      pthread_mutex_unlock(&mutex);
+      break;
+    }
+    double started = now();
+    for (vector<int>::iterator ii = returned.begin(); ii != returned.end(); ++ii) {
+      idle[*ii] = started;
+    }
+    returned.clear();
+    pthread_mutex_unlock(&mutex);
+
+    struct pollfd watch = {wake[0], POLLIN, 0};
+    fds.assign(1, watch);
+    watch.fd = listener;
+    fds.push_back(watch);
+    double oldest = started;
+    for (map<int, double>::iterator ii = idle.begin(); ii != idle.end(); ++ii) {
+      watch.fd = ii->first;
+      fds.push_back(watch);
+      oldest = min(oldest, ii->second);
+    }
+    int timeout = -1;
+    if (options.idle_timeout > 0 && !idle.empty()) {
+      timeout = max(0, static_cast<int>(ceil((oldest + options.idle_timeout - started) * 1000)));
+    }
+    if (poll(&fds[0], fds.size(), timeout) < 0) {
+      continue; // EINTR, or ENOMEM which may pass
+    }
+
+    if (fds[0].revents) {
+      char buf[64];
+      while (read(wake[0], buf, sizeof(buf)) > 0);
+    }
+    double polled = now();
+    pthread_mutex_lock(&mutex);
+    for (size_t ii = 2; ii < fds.size(); ++ii) {
+      int fd = fds[ii].fd;
+      if (fds[ii].revents) {
+        idle.erase(fd);
+        pending.push_back(fd);
+        pthread_cond_signal(&ready);
+      } else if (options.idle_timeout > 0 && polled - idle[fd] >= options.idle_timeout) {
+        idle.erase(fd);
+        close(fd);
+      }
+    }
+    if (fds[1].revents) {
+      int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+      if (fd >= 0) {
+        setTimeouts(fd, options.io_timeout);
+        idle[fd] = polled;
+        ++stats.connections;
+      } else if (errno == EMFILE || errno == ENFILE) {
+        // Out of descriptors until a connection closes
+        pthread_mutex_unlock(&mutex);
+        usleep(10000);
+        continue;
+      }
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+  for (size_t ii = 0; ii < workers.size(); ++ii) {
+    pthread_join(workers[ii], NULL);
+  }
+  for (map<int, double>::iterator ii = idle.begin(); ii != idle.end(); ++ii) {
+    close(ii->first);
+  }
+  for (vector<int>::iterator ii = returned.begin(); ii != returned.end(); ++ii) {
+    close(*ii);
+  }
+  returned.clear();
+}
+
+void DaemonServer::stop() {
+  pthread_mutex_lock(&mutex);
+  stopping = true;
+  shutdown(listener, SHUT_RDWR);
+  for (set<int>::iterator ii = active.begin(); ii != active.end(); ++ii) {
+    shutdown(*ii, SHUT_RDWR);
+  }
+  pthread_cond_broadcast(&ready);
+  pthread_mutex_unlock(&mutex);
+  ssize_t wrote = write(wake[1], "", 1);
+  (void)wrote;
+}
+
+daemon_stats_t DaemonServer::statistics() const {
+  pthread_mutex_lock(&mutex);
+  daemon_stats_t ret = stats;
+  ret.cached = cache->entries.size();
+  ret.cached_bytes = cache->bytes;
+  pthread_mutex_unlock(&mutex);
+  return ret;
+}
+
+void* DaemonServer::workerThread(void* server) {
+  static_cast<DaemonServer*>(server)->work();
+  return NULL;
+}
+
+void DaemonServer::work() {
+  daemon_worker_t worker;
+  pthread_mutex_lock(&mutex);
+  while (true) {
+    while (pending.empty() && !stopping) {
+      pthread_cond_wait(&ready, &mutex);
+    }
+    if (stopping) {
+      break;
+    }
+    int fd = pending.front();
+    pending.pop_front();
+    active.insert(fd);
+    pthread_mutex_unlock(&mutex);
+
+    bool open = serveRequest(worker, fd);
+
+    // Closed under the lock so that stop() never shuts down a descriptor which has been reused
+    pthread_mutex_lock(&mutex);
+    active.erase(fd);
+    if (open && !stopping) {
+      returned.push_back(fd);
+      ssize_t wrote = write(wake[1], "", 1);
+      (void)wrote;
+    } else {
+      close(fd);
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+//
+// Reads and answers one request. Returns false if the connection is finished with: the client hung
+// up, sent something which isn't a frame, or stalled for longer than options.io_timeout.
+bool DaemonServer::serveRequest(daemon_worker_t& worker, int fd) {
+  vector<char> frame;
+  int source_fd;
+  if (!readFrame(fd, frame, source_fd)) {
+    return false;
+  }
+  pthread_mutex_lock(&mutex);
+  ++stats.requests;
+  pthread_mutex_unlock(&mutex);
+  return handle(worker, fd, frame, source_fd);
+}
+
+//
+// Answers one request. Returns false if the response couldn't be sent.
+bool DaemonServer::handle(daemon_worker_t& worker, int fd, const vector<char>& frame, int source_fd) {
+  auto_ptr<PassedSource> passed(source_fd == -1 ? NULL : new PassedSource(source_fd));
+  daemon_response_t response;
+  response.status = DAEMON_OK;
+  response.flags = 0;
+  if (frame.size() < request_size || (passed.get() && frame.size() != request_size)) {
+    response.status = DAEMON_BAD_REQUEST;
+    response.body = "malformed request";
+    return sendResponse(fd, response);
+  }
+  daemon_request_t request(getWord(&frame[0]), getWord(&frame[4]), getWord(&frame[8]), getWord(&frame[12]));
+  if (request.op < DAEMON_PARSE || request.op > DAEMON_TRANSFORM ||
+      (request.parse_opts & ~parse_opts_mask) || (request.render_opts & ~render_opts_mask) ||
+      (request.passes & ~(DAEMON_PASS_FOLD | DAEMON_PASS_MANGLE))) {
+    response.status = DAEMON_BAD_REQUEST;
+    response.body = "unknown op or options";
+    return sendResponse(fd, response);
+  }
+
+  const char* code = frame.size() > request_size ? &frame[request_size] : "";
+  size_t length = frame.size() - request_size;
+  if (passed.get()) {
+    if (!passed->load()) {
+      response.status = DAEMON_ERROR;
+      response.body = errorMessage("can't read source");
+      return sendResponse(fd, response);
+    }
+    code = passed->data;
+    length = passed->length;
+  }
+
+  try {
+    response.body = process(worker, request, code, length, response.flags);
+  } catch (ParseException& ex) {
+    response.status = DAEMON_PARSE_ERROR;
+    response.body = ex.what();
+  } catch (ParseBudgetException& ex) {
+    response.status = DAEMON_BUDGET_ERROR;
+    response.body = ex.what();
+  } catch (exception& ex) {
+    response.status = DAEMON_ERROR;
+    response.body = ex.what();
+  }
+  return sendResponse(fd, response);
+}
+
+string DaemonServer::process(daemon_worker_t& worker, const daemon_request_t& request,
+    const char* code, size_t length, uint32_t& flags) {
+  daemon_cache_t::key_t key;
+  key.hash = hashSource(code, length);
+  key.opts = request.parse_opts;
+  pthread_mutex_lock(&mutex);
+  daemon_cache_t::program_ptr program = cache->find(key, code, length);
+  ++(program ? stats.hits : stats.misses);
+  pthread_mutex_unlock(&mutex);
+
+  if (program) {
+    flags |= DAEMON_CACHED;
+  } else {
+    parse_budget_t budget;
+    if (options.timeout > 0) {
+      budget.setTimeout(options.timeout);
+    }
+    budget.max_depth = options.max_depth;
+    size_t tree_bytes;
+    {
+      MemoryTracker tracker;
+      program.reset(worker.parser(request.parse_opts).parse(code, length,
+        options.timeout > 0 || options.max_depth > 0 ? &budget : NULL));
+      tree_bytes = tracker.live();
+    }
+    pthread_mutex_lock(&mutex);
+    program = cache->insert(key, code, length, program, tree_bytes);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  switch (request.op) {
+    case DAEMON_PARSE:
+      return string();
+
+    case DAEMON_RENDER:
+      return program->renderString(request.render_opts);
+
+    default: {
+      // Cached trees are shared, passes get a copy
+      auto_ptr<Node> copy(program->clone());
+      if (request.passes & DAEMON_PASS_FOLD) {
+        NodePipeline folder;
+        folder.add(new ConstantFolder);
+        copy.reset(folder.run(copy.release()));
+      }
+      if (request.passes & DAEMON_PASS_MANGLE) {
+        mangleIdentifiers(copy.get());
+      }
+      return copy->renderString(request.render_opts);
+    }
+  }
+}
+
+DaemonClient::DaemonClient(const string& path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw runtime_error(path + ": socket path is too long");
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw runtime_error(errorMessage("socket"));
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    string message(errorMessage(path));
+    close(fd);
+    throw runtime_error(message);
+  }
+}
+
+DaemonClient::~DaemonClient() {
+  close(fd);
+}
+
+namespace {
+  string requestHeader(const daemon_request_t& request, size_t length) {
+    string header;
+    putWord(header, request_size + length);
+    putWord(header, request.op);
+    putWord(header, request.parse_opts);
+    putWord(header, request.render_opts);
+    putWord(header, request.passes);
+    return header;
+  }
+
+  daemon_response_t readResponse(int fd) {
+    vector<char> frame;
+    int passed;
+    if (!readFrame(fd, frame, passed)) {
+      throw runtime_error("connection to fbjs daemon closed");
+    }
+    if (passed != -1) {
+      close(passed);
+    }
+    if (frame.size() < response_size) {
+      throw runtime_error("malformed response from fbjs daemon");
+    }
+    daemon_response_t response;
+    response.status = getWord(&frame[0]);
+    response.flags = getWord(&frame[4]);
+    response.body.assign(frame.begin() + response_size, frame.end());
+    return response;
+  }
+}
+
+daemon_response_t DaemonClient::request(const daemon_request_t& request, const char* code, size_t length) {
+  if (length > max_frame - request_size) {
+    throw runtime_error("source is too large for one request");
+  }
+  string header(requestHeader(request, length));
+  if (!writeAll(fd, header.data(), header.size()) || !writeAll(fd, code, length)) {
+    throw runtime_error(errorMessage("fbjs daemon"));
+  }
+  return readResponse(fd);
+}
+
+daemon_response_t DaemonClient::request(const daemon_request_t& request, int source_fd) {
+  string header(requestHeader(request, 0));
+  if (!sendWithDescriptor(fd, header.data(), header.size(), source_fd)) {
+    throw runtime_error(errorMessage("fbjs daemon"));
+  }
+  return readResponse(fd);
+}
@@ -0,0 +1,182 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+//
+// A long-running parse and render server on a UNIX domain socket, for build systems which would
+// otherwise start a process per file. Workers keep a warm Parser per set of parse options, and
+// parsed trees are cached by a hash of their source so that rendering the same file again doesn't
+// parse it again.
+//
+//   DaemonServer server("/tmp/fbjs.sock", options);
+//   server.serve(); // until server.stop() from another thread
+//
+//   DaemonClient client("/tmp/fbjs.sock");
+//   daemon_request_t request(DAEMON_RENDER, PARSE_E4X, RENDER_PRETTY);
+//   daemon_response_t response = client.request(request, code.c_str(), code.size());
+//
+// Every message is a frame: a 32-bit length in network byte order followed by that many bytes. A
+// request is four 32-bit words (op, parse options, render options and passes, see
+// daemon_request_t) followed by the source. Instead of the source a client can pass a file
+// descriptor in an SCM_RIGHTS message sent with the first byte of the frame, so the source is never
+// copied through the socket. A memfd sealed with F_SEAL_SHRINK is mapped; anything else is read into
+// a copy, since a file truncated under a mapping would crash the server. A response is two words
+// (status and flags) followed by the output or an error message.
+namespace fbjs {
+
+  enum daemon_op_enum {
+    DAEMON_PARSE = 1, // parse and cache; the response is empty
+    DAEMON_RENDER = 2, // render the cached tree
+    DAEMON_TRANSFORM = 3, // run passes over a copy of the cached tree and render that
+  };
+
+  enum daemon_pass_enum {
+    DAEMON_PASS_NONE = 0,
+    DAEMON_PASS_FOLD = 1, // ConstantFolder
+    DAEMON_PASS_MANGLE = 2, // mangleIdentifiers()
+  };
+
+  enum daemon_status_enum {
+    DAEMON_OK = 0,
+    DAEMON_PARSE_ERROR = 1,
+    DAEMON_BUDGET_ERROR = 2, // the parse ran over the server's timeout or depth limit
+    DAEMON_BAD_REQUEST = 3,
+    DAEMON_ERROR = 4,
+  };
+
+  enum daemon_flag_enum {
+    DAEMON_CACHED = 1, // the tree came from the cache
+  };
+
+  struct daemon_request_t {
+    uint32_t op;
+    uint32_t parse_opts; // node_parse_enum
+    uint32_t render_opts; // node_render_enum
+    uint32_t passes; // daemon_pass_enum, in that order
+
+    daemon_request_t(uint32_t op = DAEMON_RENDER, uint32_t parse_opts = 0, uint32_t render_opts = 0,
+      uint32_t passes = DAEMON_PASS_NONE) :
+      op(op), parse_opts(parse_opts), render_opts(render_opts), passes(passes) {}
+  };
+
+  struct daemon_response_t {
+    uint32_t status;
+    uint32_t flags;
+    std::string body;
+  };
+
+  struct daemon_options_t {
+    size_t workers;
+    size_t cache_bytes; // trees plus their sources; 0 disables the cache
+    double timeout; // seconds per parse, 0 for none
+    size_t max_depth; // brackets open at once in a parse, 0 for only the parser's own limit
+    double idle_timeout; // seconds a connection can wait between requests, 0 for no limit
+    double io_timeout; // seconds a half-sent request or an unread response can hold a worker
+
+    daemon_options_t() : workers(4), cache_bytes(256 * 1024 * 1024), timeout(0), max_depth(0),
+      idle_timeout(300), io_timeout(30) {}
+  };
+
+  struct daemon_stats_t {
+    size_t connections;
+    size_t requests;
+    size_t hits;
+    size_t misses;
+    size_t cached; // trees in the cache
+    size_t cached_bytes;
+  };
+
+  struct daemon_cache_t;
+  struct daemon_worker_t;
+
+  //
+  // DaemonServer: listens on `path`, replacing a stale socket there. serve() accepts connections and
+  // watches them; when one has a request waiting it goes to a worker, which answers that one request
+  // and hands the connection back. So a client which connects and says nothing only costs a
+  // descriptor, until options.idle_timeout closes it. Throws std::runtime_error if the socket can't
+  // be set up.
+  class DaemonServer {
+    protected:
+      std::string path;
+      daemon_options_t options;
+      int listener;
+      int wake[2]; // a pipe serve() watches, for stop() and connections coming back from workers
+      bool stopping;
+      std::deque<int> pending; // with a request waiting for a worker
+      std::vector<int> returned; // answered, for serve() to watch again
+      std::set<int> active; // being served, so stop() can hang up on them
+      daemon_cache_t* cache;
+      daemon_stats_t stats;
+      mutable pthread_mutex_t mutex;
+      pthread_cond_t ready;
+
+      static void* workerThread(void* server);
+      void work();
+      bool serveRequest(daemon_worker_t& worker, int fd);
+      bool handle(daemon_worker_t& worker, int fd, const std::vector<char>& frame, int source_fd);
+      std::string process(daemon_worker_t& worker, const daemon_request_t& request,
+        const char* code, size_t length, uint32_t& flags);
+
+    private:
+      DaemonServer(const DaemonServer&);
+      DaemonServer& operator=(const DaemonServer&);
+
+    public:
+      DaemonServer(const std::string& path, const daemon_options_t& options = daemon_options_t());
+      ~DaemonServer();
+
+      // Returns once stop() has been called and every worker has finished
+      void serve();
+
+      // Stops accepting, hangs up on open connections and wakes serve(). Safe from any thread, but
+      // not from a signal handler.
+      void stop();
+
+      daemon_stats_t statistics() const;
+  };
+
+  //
+  // DaemonClient: one connection to a DaemonServer. Requests on a connection are answered in order.
+  // Throws std::runtime_error if the connection fails.
+  class DaemonClient {
+    protected:
+      int fd;
+
+    private:
+      DaemonClient(const DaemonClient&);
+      DaemonClient& operator=(const DaemonClient&);
+
+    public:
+      DaemonClient(const std::string& path);
+      ~DaemonClient();
+
+      daemon_response_t request(const daemon_request_t& request, const char* code, size_t length);
+
+      // The server reads the source from `source_fd` (a file, memfd or shm object) itself
+      daemon_response_t request(const daemon_request_t& request, int source_fd);
+  };
+}
@@ -0,0 +1,1453 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+//
+// Hand-written replacement for the bison grammar in parser.yy, used instead of it when the
+// PARSE_DESCENT option is given. It reads the same tokens from the same scanner and builds the same
+// tree, line numbers included.
+//
+// Statements are parsed by recursive descent and binary operators by precedence climbing over the
+// %left table in parser.yy, so the *_no_in copies of the expression grammar become a flag and the
+// *_no_statement ones are just the statement parser not sending `{` or `function` to an
+// expression. Where the grammar only makes sense through its precedence declarations this does the
+// same thing, e.g. unary + and - rank with their binary forms so `-a * b` is `-(a * b)`.
+//
+// Nodes take their line from the last token the scanner returned, like `yylineno` in parser.yy.
+// To come out the same every node is created where bison would reduce its rule: after reading the
+// next token when bison needs it to decide, and before otherwise. The scanner also depends on this,
+// since XML start conditions are pushed and popped from the grammar and have to change before the
+// following token is scanned.
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "node.hpp"
+#include "parser.hpp"
+using namespace std;
+using namespace fbjs;
+
+void terminate(void* yyscanner, const char* str);
+void yyerror(YYLTYPE* yyloc, void* yyscanner, void* node, const char* str);
+void fbjs_push_xml_state(void* scanner);
+void fbjs_push_xml_embedded_expression_state(void* scanner);
+void fbjs_begin_xml_content(void* scanner);
+void fbjs_pop_xml_state(void* scanner);
+
+namespace {
+  typedef auto_ptr<Node> node_ptr;
+
+  // The parse is over, whatever stopped it has been recorded already
+  struct descent_abort_t {};
+
+  // A syntax error with PARSE_RECOVER, caught by the closest statement list
+  struct descent_recover_t {};
+
+  // Tokens which end a statement list, depending on what it's in. A second `default' isn't one of
+  // them after a default clause, so with PARSE_RECOVER that list is where the error is caught.
+  enum list_end_t {
+    END_PROGRAM,
+    END_BLOCK,
+    END_CASE,
+    END_DEFAULT,
+  };
+
+  const int NO_TOKEN = -1;
+
+  // Deeper than this fails like bison running out of stack, instead of overflowing ours. Every cycle
+  // of recursion counts at least once, and the most any one costs at -O2 is about 370 bytes of
+  // stack (`-(-(...))`). This keeps a parse within 190KB, and the trees it returns are no deeper
+  // than bison's (see Parser in node.hpp).
+  const size_t max_nesting = 500;
+
+  class DescentParser {
+    protected:
+      void* scanner;
+      fbjs_parse_extra* extra;
+      YYSTYPE lval;
+      YYLTYPE lloc;
+      int tok; // lookahead, or NO_TOKEN if the next token hasn't been scanned yet
+      size_t depth;
+
+      // Tokens
+      int peek();
+      void skip();
+      void expect(int token);
+      unsigned int lineno() const;
+      void syntaxError() __attribute__((noreturn));
+      void error(const char* str);
+      void require(node_parse_enum flag, const char* str);
+      Node* recover();
+
+      // Statements
+      Node* parseStatementList(list_end_t end);
+      Node* parseSourceElement();
+      Node* parseStatement();
+      Node* parseBlock();
+      void parseSemicolon();
+      Node* parseVarDeclarations(bool no_in);
+      Node* parseVarDeclaration(bool no_in);
+      Node* parseTypehintedIdentifier();
+      Node* parseLabelOrExpression();
+      Node* parseIf();
+      Node* parseDoWhile();
+      Node* parseWhile();
+      Node* parseFor();
+      Node* parseForEach();
+      Node* parseForIn(Node* iterator, bool each);
+      Node* parseOptionalExpression(int end);
+      Node* parseStatementWithExpression(node_statement_with_expression_t statement);
+      Node* parseWith();
+      Node* parseSwitch();
+      Node* parseCaseClauses();
+      Node* parseTry();
+      Node* parseXMLDefaultNamespace();
+      Node* parseFunction(bool declaration);
+      Node* parseFormalParameters();
+
+      // Expressions
+      Node* parseExpression(bool no_in, Node* lhs = NULL);
+      Node* parseAssignment(bool no_in, Node* lhs = NULL);
+      Node* parseConditional(bool no_in, Node* lhs = NULL);
+      Node* parseBinary(int precedence, bool no_in, Node* lhs = NULL);
+      Node* parseUnary(Node* lhs = NULL);
+      Node* parsePostfix(Node* lhs = NULL);
+      Node* parseLeftHandSide(Node* primary = NULL);
+      Node* parseMember();
+      Node* parseSuffixes(Node* expression, bool calls);
+      Node* parseArguments();
+      Node* parsePrimary();
+      Node* parseIdentifier();
+      Node* parsePrimaryIdentifier(Node* identifier);
+      Node* parseArrayLiteral();
+      Node* parseObjectLiteral();
+      Node* parsePropertyName();
+
+      // E4X
+      Node* parseMemberName(bool& e4x);
+      Node* parsePropertyIdentifier();
+      Node* parsePropertySelector();
+      Node* parseQualifiedIdentifier(Node* selector);
+      Node* parseXMLLiteral();
+      Node* parseXMLElement();
+      Node* parseXMLTagName();
+      Node* parseXMLName();
+      Node* parseXMLAttributes();
+      Node* parseXMLAttributeValue();
+      Node* parseXMLContent();
+      Node* parseXMLText();
+      Node* parseXMLEmbeddedExpression();
+
+    private:
+      DescentParser(const DescentParser&);
+      DescentParser& operator= (const DescentParser&);
+
+    public:
+      DescentParser(void* scanner);
+      ~DescentParser();
+      void parse(Node* root);
+      void enter();
+      void leave();
+  };
+
+  //
+  // Counts one level of recursion for as long as it's in scope
+  class nesting_t {
+    private:
+      DescentParser& parser;
+    public:
+      nesting_t(DescentParser& parser) : parser(parser) {
+        parser.enter();
+      }
+      ~nesting_t() {
+        parser.leave();
+      }
+  };
+
+  //
+  // Binary operator tokens with their precedence from the %left table in parser.yy
+  bool binaryOperator(int tok, node_operator_t& op, int& precedence) {
+    switch (tok) {
+      case t_OR: op = OR; precedence = PRECEDENCE_OR; break;
+      case t_AND: op = AND; precedence = PRECEDENCE_AND; break;
+      case t_BIT_OR: op = BIT_OR; precedence = PRECEDENCE_BIT_OR; break;
+      case t_BIT_XOR: op = BIT_XOR; precedence = PRECEDENCE_BIT_XOR; break;
+      case t_BIT_AND: op = BIT_AND; precedence = PRECEDENCE_BIT_AND; break;
+      case t_EQUAL: op = EQUAL; precedence = PRECEDENCE_EQUALITY; break;
+      case t_NOT_EQUAL: op = NOT_EQUAL; precedence = PRECEDENCE_EQUALITY; break;
+      case t_STRICT_EQUAL: op = STRICT_EQUAL; precedence = PRECEDENCE_EQUALITY; break;
+      case t_STRICT_NOT_EQUAL: op = STRICT_NOT_EQUAL; precedence = PRECEDENCE_EQUALITY; break;
+      case t_LESS_THAN: op = LESS_THAN; precedence = PRECEDENCE_RELATIONAL; break;
+      case t_GREATER_THAN: op = GREATER_THAN; precedence = PRECEDENCE_RELATIONAL; break;
+      case t_LESS_THAN_EQUAL: op = LESS_THAN_EQUAL; precedence = PRECEDENCE_RELATIONAL; break;
+      case t_GREATER_THAN_EQUAL: op = GREATER_THAN_EQUAL; precedence = PRECEDENCE_RELATIONAL; break;
+      case t_INSTANCEOF: op = INSTANCEOF; precedence = PRECEDENCE_RELATIONAL; break;
+      case t_IN: op = IN; precedence = PRECEDENCE_RELATIONAL; break;
+      case t_LSHIFT: op = LSHIFT; precedence = PRECEDENCE_SHIFT; break;
+      case t_RSHIFT: op = RSHIFT; precedence = PRECEDENCE_SHIFT; break;
+      case t_RSHIFT3: op = RSHIFT3; precedence = PRECEDENCE_SHIFT; break;
+      case t_PLUS: op = PLUS; precedence = PRECEDENCE_ADDITIVE; break;
+      case t_MINUS: op = MINUS; precedence = PRECEDENCE_ADDITIVE; break;
+      case t_MULT: op = MULT; precedence = PRECEDENCE_MULTIPLICATIVE; break;
+      case t_DIV: op = DIV; precedence = PRECEDENCE_MULTIPLICATIVE; break;
+      case t_MOD: op = MOD; precedence = PRECEDENCE_MULTIPLICATIVE; break;
+      default: return false;
+    }
+    return true;
+  }
+
+  bool unaryOperator(int tok, node_unary_t& op) {
+    switch (tok) {
+      case t_DELETE: op = DELETE; break;
+      case t_VOID: op = VOID; break;
+      case t_TYPEOF: op = TYPEOF; break;
+      case t_INCR: op = INCR_UNARY; break;
+      case t_DECR: op = DECR_UNARY; break;
+      case t_PLUS: op = PLUS_UNARY; break;
+      case t_MINUS: op = MINUS_UNARY; break;
+      case t_BIT_NOT: op = BIT_NOT_UNARY; break;
+      case t_NOT: op = NOT_UNARY; break;
+      default: return false;
+    }
+    return true;
+  }
+
+  bool assignmentOperator(int tok, node_assignment_t& op) {
+    switch (tok) {
+      case t_ASSIGN: op = ASSIGN; break;
+      case t_MULT_ASSIGN: op = MULT_ASSIGN; break;
+      case t_DIV_ASSIGN: op = DIV_ASSIGN; break;
+      case t_MOD_ASSIGN: op = MOD_ASSIGN; break;
+      case t_PLUS_ASSIGN: op = PLUS_ASSIGN; break;
+      case t_MINUS_ASSIGN: op = MINUS_ASSIGN; break;
+      case t_LSHIFT_ASSIGN: op = LSHIFT_ASSIGN; break;
+      case t_RSHIFT_ASSIGN: op = RSHIFT_ASSIGN; break;
+      case t_RSHIFT3_ASSIGN: op = RSHIFT3_ASSIGN; break;
+      case t_BIT_AND_ASSIGN: op = BIT_AND_ASSIGN; break;
+      case t_BIT_XOR_ASSIGN: op = BIT_XOR_ASSIGN; break;
+      case t_BIT_OR_ASSIGN: op = BIT_OR_ASSIGN; break;
+      default: return false;
+    }
+    return true;
+  }
+
+  //
+  // Punctuation which is plain text in an attribute value, see xml_cdata_char_attr
+  bool xmlCharacter(int tok, char& ch) {
+    switch (tok) {
+      case t_COLON: ch = ':'; break;
+      case t_ASSIGN: ch = '='; break;
+      case t_RCURLY: ch = '}'; break;
+      case t_GREATER_THAN: ch = '>'; break;
+      case t_DIV: ch = '/'; break;
+      case t_LESS_THAN: ch = '<'; break;
+      case t_LCURLY: ch = '{'; break;
+      default: return false;
+    }
+    return true;
+  }
+
+  //
+  // A token's name as bison reports it. yytokname() indexes bison's symbol table, which starts with
+  // the end of input and then the undefined token; newer versions quote those two.
+  string tokenName(int tok) {
+    const char* name = yytokname(tok == 0 ? 255 : tok < 255 ? 257 : tok);
+    size_t length = strlen(name);
+    if (length > 1 && name[0] == '"') {
+      return string(name + 1, length - 2);
+    }
+    return name;
+  }
+
+  bool endsStatementList(int tok, list_end_t end) {
+    switch (end) {
+      case END_PROGRAM:
+        return tok == 0;
+      case END_BLOCK:
+        return tok == t_RCURLY;
+      case END_CASE:
+        return tok == t_RCURLY || tok == t_CASE || tok == t_DEFAULT;
+      case END_DEFAULT:
+        return tok == t_RCURLY || tok == t_CASE;
+    }
+    return false;
+  }
+}
+
+DescentParser::DescentParser(void* scanner) : scanner(scanner), extra(yyget_extra(scanner)), tok(NO_TOKEN), depth(0) {
+  lloc.first_line = lloc.last_line = 1;
+  lloc.first_column = lloc.last_column = 1;
+}
+
+DescentParser::~DescentParser() {
+  if (tok != NO_TOKEN) {
+    skip();
+  }
+}
+
+void DescentParser::parse(Node* root) {
+  try {
+    node_ptr program(parseStatementList(END_PROGRAM));
+    if (program.get() == NULL) {
+      syntaxError();
+    }
+    root->appendChild(program.release());
+  } catch (descent_abort_t&) {
+  } catch (descent_recover_t&) {
+  }
+}
+
+void DescentParser::enter() {
+  if (++depth > max_nesting) {
+    yyerror(&lloc, scanner, NULL, "memory exhausted");
+    throw descent_abort_t();
+  }
+}
+
+void DescentParser::leave() {
+  --depth;
+}
+
+//
+// Tokens
+int DescentParser::peek() {
+  if (tok == NO_TOKEN) {
+    tok = yylex(&lval, &lloc, scanner);
+  }
+  return tok;
+}
+
+//
+// Consumes the lookahead, freeing its value if it has one. Values which are needed are copied into
+// a node before this is called.
+void DescentParser::skip() {
+  switch (tok) {
+    case t_IDENTIFIER:
+    case t_STRING:
+    case t_XML_NAME_FRAGMENT:
+    case t_XML_CDATA:
+    case t_XML_WHITESPACE:
+    case t_XML_COMMENT:
+    case t_XML_PI:
+      fbjs_free_text(lval.string);
+      break;
+    case t_REGEX:
+      fbjs_free_text(lval.string_duple[0]);
+      fbjs_free_text(lval.string_duple[1]);
+      break;
+  }
+  tok = NO_TOKEN;
+}
+
+void DescentParser::expect(int token) {
+  if (peek() != token) {
+    syntaxError();
+  }
+  skip();
+}
+
+unsigned int DescentParser::lineno() const {
+  return (unsigned int)lloc.first_line;
+}
+
+void DescentParser::syntaxError() {
+  string str = "syntax error, unexpected " + tokenName(peek());
+  yyerror(&lloc, scanner, NULL, str.c_str());
+  if (extra->terminated) {
+    throw descent_abort_t();
+  }
+  throw descent_recover_t();
+}
+
+//
+// Errors which still produce a node, see parsererror in parser.yy
+void DescentParser::error(const char* str) {
+  yyerror(&lloc, scanner, NULL, str);
+}
+
+void DescentParser::require(node_parse_enum flag, const char* str) {
+  if (!(extra->opts & flag)) {
+    terminate(scanner, str);
+  }
+}
+
+//
+// `error semicolon` from parser.yy: drops everything up to the end of the broken statement
+Node* DescentParser::recover() {
+  while (peek() != t_SEMICOLON && tok != t_VIRTUAL_SEMICOLON) {
+    if (tok == 0) {
+      throw descent_abort_t();
+    }
+    skip();
+  }
+  skip();
+  return new NodeEmptyExpression(lineno());
+}
+
+//
+// Statements
+Node* DescentParser::parseStatementList(list_end_t end) {
+  node_ptr list;
+  while (!endsStatementList(peek(), end)) {
+    Node* element;
+    try {
+      element = parseSourceElement();
+    } catch (descent_recover_t&) {
+      element = recover();
+    }
+    if (list.get() == NULL) {
+      list.reset(new NodeStatementList(lineno()));
+    }
+
+    // The scanner puts `t_VIRTUAL_SEMICOLON's everywhere, their empty statements are dropped here
+    if (dynamic_cast<NodeEmptyExpression*>(element) == NULL) {
+      list->appendChild(element);
+    } else {
+      delete element;
+    }
+  }
+  return list.release();
+}
+
+Node* DescentParser::parseSourceElement() {
+  if (peek() == t_FUNCTION) {
+    return parseFunction(true);
+  }
+  return parseStatement();
+}
+
+Node* DescentParser::parseStatement() {
+  nesting_t nesting(*this);
+  switch (peek()) {
+    case t_LCURLY:
+      return parseBlock();
+
+    case t_VAR: {
+      skip();
+      node_ptr declarations(parseVarDeclarations(false));
+      parseSemicolon();
+      return declarations.release();
+    }
+
+    case t_SEMICOLON:
+    case t_VIRTUAL_SEMICOLON:
+      skip();
+      return new NodeEmptyExpression(lineno());
+
+    case t_IF:
+      return parseIf();
+    case t_DO:
+      return parseDoWhile();
+    case t_WHILE:
+      return parseWhile();
+    case t_FOR:
+      return parseFor();
+    case t_FOR_EACH:
+      return parseForEach();
+    case t_CONTINUE:
+      return parseStatementWithExpression(CONTINUE);
+    case t_BREAK:
+      return parseStatementWithExpression(BREAK);
+    case t_RETURN:
+      return parseStatementWithExpression(RETURN);
+    case t_THROW:
+      return parseStatementWithExpression(THROW);
+    case t_WITH:
+      return parseWith();
+    case t_SWITCH:
+      return parseSwitch();
+    case t_TRY:
+      return parseTry();
+    case t_XML_DEFAULT_NAMESPACE:
+      return parseXMLDefaultNamespace();
+    case t_IDENTIFIER:
+      return parseLabelOrExpression();
+
+    case t_FUNCTION:
+      // Only a declaration can start a statement, and those aren't allowed here
+      syntaxError();
+
+    default: {
+      node_ptr expression(parseExpression(false));
+      parseSemicolon();
+      return expression.release();
+    }
+  }
+}
+
+Node* DescentParser::parseBlock() {
+  expect(t_LCURLY);
+  node_ptr list(parseStatementList(END_BLOCK));
+  if (list.get() == NULL) {
+    list.reset(new NodeStatementList(lineno()));
+  }
+  expect(t_RCURLY);
+  return list.release();
+}
+
+void DescentParser::parseSemicolon() {
+  if (peek() != t_SEMICOLON && tok != t_VIRTUAL_SEMICOLON) {
+    syntaxError();
+  }
+  skip();
+}
+
+Node* DescentParser::parseVarDeclarations(bool no_in) {
+  node_ptr declaration(parseVarDeclaration(no_in));
+  node_ptr list(new NodeVarDeclaration(false, lineno()));
+  list->appendChild(declaration.release());
+  while (peek() == t_COMMA) {
+    skip();
+    list->appendChild(parseVarDeclaration(no_in));
+  }
+  return list.release();
+}
+
+Node* DescentParser::parseVarDeclaration(bool no_in) {
+  node_ptr name(no_in ? parseIdentifier() : parseTypehintedIdentifier());
+  if (peek() != t_ASSIGN) {
+    return name.release();
+  }
+  skip();
+  node_ptr value(parseAssignment(no_in));
+  return (new NodeAssignment(ASSIGN, lineno()))->appendChild(name.release())->appendChild(value.release());
+}
+
+Node* DescentParser::parseTypehintedIdentifier() {
+  node_ptr identifier(parseIdentifier());
+  if (peek() != t_COLON) {
+    return identifier.release();
+  }
+  skip();
+  node_ptr type(parseIdentifier());
+  require(PARSE_TYPEHINT, "typehints not supported");
+  return (new NodeTypehint(lineno()))->appendChild(identifier.release())->appendChild(type.release());
+}
+
+//
+// A statement starting with an identifier is a label if a colon follows, otherwise the identifier
+// begins an expression
+Node* DescentParser::parseLabelOrExpression() {
+  node_ptr identifier(parseIdentifier());
+  if (peek() == t_COLON) {
+    skip();
+    node_ptr statement(parseStatement());
+    return (new NodeLabel(lineno()))->appendChild(identifier.release())->appendChild(statement.release());
+  }
+  node_ptr lhs(parseLeftHandSide(parsePrimaryIdentifier(identifier.release())));
+  node_ptr expression(parseExpression(false, lhs.release()));
+  parseSemicolon();
+  return expression.release();
+}
+
+Node* DescentParser::parseIf() {
+  expect(t_IF);
+  expect(t_LPAREN);
+  node_ptr condition(parseExpression(false));
+  expect(t_RPAREN);
+  node_ptr consequent(parseStatement());
+  node_ptr alternate;
+  if (peek() == t_ELSE) {
+    skip();
+    alternate.reset(parseStatement());
+  }
+  unsigned int line = condition->lineno();
+  return (new NodeIf(line))->appendChild(condition.release())->appendChild(consequent.release())->appendChild(alternate.release());
+}
+
+Node* DescentParser::parseDoWhile() {
+  expect(t_DO);
+  node_ptr body(parseStatement());
+  expect(t_WHILE);
+  expect(t_LPAREN);
+  node_ptr condition(parseExpression(false));
+  expect(t_RPAREN);
+  parseSemicolon();
+  unsigned int line = body->lineno();
+  return (new NodeDoWhile(line))->appendChild(body.release())->appendChild(condition.release());
+}
+
+Node* DescentParser::parseWhile() {
+  expect(t_WHILE);
+  expect(t_LPAREN);
+  node_ptr condition(parseExpression(false));
+  expect(t_RPAREN);
+  node_ptr body(parseStatement());
+  unsigned int line = condition->lineno();
+  return (new NodeWhile(line))->appendChild(condition.release())->appendChild(body.release());
+}
+
+//
+// for (;;) and for (in). Both start the same way so the initializer is parsed first, then `in`
+// decides which loop it was.
+Node* DescentParser::parseFor() {
+  expect(t_FOR);
+  expect(t_LPAREN);
+  node_ptr initializer;
+  node_unary_t op;
+  if (peek() == t_VAR) {
+    skip();
+    initializer.reset(parseVarDeclarations(true));
+    if (peek() == t_IN) {
+      static_cast<NodeVarDeclaration*>(initializer.get())->setIterator(true);
+      return parseForIn(initializer.release(), false);
+    }
+  } else if (tok == t_SEMICOLON) {
+    initializer.reset(new NodeEmptyExpression(lineno()));
+  } else if (unaryOperator(tok, op)) {
+    initializer.reset(parseExpression(true));
+  } else {
+    node_ptr lhs(parseLeftHandSide());
+    if (peek() == t_IN) {
+      return parseForIn(lhs.release(), false);
+    }
+    initializer.reset(parseExpression(true, lhs.release()));
+  }
+  expect(t_SEMICOLON);
+  node_ptr test(parseOptionalExpression(t_SEMICOLON));
+  expect(t_SEMICOLON);
+  node_ptr update(parseOptionalExpression(t_RPAREN));
+  expect(t_RPAREN);
+  node_ptr body(parseStatement());
+  unsigned int line = initializer->lineno();
+  return (new NodeForLoop(line))->appendChild(initializer.release())->appendChild(test.release())->
+    appendChild(update.release())->appendChild(body.release());
+}
+
+Node* DescentParser::parseForEach() {
+  expect(t_FOR_EACH);
+  expect(t_LPAREN);
+  node_ptr iterator;
+  if (peek() == t_VAR) {
+    skip();
+    iterator.reset(static_cast<NodeVarDeclaration*>(parseVarDeclarations(true))->setIterator(true));
+  } else {
+    iterator.reset(parseLeftHandSide());
+  }
+  return parseForIn(iterator.release(), true);
+}
+
+//
+// The rest of a for (in) or for each (in) loop, from the `in`
+Node* DescentParser::parseForIn(Node* iterator_, bool each) {
+  node_ptr iterator(iterator_);
+  expect(t_IN);
+  node_ptr collection(parseExpression(false));
+  expect(t_RPAREN);
+  node_ptr body(parseStatement());
+  unsigned int line = iterator->lineno();
+  Node* loop;
+  if (each) {
+    require(PARSE_E4X, "E4X not supported");
+    loop = new NodeForEachIn(line);
+  } else {
+    loop = new NodeForIn(line);
+  }
+  return loop->appendChild(iterator.release())->appendChild(collection.release())->appendChild(body.release());
+}
+
+Node* DescentParser::parseOptionalExpression(int end) {
+  if (peek() == end) {
+    return new NodeEmptyExpression(lineno());
+  }
+  return parseExpression(false);
+}
+
+//
+// continue and break take an optional label, return an optional expression and throw a required one
+Node* DescentParser::parseStatementWithExpression(node_statement_with_expression_t statement) {
+  skip();
+  node_ptr operand;
+  if (statement == CONTINUE || statement == BREAK) {
+    if (peek() == t_IDENTIFIER) {
+      operand.reset(parseIdentifier());
+    }
+  } else if (statement == THROW || (peek() != t_SEMICOLON && tok != t_VIRTUAL_SEMICOLON)) {
+    operand.reset(parseExpression(false));
+  }
+  parseSemicolon();
+  return (new NodeStatementWithExpression(statement, lineno()))->appendChild(operand.release());
+}
+
+Node* DescentParser::parseWith() {
+  expect(t_WITH);
+  expect(t_LPAREN);
+  node_ptr object(parseExpression(false));
+  expect(t_RPAREN);
+  node_ptr body(parseStatement());
+  unsigned int line = object->lineno();
+  return (new NodeWith(line))->appendChild(object.release())->appendChild(body.release());
+}
+
+//
+// A switch's case block is a statement list of case clauses, each one followed by its statements.
+// With a default clause it's a list of: the cases before the default, the default and its
+// statements, and then the cases after.
+Node* DescentParser::parseSwitch() {
+  nesting_t nesting(*this);
+  expect(t_SWITCH);
+  expect(t_LPAREN);
+  node_ptr discriminant(parseExpression(false));
+  expect(t_RPAREN);
+  expect(t_LCURLY);
+  node_ptr block(parseCaseClauses());
+  if (block.get() == NULL) {
+    block.reset(new NodeStatementList(lineno()));
+  }
+  if (peek() == t_DEFAULT) {
+    node_ptr before(block.release());
+    skip();
+    expect(t_COLON);
+    node_ptr statements(parseStatementList(END_DEFAULT));
+    node_ptr clause(new NodeDefaultClause(lineno()));
+    node_ptr after(parseCaseClauses());
+    if (after.get() == NULL) {
+      after.reset(new NodeStatementList(lineno()));
+    }
+    expect(t_RCURLY);
+    block.reset((new NodeStatementList(lineno()))->appendChild(before.release())->appendChild(clause.release()));
+    if (statements.get() != NULL) {
+      block->appendChild(statements.release());
+    }
+    block->appendChild(after.release());
+  } else {
+    expect(t_RCURLY);
+  }
+  unsigned int line = discriminant->lineno();
+  return (new NodeSwitch(line))->appendChild(discriminant.release())->appendChild(block.release());
+}
+
+//
+// Returns NULL if there are none, callers create the empty list
+Node* DescentParser::parseCaseClauses() {
+  node_ptr clauses;
+  while (peek() == t_CASE) {
+    skip();
+    node_ptr expression(parseExpression(false));
+    expect(t_COLON);
+    node_ptr statements(parseStatementList(END_CASE));
+    unsigned int line = expression->lineno();
+    node_ptr clause((new NodeCaseClause(line))->appendChild(expression.release()));
+    if (clauses.get() == NULL) {
+      clauses.reset(new NodeStatementList(lineno()));
+    }
+    clauses->appendChild(clause.release());
+    if (statements.get() != NULL) {
+      clauses->appendChild(statements.release());
+    }
+  }
+  return clauses.release();
+}
+
+Node* DescentParser::parseTry() {
+  expect(t_TRY);
+  node_ptr block(parseBlock());
+  node_ptr identifier;
+  node_ptr handler;
+  node_ptr finalizer;
+  if (peek() == t_CATCH) {
+    skip();
+    expect(t_LPAREN);
+    identifier.reset(parseIdentifier());
+    expect(t_RPAREN);
+    handler.reset(parseBlock());
+  }
+  if (peek() == t_FINALLY) {
+    skip();
+    finalizer.reset(parseBlock());
+  } else if (handler.get() == NULL) {
+    syntaxError();
+  }
+  unsigned int line = block->lineno();
+  return (new NodeTry(line))->appendChild(block.release())->appendChild(identifier.release())->
+    appendChild(handler.release())->appendChild(finalizer.release());
+}
+
+Node* DescentParser::parseXMLDefaultNamespace() {
+  expect(t_XML_DEFAULT_NAMESPACE);
+  expect(t_ASSIGN);
+  node_ptr expression(parseExpression(false));
+  parseSemicolon();
+  require(PARSE_E4X, "E4X not supported");
+  return (new NodeXMLDefaultNamespace(lineno()))->appendChild(expression.release());
+}
+
+//
+// Declarations and expressions only differ in their class and whether the name is optional
+Node* DescentParser::parseFunction(bool declaration) {
+  nesting_t nesting(*this);
+  expect(t_FUNCTION);
+  node_ptr name;
+  if (declaration || peek() == t_IDENTIFIER) {
+    name.reset(parseIdentifier());
+  }
+  expect(t_LPAREN);
+  node_ptr params;
+  if (peek() != t_RPAREN) {
+    params.reset(parseFormalParameters());
+  }
+  expect(t_RPAREN);
+  node_ptr body(parseBlock());
+  unsigned int line = name.get() ? name->lineno() : params.get() ? params->lineno() : body->lineno();
+  if (params.get() == NULL) {
+    params.reset(new NodeArgList(lineno()));
+  }
+  Node* function = declaration ? static_cast<Node*>(new NodeFunctionDeclaration(line)) : new NodeFunctionExpression(line);
+  return function->appendChild(name.release())->appendChild(params.release())->appendChild(body.release());
+}
+
+Node* DescentParser::parseFormalParameters() {
+  node_ptr param(parseTypehintedIdentifier());
+  node_ptr params(new NodeArgList(lineno()));
+  params->appendChild(param.release());
+  while (peek() == t_COMMA) {
+    skip();
+    params->appendChild(parseTypehintedIdentifier());
+  }
+  return params.release();
+}
+
+//
+// Expressions. Each level takes an optional left-hand side expression which has already been
+// parsed, for places where the parser has to read one before it knows what it's part of.
+Node* DescentParser::parseExpression(bool no_in, Node* lhs /* = NULL */) {
+  node_ptr expression(parseAssignment(no_in, lhs));
+  while (peek() == t_COMMA) {
+    skip();
+    node_ptr right(parseAssignment(no_in));
+    expression.reset((new NodeOperator(COMMA, lineno()))->appendChild(expression.release())->appendChild(right.release()));
+  }
+  return expression.release();
+}
+
+Node* DescentParser::parseAssignment(bool no_in, Node* lhs_ /* = NULL */) {
+  nesting_t nesting(*this);
+  node_ptr lhs(lhs_);
+  node_unary_t unary;
+  if (lhs.get() == NULL) {
+    if (unaryOperator(peek(), unary)) {
+      return parseConditional(no_in);
+    }
+    lhs.reset(parseLeftHandSide());
+  }
+  node_assignment_t op;
+  if (!assignmentOperator(peek(), op)) {
+    return parseConditional(no_in, lhs.release());
+  }
+  skip();
+  node_ptr value(parseAssignment(no_in));
+  if (!static_cast<NodeExpression*>(lhs.get())->isValidlVal()) {
+    error("invalid assignment left-hand side");
+  }
+  return (new NodeAssignment(op, lineno()))->appendChild(lhs.release())->appendChild(value.release());
+}
+
+Node* DescentParser::parseConditional(bool no_in, Node* lhs /* = NULL */) {
+  node_ptr condition(parseBinary(PRECEDENCE_OR, no_in, lhs));
+  if (peek() != t_PLING) {
+    return condition.release();
+  }
+  skip();
+  node_ptr consequent(parseAssignment(no_in));
+  expect(t_COLON);
+  node_ptr alternate(parseAssignment(no_in));
+  return (new NodeConditionalExpression(lineno()))->appendChild(condition.release())->
+    appendChild(consequent.release())->appendChild(alternate.release());
+}
+
+//
+// Precedence climbing. `no_in` only applies to this level: in parser.yy the right operand of an
+// operator is always a post_in_expression, which may contain an `in` that binds tighter.
+Node* DescentParser::parseBinary(int precedence, bool no_in, Node* lhs /* = NULL */) {
+  node_ptr left(parseUnary(lhs));
+  node_operator_t op;
+  int op_precedence;
+  while (binaryOperator(peek(), op, op_precedence) && op_precedence >= precedence && !(no_in && tok == t_IN)) {
+    skip();
+    nesting_t nesting(*this);
+    node_ptr right(parseBinary(op_precedence + 1, false));
+    left.reset((new NodeOperator(op, lineno()))->appendChild(left.release())->appendChild(right.release()));
+  }
+  return left.release();
+}
+
+Node* DescentParser::parseUnary(Node* lhs /* = NULL */) {
+  node_unary_t op;
+  if (lhs != NULL || !unaryOperator(peek(), op)) {
+    return parsePostfix(lhs);
+  }
+  nesting_t nesting(*this);
+  skip();
+  node_ptr operand(op == PLUS_UNARY || op == MINUS_UNARY ? parseBinary(PRECEDENCE_MULTIPLICATIVE, false) : parseUnary());
+  bool valid = static_cast<NodeExpression*>(operand.get())->isValidlVal();
+  node_ptr unary((new NodeUnary(op, lineno()))->appendChild(operand.release()));
+  if (op == INCR_UNARY && !valid) {
+    error("invalid increment operand");
+  } else if (op == DECR_UNARY && !valid) {
+    error("invalid decrement operand");
+  }
+  return unary.release();
+}
+
+Node* DescentParser::parsePostfix(Node* lhs /* = NULL */) {
+  node_ptr expression(lhs ? lhs : parseLeftHandSide());
+  while (peek() == t_INCR || tok == t_DECR) {
+    node_postfix_t op = tok == t_INCR ? INCR_POSTFIX : DECR_POSTFIX;
+    skip();
+    expression.reset((new NodePostfix(op, lineno()))->appendChild(expression.release()));
+  }
+  return expression.release();
+}
+
+Node* DescentParser::parseLeftHandSide(Node* primary /* = NULL */) {
+  node_ptr member(primary ? parseSuffixes(primary, false) : parseMember());
+  return parseSuffixes(member.release(), true);
+}
+
+//
+// member_expression and new_expression. `new` takes the arguments which follow its member
+// expression; without any it can't be followed by anything else either.
+Node* DescentParser::parseMember() {
+  if (peek() != t_NEW) {
+    return parseSuffixes(parsePrimary(), false);
+  }
+  nesting_t nesting(*this);
+  skip();
+  node_ptr constructor(parseMember());
+  if (peek() != t_LPAREN) {
+    return (new NodeFunctionConstructor(lineno()))->appendChild(constructor.release())->appendChild(new NodeArgList(lineno()));
+  }
+  node_ptr args(parseArguments());
+  return parseSuffixes((new NodeFunctionConstructor(lineno()))->appendChild(constructor.release())->appendChild(args.release()), false);
+}
+
+//
+// Member accesses, and calls too once `calls` is set
+Node* DescentParser::parseSuffixes(Node* expression_, bool calls) {
+  node_ptr expression(expression_);
+  for (;;) {
+    switch (peek()) {
+      case t_LPAREN: {
+        if (!calls) {
+          return expression.release();
+        }
+        node_ptr args(parseArguments());
+        expression.reset((new NodeFunctionCall(lineno()))->appendChild(expression.release())->appendChild(args.release()));
+        break;
+      }
+
+      case t_LBRACKET: {
+        skip();
+        node_ptr property(parseExpression(false));
+        expect(t_RBRACKET);
+        expression.reset((new NodeDynamicMemberExpression(lineno()))->appendChild(expression.release())->appendChild(property.release()));
+        break;
+      }
+
+      case t_PERIOD: {
+        skip();
+        if (peek() == t_LPAREN) {
+          skip();
+          node_ptr predicate(parseExpression(false));
+          expect(t_RPAREN);
+          expression.reset((new NodeFilteringPredicate(lineno()))->appendChild(expression.release())->appendChild(predicate.release()));
+          require(PARSE_E4X, "E4X not supported");
+        } else {
+          bool e4x;
+          node_ptr name(parseMemberName(e4x));
+          expression.reset((new NodeStaticMemberExpression(lineno()))->appendChild(expression.release())->appendChild(name.release()));
+          if (e4x) {
+            require(PARSE_E4X, "E4X not supported");
+          }
+        }
+        break;
+      }
+
+      case t_XML_DESCENDENT: {
+        skip();
+        bool e4x;
+        node_ptr name(parseMemberName(e4x));
+        expression.reset((new NodeDescendantExpression(lineno()))->appendChild(expression.release())->appendChild(name.release()));
+        require(PARSE_E4X, "E4X not supported");
+        break;
+      }
+
+      default:
+        return expression.release();
+    }
+  }
+}
+
+Node* DescentParser::parseArguments() {
+  expect(t_LPAREN);
+  if (peek() == t_RPAREN) {
+    skip();
+    return new NodeArgList(lineno());
+  }
+  node_ptr arg(parseAssignment(false));
+  node_ptr args(new NodeArgList(lineno()));
+  args->appendChild(arg.release());
+  while (peek() == t_COMMA) {
+    skip();
+    args->appendChild(parseAssignment(false));
+  }
+  expect(t_RPAREN);
+  return args.release();
+}
+
+Node* DescentParser::parsePrimary() {
+  Node* node;
+  switch (peek()) {
+    case t_THIS:
+      node = new NodeThis(lineno());
+      break;
+    case t_NULL:
+      node = new NodeNullLiteral(lineno());
+      break;
+    case t_TRUE:
+      node = new NodeBooleanLiteral(true, lineno());
+      break;
+    case t_FALSE:
+      node = new NodeBooleanLiteral(false, lineno());
+      break;
+    case t_NUMBER:
+      node = new NodeNumericLiteral(lval.number, lineno());
+      break;
+    case t_STRING:
+      node = new NodeStringLiteral(lval.string, true, lineno());
+      break;
+    case t_REGEX:
+      node = new NodeRegexLiteral(lval.string_duple[0], lval.string_duple[1], lineno());
+      break;
+
+    case t_IDENTIFIER:
+      return parsePrimaryIdentifier(parseIdentifier());
+    case t_LBRACKET:
+      return parseArrayLiteral();
+    case t_LCURLY:
+      return parseObjectLiteral();
+    case t_FUNCTION:
+      return parseFunction(false);
+
+    case t_LPAREN: {
+      skip();
+      node_ptr expression(parseExpression(false));
+      expect(t_RPAREN);
+      return (new NodeParenthetical(lineno()))->appendChild(expression.release());
+    }
+
+    case t_LESS_THAN: {
+      node_ptr xml(parseXMLLiteral());
+      require(PARSE_E4X, "E4X not supported");
+      return xml.release();
+    }
+
+    case t_XML_ATTRIBUTE:
+    case t_MULT: {
+      node_ptr property(parsePropertyIdentifier());
+      require(PARSE_E4X, "E4X not supported");
+      return property.release();
+    }
+
+    default:
+      syntaxError();
+  }
+  skip();
+  return node;
+}
+
+Node* DescentParser::parseIdentifier() {
+  if (peek() != t_IDENTIFIER) {
+    syntaxError();
+  }
+  Node* identifier = new NodeIdentifier(lval.string, lineno());
+  skip();
+  return identifier;
+}
+
+//
+// An identifier which has been read as a primary expression may still be the start of a qualified
+// identifier
+Node* DescentParser::parsePrimaryIdentifier(Node* identifier_) {
+  node_ptr identifier(identifier_);
+  if (peek() != t_XML_QUALIFIER) {
+    return identifier.release();
+  }
+  node_ptr qualified(parseQualifiedIdentifier(identifier.release()));
+  require(PARSE_E4X, "E4X not supported");
+  return qualified.release();
+}
+
+//
+// Elisons are counted as they come and become empty expressions. parser.yy adds one more than
+// there are commas for an array of nothing but elisons.
+Node* DescentParser::parseArrayLiteral() {
+  expect(t_LBRACKET);
+  size_t elison = 0;
+  while (peek() == t_COMMA) {
+    skip();
+    ++elison;
+  }
+  if (tok == t_RBRACKET) {
+    skip();
+    Node* array = new NodeArrayLiteral(lineno());
+    for (size_t ii = 0; elison && ii < elison + 1; ++ii) {
+      array->appendChild(new NodeEmptyExpression(lineno()));
+    }
+    return array;
+  }
+  node_ptr element(parseAssignment(false));
+  node_ptr array(new NodeArrayLiteral(lineno()));
+  for (size_t ii = 0; ii < elison; ++ii) {
+    array->appendChild(new NodeEmptyExpression(lineno()));
+  }
+  array->appendChild(element.release());
+  for (;;) {
+    if (peek() == t_RBRACKET) {
+      skip();
+      return array.release();
+    } else if (tok != t_COMMA) {
+      syntaxError();
+    }
+    elison = 0;
+    while (peek() == t_COMMA) {
+      skip();
+      ++elison;
+    }
+    if (tok == t_RBRACKET) {
+      skip();
+      for (size_t ii = 0; ii < elison; ++ii) {
+        array->appendChild(new NodeEmptyExpression(lineno()));
+      }
+      return array.release();
+    }
+    element.reset(parseAssignment(false));
+    for (size_t ii = 1; ii < elison; ++ii) {
+      array->appendChild(new NodeEmptyExpression(lineno()));
+    }
+    array->appendChild(element.release());
+  }
+}
+
+//
+// The scanner puts a `t_VIRTUAL_SEMICOLON' before the closing curly of a non-empty object
+Node* DescentParser::parseObjectLiteral() {
+  expect(t_LCURLY);
+  if (peek() == t_RCURLY) {
+    skip();
+    return new NodeObjectLiteral(lineno());
+  }
+  node_ptr object;
+  for (;;) {
+    node_ptr name(parsePropertyName());
+    expect(t_COLON);
+    node_ptr value(parseAssignment(false));
+    if (object.get() == NULL) {
+      object.reset(new NodeObjectLiteral(lineno()));
+    }
+    object->appendChild((new NodeObjectLiteralProperty(lineno()))->appendChild(name.release())->appendChild(value.release()));
+    if (peek() == t_VIRTUAL_SEMICOLON) {
+      skip();
+      expect(t_RCURLY);
+      return object.release();
+    }
+    expect(t_COMMA);
+    if (peek() == t_VIRTUAL_SEMICOLON) {
+      skip();
+      expect(t_RCURLY);
+      require(PARSE_OBJECT_LITERAL_ELISON, "object literal elisons not supported");
+      return object.release();
+    }
+  }
+}
+
+Node* DescentParser::parsePropertyName() {
+  Node* name;
+  switch (peek()) {
+    case t_IDENTIFIER:
+      return parseIdentifier();
+    case t_STRING:
+      name = new NodeStringLiteral(lval.string, true, lineno());
+      break;
+    case t_NUMBER:
+      name = new NodeNumericLiteral(lval.number, lineno());
+      break;
+    default:
+      syntaxError();
+  }
+  skip();
+  return name;
+}
+
+//
+// E4X
+//
+// The name after `.` or `..`. Anything but a plain identifier needs E4X, which `e4x` is set for.
+Node* DescentParser::parseMemberName(bool& e4x) {
+  e4x = true;
+  if (peek() != t_IDENTIFIER) {
+    return parsePropertyIdentifier();
+  }
+  node_ptr identifier(parseIdentifier());
+  if (peek() != t_XML_QUALIFIER) {
+    e4x = false;
+    return identifier.release();
+  }
+  return parseQualifiedIdentifier(identifier.release());
+}
+
+//
+// property_identifier: an attribute, wildcard or qualified identifier. An identifier on its own
+// isn't one, callers which allow those handle them first.
+Node* DescentParser::parsePropertyIdentifier() {
+  if (peek() != t_XML_ATTRIBUTE) {
+    node_ptr selector(parsePropertySelector());
+    if (peek() != t_XML_QUALIFIER) {
+      return selector.release();
+    }
+    return parseQualifiedIdentifier(selector.release());
+  }
+  skip();
+  if (peek() == t_LBRACKET) {
+    skip();
+    node_ptr expression(parseExpression(false));
+    expect(t_RBRACKET);
+    return (new NodeDynamicAttributeIdentifier(lineno()))->appendChild(expression.release());
+  }
+  node_ptr name(parsePropertySelector());
+  if (peek() == t_XML_QUALIFIER) {
+    name.reset(parseQualifiedIdentifier(name.release()));
+  }
+  return (new NodeStaticAttributeIdentifier(lineno()))->appendChild(name.release());
+}
+
+Node* DescentParser::parsePropertySelector() {
+  if (peek() != t_MULT) {
+    return parseIdentifier();
+  }
+  Node* wildcard = new NodeWildcardIdentifier(lineno());
+  skip();
+  return wildcard;
+}
+
+//
+// The rest of a qualified identifier, from the `::` after its namespace
+Node* DescentParser::parseQualifiedIdentifier(Node* selector_) {
+  node_ptr selector(selector_);
+  unsigned int line = selector->lineno();
+  expect(t_XML_QUALIFIER);
+  if (peek() == t_LBRACKET) {
+    skip();
+    node_ptr expression(parseExpression(false));
+    expect(t_RBRACKET);
+    return (new NodeDynamicQualifiedIdentifier(line))->appendChild(selector.release())->appendChild(expression.release());
+  }
+  node_ptr name(parsePropertySelector());
+  return (new NodeStaticQualifiedIdentifier(line))->appendChild(selector.release())->appendChild(name.release());
+}
+
+//
+// An element, or a list of them in `<>...</>`. This is at a `<` in an expression, the scanner
+// switches to XML as soon as it's consumed and back after the closing `>`.
+Node* DescentParser::parseXMLLiteral() {
+  expect(t_LESS_THAN);
+  fbjs_push_xml_state(scanner);
+  if (peek() != t_GREATER_THAN) {
+    return parseXMLElement();
+  }
+  skip();
+  node_ptr content(parseXMLContent());
+  expect(t_XML_LT_DIV);
+  expect(t_GREATER_THAN);
+  fbjs_pop_xml_state(scanner);
+  return (new NodeXMLElement(lineno()))->appendChild(NULL)->appendChild(NULL)->appendChild(content.release())->appendChild(NULL);
+}
+
+//
+// The rest of an element after its `<`
+Node* DescentParser::parseXMLElement() {
+  nesting_t nesting(*this);
+  node_ptr name(parseXMLTagName());
+  node_ptr attributes(parseXMLAttributes());
+  node_ptr element((new NodeXMLElement(lineno()))->appendChild(name.release())->appendChild(attributes.release()));
+  if (peek() == t_DIV) {
+    skip();
+    expect(t_GREATER_THAN);
+    fbjs_pop_xml_state(scanner);
+    element->appendChild(new NodeXMLContentList(lineno()))->appendChild(NULL);
+    return element.release();
+  }
+  expect(t_GREATER_THAN);
+  node_ptr content(parseXMLContent());
+  expect(t_XML_LT_DIV);
+  node_ptr closing(parseXMLTagName());
+  if (peek() == t_XML_WHITESPACE) {
+    skip();
+  }
+  expect(t_GREATER_THAN);
+  fbjs_pop_xml_state(scanner);
+  element->appendChild(content.release())->appendChild(closing.release());
+  return element.release();
+}
+
+Node* DescentParser::parseXMLTagName() {
+  if (peek() == t_LCURLY) {
+    return parseXMLEmbeddedExpression();
+  }
+  return parseXMLName();
+}
+
+Node* DescentParser::parseXMLName() {
+  if (peek() != t_XML_NAME_FRAGMENT) {
+    syntaxError();
+  }
+  string name = lval.string;
+  skip();
+  if (peek() != t_COLON) {
+    return new NodeXMLName("", name, lineno());
+  }
+  skip();
+  if (peek() != t_XML_NAME_FRAGMENT) {
+    syntaxError();
+  }
+  Node* qualified = new NodeXMLName(name, lval.string, lineno());
+  skip();
+  return qualified;
+}
+
+//
+// Attributes are preceded by whitespace, which only counts before the first one
+Node* DescentParser::parseXMLAttributes() {
+  if (peek() != t_XML_WHITESPACE) {
+    return new NodeXMLAttributeList(lineno());
+  }
+  skip();
+  node_ptr list(new NodeXMLAttributeList(lineno()));
+  for (;;) {
+    if (peek() == t_XML_WHITESPACE) {
+      skip();
+    } else if (tok == t_XML_NAME_FRAGMENT) {
+      node_ptr name(parseXMLName());
+      expect(t_ASSIGN);
+      node_ptr value(parseXMLAttributeValue());
+      list->appendChild((new NodeXMLAttribute(lineno()))->appendChild(name.release())->appendChild(value.release()));
+    } else {
+      return list.release();
+    }
+  }
+}
+
+//
+// A quoted value is text up to the matching quote, with the other kind of quote and all punctuation
+// taken literally
+Node* DescentParser::parseXMLAttributeValue() {
+  if (peek() == t_LCURLY) {
+    return parseXMLEmbeddedExpression();
+  } else if (tok != t_XML_QUOTE && tok != t_XML_APOS) {
+    syntaxError();
+  }
+  int quote = tok;
+  skip();
+  node_ptr data(new NodeXMLTextData());
+  NodeXMLTextData* text = static_cast<NodeXMLTextData*>(data.get());
+  char ch;
+  while (peek() != quote) {
+    if (tok == t_XML_CDATA || tok == t_XML_NAME_FRAGMENT || tok == t_XML_WHITESPACE) {
+      text->appendData(lval.string);
+    } else if (tok == t_XML_QUOTE || tok == t_XML_APOS) {
+      text->appendData(tok == t_XML_QUOTE ? '"' : '\'');
+    } else if (xmlCharacter(tok, ch)) {
+      text->appendData(ch);
+    } else {
+      syntaxError();
+    }
+    skip();
+  }
+  skip();
+  return data.release();
+}
+
+//
+// Runs of text alternating with elements, embedded expressions, comments and processing
+// instructions, up to the `</`. This is just after the `>` of the opening tag, and the scanner
+// switches to element content until the `</`.
+Node* DescentParser::parseXMLContent() {
+  fbjs_begin_xml_content(scanner);
+  node_ptr text(parseXMLText());
+  node_ptr list(new NodeXMLContentList(lineno()));
+  if (text.get() != NULL) {
+    list->appendChild(text.release());
+  }
+  for (;;) {
+    switch (peek()) {
+      case t_LESS_THAN:
+        skip();
+        fbjs_push_xml_state(scanner);
+        list->appendChild(parseXMLElement());
+        break;
+      case t_LCURLY:
+        list->appendChild(parseXMLEmbeddedExpression());
+        break;
+      case t_XML_COMMENT:
+        list->appendChild(new NodeXMLComment(lval.string, lineno()));
+        skip();
+        break;
+      case t_XML_PI:
+        list->appendChild(new NodeXMLPI(lval.string, lineno()));
+        skip();
+        break;
+      default:
+        return list.release();
+    }
+    text.reset(parseXMLText());
+    if (text.get() != NULL) {
+      list->appendChild(text.release());
+    }
+  }
+}
+
+//
+// One run of text, merged into a single node. Returns NULL if there isn't any. The scanner gives
+// all of it as one token, unless there are CDATA sections.
+Node* DescentParser::parseXMLText() {
+  NodeXMLTextData* text = NULL;
+  while (peek() == t_XML_WHITESPACE || tok == t_XML_CDATA) {
+    if (text == NULL) {
+      text = new NodeXMLTextData(lineno());
+    }
+    text->appendData(lval.string, tok == t_XML_WHITESPACE);
+    skip();
+  }
+  return text;
+}
+
+Node* DescentParser::parseXMLEmbeddedExpression() {
+  expect(t_LCURLY);
+  fbjs_push_xml_embedded_expression_state(scanner);
+  node_ptr expression(parseExpression(false));
+  expect(t_VIRTUAL_SEMICOLON);
+  expect(t_RCURLY);
+  fbjs_pop_xml_state(scanner);
+  unsigned int line = expression->lineno();
+  return (new NodeXMLEmbeddedExpression(line))->appendChild(expression.release());
+}
+
+void fbjs_descent_parse(void* scanner, Node* root) {
+  DescentParser parser(scanner);
+  parser.parse(root);
+}
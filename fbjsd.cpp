@@ -0,0 +1,234 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include "daemon.hpp"
+#include "node.hpp"
+using namespace std;
+using namespace fbjs;
+
+//
+// Runs a DaemonServer until SIGINT or SIGTERM, or talks to one. See daemon.hpp.
+//
+//   fbjsd [-w workers] [-c cache_mb] [-t timeout] [-d depth] [-k idle] socket
+//   fbjsd -s socket [-o parse|render|transform] [-e] [-p] [-f] [-m] [-i] [-n repeat] file...
+//
+// As a client it sends each file (passing its descriptor, or inline with -i) `repeat` times and
+// writes the output to stdout. -e parses E4X, -p renders pretty, -f and -m fold constants and
+// mangle identifiers (with -o transform). Each request's status, time and whether it hit the cache
+// go to stderr.
+//
+// As a server, -t limits the seconds a parse can take and -d how many brackets can be open at once.
+// A connection which sends nothing for -k seconds (300 by default, 0 for ever) is closed.
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+    "usage: %s [-w workers] [-c cache_mb] [-t timeout] [-d depth] [-k idle] socket\n"
+    "       %s -s socket [-o parse|render|transform] [-e] [-p] [-f] [-m] [-i] [-n repeat] file...\n",
+    name, name);
+  exit(2);
+}
+
+static void* waitForSignal(void* server) {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  int signal;
+  sigwait(&signals, &signal);
+  static_cast<DaemonServer*>(server)->stop();
+  return NULL;
+}
+
+static int serve(int argc, char* argv[]) {
+  daemon_options_t options;
+  int opt;
+  while ((opt = getopt(argc, argv, "w:c:t:d:k:")) != -1) {
+    switch (opt) {
+      case 'w':
+        options.workers = atoi(optarg);
+        break;
+      case 'c':
+        options.cache_bytes = strtoul(optarg, NULL, 10) * 1024 * 1024;
+        break;
+      case 't':
+        options.timeout = strtod(optarg, NULL);
+        break;
+      case 'd':
+        options.max_depth = strtoul(optarg, NULL, 10);
+        break;
+      case 'k':
+        options.idle_timeout = strtod(optarg, NULL);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind + 1 != argc) {
+    usage(argv[0]);
+  }
+
+  // Blocked in every thread so that only waitForSignal() sees them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  try {
+    DaemonServer server(argv[optind], options);
+    pthread_t waiter;
+    pthread_create(&waiter, NULL, waitForSignal, &server);
+    server.serve();
+    pthread_join(waiter, NULL);
+    daemon_stats_t stats = server.statistics();
+    fprintf(stderr, "%lu connections, %lu requests, %lu cache hits, %lu misses, %lu trees (%lu bytes) cached\n",
+      (unsigned long)stats.connections, (unsigned long)stats.requests, (unsigned long)stats.hits,
+      (unsigned long)stats.misses, (unsigned long)stats.cached, (unsigned long)stats.cached_bytes);
+  } catch (runtime_error& ex) {
+    fprintf(stderr, "%s\n", ex.what());
+    return 1;
+  }
+  return 0;
+}
+
+static const char* statusName(uint32_t status) {
+  switch (status) {
+    case DAEMON_OK: return "ok";
+    case DAEMON_PARSE_ERROR: return "parse error";
+    case DAEMON_BUDGET_ERROR: return "over budget";
+    case DAEMON_BAD_REQUEST: return "bad request";
+    default: return "error";
+  }
+}
+
+static int client(int argc, char* argv[]) {
+  const char* socket_path = NULL;
+  daemon_request_t request(DAEMON_RENDER);
+  bool inline_source = false;
+  int repeat = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:o:epfmin:")) != -1) {
+    switch (opt) {
+      case 's':
+        socket_path = optarg;
+        break;
+      case 'o':
+        if (strcmp(optarg, "parse") == 0) {
+          request.op = DAEMON_PARSE;
+        } else if (strcmp(optarg, "render") == 0) {
+          request.op = DAEMON_RENDER;
+        } else if (strcmp(optarg, "transform") == 0) {
+          request.op = DAEMON_TRANSFORM;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'e':
+        request.parse_opts |= PARSE_E4X;
+        break;
+      case 'p':
+        request.render_opts |= RENDER_PRETTY;
+        break;
+      case 'f':
+        request.passes |= DAEMON_PASS_FOLD;
+        break;
+      case 'm':
+        request.passes |= DAEMON_PASS_MANGLE;
+        break;
+      case 'i':
+        inline_source = true;
+        break;
+      case 'n':
+        repeat = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (socket_path == NULL || optind == argc) {
+    usage(argv[0]);
+  }
+
+  int failed = 0;
+  try {
+    DaemonClient daemon(socket_path);
+    for (int ii = optind; ii < argc; ++ii) {
+      int fd = open(argv[ii], O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        perror(argv[ii]);
+        ++failed;
+        continue;
+      }
+      string code;
+      if (inline_source) {
+        char buf[64 * 1024];
+        ssize_t got;
+        while ((got = read(fd, buf, sizeof(buf))) > 0) {
+          code.append(buf, got);
+        }
+      }
+      for (int run = 0; run < repeat; ++run) {
+        double start = now();
+        daemon_response_t response = inline_source ?
+          daemon.request(request, code.data(), code.size()) : daemon.request(request, fd);
+        fprintf(stderr, "%s: %s%s, %.3f ms\n", argv[ii], statusName(response.status),
+          response.flags & DAEMON_CACHED ? " (cached)" : "", (now() - start) * 1000);
+        if (response.status != DAEMON_OK) {
+          fprintf(stderr, "%s\n", response.body.c_str());
+          ++failed;
+          break;
+        }
+        if (run == repeat - 1) {
+          fwrite(response.body.data(), 1, response.body.size(), stdout);
+        }
+      }
+      close(fd);
+    }
+  } catch (runtime_error& ex) {
+    fprintf(stderr, "%s\n", ex.what());
+    return 1;
+  }
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strcmp(argv[ii], "-s") == 0) {
+      return client(argc, argv);
+    }
+  }
+  return serve(argc, argv);
+}
@@ -0,0 +1,868 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "folder.hpp"
+using namespace std;
+using namespace fbjs;
+
+namespace {
+  enum constant_type_t {
+    CONSTANT_NUMBER, CONSTANT_STRING, CONSTANT_BOOLEAN, CONSTANT_NULL
+  };
+
+  struct constant_t {
+    constant_type_t type;
+    double number;
+    bool boolean;
+    string body; // raw source between the quotes, escapes intact
+    char quote;
+  };
+
+  //
+  // Extracts the value of a literal. Besides plain literals this understands what the folder emits
+  // for values which have no literal syntax: -n, !0 and !1.
+  bool constantValue(Node* node, constant_t& value) {
+    while (typeid(*node) == typeid(NodeParenthetical)) {
+      node = node->childNodes().front();
+    }
+    if (typeid(*node) == typeid(NodeNumericLiteral)) {
+      value.type = CONSTANT_NUMBER;
+      value.number = static_cast<NodeNumericLiteral*>(node)->number();
+    } else if (typeid(*node) == typeid(NodeStringLiteral)) {
+      NodeStringLiteral* string = static_cast<NodeStringLiteral*>(node);
+      if (!string->isQuoted()) {
+        return false;
+      }
+      value.type = CONSTANT_STRING;
+      value.body = string->unquoted_value();
+      value.quote = string->quote();
+    } else if (typeid(*node) == typeid(NodeBooleanLiteral)) {
+      value.type = CONSTANT_BOOLEAN;
+      value.boolean = static_cast<NodeBooleanLiteral*>(node)->compare(true);
+    } else if (typeid(*node) == typeid(NodeNullLiteral)) {
+      value.type = CONSTANT_NULL;
+    } else if (typeid(*node) == typeid(NodeUnary)) {
+      node_unary_t op = static_cast<NodeUnary*>(node)->operatorType();
+      Node* operand = node->childNodes().front();
+      if (typeid(*operand) != typeid(NodeNumericLiteral) || (op != MINUS_UNARY && op != NOT_UNARY)) {
+        return false;
+      }
+      double number = static_cast<NodeNumericLiteral*>(operand)->number();
+      if (op == MINUS_UNARY) {
+        value.type = CONSTANT_NUMBER;
+        value.number = -number;
+      } else {
+        value.type = CONSTANT_BOOLEAN;
+        value.boolean = !static_cast<NodeNumericLiteral*>(operand)->compare(true);
+      }
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // ToNumber(), except for strings which would require a full numeric parser
+  bool toNumber(const constant_t& value, double& number) {
+    switch (value.type) {
+      case CONSTANT_NUMBER:
+        number = value.number;
+        return true;
+      case CONSTANT_BOOLEAN:
+        number = value.boolean ? 1 : 0;
+        return true;
+      case CONSTANT_NULL:
+        number = 0;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Number.prototype.toString(). Integers up to 2^53 are exact; anything else uses the fewest
+  // significant digits (17 at most) which read back as the same number, laid out the way JavaScript
+  // does: no exponent from 1e-6 up to 1e21, and `1.5e+21` style outside of that.
+  bool numberToString(double number, string& str) {
+    if (number != number || isinf(number)) {
+      return false;
+    }
+    char buf[32];
+    if (number == 0) {
+      str = "0";
+      return true;
+    } else if (number == floor(number) && fabs(number) <= 9007199254740992.0) {
+      snprintf(buf, sizeof(buf), "%.0f", number);
+      str = buf;
+      return true;
+    }
+    str = number < 0 ? "-" : "";
+    number = fabs(number);
+    for (int precision = 0; precision <= 16; ++precision) {
+      snprintf(buf, sizeof(buf), "%.*e", precision, number);
+      if (strtod(buf, NULL) == number) {
+        break;
+      }
+    }
+
+    // buf is d.ddde[+-]x, or de[+-]x for one digit; the value is 0.digits * 10^point
+    char* exponent = strchr(buf, 'e');
+    string digits(1, buf[0]);
+    if (buf[1] == '.') {
+      digits.append(buf + 2, exponent);
+    }
+    digits.erase(digits.find_last_not_of('0') + 1);
+    int point = atoi(exponent + 1) + 1;
+    int length = digits.size();
+    if (length <= point && point <= 21) {
+      str += digits + string(point - length, '0');
+    } else if (0 < point && point <= 21) {
+      str += digits.substr(0, point) + "." + digits.substr(point);
+    } else if (-6 < point && point <= 0) {
+      str += "0." + string(-point, '0') + digits;
+    } else {
+      snprintf(buf, sizeof(buf), "e%c%d", point > 0 ? '+' : '-', abs(point - 1));
+      str += digits.substr(0, 1) + (length > 1 ? "." + digits.substr(1) : "") + buf;
+    }
+    return true;
+  }
+
+  // ToString(), producing an escaped string body
+  bool toStringBody(const constant_t& value, string& body) {
+    switch (value.type) {
+      case CONSTANT_STRING:
+        body = value.body;
+        return true;
+      case CONSTANT_BOOLEAN:
+        body = value.boolean ? "true" : "false";
+        return true;
+      case CONSTANT_NULL:
+        body = "null";
+        return true;
+      case CONSTANT_NUMBER:
+        return numberToString(value.number, body);
+    }
+    return false;
+  }
+
+  bool hasEscapes(const string& body) {
+    return body.find('\\') != string::npos;
+  }
+
+  bool isAscii(const string& body) {
+    for (string::const_iterator ii = body.begin(); ii != body.end(); ++ii) {
+      if (*ii & 0x80) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Requotes a string body for use inside of `quote`. Escapes are left alone.
+  string requote(const string& body, char from, char quote) {
+    if (from == quote) {
+      return body;
+    }
+    string ret;
+    ret.reserve(body.size());
+    for (string::const_iterator ii = body.begin(); ii != body.end(); ++ii) {
+      if (*ii == '\\') {
+        ret += *ii;
+        if (++ii == body.end()) {
+          break;
+        }
+      } else if (*ii == quote) {
+        ret += '\\';
+      }
+      ret += *ii;
+    }
+    return ret;
+  }
+
+  // "\x4" + "1" must not turn into "\x41", nor "\0" + "1" into "\01"
+  bool canAppend(const string& left, const string& right) {
+    if (right.empty() || !isxdigit(right[0])) {
+      return true;
+    }
+    // Only an escape in the last few characters can still be extended; left may be long
+    size_t tail = left.size() < 6 ? 0 : left.size() - 6;
+    size_t escape = string(left, tail).rfind('\\');
+    if (escape == string::npos) {
+      return true;
+    }
+    escape += tail;
+    size_t run = 1;
+    while (run <= escape && left[escape - run] == '\\') {
+      ++run;
+    }
+    if (run % 2 == 0 || escape + 1 == left.size()) {
+      return true;
+    }
+    char type = left[escape + 1];
+    return !(type == 'x' || type == 'u' || (type >= '0' && type <= '7'));
+  }
+
+  int32_t toInt32(double number) {
+    if (number != number || isinf(number)) {
+      return 0;
+    }
+    double bits = fmod(number < 0 ? ceil(number) : floor(number), 4294967296.0);
+    if (bits < 0) {
+      bits += 4294967296.0;
+    }
+    return (int32_t)(uint32_t)bits;
+  }
+
+  // Strict equality of two values of the same type. Returns false if it can't be determined.
+  bool strictEquals(const constant_t& left, const constant_t& right, bool& result) {
+    switch (left.type) {
+      case CONSTANT_NUMBER:
+        result = left.number == right.number;
+        return true;
+      case CONSTANT_BOOLEAN:
+        result = left.boolean == right.boolean;
+        return true;
+      case CONSTANT_NULL:
+        result = true;
+        return true;
+      case CONSTANT_STRING:
+        if (left.quote == right.quote && left.body == right.body) {
+          result = true;
+          return true;
+        } else if (hasEscapes(left.body) || hasEscapes(right.body)) {
+          return false;
+        }
+        result = left.body == right.body;
+        return true;
+    }
+    return false;
+  }
+
+  //
+  // Evaluates a binary operator according to ECMA-262 section 11.
+  enum fold_result_t {
+    FOLD_NONE, FOLD_NUMBER, FOLD_STRING, FOLD_BOOLEAN
+  };
+  fold_result_t evaluate(node_operator_t op, const constant_t& left, const constant_t& right, constant_t& result) {
+    double a, b;
+    bool numbers = toNumber(left, a) && toNumber(right, b);
+    switch (op) {
+      case PLUS:
+        if (left.type == CONSTANT_STRING || right.type == CONSTANT_STRING) {
+          string lbody, rbody;
+          if (!toStringBody(left, lbody) || !toStringBody(right, rbody)) {
+            return FOLD_NONE;
+          }
+          result.quote = left.type == CONSTANT_STRING ? left.quote : right.quote;
+          if (left.type == CONSTANT_STRING) {
+            lbody = requote(lbody, left.quote, result.quote);
+          }
+          if (right.type == CONSTANT_STRING) {
+            rbody = requote(rbody, right.quote, result.quote);
+          }
+          if (!canAppend(lbody, rbody)) {
+            return FOLD_NONE;
+          }
+          result.body = lbody + rbody;
+          return FOLD_STRING;
+        }
+        if (!numbers) return FOLD_NONE;
+        result.number = a + b;
+        return FOLD_NUMBER;
+
+      case MINUS:
+        if (!numbers) return FOLD_NONE;
+        result.number = a - b;
+        return FOLD_NUMBER;
+
+      case MULT:
+        if (!numbers) return FOLD_NONE;
+        result.number = a * b;
+        return FOLD_NUMBER;
+
+      case DIV:
+        if (!numbers) return FOLD_NONE;
+        result.number = a / b;
+        return FOLD_NUMBER;
+
+      case MOD:
+        if (!numbers) return FOLD_NONE;
+        result.number = fmod(a, b);
+        return FOLD_NUMBER;
+
+      case LSHIFT:
+        if (!numbers) return FOLD_NONE;
+        result.number = (int32_t)((uint32_t)toInt32(a) << ((uint32_t)toInt32(b) & 0x1f));
+        return FOLD_NUMBER;
+
+      case RSHIFT:
+        if (!numbers) return FOLD_NONE;
+        result.number = toInt32(a) >> ((uint32_t)toInt32(b) & 0x1f);
+        return FOLD_NUMBER;
+
+      case RSHIFT3:
+        if (!numbers) return FOLD_NONE;
+        result.number = (uint32_t)toInt32(a) >> ((uint32_t)toInt32(b) & 0x1f);
+        return FOLD_NUMBER;
+
+      case BIT_AND:
+        if (!numbers) return FOLD_NONE;
+        result.number = toInt32(a) & toInt32(b);
+        return FOLD_NUMBER;
+
+      case BIT_OR:
+        if (!numbers) return FOLD_NONE;
+        result.number = toInt32(a) | toInt32(b);
+        return FOLD_NUMBER;
+
+      case BIT_XOR:
+        if (!numbers) return FOLD_NONE;
+        result.number = toInt32(a) ^ toInt32(b);
+        return FOLD_NUMBER;
+
+      case STRICT_EQUAL:
+      case STRICT_NOT_EQUAL:
+        if (left.type != right.type) {
+          result.boolean = false;
+        } else if (!strictEquals(left, right, result.boolean)) {
+          return FOLD_NONE;
+        }
+        if (op == STRICT_NOT_EQUAL) {
+          result.boolean = !result.boolean;
+        }
+        return FOLD_BOOLEAN;
+
+      case EQUAL:
+      case NOT_EQUAL:
+        if (left.type == right.type) {
+          if (!strictEquals(left, right, result.boolean)) {
+            return FOLD_NONE;
+          }
+        } else if (left.type == CONSTANT_NULL || right.type == CONSTANT_NULL) {
+          result.boolean = false;
+        } else if (numbers) {
+          result.boolean = a == b;
+        } else {
+          // String to number conversion
+          return FOLD_NONE;
+        }
+        if (op == NOT_EQUAL) {
+          result.boolean = !result.boolean;
+        }
+        return FOLD_BOOLEAN;
+
+      case LESS_THAN:
+      case GREATER_THAN:
+      case LESS_THAN_EQUAL:
+      case GREATER_THAN_EQUAL:
+        if (left.type == CONSTANT_STRING && right.type == CONSTANT_STRING) {
+          // Byte order matches UTF-16 code unit order for plain ASCII
+          if (hasEscapes(left.body) || hasEscapes(right.body) || !isAscii(left.body) || !isAscii(right.body)) {
+            return FOLD_NONE;
+          }
+          int cmp = left.body.compare(right.body);
+          a = cmp;
+          b = 0;
+        } else if (!numbers) {
+          return FOLD_NONE;
+        }
+        // Comparisons with NaN are always false, which is also what C++ does
+        switch (op) {
+          case LESS_THAN:
+            result.boolean = a < b;
+            break;
+          case GREATER_THAN:
+            result.boolean = a > b;
+            break;
+          case LESS_THAN_EQUAL:
+            result.boolean = a <= b;
+            break;
+          default:
+            result.boolean = a >= b;
+            break;
+        }
+        return FOLD_BOOLEAN;
+
+      default:
+        return FOLD_NONE;
+    }
+  }
+
+  // Appends a constant to a string folded so far, the same as evaluate() would for PLUS but without
+  // copying what's already there
+  bool appendConstant(constant_t& folded, const constant_t& value) {
+    string body;
+    if (!toStringBody(value, body)) {
+      return false;
+    }
+    if (value.type == CONSTANT_STRING) {
+      body = requote(body, value.quote, folded.quote);
+    }
+    if (!canAppend(folded.body, body)) {
+      return false;
+    }
+    folded.body += body;
+    return true;
+  }
+
+  bool isPlus(Node* node) {
+    return node != NULL && typeid(*node) == typeid(NodeOperator) &&
+      static_cast<NodeOperator*>(node)->operatorType() == PLUS;
+  }
+
+  Node* booleanNode(bool value) {
+    return (new NodeUnary(NOT_UNARY))->appendChild(new NodeNumericLiteral(value ? 0 : 1));
+  }
+
+  // Returns NULL for NaN and Infinity; those are identifiers which could have been shadowed.
+  Node* numberNode(double value) {
+    if (value != value || isinf(value)) {
+      return NULL;
+    }
+    if (value < 0 || (value == 0 && signbit(value))) {
+      return (new NodeUnary(MINUS_UNARY))->appendChild(new NodeNumericLiteral(-value));
+    }
+    return new NodeNumericLiteral(value);
+  }
+
+  Node* withoutParens(Node* node) {
+    while (typeid(*node) == typeid(NodeParenthetical)) {
+      node = node->childNodes().front();
+    }
+    return node;
+  }
+
+  // Whether `node` means something else as a callee (or with `names`, under delete or typeof) than
+  // its value does: a.b() passes a as `this` and eval() is a direct eval.
+  bool isReference(Node* node, bool names) {
+    node = withoutParens(node);
+    if (typeid(*node) == typeid(NodeIdentifier)) {
+      return names || static_cast<NodeIdentifier*>(node)->name() == "eval";
+    }
+    return typeid(*node) == typeid(NodeStaticMemberExpression) ||
+      typeid(*node) == typeid(NodeDynamicMemberExpression) ||
+      typeid(*node) == typeid(NodeDescendantExpression);
+  }
+
+  bool shorter(Node* replacement, Node* original) {
+    return replacement->renderSize(RENDER_NONE) <= original->renderSize(RENDER_NONE);
+  }
+
+  //
+  // HoistCollector: finds the declarations in code which is about to be dropped.
+  class HoistCollector: public NodePass {
+    protected:
+      set<string>* seen;
+      NodeVarDeclaration* declaration;
+      bool* functions;
+
+    public:
+      HoistCollector(set<string>* seen, NodeVarDeclaration* declaration, bool* functions) :
+        seen(seen), declaration(declaration), functions(functions) {}
+
+      virtual void enter(NodeFunctionExpression& node) {
+        skipChildren();
+      }
+
+      virtual void enter(NodeFunctionDeclaration& node) {
+        *functions = true;
+        skipChildren();
+      }
+
+      virtual void enter(NodeVarDeclaration& node) {
+        skipChildren();
+        for (node_list_t::iterator ii = node.childNodes().begin(); ii != node.childNodes().end(); ++ii) {
+          Node* name = *ii;
+          if (typeid(*name) == typeid(NodeAssignment)) {
+            name = name->childNodes().front();
+          }
+          if (typeid(*name) == typeid(NodeTypehint)) {
+            name = name->childNodes().front();
+          }
+          NodeIdentifier* identifier = dynamic_cast<NodeIdentifier*>(name);
+          if (identifier && seen->insert(identifier->name()).second) {
+            declaration->appendChild(new NodeIdentifier(identifier->name(), identifier->lineno()));
+          }
+        }
+      }
+  };
+}
+
+//
+// Replaces the current statement with `kept` (which may be NULL), preserving any `var` declarations
+// from `dropped`. Does nothing if `dropped` declares functions.
+void ConstantFolder::replaceStatement(Node* kept, Node* dropped) {
+  set<string> seen;
+  bool functions = false;
+  NodeVarDeclaration* hoisted = new NodeVarDeclaration(false, node()->lineno());
+  if (dropped != NULL) {
+    NodePipeline collector;
+    collector.add(new HoistCollector(&seen, hoisted, &functions));
+    collector.run(dropped);
+  }
+  if (functions) {
+    delete hoisted;
+    return;
+  }
+  if (hoisted->empty()) {
+    delete hoisted;
+    hoisted = NULL;
+  }
+
+  // A NodeStatementList renders as a block inside of if and loop bodies, but a label would only
+  // apply to its first statement.
+  if (hoisted != NULL && kept != NULL &&
+      parentNode() != NULL && typeid(*parentNode()) == typeid(NodeLabel)) {
+    delete hoisted;
+    return;
+  }
+
+  Node* replacement;
+  if (hoisted != NULL && kept != NULL) {
+    replacement = (new NodeStatementList(node()->lineno()))->appendChild(hoisted)->appendChild(kept);
+  } else if (hoisted != NULL) {
+    replacement = hoisted;
+  } else if (kept != NULL) {
+    replacement = kept;
+  } else {
+    replacement = new NodeEmptyExpression(node()->lineno());
+  }
+
+  // Detach whatever we're keeping so it isn't deleted along with the old node
+  for (node_list_t::iterator ii = node()->childNodes().begin(); ii != node()->childNodes().end(); ++ii) {
+    if (*ii == kept) {
+      node()->removeChild(ii);
+      break;
+    }
+  }
+  if (typeid(*replacement) == typeid(NodeStatementList) &&
+      parentNode() != NULL && typeid(*parentNode()) == typeid(NodeStatementList)) {
+    spliced.insert(replacement);
+  }
+  replace(replacement);
+}
+
+//
+// Records the operators and conditionals whose result `node` is, so they don't fold down to a
+// reference. Folding is bottom-up, so this has to happen on the way in.
+void ConstantFolder::markReferences(Node* node, bool names) {
+  vector<Node*> pending(1, node);
+  while (!pending.empty()) {
+    node = withoutParens(pending.back());
+    pending.pop_back();
+    if (typeid(*node) == typeid(NodeOperator)) {
+      node_operator_t op = static_cast<NodeOperator*>(node)->operatorType();
+      if (op == COMMA || op == AND || op == OR) {
+        references[node] = names;
+        pending.push_back(node->childNodes().back());
+      }
+    } else if (typeid(*node) == typeid(NodeConditionalExpression)) {
+      references[node] = names;
+      pending.push_back(*++node->childNodes().begin());
+      pending.push_back(node->childNodes().back());
+    }
+  }
+}
+
+//
+// Forgets `node`, returning true if it was marked and replacing it with `kept` would change what it
+// means.
+bool ConstantFolder::keepsReference(Node* node, Node* kept) {
+  map<Node*, bool>::iterator ii = references.find(node);
+  if (ii == references.end()) {
+    return false;
+  }
+  bool names = ii->second;
+  references.erase(ii);
+  return isReference(kept, names);
+}
+
+void ConstantFolder::enter(NodeFunctionCall& node) {
+  markReferences(node.childNodes().front(), false);
+}
+
+void ConstantFolder::enter(NodeUnary& node) {
+  if (node.operatorType() == DELETE || node.operatorType() == TYPEOF) {
+    markReferences(node.childNodes().front(), true);
+  }
+}
+
+void ConstantFolder::leave(NodeStatementList& node) {
+  node_list_t& children = node.childNodes();
+  node_list_t::iterator ii = children.begin();
+  while (ii != children.end()) {
+    node_list_t::iterator child = ii++;
+    if (*child == NULL) {
+      continue;
+    } else if (typeid(**child) == typeid(NodeEmptyExpression)) {
+      delete node.removeChild(child);
+    } else if (!spliced.empty() && spliced.erase(*child)) {
+      Node* list = node.removeChild(child);
+      children.splice(ii, list->childNodes());
+      delete list;
+    }
+  }
+}
+
+//
+// `a + b + c` nests to the left, so a long concatenation is as deep as it is long and folding it a
+// level at a time copies the string built so far at every level. The `+` nodes under the top of a
+// chain leave it alone, and once its operands are folded the top walks the spine and appends each
+// constant to a single string which goes into the tree once.
+void ConstantFolder::foldChain(NodeOperator& node) {
+  vector<Node*> spine(1, &node);
+  while (isPlus(spine.back()->childNodes().front())) {
+    spine.push_back(spine.back()->childNodes().front());
+  }
+
+  constant_t folded; // the value of spine[ii + 1] once it's a string, which isn't in the tree yet
+  bool pending = false;
+  size_t ii = spine.size();
+  while (ii-- > 0) {
+    constant_t left, right, result;
+    if (!constantValue(spine[ii]->childNodes().back(), right)) {
+      break;
+    }
+    if (pending) {
+      if (!appendConstant(folded, right)) {
+        break;
+      }
+      continue;
+    }
+    if (!constantValue(spine[ii]->childNodes().front(), left)) {
+      break;
+    }
+    fold_result_t type = evaluate(PLUS, left, right, result);
+    if (type == FOLD_STRING) {
+      folded = result;
+      pending = true;
+      continue;
+    }
+    Node* replacement = type == FOLD_NUMBER ? numberNode(result.number) : NULL;
+    if (replacement != NULL && !shorter(replacement, spine[ii])) {
+      delete replacement;
+      replacement = NULL;
+    }
+    if (replacement == NULL) {
+      break;
+    }
+    replaceSpine(spine, ii, replacement);
+  }
+  if (pending) {
+    // ii is the node which couldn't be folded, or -1 if none of them was left
+    replaceSpine(spine, ii + 1,
+      new NodeStringLiteral(folded.quote + folded.body + folded.quote, true));
+  }
+}
+
+// Replaces spine[ii] in its parent, deleting it and whatever is left of the spine beneath it
+void ConstantFolder::replaceSpine(const vector<Node*>& spine, size_t ii, Node* replacement) {
+  if (ii == 0) {
+    replace(replacement);
+    return;
+  }
+  replacement->setLineno(spine[ii]->lineno());
+  delete spine[ii - 1]->replaceChild(replacement, spine[ii - 1]->childNodes().begin());
+}
+
+void ConstantFolder::leave(NodeOperator& node) {
+  if (isPlus(&node)) {
+    if (isPlus(parentNode()) && parentNode()->childNodes().front() == &node) {
+      return;
+    } else if (isPlus(node.childNodes().front())) {
+      foldChain(node);
+      return;
+    }
+  }
+  constant_t left, right, result;
+  if (!constantValue(node.childNodes().front(), left)) {
+    if (!references.empty()) {
+      references.erase(&node);
+    }
+    return;
+  }
+  switch (node.operatorType()) {
+    case AND:
+    case OR: {
+      // Only the result is kept, the other side is either constant or never evaluated
+      bool truthy = static_cast<NodeExpression*>(node.childNodes().front())->compare(true);
+      node_list_t::iterator keep = node.childNodes().begin();
+      if (truthy == (node.operatorType() == AND)) {
+        ++keep;
+      }
+      if (!keepsReference(&node, *keep)) {
+        replace(node.removeChild(keep));
+      }
+      return;
+    }
+
+    case COMMA:
+      if (!keepsReference(&node, node.childNodes().back())) {
+        replace(node.removeChild(--node.childNodes().end()));
+      }
+      return;
+
+    default:
+      break;
+  }
+  if (!constantValue(node.childNodes().back(), right)) {
+    return;
+  }
+  Node* replacement = NULL;
+  switch (evaluate(node.operatorType(), left, right, result)) {
+    case FOLD_NUMBER:
+      replacement = numberNode(result.number);
+      if (replacement != NULL && !shorter(replacement, &node)) {
+        delete replacement;
+        replacement = NULL;
+      }
+      break;
+    case FOLD_STRING:
+      replacement = new NodeStringLiteral(result.quote + result.body + result.quote, true);
+      break;
+    case FOLD_BOOLEAN:
+      replacement = booleanNode(result.boolean);
+      break;
+    case FOLD_NONE:
+      break;
+  }
+  if (replacement != NULL) {
+    replace(replacement);
+  }
+}
+
+void ConstantFolder::leave(NodeUnary& node) {
+  constant_t value;
+  if (!constantValue(node.childNodes().front(), value)) {
+    return;
+  }
+  Node* operand = node.childNodes().front();
+  Node* replacement = NULL;
+  double number;
+  switch (node.operatorType()) {
+    case NOT_UNARY:
+      // !0 and !1 are already as short as it gets
+      if (typeid(*operand) != typeid(NodeNumericLiteral)) {
+        replacement = booleanNode(!static_cast<NodeExpression*>(operand)->compare(true));
+      }
+      break;
+
+    case MINUS_UNARY:
+      if (typeid(*operand) != typeid(NodeNumericLiteral) && toNumber(value, number)) {
+        replacement = numberNode(-number);
+      }
+      break;
+
+    case PLUS_UNARY:
+      if (toNumber(value, number)) {
+        replacement = numberNode(number);
+      }
+      break;
+
+    case BIT_NOT_UNARY:
+      if (toNumber(value, number)) {
+        replacement = numberNode(~toInt32(number));
+      }
+      break;
+
+    case TYPEOF:
+      replacement = new NodeStringLiteral(
+        value.type == CONSTANT_NUMBER ? "\"number\"" :
+        value.type == CONSTANT_STRING ? "\"string\"" :
+        value.type == CONSTANT_BOOLEAN ? "\"boolean\"" : "\"object\"", true);
+      break;
+
+    default:
+      break;
+  }
+  if (replacement != NULL && !shorter(replacement, &node)) {
+    delete replacement;
+    replacement = NULL;
+  }
+  if (replacement != NULL) {
+    replace(replacement);
+  }
+}
+
+void ConstantFolder::leave(NodeConditionalExpression& node) {
+  constant_t value;
+  if (constantValue(node.childNodes().front(), value)) {
+    node_list_t::iterator branch = ++node.childNodes().begin();
+    if (!static_cast<NodeExpression*>(node.childNodes().front())->compare(true)) {
+      ++branch;
+    }
+    if (!keepsReference(&node, *branch)) {
+      replace(node.removeChild(branch));
+    }
+  } else if (!references.empty()) {
+    references.erase(&node);
+  }
+}
+
+void ConstantFolder::leave(NodeIf& node) {
+  node_list_t::iterator ii = node.childNodes().begin();
+  Node* test = *ii;
+  Node* then_block = *++ii;
+  Node* else_block = *++ii;
+
+  // `else` followed by nothing, usually from a folded `else if`
+  if (else_block != NULL && typeid(*else_block) == typeid(NodeEmptyExpression)) {
+    delete node.replaceChild(NULL, ii);
+    else_block = NULL;
+  }
+
+  constant_t value;
+  if (!constantValue(test, value)) {
+    return;
+  }
+  if (static_cast<NodeExpression*>(test)->compare(true)) {
+    replaceStatement(then_block, else_block);
+  } else {
+    replaceStatement(else_block, then_block);
+  }
+}
+
+void ConstantFolder::leave(NodeWhile& node) {
+  constant_t value;
+  Node* test = node.childNodes().front();
+  if (constantValue(test, value) && static_cast<NodeExpression*>(test)->compare(false)) {
+    replaceStatement(NULL, node.childNodes().back());
+  }
+}
+
+void ConstantFolder::leave(NodeForLoop& node) {
+  node_list_t::iterator ii = node.childNodes().begin();
+  Node* initializer = *ii;
+  Node* test = *++ii;
+  constant_t value;
+  if (constantValue(test, value) && static_cast<NodeExpression*>(test)->compare(false)) {
+    // The initializer still runs once
+    if (typeid(*initializer) == typeid(NodeEmptyExpression)) {
+      initializer = NULL;
+    }
+    replaceStatement(initializer, node.childNodes().back());
+  }
+}
@@ -0,0 +1,65 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <map>
+#include <set>
+#include <vector>
+#include "pipeline.hpp"
+
+namespace fbjs {
+
+  //
+  // ConstantFolder: folds constant expressions and drops unreachable code in one bottom-up pass.
+  //
+  //   NodePipeline pipeline;
+  //   pipeline.add(new ConstantFolder);
+  //   root = pipeline.run(root);
+  //
+  // Only literals (and expressions already folded into literals) are treated as constants, so an
+  // expression is never dropped if it could have side effects. Folded booleans are emitted as !0
+  // and !1. Numeric results are only substituted when they render shorter than the original.
+  // `var` declarations in dropped branches are kept so hoisting behaves the same, and branches
+  // containing function declarations are left alone. `(0, a.b)()`, `(0, eval)(s)` and
+  // `typeof (0, a)` are left as they are since dropping the 0 would change what they mean.
+  class ConstantFolder: public NodePass {
+    protected:
+      std::set<Node*> spliced; // NodeStatementLists which replaced a statement, to merge into their parent
+      // `,`, `&&`, `||` and `?:` which are callees or operands of delete or typeof. True for the
+      // operands, where a plain name is a reference too and not only a.b and eval.
+      std::map<Node*, bool> references;
+
+      void markReferences(Node* node, bool names);
+      bool keepsReference(Node* node, Node* kept);
+      void replaceStatement(Node* kept, Node* dropped);
+      void foldChain(NodeOperator& node);
+      void replaceSpine(const std::vector<Node*>& spine, size_t ii, Node* replacement);
+
+    public:
+      virtual void enter(NodeFunctionCall& node);
+      virtual void enter(NodeUnary& node);
+      virtual void leave(NodeStatementList& node);
+      virtual void leave(NodeOperator& node);
+      virtual void leave(NodeUnary& node);
+      virtual void leave(NodeConditionalExpression& node);
+      virtual void leave(NodeIf& node);
+      virtual void leave(NodeWhile& node);
+      virtual void leave(NodeForLoop& node);
+  };
+}
@@ -0,0 +1,77 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <string.h>
+#include "keywords.hpp"
+#include "parser.hpp"
+using namespace fbjs;
+
+static const keyword_t keywords[] = {
+  {"abstract", 8, 0}, {"boolean", 7, 0}, {"break", 5, t_BREAK}, {"byte", 4, 0},
+  {"case", 4, t_CASE}, {"catch", 5, t_CATCH}, {"char", 4, 0}, {"class", 5, 0},
+  {"const", 5, t_CONST}, {"continue", 8, t_CONTINUE}, {"debugger", 8, 0},
+  {"default", 7, t_DEFAULT}, {"delete", 6, t_DELETE}, {"do", 2, t_DO}, {"double", 6, 0},
+  {"else", 4, t_ELSE}, {"enum", 4, 0}, {"export", 6, 0}, {"extends", 7, 0}, {"false", 5, t_FALSE},
+  {"final", 5, 0}, {"finally", 7, t_FINALLY}, {"float", 5, 0}, {"for", 3, t_FOR},
+  {"function", 8, t_FUNCTION}, {"goto", 4, 0}, {"if", 2, t_IF}, {"implements", 10, 0},
+  {"import", 6, 0}, {"in", 2, t_IN}, {"instanceof", 10, t_INSTANCEOF}, {"int", 3, 0},
+  {"interface", 9, 0}, {"long", 4, 0}, {"native", 6, 0}, {"new", 3, t_NEW}, {"null", 4, t_NULL},
+  {"package", 7, 0}, {"private", 7, 0}, {"protected", 9, 0}, {"public", 6, 0},
+  {"return", 6, t_RETURN}, {"short", 5, 0}, {"static", 6, 0}, {"super", 5, 0},
+  {"switch", 6, t_SWITCH}, {"synchronized", 12, 0}, {"this", 4, t_THIS}, {"throw", 5, t_THROW},
+  {"throws", 6, 0}, {"transient", 9, 0}, {"true", 4, t_TRUE}, {"try", 3, t_TRY},
+  {"typeof", 6, t_TYPEOF}, {"var", 3, t_VAR}, {"void", 4, t_VOID}, {"volatile", 8, 0},
+  {"while", 5, t_WHILE}, {"with", 4, t_WITH},
+};
+
+//
+// 1 + index into `keywords` for each hash value, 0 if there's no word there. The multipliers were
+// found by searching for a set under which none of the words collide; adding a word means finding
+// new ones and regenerating this table.
+static const unsigned char slots[256] = {
+  24,  6, 15,  0, 53,  0, 49,  0, 13, 30,  0,  0,  0,  0,  0,  0,
+   0,  0, 55, 48,  0,  0, 12,  0,  0,  0, 17,  0,  0,  0,  0,  0,
+   0,  0,  0, 42,  0,  0, 59, 38,  0, 51,  0,  0,  0,  0,  0,  8,
+  14,  0,  0, 36,  0,  0,  3,  0,  0,  0,  0,  0,  0,  0, 34,  5,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 47, 45,
+   0,  0,  0,  0,  0,  0,  0,  0,  0, 10,  0,  0,  0, 28, 32, 52,
+  16,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  7, 43,  0,  0,  0,
+   0, 50,  0,  0,  0, 23,  0,  0,  0,  0,  0,  0,  0, 22,  0,  0,
+   0,  0,  0, 20,  0,  0, 44,  0,  0,  0, 41,  0,  0,  0,  0,  0,
+   4,  0,  0,  0,  0,  0,  0,  0,  0, 33,  0,  0,  0, 54,  0,  0,
+   0,  0, 21, 26,  0,  0,  0,  0,  0, 58,  0,  9,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0, 27,  0,  0,  0, 25,  0,  0,
+   0,  0,  0,  0,  0,  0, 46, 19,  0, 18,  0,  0,  0,  0,  0,  0,
+  39,  0, 29,  0,  0,  0,  0, 37,  0,  0,  0,  0,  2,  0, 57,  0,
+   0,  0,  0, 11,  0,  1,  0,  0,  0,  0, 35,  0,  0,  0,  0,  0,
+   0, 56,  0,  0,  0,  0,  0,  0,  0, 31,  0,  0,  0, 40,  0,  0,
+};
+
+const keyword_t* fbjs::findKeyword(const char* word, size_t length) {
+  if (length < 2 || length > 12) {
+    return NULL;
+  }
+  const unsigned char* ch = reinterpret_cast<const unsigned char*>(word);
+  unsigned char slot = slots[(ch[0] * 7 + ch[1] * 25 + ch[length - 1] * 49 + length * 47) & 255];
+  if (slot == 0) {
+    return NULL;
+  }
+  const keyword_t* keyword = &keywords[slot - 1];
+  return keyword->length == length && memcmp(keyword->word, word, length) == 0 ? keyword : NULL;
+}
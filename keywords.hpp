@@ -0,0 +1,36 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+
+namespace fbjs {
+
+  struct keyword_t {
+    const char* word;
+    size_t length;
+    int token; // 0 for future reserved words, which are scanned as identifiers
+  };
+
+  //
+  // Looks up a reserved word of ECMA-262 (keywords, literals and future reserved words) in a perfect
+  // hash. This is what the scanner uses to tell keywords from identifiers, and what isReservedWord()
+  // answers from. Returns NULL for anything else.
+  const keyword_t* findKeyword(const char* word, size_t length);
+}
@@ -0,0 +1,1283 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+//
+// Hand-written replacement for the flex scanner in parser.ll, built instead of it when
+// FBJS_HAND_LEXER is defined (`make HAND_LEXER=1`). It provides the same entry points so parser.yy
+// and parser.cpp don't know which one they're talking to.
+//
+// Every start condition and rule from parser.ll is reproduced, including flex's matching rules:
+// the longest match wins and ties go to the rule which comes first in parser.ll. That's what makes
+// e.g. `return ++x` and `return x` come out differently in NO_LINEBREAK, so candidates are still
+// collected per rule and compared the same way; they're just found by looking at the first
+// character instead of running a DFA, and keywords are looked up in a perfect hash after the whole
+// word has been read.
+//
+// Nothing checks this against parser.ll at build time. lexer_diff.sh compares the token streams of
+// the two over lexer_corpus/ or any other files.
+#ifdef FBJS_HAND_LEXER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "keywords.hpp"
+#include "parser.hpp"
+#include "scan.hpp"
+using namespace std;
+using namespace fbjs;
+
+void terminate(void* yyscanner, const char* str);
+
+// Start conditions, in the same order as parser.ll so INITIAL is 0
+enum lexer_state_t {
+  INITIAL,
+  IDENTIFIER,
+  DOT,
+  VIRTUAL_SEMICOLON,
+  NO_LINEBREAK,
+  REGEX,
+  XML,
+  XML_CDATA,
+  XML_PI,
+  XML_TEXT,
+};
+
+// Rules in parser.ll order, which breaks ties between matches of the same length
+enum lexer_rule_t {
+  R_NO_LINEBREAK_NEWLINE,
+  R_NO_LINEBREAK_ANY,
+  R_LINE_COMMENT,
+  R_WHITESPACE,
+  R_BLOCK_COMMENT,
+  R_KEYWORD,
+  R_VIRTUAL_SEMICOLON_ELSE,
+  R_VIRTUAL_SEMICOLON_WHILE,
+  R_VIRTUAL_SEMICOLON_WORD,
+  R_VIRTUAL_SEMICOLON_NEWLINE,
+  R_VIRTUAL_SEMICOLON_ANY,
+  R_KEYWORD_PHRASE,
+  R_HEX,
+  R_OCTAL,
+  R_EXPONENT,
+  R_DECIMAL,
+  R_IDENTIFIER,
+  R_DOT_NEWLINE,
+  R_DOT_ANY,
+  R_STRING,
+  R_REGEX_START,
+  R_PUNCTUATOR,
+  R_NEWLINE,
+  R_DEFAULT,
+  R_NONE,
+};
+
+//
+// Scanner state, handed out as the `void* yyscanner` of the flex interface. The input is always
+// followed by a NUL, so lookahead can compare one character past `end` without a bounds check.
+struct fbjs_lexer {
+  fbjs_parse_extra* extra;
+  YYLTYPE* lloc;
+  const char* pos;
+  const char* end;
+  int state;
+  bool started;
+  bool pending_newline; // a block comment which spanned lines acts like a "\n"
+  const char* unterminated_string; // already returned once, see lex_string()
+  vector<char> file;
+};
+
+//
+// Character classes
+enum {
+  CH_WORD = 1, // [a-zA-Z$_0-9]
+  CH_DIGIT = 2,
+  CH_OCTAL = 4,
+  CH_HEX = 8,
+  CH_SPACE = 16, // {JS_WHITESPACE}
+  CH_XML_NAME = 32, // [a-zA-Z0-9.\-_]
+  CH_XML_TEXT = 64, // {XML_TEXT}
+  CH_XML_SPACE = 128, // [ \t\r\n]
+};
+
+static unsigned char char_class[256];
+
+static struct char_class_init_t {
+  char_class_init_t() {
+    for (int ii = 0; ii < 256; ++ii) {
+      unsigned char cls = CH_XML_TEXT;
+      if ((ii >= 'a' && ii <= 'z') || (ii >= 'A' && ii <= 'Z') || ii == '_') {
+        cls |= CH_WORD | CH_XML_NAME;
+      } else if (ii >= '0' && ii <= '9') {
+        cls |= CH_WORD | CH_DIGIT | CH_XML_NAME | CH_HEX | (ii <= '7' ? CH_OCTAL : 0);
+      }
+      if ((ii >= 'a' && ii <= 'f') || (ii >= 'A' && ii <= 'F')) {
+        cls |= CH_HEX;
+      }
+      if (ii == '$') {
+        cls |= CH_WORD;
+      } else if (ii == '.' || ii == '-') {
+        cls |= CH_XML_NAME;
+      }
+      if (strchr(" \t\x0b\x0c\xa0\r", ii) && ii) {
+        cls |= CH_SPACE;
+      }
+      if (strchr(" \t\r\n", ii) && ii) {
+        cls |= CH_XML_SPACE;
+      }
+      if (strchr(":={}<>\"'/& \t\r\n", ii) && ii) {
+        cls &= ~CH_XML_TEXT;
+      }
+      char_class[ii] = cls;
+    }
+  }
+} char_class_init;
+
+static inline bool is(char ch, unsigned char cls) {
+  return char_class[static_cast<unsigned char>(ch)] & cls;
+}
+
+static inline const char* span(const char* pos, unsigned char cls) {
+  while (is(*pos, cls)) {
+    ++pos;
+  }
+  return pos;
+}
+
+//
+// catch, finally, in and instanceof are the keywords which are also matched in VIRTUAL_SEMICOLON
+static inline bool continues_statement(int tok) {
+  return tok == t_CATCH || tok == t_FINALLY || tok == t_IN || tok == t_INSTANCEOF;
+}
+
+//
+// Matches ({JS_WHITESPACE}|\n)+ followed by `word`, for "for each" and "default xml namespace"
+static const char* match_phrase_word(const char* pos, const char* word) {
+  const char* ii = pos;
+  while (is(*ii, CH_SPACE) || *ii == '\n') {
+    ++ii;
+  }
+  if (ii == pos) {
+    return NULL;
+  }
+  for (; *word; ++word, ++ii) {
+    if (*ii != *word) {
+      return NULL;
+    }
+  }
+  return ii;
+}
+
+//
+// Longest of the four number rules. Returns 0 if none match.
+static size_t match_number(const char* pos, lexer_rule_t& rule) {
+  size_t best = 0;
+  rule = R_NONE;
+
+  // 0x[a-fA-F0-9]+
+  if (pos[0] == '0' && pos[1] == 'x' && is(pos[2], CH_HEX)) {
+    best = span(pos + 2, CH_HEX) - pos;
+    rule = R_HEX;
+  }
+
+  // 0[0-7]+
+  if (pos[0] == '0' && is(pos[1], CH_OCTAL)) {
+    size_t len = span(pos + 1, CH_OCTAL) - pos;
+    if (len > best) {
+      best = len;
+      rule = R_OCTAL;
+    }
+  }
+
+  // [0-9]*\.?[0-9]+[eE][\-+]?[0-9]{1,3}
+  const char* digits = span(pos, CH_DIGIT);
+  const char* mantissa = NULL;
+  if (*digits == '.') {
+    const char* fraction = span(digits + 1, CH_DIGIT);
+    if (fraction != digits + 1) {
+      mantissa = fraction;
+    }
+  } else if (digits != pos) {
+    mantissa = digits;
+  }
+  if (mantissa != NULL && (*mantissa == 'e' || *mantissa == 'E')) {
+    const char* exponent = mantissa + 1;
+    if (*exponent == '-' || *exponent == '+') {
+      ++exponent;
+    }
+    const char* ii = exponent;
+    while (ii < exponent + 3 && is(*ii, CH_DIGIT)) {
+      ++ii;
+    }
+    if (ii != exponent && static_cast<size_t>(ii - pos) > best) {
+      best = ii - pos;
+      rule = R_EXPONENT;
+    }
+  }
+
+  // [0-9]+\.? | [0-9]*\.[0-9]+
+  size_t len = 0;
+  if (*digits == '.') {
+    const char* fraction = span(digits + 1, CH_DIGIT);
+    if (fraction != digits + 1) {
+      len = fraction - pos;
+    } else if (digits != pos) {
+      len = digits + 1 - pos;
+    }
+  } else {
+    len = digits - pos;
+  }
+  if (len > best) {
+    best = len;
+    rule = R_DECIMAL;
+  }
+  return best;
+}
+
+//
+// Longest punctuator. "/=" is only a rule in INITIAL and VIRTUAL_SEMICOLON, and that's the only
+// one active in VIRTUAL_SEMICOLON.
+static size_t match_punctuator(const char* pos, int state, int& token) {
+  bool div_assign = state == INITIAL || state == VIRTUAL_SEMICOLON;
+  if (state == VIRTUAL_SEMICOLON) {
+    if (pos[0] == '/' && pos[1] == '=') {
+      token = t_DIV_ASSIGN;
+      return 2;
+    }
+    return 0;
+  }
+  switch (pos[0]) {
+    case '{': token = t_LCURLY; return 1;
+    case '}': token = t_RCURLY; return 1;
+    case '(': token = t_LPAREN; return 1;
+    case ')': token = t_RPAREN; return 1;
+    case '[': token = t_LBRACKET; return 1;
+    case ']': token = t_RBRACKET; return 1;
+    case ';': token = t_SEMICOLON; return 1;
+    case ',': token = t_COMMA; return 1;
+    case '?': token = t_PLING; return 1;
+    case '~': token = t_BIT_NOT; return 1;
+    case '@': token = t_XML_ATTRIBUTE; return 1;
+    case '.':
+      if (pos[1] == '.') {
+        token = t_XML_DESCENDENT;
+        return 2;
+      }
+      token = t_PERIOD;
+      return 1;
+    case ':':
+      if (pos[1] == ':') {
+        token = t_XML_QUALIFIER;
+        return 2;
+      }
+      token = t_COLON;
+      return 1;
+    case '&':
+      if (pos[1] == '&') {
+        token = t_AND;
+        return 2;
+      } else if (pos[1] == '=') {
+        token = t_BIT_AND_ASSIGN;
+        return 2;
+      }
+      token = t_BIT_AND;
+      return 1;
+    case '|':
+      if (pos[1] == '|') {
+        token = t_OR;
+        return 2;
+      } else if (pos[1] == '=') {
+        token = t_BIT_OR_ASSIGN;
+        return 2;
+      }
+      token = t_BIT_OR;
+      return 1;
+    case '=':
+      if (pos[1] == '=') {
+        if (pos[2] == '=') {
+          token = t_STRICT_EQUAL;
+          return 3;
+        }
+        token = t_EQUAL;
+        return 2;
+      }
+      token = t_ASSIGN;
+      return 1;
+    case '!':
+      if (pos[1] == '=') {
+        if (pos[2] == '=') {
+          token = t_STRICT_NOT_EQUAL;
+          return 3;
+        }
+        token = t_NOT_EQUAL;
+        return 2;
+      }
+      token = t_NOT;
+      return 1;
+    case '<':
+      if (pos[1] == '<') {
+        if (pos[2] == '=') {
+          token = t_LSHIFT_ASSIGN;
+          return 3;
+        }
+        token = t_LSHIFT;
+        return 2;
+      } else if (pos[1] == '=') {
+        token = t_LESS_THAN_EQUAL;
+        return 2;
+      }
+      token = t_LESS_THAN;
+      return 1;
+    case '>':
+      if (pos[1] == '>') {
+        if (pos[2] == '>') {
+          if (pos[3] == '=') {
+            token = t_RSHIFT3_ASSIGN;
+            return 4;
+          }
+          token = t_RSHIFT3;
+          return 3;
+        } else if (pos[2] == '=') {
+          token = t_RSHIFT_ASSIGN;
+          return 3;
+        }
+        token = t_RSHIFT;
+        return 2;
+      } else if (pos[1] == '=') {
+        token = t_GREATER_THAN_EQUAL;
+        return 2;
+      }
+      token = t_GREATER_THAN;
+      return 1;
+    case '+':
+      if (pos[1] == '+') {
+        token = t_INCR;
+        return 2;
+      } else if (pos[1] == '=') {
+        token = t_PLUS_ASSIGN;
+        return 2;
+      }
+      token = t_PLUS;
+      return 1;
+    case '-':
+      if (pos[1] == '-') {
+        token = t_DECR;
+        return 2;
+      } else if (pos[1] == '=') {
+        token = t_MINUS_ASSIGN;
+        return 2;
+      }
+      token = t_MINUS;
+      return 1;
+    case '*':
+      if (pos[1] == '=') {
+        token = t_MULT_ASSIGN;
+        return 2;
+      }
+      token = t_MULT;
+      return 1;
+    case '%':
+      if (pos[1] == '=') {
+        token = t_MOD_ASSIGN;
+        return 2;
+      }
+      token = t_MOD;
+      return 1;
+    case '^':
+      if (pos[1] == '=') {
+        token = t_BIT_XOR_ASSIGN;
+        return 2;
+      }
+      token = t_BIT_XOR;
+      return 1;
+    case '/':
+      if (div_assign && pos[1] == '=') {
+        token = t_DIV_ASSIGN;
+        return 2;
+      }
+      token = t_DIV;
+      return 1;
+  }
+  return 0;
+}
+
+//
+// The REGEX rule, run as an NFA because `[` may either open a class (which can contain '/') or be
+// a plain character:
+//   (\[([^\]\\\n]+|\\.)+\]|\\.|[^\/\\\n])*"/"[A-Za-z]*
+// Returns the length of the longest match or 0.
+static size_t match_regex(const char* pos, const char* end) {
+  enum {
+    BODY = 1,
+    BODY_ESCAPE = 2,
+    CLASS_OPEN = 4, // needs at least one character before the ]
+    CLASS_ESCAPE = 8,
+    CLASS = 16,
+    FLAGS = 32,
+  };
+  unsigned int states = BODY;
+  size_t match = 0;
+  for (const char* ii = pos; ii < end && states && *ii != '\n'; ++ii) {
+    char ch = *ii;
+    unsigned int next = 0;
+    if (states & BODY) {
+      next |= ch == '\\' ? BODY_ESCAPE : ch == '/' ? FLAGS : ch == '[' ? BODY | CLASS_OPEN : BODY;
+    }
+    if (states & BODY_ESCAPE) {
+      next |= BODY;
+    }
+    if (states & CLASS_OPEN) {
+      next |= ch == '\\' ? CLASS_ESCAPE : ch == ']' ? 0 : CLASS;
+    }
+    if (states & CLASS_ESCAPE) {
+      next |= CLASS;
+    }
+    if (states & CLASS) {
+      next |= ch == ']' ? BODY : ch == '\\' ? CLASS_ESCAPE : CLASS;
+    }
+    if ((states & FLAGS) && ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'))) {
+      next |= FLAGS;
+    }
+    states = next;
+    if (states & FLAGS) {
+      match = ii + 1 - pos;
+    }
+  }
+  return match;
+}
+
+//
+// {XML_ENTITY}, or 0
+static size_t match_xml_entity(const char* pos) {
+  static const char* entities[] = {"&amp;", "&lt;", "&gt;", "&apos;", "&quot;"};
+  for (size_t ii = 0; ii < sizeof(entities) / sizeof(entities[0]); ++ii) {
+    size_t len = strlen(entities[ii]);
+    if (strncmp(pos, entities[ii], len) == 0) {
+      return len;
+    }
+  }
+  return 0;
+}
+
+//
+// ({XML_TEXT}|{XML_ENTITY})+. NUL is text, so this one has to watch for the end.
+static const char* match_xml_text(const char* pos, const char* end) {
+  while (pos < end) {
+    size_t len;
+    if (is(*pos, CH_XML_TEXT)) {
+      ++pos;
+    } else if (*pos == '&' && (len = match_xml_entity(pos)) != 0) {
+      pos += len;
+    } else {
+      return pos;
+    }
+  }
+  return pos;
+}
+
+//
+// ([^<{&]|{XML_ENTITY})+, and whether it's all [ \t\r\n]. Also watches for the end.
+static const char* match_xml_content(const char* pos, const char* end, bool& whitespace) {
+  whitespace = true;
+  while (pos < end) {
+    size_t len;
+    if (*pos == '<' || *pos == '{') {
+      return pos;
+    } else if (*pos == '&') {
+      if ((len = match_xml_entity(pos)) == 0) {
+        return pos;
+      }
+      pos += len;
+      whitespace = false;
+    } else {
+      whitespace = whitespace && is(*pos, CH_XML_SPACE);
+      ++pos;
+    }
+  }
+  return pos;
+}
+
+//
+// "<!--"([^\-\n]+|-[^\-\n])+"-->", returns NULL if it doesn't match
+static const char* match_xml_comment(const char* pos, const char* end) {
+  if (strncmp(pos, "<!--", 4) != 0) {
+    return NULL;
+  }
+  bool content = false;
+  for (const char* ii = pos + 4; ii < end && *ii != '\n'; ++ii) {
+    if (*ii != '-') {
+      content = true;
+    } else if (ii + 1 < end && ii[1] != '-' && ii[1] != '\n') {
+      content = true;
+      ++ii;
+    } else if (content && ii + 2 < end && ii[1] == '-' && ii[2] == '>') {
+      return ii + 3;
+    } else {
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+static char* copy_text(const char* begin, const char* end) {
+  return fbjs_copy_text(begin, end - begin);
+}
+
+static unsigned int count_newlines(const char* begin, const char* end) {
+  unsigned int newlines = 0;
+  while ((begin = static_cast<const char*>(memchr(begin, '\n', end - begin))) != NULL) {
+    ++newlines;
+    ++begin;
+  }
+  return newlines;
+}
+
+//
+// Same as parsertok_() in parser.ll
+static int token(fbjs_lexer* lexer, int tok, bool was_xml = false) {
+  if (lexer->state != XML && lexer->state != XML_TEXT) {
+    switch (tok) {
+      case t_IDENTIFIER:
+      case t_NUMBER:
+      case t_STRING:
+      case t_REGEX:
+      case t_INCR:
+      case t_DECR:
+      case t_RBRACKET:
+      case t_RPAREN:
+      case t_FALSE:
+      case t_NULL:
+      case t_THIS:
+      case t_TRUE:
+        lexer->state = INITIAL;
+        break;
+      case t_CONTINUE:
+      case t_BREAK:
+      case t_RETURN:
+      case t_THROW:
+        lexer->state = NO_LINEBREAK;
+        break;
+      case t_PERIOD:
+        lexer->state = DOT;
+        break;
+      default:
+        lexer->state = IDENTIFIER;
+        break;
+    }
+  }
+  lexer->extra->last_tok = tok;
+  lexer->extra->last_tok_xml = was_xml;
+  FBJS_STAT(token(tok));
+  if (lexer->extra->budget != NULL) {
+    fbjs_check_budget(lexer, tok);
+  }
+#ifdef DEBUG_FLEX
+  fprintf(stderr, "--> %s\n", yytokname(tok));
+#endif
+  return tok;
+}
+
+//
+// Number conversions go through the same libc calls as the flex actions so the values match
+static double number_value(lexer_rule_t rule, const char* text, size_t length) {
+  char buf[64];
+  string big;
+  const char* str;
+  if (length < sizeof(buf)) {
+    memcpy(buf, text, length);
+    buf[length] = 0;
+    str = buf;
+  } else {
+    big.assign(text, length);
+    str = big.c_str();
+  }
+  unsigned int val;
+  switch (rule) {
+    case R_HEX:
+      sscanf(str, "%x", &val);
+      return (double)val;
+    case R_OCTAL:
+      sscanf(str, "%o", &val);
+      return (double)val;
+    case R_EXPONENT:
+      return strtod(str, NULL);
+    default:
+      return atof(str);
+  }
+}
+
+//
+// The string action. A string which runs into a line break is returned as far as it got, and like
+// flex's yyless(0) the next call starts over at its quote, which makes it a syntax error. flex then
+// rescans a buffer its yyinput() calls have already clobbered, so the second time around this just
+// carries on after the line break instead.
+static void unterminated_string(fbjs_lexer* lexer, const char* text) {
+  if (lexer->unterminated_string != text) {
+    lexer->unterminated_string = text;
+    lexer->pos = text;
+  }
+}
+
+static char* lex_string(fbjs_lexer* lexer, const char* text) {
+  char quote = *text;
+  string str(1, quote);
+  const char*& pos = lexer->pos;
+  const char* end = lexer->end;
+  for (;;) {
+    const char* stop = scan_string(pos, end, quote);
+    str.append(pos, stop - pos);
+    pos = stop;
+    if (pos == end) {
+      break;
+    }
+    char c = *pos++;
+    str += c;
+    if (c == quote) {
+      break;
+    } else if (c == '\\') {
+      if (pos == end) {
+        unterminated_string(lexer, text);
+        break;
+      }
+      c = *pos++;
+      if (c == '\r') {
+        str.erase(--str.end());
+        ++lexer->lloc->first_line;
+        if (pos == end) {
+          break;
+        }
+        c = *pos++;
+        if (c != '\n') {
+          str += c;
+          if (c == quote) {
+            break;
+          }
+        }
+      } else if (c == '\n') {
+        str.erase(--str.end());
+        ++lexer->lloc->first_line;
+      } else {
+        str += c;
+      }
+    } else {
+      unterminated_string(lexer, text);
+      break;
+    }
+  }
+  return fbjs_copy_text(str.data(), str.size());
+}
+
+//
+// Skips a block comment. Returns false if it's unterminated.
+static bool lex_block_comment(fbjs_lexer* lexer) {
+  const char*& pos = lexer->pos;
+  bool newline = false;
+  for (;;) {
+    unsigned int newlines = 0;
+    pos = scan_block_comment(pos, lexer->end, newlines);
+    if (newlines) {
+      lexer->lloc->first_line += newlines;
+      newline = true;
+    }
+    if (pos == lexer->end) {
+      return false;
+    }
+    while (++pos < lexer->end && *pos == '*');
+    if (pos == lexer->end) {
+      return false;
+    }
+    char c = *pos++;
+    if (c == '/') {
+      break;
+    } else if (c == '\n') {
+      ++lexer->lloc->first_line;
+      newline = true;
+    }
+  }
+  // See the "/*" rule in parser.ll
+  if (newline) {
+    --lexer->lloc->first_line;
+    lexer->pending_newline = true;
+  }
+  return true;
+}
+
+//
+// Finds the longest match at `pos` among the rules active in the current (non-XML, non-REGEX)
+// start condition
+static lexer_rule_t match_script(fbjs_lexer* lexer, size_t& length, int& tok) {
+  const char* pos = lexer->pos;
+  int state = lexer->state;
+  bool inclusive = state == INITIAL || state == IDENTIFIER || state == NO_LINEBREAK;
+  char c = *pos;
+  lexer_rule_t rule = R_NONE;
+  length = 0;
+#define CANDIDATE(r, len) \
+  if ((len) > length || ((len) == length && (r) < rule)) { \
+    rule = (r); \
+    length = (len); \
+  }
+
+  if (state == NO_LINEBREAK) {
+    CANDIDATE(c == '\n' ? R_NO_LINEBREAK_NEWLINE : R_NO_LINEBREAK_ANY, 1u);
+  }
+
+  // Comments and whitespace are active in all of these
+  if (c == '/' && pos[1] == '/') {
+    CANDIDATE(R_LINE_COMMENT, 2u);
+  } else if (c == '<' && pos[1] == '!' && pos[2] == '-' && pos[3] == '-') {
+    CANDIDATE(R_LINE_COMMENT, 4u);
+  } else if (c == '/' && pos[1] == '*') {
+    CANDIDATE(R_BLOCK_COMMENT, 2u);
+  } else if (is(c, CH_SPACE)) {
+    CANDIDATE(R_WHITESPACE, static_cast<size_t>(span(pos, CH_SPACE) - pos));
+  }
+
+  // Words
+  if (is(c, CH_WORD) && state != NO_LINEBREAK) {
+    size_t word = span(pos, CH_WORD) - pos;
+    const keyword_t* keyword = state == DOT ? NULL : findKeyword(pos, word);
+    int keyword_tok = keyword ? keyword->token : 0;
+    if (state == VIRTUAL_SEMICOLON) {
+      if (continues_statement(keyword_tok)) {
+        tok = keyword_tok;
+        CANDIDATE(R_KEYWORD, word);
+      } else if (keyword_tok == t_ELSE) {
+        CANDIDATE(R_VIRTUAL_SEMICOLON_ELSE, word);
+      } else if (keyword_tok == t_WHILE) {
+        CANDIDATE(R_VIRTUAL_SEMICOLON_WHILE, word);
+      } else {
+        CANDIDATE(R_VIRTUAL_SEMICOLON_WORD, word);
+      }
+    } else if (!is(c, CH_DIGIT)) {
+      if (keyword_tok) {
+        tok = keyword_tok;
+        CANDIDATE(R_KEYWORD, word);
+        const char* phrase = NULL;
+        if (keyword_tok == t_FOR) {
+          phrase = match_phrase_word(pos + word, "each");
+          tok = phrase ? t_FOR_EACH : tok;
+        } else if (keyword_tok == t_DEFAULT) {
+          phrase = match_phrase_word(pos + word, "xml");
+          phrase = phrase ? match_phrase_word(phrase, "namespace") : NULL;
+          tok = phrase ? t_XML_DEFAULT_NAMESPACE : tok;
+        }
+        if (phrase) {
+          CANDIDATE(R_KEYWORD_PHRASE, static_cast<size_t>(phrase - pos));
+        }
+      }
+      CANDIDATE(R_IDENTIFIER, word);
+    }
+  }
+
+  if (inclusive) {
+    if (is(c, CH_DIGIT) || c == '.') {
+      lexer_rule_t number;
+      size_t len = match_number(pos, number);
+      if (len) {
+        CANDIDATE(number, len);
+      }
+    }
+    if (c == '\'' || c == '"') {
+      CANDIDATE(R_STRING, 1u);
+    }
+    if (state == IDENTIFIER && c == '/') {
+      CANDIDATE(R_REGEX_START, 1u);
+    }
+  }
+
+  if (inclusive || state == VIRTUAL_SEMICOLON) {
+    int punctuator;
+    size_t len = match_punctuator(pos, state, punctuator);
+    if (len) {
+      if (len > length || (len == length && R_PUNCTUATOR < rule)) {
+        tok = punctuator;
+      }
+      CANDIDATE(R_PUNCTUATOR, len);
+    }
+  }
+
+  if (state == DOT) {
+    CANDIDATE(c == '\n' ? R_DOT_NEWLINE : R_DOT_ANY, 1u);
+  } else if (state == VIRTUAL_SEMICOLON) {
+    CANDIDATE(c == '\n' ? R_VIRTUAL_SEMICOLON_NEWLINE : R_VIRTUAL_SEMICOLON_ANY, 1u);
+  } else {
+    CANDIDATE(c == '\n' ? R_NEWLINE : R_DEFAULT, 1u);
+  }
+#undef CANDIDATE
+  return rule;
+}
+
+static lexer_rule_t newline_rule(int state) {
+  switch (state) {
+    case NO_LINEBREAK:
+      return R_NO_LINEBREAK_NEWLINE;
+    case DOT:
+      return R_DOT_NEWLINE;
+    case VIRTUAL_SEMICOLON:
+      return R_VIRTUAL_SEMICOLON_NEWLINE;
+    default:
+      return R_NEWLINE;
+  }
+}
+
+//
+// XML, XML_CDATA, XML_PI and XML_TEXT. Returns -1 to keep scanning.
+static int lex_xml(fbjs_lexer* lexer, YYSTYPE* yylval) {
+  fbjs_parse_extra* extra = lexer->extra;
+  const char*& pos = lexer->pos;
+  const char* text = pos;
+
+  if (lexer->state == XML_CDATA || lexer->state == XML_PI) {
+    const char* close = lexer->state == XML_CDATA ? "]]>" : "?>";
+    size_t close_length = strlen(close);
+    const char* ii = pos;
+    while ((ii = static_cast<const char*>(memchr(ii, close[0], lexer->end - ii))) != NULL &&
+        (static_cast<size_t>(lexer->end - ii) < close_length || memcmp(ii, close, close_length) != 0)) {
+      ++ii;
+    }
+    if (extra->terminated) {
+      return 0;
+    }
+    lexer->lloc->first_line += count_newlines(pos, ii ? ii : lexer->end);
+    if (ii == NULL) {
+      pos = lexer->end;
+      return -1;
+    }
+    yylval->string = copy_text(pos, ii);
+    pos = ii + close_length;
+    int tok = lexer->state == XML_CDATA ? t_XML_CDATA : t_XML_PI;
+    lexer->state = extra->pre_xml_stack.top();
+    extra->pre_xml_stack.pop();
+    return tok;
+  }
+
+  char c = *pos;
+  const char* match;
+  if (lexer->state == XML_TEXT && c != '<' && c != '{') {
+    // Element content: all of it up to the next tag or embedded expression is one token
+    bool whitespace;
+    match = match_xml_content(pos, lexer->end, whitespace);
+    if (match == pos) {
+      ++pos;
+      if (!extra->terminated) {
+        terminate(lexer, "invalid entity");
+      }
+      return 0;
+    }
+    pos = match;
+    if (extra->terminated) {
+      return 0;
+    }
+    lexer->lloc->first_line += count_newlines(text, pos);
+    if (whitespace) {
+      yylval->string = copy_text(text, pos);
+      return token(lexer, t_XML_WHITESPACE);
+    }
+    yylval->string = xml_decode_text(text, pos - text);
+    return token(lexer, t_XML_CDATA);
+  } else if (is(c, CH_XML_SPACE)) {
+    pos = span(pos, CH_XML_SPACE);
+    if (extra->terminated) {
+      return 0;
+    }
+    lexer->lloc->first_line += count_newlines(text, pos);
+    yylval->string = copy_text(text, pos);
+    return token(lexer, t_XML_WHITESPACE);
+  } else if (c == '<') {
+    if (strncmp(pos, "<![CDATA[", 9) == 0) {
+      pos += 9;
+      extra->pre_xml_stack.push(lexer->state);
+      lexer->state = XML_CDATA;
+    } else if ((match = match_xml_comment(pos, lexer->end)) != NULL) {
+      pos = match;
+      if (extra->terminated) {
+        return 0;
+      }
+      yylval->string = copy_text(text + 4, pos - 3);
+      return t_XML_COMMENT;
+    } else if (pos[1] == '?') {
+      pos += 2;
+      extra->pre_xml_stack.push(lexer->state);
+      lexer->state = XML_PI;
+    } else if (pos[1] == '/') {
+      pos += 2;
+      lexer->state = XML; // the closing tag
+      return extra->terminated ? 0 : token(lexer, t_XML_LT_DIV);
+    } else {
+      ++pos;
+      return extra->terminated ? 0 : token(lexer, t_LESS_THAN);
+    }
+    return extra->terminated ? 0 : -1;
+  }
+
+  int tok = 0;
+  switch (c) {
+    case ':': tok = t_COLON; break;
+    case '=': tok = t_ASSIGN; break;
+    case '{': tok = t_LCURLY; break;
+    case '}': tok = t_RCURLY; break;
+    case '"': tok = t_XML_QUOTE; break;
+    case '\'': tok = t_XML_APOS; break;
+    case '/': tok = t_DIV; break;
+    case '>': tok = t_GREATER_THAN; break;
+  }
+  if (tok) {
+    ++pos;
+    return extra->terminated ? 0 : token(lexer, tok, tok == t_GREATER_THAN);
+  }
+
+  // A name fragment is always also a run of text; the name wins a tie
+  match = match_xml_text(pos, lexer->end);
+  if (match == pos) {
+    ++pos;
+    if (!extra->terminated) {
+      terminate(lexer, "invalid entity");
+    }
+    return 0;
+  }
+  if (extra->terminated) {
+    pos = match;
+    return 0;
+  }
+  if ((is(c, CH_WORD) && !is(c, CH_DIGIT) && c != '$') && span(pos, CH_XML_NAME) == match) {
+    pos = match;
+    yylval->string = copy_text(text, pos);
+    return token(lexer, t_XML_NAME_FRAGMENT);
+  }
+  pos = match;
+  yylval->string = xml_decode_text(text, pos - text);
+  return token(lexer, t_XML_CDATA);
+}
+
+//
+// REGEX
+static int lex_regex(fbjs_lexer* lexer, YYSTYPE* yylval) {
+  const char* text = lexer->pos;
+  size_t len = match_regex(text, lexer->end);
+  lexer->pos += len ? len : 1;
+  if (lexer->extra->terminated) {
+    return 0;
+  } else if (!len) {
+    return token(lexer, t_UNTERMINATED_REGEX_LITERAL);
+  }
+  size_t flag_pos = len - 1;
+  while (text[flag_pos] != '/') {
+    --flag_pos;
+  }
+  yylval->string_duple[0] = copy_text(text, text + flag_pos);
+  yylval->string_duple[1] = copy_text(text + flag_pos + 1, text + len);
+  return token(lexer, t_REGEX);
+}
+
+static int lex(fbjs_lexer* lexer, YYSTYPE* yylval) {
+  fbjs_parse_extra* extra = lexer->extra;
+  YYLTYPE* yylloc = lexer->lloc;
+  for (;;) {
+    lexer_rule_t rule;
+    size_t length;
+    int tok = 0;
+    if (lexer->pending_newline) {
+      lexer->pending_newline = false;
+      rule = newline_rule(lexer->state);
+      length = 0;
+    } else if (lexer->pos == lexer->end) {
+      // <<EOF>>
+      if (extra->partial) {
+        return 0;
+      } else if (extra->last_tok != t_VIRTUAL_SEMICOLON && extra->last_tok != t_SEMICOLON) {
+        return token(lexer, t_VIRTUAL_SEMICOLON);
+      } else {
+        return 0;
+      }
+    } else if (lexer->state == REGEX) {
+      return lex_regex(lexer, yylval);
+    } else if (lexer->state >= XML) {
+      int ret = lex_xml(lexer, yylval);
+      if (ret != -1) {
+        return ret;
+      }
+      continue;
+    } else {
+      rule = match_script(lexer, length, tok);
+    }
+
+    const char* text = lexer->pos;
+    lexer->pos += length;
+    if (extra->terminated) {
+      return 0;
+    }
+    switch (rule) {
+      case R_NO_LINEBREAK_NEWLINE:
+        ++yylloc->first_line;
+        lexer->state = IDENTIFIER;
+        return t_VIRTUAL_SEMICOLON;
+
+      case R_NO_LINEBREAK_ANY:
+        lexer->state = IDENTIFIER;
+        lexer->pos = text;
+        break;
+
+      case R_LINE_COMMENT:
+        lexer->pos = scan_line_comment(lexer->pos, lexer->end);
+        break;
+
+      case R_WHITESPACE:
+        break;
+
+      case R_BLOCK_COMMENT:
+        if (!lex_block_comment(lexer)) {
+          return 0;
+        }
+        break;
+
+      case R_KEYWORD:
+        return token(lexer, tok);
+
+      case R_VIRTUAL_SEMICOLON_ELSE:
+        if ((extra->last_tok == t_RPAREN && (extra->last_paren_tok == t_IF || extra->last_paren_tok == t_FOR || extra->last_paren_tok == t_WHILE)) ||
+            extra->last_tok == t_SEMICOLON || extra->last_tok == t_RCURLY) {
+          return token(lexer, t_ELSE);
+        }
+        lexer->pos = text;
+        lexer->state = INITIAL;
+        return t_VIRTUAL_SEMICOLON;
+
+      case R_VIRTUAL_SEMICOLON_WHILE:
+        if ((extra->last_tok == t_RPAREN && (extra->last_paren_tok == t_IF || extra->last_paren_tok == t_FOR || extra->last_paren_tok == t_WHILE)) ||
+            (extra->last_tok == t_RCURLY && extra->last_curly_tok == t_DO) ||
+            extra->last_tok == t_SEMICOLON || extra->last_tok == t_RCURLY) {
+          return token(lexer, t_WHILE);
+        }
+        lexer->pos = text;
+        lexer->state = INITIAL;
+        return t_VIRTUAL_SEMICOLON;
+
+      case R_VIRTUAL_SEMICOLON_WORD:
+        lexer->pos = text;
+        lexer->state = INITIAL;
+        if (!(extra->last_tok == t_RPAREN &&
+            (extra->last_paren_tok == t_IF || extra->last_paren_tok == t_DO || extra->last_paren_tok == t_FOR ||
+             (extra->last_paren_tok == t_WHILE && extra->last_curly_tok != t_DO)))) {
+          return t_VIRTUAL_SEMICOLON;
+        }
+        break;
+
+      case R_VIRTUAL_SEMICOLON_NEWLINE:
+      case R_DOT_NEWLINE:
+        ++yylloc->first_line;
+        break;
+
+      case R_VIRTUAL_SEMICOLON_ANY:
+        lexer->state = extra->virtual_semicolon_last_state;
+        lexer->pos = text;
+        break;
+
+      case R_KEYWORD_PHRASE:
+        yylloc->first_line += count_newlines(text, lexer->pos);
+        return token(lexer, tok);
+
+      case R_HEX:
+      case R_OCTAL:
+      case R_EXPONENT:
+      case R_DECIMAL:
+        yylval->number = number_value(rule, text, length);
+        return token(lexer, t_NUMBER);
+
+      case R_IDENTIFIER:
+        yylval->string = copy_text(text, lexer->pos);
+        return token(lexer, t_IDENTIFIER);
+
+      case R_DOT_ANY:
+        lexer->state = INITIAL;
+        lexer->pos = text;
+        break;
+
+      case R_STRING:
+        yylval->string = lex_string(lexer, text);
+        return token(lexer, t_STRING);
+
+      case R_REGEX_START:
+        lexer->state = REGEX;
+        break;
+
+      case R_PUNCTUATOR:
+        switch (tok) {
+          case t_LCURLY:
+            extra->curly_stack.push(extra->last_tok);
+            break;
+          case t_RCURLY:
+            if (extra->last_tok != t_LCURLY && extra->last_tok != t_SEMICOLON && extra->last_tok != t_VIRTUAL_SEMICOLON) {
+              lexer->pos = text;
+              return token(lexer, t_VIRTUAL_SEMICOLON);
+            }
+            if (extra->curly_stack.empty()) {
+              extra->last_curly_tok = 0;
+            } else {
+              extra->last_curly_tok = extra->curly_stack.top();
+              extra->curly_stack.pop();
+            }
+            break;
+          case t_LPAREN:
+            extra->paren_stack.push(extra->last_tok);
+            break;
+          case t_RPAREN:
+            if (!extra->paren_stack.empty()) {
+              extra->last_paren_tok = extra->paren_stack.top();
+              extra->paren_stack.pop();
+            }
+            break;
+        }
+        return token(lexer, tok);
+
+      case R_NEWLINE:
+        ++yylloc->first_line;
+        if (extra->last_tok == t_IDENTIFIER || extra->last_tok == t_NUMBER || extra->last_tok == t_STRING ||
+            extra->last_tok == t_REGEX || extra->last_tok == t_TRUE || extra->last_tok == t_FALSE ||
+            extra->last_tok == t_RPAREN || extra->last_tok == t_RCURLY || extra->last_tok == t_RBRACKET ||
+            extra->last_tok == t_NULL || extra->last_tok == t_THIS ||
+            (extra->last_tok_xml && extra->last_tok == t_GREATER_THAN)) {
+          extra->virtual_semicolon_last_state = lexer->state;
+          lexer->state = VIRTUAL_SEMICOLON;
+        }
+        break;
+
+      case R_DEFAULT:
+        // Syntax error!
+        return *text;
+
+      case R_NONE:
+        return 0;
+    }
+  }
+}
+
+static void set_input(fbjs_lexer* lexer, const char* begin, const char* end) {
+  lexer->pos = begin;
+  lexer->end = end;
+  lexer->pending_newline = false;
+  lexer->unterminated_string = NULL;
+}
+
+//
+// The flex interface declared in parser.hpp
+int yylex(YYSTYPE* yylval, YYLTYPE* yylloc, void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->lloc = yylloc;
+  if (!lexer->started) {
+    lexer->started = true;
+    YY_USER_INIT;
+  }
+  return lex(lexer, yylval);
+}
+
+int yylex_init_extra(YY_EXTRA_TYPE extra, void** scanner) {
+  fbjs_lexer* lexer = new fbjs_lexer;
+  lexer->extra = extra;
+  lexer->lloc = NULL;
+  lexer->state = INITIAL;
+  lexer->started = false;
+  set_input(lexer, "", "");
+  *scanner = lexer;
+  return 0;
+}
+
+int yylex_destroy(void* scanner) {
+  delete static_cast<fbjs_lexer*>(scanner);
+  return 0;
+}
+
+YY_EXTRA_TYPE yyget_extra(void* scanner) {
+  return static_cast<fbjs_lexer*>(scanner)->extra;
+}
+
+YYLTYPE* yyget_lloc(void* scanner) {
+  return static_cast<fbjs_lexer*>(scanner)->lloc;
+}
+
+void yyset_extra(YY_EXTRA_TYPE extra, void* scanner) {
+  static_cast<fbjs_lexer*>(scanner)->extra = extra;
+}
+
+void yyset_debug(int bdebug, void* scanner) {
+}
+
+//
+// The whole file is read up front
+void yyrestart(FILE* file, void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->file.clear();
+  char buf[4096];
+  size_t read;
+  while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+    lexer->file.insert(lexer->file.end(), buf, buf + read);
+  }
+  lexer->file.push_back(0);
+  set_input(lexer, &lexer->file[0], &lexer->file[0] + lexer->file.size() - 1);
+}
+
+//
+// The string is scanned in place rather than copied
+void* yy_scan_string(const char* str, void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  set_input(lexer, str, str + strlen(str));
+  return scanner;
+}
+
+// Like flex, the last two bytes of `base` must be NUL and aren't part of the input
+void* yy_scan_buffer(char* base, size_t size, void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  set_input(lexer, base, base + size - 2);
+  return scanner;
+}
+
+void yy_delete_buffer(void* buffer, void* scanner) {
+}
+
+void fbjs_reset_scanner(void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->state = INITIAL;
+  set_input(lexer, lexer->pos, lexer->end);
+}
+
+void fbjs_push_xml_state(void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->extra->pre_xml_stack.push(lexer->state);
+  lexer->state = XML;
+}
+
+void fbjs_push_xml_embedded_expression_state(void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->extra->pre_xml_stack.push(lexer->state);
+  lexer->state = IDENTIFIER;
+}
+
+void fbjs_begin_xml_content(void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->state = XML_TEXT;
+}
+
+void fbjs_pop_xml_state(void* scanner) {
+  fbjs_lexer* lexer = static_cast<fbjs_lexer*>(scanner);
+  lexer->state = lexer->extra->pre_xml_stack.top();
+  lexer->extra->pre_xml_stack.pop();
+}
+
+#endif
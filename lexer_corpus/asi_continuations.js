@@ -0,0 +1,20 @@
+try { a }
+catch (e) {}
+finally {}
+x = a
+in b
+x = a
+instanceof B
+x = a
+catchy = 1
+x = a
+(b)
+x = a
+[b]
+x = {}
+.y
+return_ = 1
+function f() {
+  return
+  a
+}
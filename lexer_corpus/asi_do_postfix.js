@@ -0,0 +1,2 @@
+do x++
+while (x < 3)
@@ -0,0 +1,21 @@
+if (a) b
+else c
+if (a) { b }
+else
+{ c }
+if (a) b;
+else c
+if (a) x = y
+else z = w
+if (a)
+  if (b) c()
+  else d()
+else e()
+if (a)
+  while (b) c()
+else d()
+for (;;) if (a) break
+else continue
+elsewhere = 1
+x = y
+elseif = 2
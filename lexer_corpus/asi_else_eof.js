@@ -0,0 +1,6 @@
+if (a) b
+
+
+   else
+
+ c
\ No newline at end of file
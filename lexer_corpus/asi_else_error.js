@@ -0,0 +1,2 @@
+x = y
+else z
@@ -0,0 +1,2 @@
+x = a
+++b
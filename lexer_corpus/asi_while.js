@@ -0,0 +1,15 @@
+do { x++ }
+while (x < 3)
+do x()
+while (y)
+do {} while (a)
+b()
+var x = y
+while (x) x = x - 1
+while (a)
+b
+whiled = 2
+label:
+while (a) break label
+if (a) b
+while (c) d
@@ -0,0 +1,4 @@
+a = 1; /* a comment
+ with lines **/ b = 2 /*
+*/ c = 3
+d /* x */ = /**/ 4; /* * / ** */
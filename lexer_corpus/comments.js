@@ -0,0 +1,7 @@
+// a line comment
+/* a block
+   comment */ a = 1; /**/ b = 2; /***/ c = 3;
+/* star ** inside */ d = 4; // trailing
+<!-- an html comment
+e = /* inline */ 5;
+/* unterminated at the end? no */ f = 6
@@ -0,0 +1,4 @@
+var x = <a b="c" d='e'>text &amp; more<b/>{1 + 2}<!-- comment --><![CDATA[ <raw> ]]><?pi data?></a>;
+var y = x.b.@d + x..b + x.*;
+var z = <>list</>;
+default xml namespace = "http://example.com/";
@@ -0,0 +1,2 @@
+a = 1;
+<!-- html comment at the end
\ No newline at end of file
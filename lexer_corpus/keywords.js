@@ -0,0 +1,9 @@
+function f(a, b) {
+  var x = this, y = null, z = true || false;
+  for (var i in a) { if (i instanceof b) continue; else break; }
+  do { x = typeof x; } while (void 0);
+  switch (a) { case 1: default: return new b(); }
+  try { throw delete a.b; } catch (e) {} finally {}
+  with (a) {}
+  a.if = a.else + a["while"];
+}
@@ -0,0 +1 @@
+a = 1; // no line break after this
\ No newline at end of file
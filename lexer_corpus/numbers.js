@@ -0,0 +1,3 @@
+var a = [0, 1, 12.5, .5, 5., 0x1F, 0XaB, 012, 1e3, 1E-3, 2.5e+10, 1.5e1];
+var b = 1..toString() + 1 .toString() + 0x10.toString();
+var c = a.length/2/b;
@@ -0,0 +1,5 @@
+a >>>= b >>= c <<= d ^= e |= f &= g %= h *= i -= j += k;
+l = m === n !== o == p != q <= r >= s < t > u;
+v = w >>> x >> y << z & aa | bb ^ cc && dd || ee ? ff : gg;
+hh = !ii + ~jj - -kk + +ll - --mm + ++nn;
+oo = {a: 1, "b": 2, 3: [4, 5]}, pp = (6, 7);
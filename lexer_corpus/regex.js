@@ -0,0 +1,8 @@
+var r = /ab+c/gi, s = /[/]/, t = /\//, u = /[\]/]+/m;
+x = a / b / c;
+y = (a) / 2;
+z = [/x/, /y/g];
+if (/^\s*$/.test(s)) { s = s.replace(/a|b/g, "c"); }
+w = a /= 2;
+v = typeof /x/;
+q = b++ / 2;
@@ -0,0 +1 @@
+a = "ends in a backslash \
\ No newline at end of file
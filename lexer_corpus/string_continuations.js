@@ -0,0 +1,5 @@
+a = "line\
+breaks\
+and \cr", b = 1;
+c = "unterminated
+d = 2;
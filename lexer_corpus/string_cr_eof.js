@@ -0,0 +1 @@
+a = "ends in a continuation \
\ No newline at end of file
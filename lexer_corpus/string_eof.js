@@ -0,0 +1 @@
+a = "never closed
\ No newline at end of file
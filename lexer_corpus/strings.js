@@ -0,0 +1,5 @@
+var a = "double", b = 'single', c = "with \"escaped\" quotes", d = 'it\'s';
+var e = "a \
+continued line", f = "\x41B\n\t\\";
+var g = "", h = '';
+var i = "/* not a comment */" + '// nor this';
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Copyright (c) 2008-2009 Facebook
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# See accompanying file LICENSE.txt.
+
+# Builds lexer_dump with the flex scanner and with the hand-written one in two scratch copies of
+# this directory, runs both over the files given (lexer_corpus/ if none are) with and without E4X,
+# and diffs the token streams. Exits non-zero if they differ. Needs flex and bison. Extra make
+# variables can be passed in MAKEVARS, eg MAKEVARS="OPT=1".
+#
+#   ./lexer_diff.sh [file...]
+
+set -e
+src=$(cd "$(dirname "$0")" && pwd)
+if [ $# -eq 0 ]; then
+  set -- "$src"/lexer_corpus/*
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+for build in flex hand; do
+  mkdir "$work/$build"
+  cp "$src"/*.cpp "$src"/*.hpp "$src"/*.ll "$src"/*.yy "$src"/Makefile "$work/$build"
+  cp "$src"/dmg_fp_*.c "$work/$build" 2>/dev/null || true
+done
+make -s -C "$work/flex" $MAKEVARS lexer_dump
+make -s -C "$work/hand" $MAKEVARS HAND_LEXER=1 lexer_dump
+
+status=0
+for opts in "" "-x"; do
+  "$work/flex/lexer_dump" $opts "$@" > "$work/flex.out" || true
+  "$work/hand/lexer_dump" $opts "$@" > "$work/hand.out" || true
+  if ! diff -u --label "flex $opts" --label "hand $opts" "$work/flex.out" "$work/hand.out"; then
+    status=1
+  fi
+done
+if [ $status -eq 0 ]; then
+  echo "same tokens: $# files"
+fi
+exit $status
@@ -0,0 +1,134 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+using namespace std;
+using namespace fbjs;
+
+//
+// Prints every token the scanner hands the grammar, one per line with its line number and value, so
+// the flex scanner and the hand-written one in lexer.cpp can be compared. The tokens are fed to the
+// bison push parser as they're read, because the grammar switches the scanner in and out of its XML
+// states; a parse error ends the file. lexer_diff.sh builds this both ways and diffs the output.
+//
+//   lexer_dump [-x] file...
+//
+// -x parses with PARSE_E4X.
+
+static void printText(const char* text) {
+  putchar(' ');
+  for (const char* ii = text; *ii; ++ii) {
+    if (*ii == '\\') {
+      fputs("\\\\", stdout);
+    } else if (*ii == '\n') {
+      fputs("\\n", stdout);
+    } else if (*ii == '\r') {
+      fputs("\\r", stdout);
+    } else {
+      putchar(*ii);
+    }
+  }
+}
+
+static void printToken(int tok, const YYSTYPE& value, const YYLTYPE& lloc) {
+  printf("%d %s", lloc.first_line, tok == 0 ? "$end" : yytokname(tok));
+  switch (tok) {
+    case t_NUMBER:
+      printf(" %.17g", value.number);
+      break;
+    case t_IDENTIFIER:
+    case t_STRING:
+    case t_XML_NAME_FRAGMENT:
+    case t_XML_CDATA:
+    case t_XML_WHITESPACE:
+    case t_XML_COMMENT:
+    case t_XML_PI:
+      printText(value.string);
+      break;
+    case t_REGEX:
+      printText(value.string_duple[0]);
+      printText(value.string_duple[1]);
+      break;
+  }
+  putchar('\n');
+}
+
+static bool dump(const char* path, node_parse_enum opts) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+  vector<char> code;
+  char buf[4096];
+  size_t read;
+  while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+    code.insert(code.end(), buf, buf + read);
+  }
+  fclose(file);
+  code.push_back(0);
+  code.push_back(0);
+
+  printf("== %s\n", path);
+  fbjs_parse_extra extra;
+  void* scanner = fbjs_init_parser(&extra);
+  extra.opts = opts;
+  void* buffer = yy_scan_buffer(&code[0], code.size(), scanner);
+  yypstate* state = yypstate_new();
+  NodeProgram root;
+  YYLTYPE lloc;
+  lloc.first_line = lloc.last_line = 1;
+  lloc.first_column = lloc.last_column = 1;
+  int status;
+  do {
+    YYSTYPE value;
+    int tok = yylex(&value, &lloc, scanner);
+    printToken(tok, value, lloc);
+    status = yypush_parse(state, tok, &value, &lloc, scanner, &root);
+  } while (status == YYPUSH_MORE);
+  for (size_t ii = 0; ii < extra.errors.size(); ++ii) {
+    printf("error %d %s\n", extra.errors[ii].lineno, extra.errors[ii].message.c_str());
+  }
+  yypstate_delete(state);
+  yy_delete_buffer(buffer, scanner);
+  yylex_destroy(scanner);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  node_parse_enum opts = PARSE_NONE;
+  int ii = 1;
+  if (ii < argc && strcmp(argv[ii], "-x") == 0) {
+    opts = PARSE_E4X;
+    ++ii;
+  }
+  if (ii == argc) {
+    fprintf(stderr, "usage: %s [-x] file...\n", argv[0]);
+    return 1;
+  }
+  bool ok = true;
+  for (; ii < argc; ++ii) {
+    ok = dump(argv[ii], opts) && ok;
+  }
+  return ok ? 0 : 1;
+}
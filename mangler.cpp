@@ -0,0 +1,131 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <algorithm>
+#include <vector>
+#include <tr1/unordered_set>
+#include "keywords.hpp"
+#include "mangler.hpp"
+#include "scope.hpp"
+using namespace std;
+using namespace fbjs;
+
+namespace {
+  //
+  // Generates the n'th shortest identifier.
+  string mangledName(size_t index) {
+    static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ$_";
+    static const char rest[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ$_0123456789";
+    string name(1, first[index % 54]);
+    index /= 54;
+    while (index) {
+      --index;
+      name += rest[index % 64];
+      index /= 64;
+    }
+    return name;
+  }
+
+  struct compareSymbolFrequency {
+    const ScopeIndex& index;
+    compareSymbolFrequency(const ScopeIndex& index) : index(index) {}
+    size_t refs(ScopeIndex::symbol_id_t symbol) const {
+      ScopeIndex::id_range_t range = index.refsOf(symbol);
+      return range.second - range.first;
+    }
+    bool operator() (ScopeIndex::symbol_id_t a, ScopeIndex::symbol_id_t b) const {
+      return refs(a) > refs(b);
+    }
+  };
+}
+
+bool fbjs::isReservedWord(const string& name) {
+  return findKeyword(name.data(), name.size()) != NULL;
+}
+
+mangle_stats_t fbjs::mangleIdentifiers(Node* root) {
+  mangle_stats_t stats = {0, 0, 0, 0, 0};
+  ScopeIndex index(root);
+
+  // Each scope between a reference and its declaration learns that the symbol is used from inside
+  // of it so it won't hand out a conflicting name. Walking stops early once a scope already knows
+  // about a symbol, which keeps this linear in practice.
+  vector<tr1::unordered_set<ScopeIndex::symbol_id_t> > outer(index.scopeCount());
+  vector<tr1::unordered_set<string> > free(index.scopeCount());
+  for (ScopeIndex::ref_id_t ii = 0; ii < index.refCount(); ++ii) {
+    const ScopeIndex::ref_t& ref = index.ref(ii);
+    ScopeIndex::scope_id_t scope = ref.scope;
+    if (ref.symbol == ScopeIndex::npos) {
+      for (; scope != ScopeIndex::npos && free[scope].insert(ref.node->name()).second; scope = index.scope(scope).parent);
+    } else {
+      ScopeIndex::scope_id_t target = index.symbol(ref.symbol).scope;
+      for (; scope != target && outer[scope].insert(ref.symbol).second; scope = index.scope(scope).parent);
+    }
+  }
+
+  // Hand out names. Scopes are visited parents-first so the new names of outer symbols are known.
+  // Globals are visible to other scripts and are never renamed, nor is anything eval() or `with`
+  // could see.
+  vector<string> mangled(index.symbolCount());
+  for (ScopeIndex::scope_id_t ii = 0; ii < index.scopeCount(); ++ii) {
+    const ScopeIndex::scope_t& scope = index.scope(ii);
+    ScopeIndex::id_range_t declared = index.symbolsOf(ii);
+    if (scope.type == ScopeIndex::SCOPE_FUNCTION || scope.type == ScopeIndex::SCOPE_CATCH) {
+      ++stats.scopes;
+      if (scope.dynamic) {
+        ++stats.tainted_scopes;
+      }
+    }
+    if (scope.type == ScopeIndex::SCOPE_GLOBAL || scope.dynamic) {
+      for (const size_t* jj = declared.first; jj != declared.second; ++jj) {
+        mangled[*jj] = index.symbol(*jj).name;
+      }
+      continue;
+    }
+
+    tr1::unordered_set<string> taken(free[ii]);
+    for (tr1::unordered_set<ScopeIndex::symbol_id_t>::iterator jj = outer[ii].begin(); jj != outer[ii].end(); ++jj) {
+      taken.insert(mangled[*jj]);
+    }
+    vector<ScopeIndex::symbol_id_t> symbols(declared.first, declared.second);
+    stable_sort(symbols.begin(), symbols.end(), compareSymbolFrequency(index));
+    size_t next = 0;
+    for (vector<ScopeIndex::symbol_id_t>::iterator jj = symbols.begin(); jj != symbols.end(); ++jj) {
+      // `catch (e) { var e; }` declares the function's `e` through the catch variable, so they
+      // share a name. Nothing inside the catch can see the function's `e` so the name is free.
+      string name;
+      if (index.symbol(*jj).hoisted != ScopeIndex::npos) {
+        name = mangled[index.symbol(*jj).hoisted];
+      } else {
+        do {
+          name = mangledName(next++);
+        } while (taken.find(name) != taken.end() || isReservedWord(name));
+      }
+      mangled[*jj] = name;
+      ++stats.symbols;
+      ScopeIndex::id_range_t refs = index.refsOf(*jj);
+      stats.bytes_saved += ((long)index.symbol(*jj).name.size() - (long)name.size()) * (long)(refs.second - refs.first);
+      for (const size_t* kk = refs.first; kk != refs.second; ++kk) {
+        index.ref(*kk).node->rename(name);
+        ++stats.identifiers;
+      }
+    }
+  }
+  return stats;
+}
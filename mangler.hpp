@@ -0,0 +1,47 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include "node.hpp"
+
+namespace fbjs {
+
+  //
+  // Results of a mangle run.
+  struct mangle_stats_t {
+    size_t scopes; // function and catch scopes found
+    size_t tainted_scopes; // scopes left untouched because of `with` or `eval`
+    size_t symbols; // local symbols which were renamed
+    size_t identifiers; // NodeIdentifier's which were rewritten
+    long bytes_saved; // difference in rendered identifier bytes
+  };
+
+  //
+  // Renames function-local variables, parameters and function names to the
+  // shortest names available. Names are handed out per scope with the most
+  // referenced symbols getting the shortest names. Globals are never renamed,
+  // and any scope which contains `with` or references `eval` (along with every
+  // scope enclosing it) keeps its original names.
+  mangle_stats_t mangleIdentifiers(Node* root);
+
+  //
+  // Returns true if `name` is a reserved word and may not be used as an identifier.
+  bool isReservedWord(const std::string& name);
+}
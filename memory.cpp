@@ -0,0 +1,283 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <typeinfo>
+#include <vector>
+#include "memory.hpp"
+#include "node.hpp"
+#include "stats.hpp"
+using namespace std;
+using namespace fbjs;
+
+__thread MemoryTracker* MemoryTracker::_current = NULL;
+__thread MemoryResource* MemoryResource::_current = NULL;
+
+size_t memory_usage_t::kind_t::bytes() const {
+  return headers + fields + links + strings + overhead;
+}
+
+memory_usage_t::kind_t& memory_usage_t::kind_t::operator+= (const kind_t& that) {
+  nodes += that.nodes;
+  headers += that.headers;
+  fields += that.fields;
+  links += that.links;
+  strings += that.strings;
+  overhead += that.overhead;
+  return *this;
+}
+
+namespace {
+
+  struct type_info_less {
+    bool operator() (const type_info* left, const type_info* right) const {
+      return left->before(*right) != 0;
+    }
+  };
+
+  typedef map<const type_info*, size_t, type_info_less> node_sizes_t;
+
+  //
+  // sizeof() for each node class. Classes from outside the library aren't in here and are counted as
+  // a plain Node.
+  node_sizes_t nodeSizes() {
+    node_sizes_t sizes;
+#define NODE_SIZE(type) sizes[&typeid(type)] = sizeof(type)
+    NODE_SIZE(Node);
+    NODE_SIZE(NodeProgram);
+    NODE_SIZE(NodeStatementList);
+    NODE_SIZE(NodeNumericLiteral);
+    NODE_SIZE(NodeStringLiteral);
+    NODE_SIZE(NodeRegexLiteral);
+    NODE_SIZE(NodeBooleanLiteral);
+    NODE_SIZE(NodeNullLiteral);
+    NODE_SIZE(NodeThis);
+    NODE_SIZE(NodeEmptyExpression);
+    NODE_SIZE(NodeOperator);
+    NODE_SIZE(NodeConditionalExpression);
+    NODE_SIZE(NodeParenthetical);
+    NODE_SIZE(NodeAssignment);
+    NODE_SIZE(NodeUnary);
+    NODE_SIZE(NodePostfix);
+    NODE_SIZE(NodeIdentifier);
+    NODE_SIZE(NodeFunctionCall);
+    NODE_SIZE(NodeFunctionConstructor);
+    NODE_SIZE(NodeObjectLiteral);
+    NODE_SIZE(NodeArrayLiteral);
+    NODE_SIZE(NodeStaticMemberExpression);
+    NODE_SIZE(NodeDynamicMemberExpression);
+    NODE_SIZE(NodeStatement);
+    NODE_SIZE(NodeStatementWithExpression);
+    NODE_SIZE(NodeVarDeclaration);
+    NODE_SIZE(NodeTypehint);
+    NODE_SIZE(NodeFunctionDeclaration);
+    NODE_SIZE(NodeFunctionExpression);
+    NODE_SIZE(NodeArgList);
+    NODE_SIZE(NodeIf);
+    NODE_SIZE(NodeWith);
+    NODE_SIZE(NodeTry);
+    NODE_SIZE(NodeLabel);
+    NODE_SIZE(NodeCaseClause);
+    NODE_SIZE(NodeSwitch);
+    NODE_SIZE(NodeDefaultClause);
+    NODE_SIZE(NodeObjectLiteralProperty);
+    NODE_SIZE(NodeForLoop);
+    NODE_SIZE(NodeForIn);
+    NODE_SIZE(NodeForEachIn);
+    NODE_SIZE(NodeWhile);
+    NODE_SIZE(NodeDoWhile);
+    NODE_SIZE(NodeXMLDefaultNamespace);
+    NODE_SIZE(NodeXMLName);
+    NODE_SIZE(NodeXMLElement);
+    NODE_SIZE(NodeXMLComment);
+    NODE_SIZE(NodeXMLPI);
+    NODE_SIZE(NodeXMLContentList);
+    NODE_SIZE(NodeXMLTextData);
+    NODE_SIZE(NodeXMLEmbeddedExpression);
+    NODE_SIZE(NodeXMLAttributeList);
+    NODE_SIZE(NodeXMLAttribute);
+    NODE_SIZE(NodeWildcardIdentifier);
+    NODE_SIZE(NodeStaticAttributeIdentifier);
+    NODE_SIZE(NodeDynamicAttributeIdentifier);
+    NODE_SIZE(NodeStaticQualifiedIdentifier);
+    NODE_SIZE(NodeDynamicQualifiedIdentifier);
+    NODE_SIZE(NodeFilteringPredicate);
+    NODE_SIZE(NodeDescendantExpression);
+#undef NODE_SIZE
+    return sizes;
+  }
+
+  string jsonNumber(size_t value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)value);
+    return buf;
+  }
+
+  string jsonKind(const memory_usage_t::kind_t& kind) {
+    return "{\"nodes\": " + jsonNumber(kind.nodes) +
+      ", \"headers\": " + jsonNumber(kind.headers) +
+      ", \"fields\": " + jsonNumber(kind.fields) +
+      ", \"links\": " + jsonNumber(kind.links) +
+      ", \"strings\": " + jsonNumber(kind.strings) +
+      ", \"overhead\": " + jsonNumber(kind.overhead) +
+      ", \"bytes\": " + jsonNumber(kind.bytes()) + "}";
+  }
+}
+
+//
+// Like stats_t::countTree() this tallies by type_info first and only names the classes at the end.
+// NULL children have a link but no node.
+memory_usage_t Node::memoryUsage() const {
+  static const node_sizes_t sizes = nodeSizes();
+  const size_t link = linkSize();
+  map<const type_info*, memory_usage_t::kind_t> kinds;
+  vector<const Node*> pending(1, this);
+  while (!pending.empty()) {
+    const Node* node = pending.back();
+    pending.pop_back();
+    const type_info& type = typeid(*node);
+    node_sizes_t::const_iterator size = sizes.find(&type);
+    size_t object = size == sizes.end() ? sizeof(Node) : size->second;
+    memory_usage_t::kind_t& kind = kinds[&type];
+    ++kind.nodes;
+    kind.headers += sizeof(Node);
+    kind.fields += object - sizeof(Node);
+    kind.links += node->_childNodes.size() * linkBytes();
+    kind.strings += node->stringSize();
+    kind.overhead += (node->_from_resource ? sizeof(MemoryResource*) : heapSize(object) - object) +
+      node->_childNodes.size() * (link - linkBytes());
+    for (node_list_t::const_iterator ii = node->_childNodes.begin(); ii != node->_childNodes.end(); ++ii) {
+      if (*ii != NULL) {
+        pending.push_back(*ii);
+      }
+    }
+  }
+
+  memory_usage_t usage;
+  for (map<const type_info*, memory_usage_t::kind_t>::iterator ii = kinds.begin(); ii != kinds.end(); ++ii) {
+    usage.kinds[stats_t::typeName(*ii->first)] += ii->second;
+    usage.total += ii->second;
+  }
+  return usage;
+}
+
+memory_usage_t NodeProgram::memoryUsage() const {
+  memory_usage_t usage = Node::memoryUsage();
+  usage.peak = this->_peak;
+  return usage;
+}
+
+string memory_usage_t::json() const {
+  string out("{\n");
+  out += "  \"total\": " + jsonKind(total) + ",\n";
+  out += "  \"peak\": " + jsonNumber(peak) + ",\n";
+  out += "  \"kinds\": {";
+  for (map<string, kind_t>::const_iterator ii = kinds.begin(); ii != kinds.end(); ++ii) {
+    out += ii == kinds.begin() ? "\n    " : ",\n    ";
+    out += jsonString(ii->first) + ": " + jsonKind(ii->second);
+  }
+  out += kinds.empty() ? "}\n}\n" : "\n  }\n}\n";
+  return out;
+}
+
+//
+// MemoryTracker
+MemoryTracker::MemoryTracker() : _live(0), _peak(0), _nodes(0), previous(_current) {
+  _current = this;
+}
+
+MemoryTracker::~MemoryTracker() {
+  _current = previous;
+  if (previous != NULL) {
+    if (previous->_live + _peak > previous->_peak) {
+      previous->_peak = previous->_live + _peak;
+    }
+    previous->_live += _live;
+    previous->_nodes += _nodes;
+  }
+}
+
+//
+// Anything allocated before the tracker was installed can still be freed inside it
+size_t MemoryTracker::live() const {
+  return _live < 0 ? 0 : _live;
+}
+
+size_t MemoryTracker::peak() const {
+  return _peak;
+}
+
+size_t MemoryTracker::nodes() const {
+  return _nodes;
+}
+
+//
+// MemoryResourceScope
+MemoryResourceScope::MemoryResourceScope(MemoryResource& resource) : previous(MemoryResource::_current) {
+  MemoryResource::_current = &resource;
+}
+
+MemoryResourceScope::MemoryResourceScope(MemoryResource* resource) : previous(MemoryResource::_current) {
+  if (resource != NULL) {
+    MemoryResource::_current = resource;
+  }
+}
+
+MemoryResourceScope::~MemoryResourceScope() {
+  MemoryResource::_current = previous;
+}
+
+//
+// MonotonicResource. Anything bigger than a quarter of a block gets a block of its own, so a big
+// allocation doesn't waste the rest of the current one.
+MonotonicResource::MonotonicResource(size_t block_size /* = 64 * 1024 */) :
+  pos(NULL), end(NULL), block_size(block_size) {}
+
+MonotonicResource::~MonotonicResource() {
+  for (vector<char*>::iterator ii = blocks.begin(); ii != blocks.end(); ++ii) {
+    free(*ii);
+  }
+}
+
+void* MonotonicResource::allocate(size_t size) {
+  const size_t alignment = 2 * sizeof(size_t);
+  size = (size + alignment - 1) & ~(alignment - 1);
+  if (size > (size_t)(end - pos)) {
+    size_t length = size > block_size / 4 ? size : block_size;
+    blocks.reserve(blocks.size() + 1);
+    char* block = static_cast<char*>(malloc(length));
+    if (block == NULL) {
+      throw bad_alloc();
+    }
+    blocks.push_back(block);
+    if (length != size) {
+      pos = block;
+      end = block + length;
+    } else {
+      return block;
+    }
+  }
+  void* ret = pos;
+  pos += size;
+  return ret;
+}
+
+void MonotonicResource::deallocate(void* ptr, size_t size) {}
@@ -0,0 +1,227 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+//
+// Heap accounting for syntax trees. Node::memoryUsage() adds up what a tree holds right now, by node
+// class, and NodeProgram::memoryUsage() also has the most the tree held at once while it was being
+// parsed:
+//
+//   NodeProgram program(code);
+//   memory_usage_t usage = program.memoryUsage();
+//   printf("%lu bytes now, %lu at most\n", usage.total.bytes(), usage.peak);
+//
+// Sizes are what glibc's malloc actually hands out, headers and rounding included, so they add up to
+// the process's heap growth rather than to the sum of the sizeof()'s. Nodes from a MemoryResource
+// count what was asked of it instead.
+namespace fbjs {
+  class Node;
+
+  // Bytes a malloc of `size` takes up in glibc: a size_t header, rounded up to two size_t's, and at
+  // least four of them.
+  inline size_t heapSize(size_t size) {
+    const size_t alignment = 2 * sizeof(size_t);
+    size_t chunk = (size + sizeof(size_t) + alignment - 1) & ~(alignment - 1);
+    return chunk < 2 * alignment ? 2 * alignment : chunk;
+  }
+
+  // Bytes a string keeps on the heap. Short strings are stored in the string object itself and keep
+  // none. Reference-counted strings (the old libstdc++ ABI) put their length, capacity and count in
+  // front of the characters and share one empty string; copies that share a buffer are each counted.
+  inline size_t heapSize(const std::string& str) {
+#if defined(_GLIBCXX_USE_CXX11_ABI) && _GLIBCXX_USE_CXX11_ABI
+    const char* data = str.data();
+    if (data >= reinterpret_cast<const char*>(&str) && data < reinterpret_cast<const char*>(&str + 1)) {
+      return 0;
+    }
+    return heapSize(str.capacity() + 1);
+#else
+    return str.capacity() == 0 ? 0 : heapSize(3 * sizeof(size_t) + str.capacity() + 1);
+#endif
+  }
+
+  // Bytes of one std::list node holding a child pointer: the next and previous pointers and the
+  // value. Worked out by hand because the node type is the library's own.
+  inline size_t linkBytes() {
+    return 2 * sizeof(void*) + sizeof(Node*);
+  }
+
+  // Bytes each child pointer costs in a node's std::list, with the malloc overhead
+  inline size_t linkSize() {
+    return heapSize(linkBytes());
+  }
+
+  struct memory_usage_t {
+    struct kind_t {
+      size_t nodes;
+      size_t headers; // the Node part of each node: vtable pointer, child list and line number
+      size_t fields; // the rest of each node's object
+      size_t links; // std::list nodes pointing at its children
+      size_t strings; // names, values and XML text kept on the heap
+      size_t overhead; // malloc's or a MemoryResource's headers and rounding for nodes and links
+
+      kind_t() : nodes(0), headers(0), fields(0), links(0), strings(0), overhead(0) {}
+      size_t bytes() const;
+      kind_t& operator+= (const kind_t& that);
+    };
+
+    std::map<std::string, kind_t> kinds; // by node class, without the fbjs:: namespace
+    kind_t total;
+    size_t peak; // most heap the tree held while it was parsed, or 0 if it wasn't
+
+    memory_usage_t() : peak(0) {}
+    std::string json() const;
+  };
+
+  //
+  // MemoryTracker: counts the nodes, links and strings allocated and freed on the current thread
+  // while it's in scope, and remembers the most that were live at once. Trackers nest and each one
+  // sees everything allocated inside it. The parser installs one around every parse for
+  // NodeProgram::memoryUsage().
+  class MemoryTracker {
+    private:
+      ptrdiff_t _live; // less than zero if it's freed more than it allocated
+      ptrdiff_t _peak;
+      size_t _nodes;
+      MemoryTracker* previous;
+      static __thread MemoryTracker* _current;
+      MemoryTracker(const MemoryTracker&);
+      MemoryTracker& operator=(const MemoryTracker&);
+
+    public:
+      MemoryTracker();
+      ~MemoryTracker();
+      size_t live() const;
+      size_t peak() const;
+      size_t nodes() const; // allocated, freed or not
+
+      // The innermost tracker for this thread, if any
+      static MemoryTracker* current() {
+        return _current;
+      }
+
+      // Only the innermost tracker is kept up to date, it adds itself to the one outside it when it's
+      // done.
+      static void allocate(ptrdiff_t bytes) {
+        if (MemoryTracker* tracker = _current) {
+          tracker->_live += bytes;
+          if (tracker->_live > tracker->_peak) {
+            tracker->_peak = tracker->_live;
+          }
+        }
+      }
+
+      static void allocateNode(size_t bytes) {
+        if (MemoryTracker* tracker = _current) {
+          ++tracker->_nodes;
+          allocate(bytes);
+        }
+      }
+
+      static void release(ptrdiff_t bytes) {
+        if (MemoryTracker* tracker = _current) {
+          tracker->_live -= bytes;
+        }
+      }
+
+      // A string that was `before` heap bytes and is now `after`
+      static void resize(size_t before, size_t after) {
+        allocate((ptrdiff_t)after - (ptrdiff_t)before);
+      }
+  };
+
+  //
+  // MemoryResource: somewhere other than the global heap to put nodes and the scanner's token text,
+  // like a per-request arena or a NUMA-local pool. Install one for the current thread with a
+  // MemoryResourceScope, or give it to a Parser or PushParser to use for every parse. Nodes made
+  // inside it, whether parsed, cloned or made by a walker, come from
+  // it and go back to it when they're deleted, wherever that happens; it has to outlive them.
+  //
+  // That's all that comes from it. The std::list links to each node's children and the std::string
+  // names and values inside nodes still use the global heap: links move between lists when they're
+  // spliced, so an allocator for them would have to put a header on every one or make node_list_t
+  // stateful, and strings with an allocator would change the types name() and friends return. A
+  // tree's memoryUsage() counts its links and strings apart from its nodes, which is the part a
+  // resource doesn't see. Bison's stacks and the scanner's buffer aren't from it either.
+  class MemoryResource {
+    public:
+      virtual ~MemoryResource() {}
+
+      // Memory for `size` bytes, aligned for anything a node holds. Throws std::bad_alloc if there's
+      // none.
+      virtual void* allocate(size_t size) = 0;
+      virtual void deallocate(void* ptr, size_t size) = 0;
+
+      // The resource installed for this thread, or NULL for the global heap
+      static MemoryResource* current() {
+        return _current;
+      }
+
+    private:
+      static __thread MemoryResource* _current;
+      friend class MemoryResourceScope;
+  };
+
+  //
+  // MemoryResourceScope: installs a MemoryResource for the current thread until it goes out of
+  // scope. Scopes nest, like StatsScope.
+  class MemoryResourceScope {
+    private:
+      MemoryResource* previous;
+      MemoryResourceScope(const MemoryResourceScope&);
+      MemoryResourceScope& operator=(const MemoryResourceScope&);
+
+    public:
+      MemoryResourceScope(MemoryResource& resource);
+      explicit MemoryResourceScope(MemoryResource* resource); // NULL leaves the current one installed
+      ~MemoryResourceScope();
+  };
+
+  //
+  // MonotonicResource: hands out memory from big blocks and never gives any back until it's
+  // destroyed, which makes allocating nodes almost free (links and strings still go through malloc,
+  // see above). Good for a tree which lives as long as a request:
+  //
+  //   MonotonicResource arena;
+  //   MemoryResourceScope scope(arena);
+  //   NodeProgram program(code);
+  //   ...
+  //
+  // Everything made from it has to be gone by the time it is.
+  class MonotonicResource: public MemoryResource {
+    private:
+      std::vector<char*> blocks;
+      char* pos;
+      char* end;
+      size_t block_size;
+      MonotonicResource(const MonotonicResource&);
+      MonotonicResource& operator=(const MonotonicResource&);
+
+    public:
+      MonotonicResource(size_t block_size = 64 * 1024);
+      virtual ~MonotonicResource();
+      virtual void* allocate(size_t size);
+      virtual void deallocate(void* ptr, size_t size);
+  };
+}
@@ -18,7 +18,10 @@
 * @author Marcel Laverdet 
 */
 
+#include <pthread.h>
 #include "node.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 extern "C" char* g_fmt(char*, double);
 using namespace std;
@@ -26,39 +29,166 @@ using namespace fbjs;
 
 //
 // Node: All other nodes inherit from this.
-Node::Node(const unsigned int lineno /* = 0 */) : _lineno(lineno) {}
-
-Node::~Node() {
+Node::Node(const unsigned int lineno /* = 0 */) : _lineno(lineno), _from_resource(MemoryResource::current() != NULL) {
+  FBJS_STAT(nodes_allocated++);
+}
 
-  // Delete all children of this node recursively
-  for (node_list_t::iterator node = this->_childNodes.begin(); node != this->_childNodes.end(); ++node) {
-    delete *node;
+//
+// A node from a MemoryResource has a pointer to it just in front. Whether there is one is kept in the
+// node itself so that nodes from the global heap don't need it, but operator delete only runs once
+// the node is destroyed, so ~Node leaves a note of it here on the way out. A node whose constructor
+// throws before Node's has run is freed from inside the same `new`, and so from the same resource.
+namespace {
+  __thread const Node* deleting;
+  __thread bool deleting_from_resource;
+}
+
+void* Node::operator new(size_t size) {
+  MemoryResource* resource = MemoryResource::current();
+  if (resource == NULL) {
+    MemoryTracker::allocateNode(heapSize(size));
+    return ::operator new(size);
+  }
+  MemoryTracker::allocateNode(sizeof(MemoryResource*) + size);
+  MemoryResource** block = static_cast<MemoryResource**>(resource->allocate(sizeof(MemoryResource*) + size));
+  *block = resource;
+  return block + 1;
+}
+
+void Node::operator delete(void* ptr, size_t size) {
+  bool from_resource = ptr == deleting ? deleting_from_resource : MemoryResource::current() != NULL;
+  deleting = NULL;
+  if (!from_resource) {
+    MemoryTracker::release(heapSize(size));
+    ::operator delete(ptr);
+    return;
   }
+  MemoryTracker::release(sizeof(MemoryResource*) + size);
+  MemoryResource** block = static_cast<MemoryResource**>(ptr) - 1;
+  (*block)->deallocate(block, sizeof(MemoryResource*) + size);
 }
 
-Node* Node::clone(Node* node) const {
-  if (node == NULL) {
-    node = new Node();
+//
+// Children are freed from a worklist rather than recursively, so deleting a deep tree doesn't depend
+// on how much stack there is. A node's children are moved in front of it and it's only deleted once
+// they're gone, which frees everything in the same order the recursive version did and leaves each
+// destructor nothing to do.
+Node::~Node() {
+  node_list_t pending;
+  pending.swap(this->_childNodes);
+  while (!pending.empty()) {
+    Node* node = pending.front();
+    if (node != NULL && !node->_childNodes.empty()) {
+      pending.splice(pending.begin(), node->_childNodes);
+    } else {
+      pending.pop_front();
+      MemoryTracker::release(linkSize());
+      delete node;
+    }
   }
-  for (node_list_t::const_iterator i = const_cast<Node*>(this)->childNodes().begin(); i != const_cast<Node*>(this)->childNodes().end(); ++i) {
-    node->appendChild((*i) == NULL ? NULL : (*i)->clone());
+  deleting = this;
+  deleting_from_resource = this->_from_resource;
+}
+
+//
+// Also iterative. Copies are attached to their parent as soon as they're made, so if anything throws
+// the whole partial copy goes with `root`.
+namespace {
+
+  //
+  // Worklist for the iterative tree operations below. The first levels live in the object itself,
+  // so typical trees never allocate one; only very deep ones spill over to the heap.
+  template <typename T>
+  class node_stack_t {
+    static const size_t local_size = 64;
+    T local[local_size];
+    vector<T> spill;
+    size_t depth;
+
+    public:
+      node_stack_t() : depth(0) {}
+
+      bool empty() const {
+        return depth == 0;
+      }
+
+      T& back() {
+        return depth <= local_size ? local[depth - 1] : spill[depth - local_size - 1];
+      }
+
+      void push(const T& value) {
+        if (depth < local_size) {
+          local[depth] = value;
+        } else {
+          spill.push_back(value);
+        }
+        ++depth;
+      }
+
+      void pop() {
+        if (--depth >= local_size) {
+          spill.pop_back();
+        }
+      }
+  };
+
+  struct clone_frame_t {
+    node_list_t::const_iterator child;
+    node_list_t::const_iterator end;
+    Node* copy;
+  };
+}
+
+Node* Node::clone() const {
+  auto_ptr<Node> root(this->shallowClone());
+  node_stack_t<clone_frame_t> pending;
+  clone_frame_t top = {this->_childNodes.begin(), this->_childNodes.end(), root.get()};
+  pending.push(top);
+  while (!pending.empty()) {
+    clone_frame_t& frame = pending.back();
+    if (frame.child == frame.end) {
+      pending.pop();
+      continue;
+    }
+    const Node* source = *frame.child++;
+    if (source == NULL) {
+      frame.copy->appendChild(NULL);
+      continue;
+    }
+    Node* copy = source->shallowClone();
+    frame.copy->appendChild(copy);
+    if (!source->_childNodes.empty()) {
+      clone_frame_t next = {source->_childNodes.begin(), source->_childNodes.end(), copy};
+      pending.push(next);
+    }
   }
-  return node;
+  return root.release();
+}
+
+Node* Node::shallowClone() const {
+  return new Node();
+}
+
+size_t Node::stringSize() const {
+  return 0;
 }
 
 Node* Node::appendChild(Node* node) {
   this->_childNodes.push_back(node);
+  MemoryTracker::allocate(linkSize());
   return this;
 }
 
 Node* Node::prependChild(Node* node) {
   this->_childNodes.push_front(node);
+  MemoryTracker::allocate(linkSize());
   return this;
 }
 
 Node* Node::removeChild(node_list_t::iterator node_pos) {
   Node* node = (*node_pos);
   this->_childNodes.erase(node_pos);
+  MemoryTracker::release(linkSize());
   return node;
 }
 
@@ -69,6 +199,7 @@ Node* Node::replaceChild(Node* node, node_list_t::iterator node_pos) {
 
 Node* Node::insertBefore(Node* node, node_list_t::iterator node_pos) {
   this->_childNodes.insert(node_pos, node);
+  MemoryTracker::allocate(linkSize());
   return node;
 }
 
@@ -85,56 +216,82 @@ rope_t Node::render(node_render_enum opts /* = RENDER_NONE */) const {
 }
 
 rope_t Node::render(int opts) const {
+  string ret(this->renderString(opts));
+  return rope_t(ret.data(), ret.size());
+}
+
+//
+// Rendering is deterministic, so the first pass measures the output and the second writes it into
+// a buffer of exactly that size.
+string Node::renderString(int opts /* = RENDER_NONE */) const {
+  size_t size = this->renderSize(opts);
+  string ret(size + 1, '\0');
+  this->render(&ret[0], ret.size(), opts);
+  ret.resize(size);
+  return ret;
+}
+
+size_t Node::renderSize(int opts /* = RENDER_NONE */) const {
+  return this->render(NULL, 0, opts);
+}
+
+size_t Node::render(char* buffer, size_t size, int opts /* = RENDER_NONE */) const {
+  FBJS_STAT_PHASE("render");
+  FBJS_TRACE_EVENT(buffer == NULL ? "measure" : "render");
   render_guts_t guts;
   guts.pretty = opts & RENDER_PRETTY;
   guts.sanelineno = opts & RENDER_MAINTAIN_LINENO;
+  guts.minparens = opts & RENDER_MINIMAL_PARENS;
+  guts.noin = false;
+  guts.statement = (size_t)-1;
+  guts.functions = 0;
   guts.lineno = 1;
-  return this->render(&guts, 0);
+  guts.out = render_buffer_t(buffer, size == 0 ? 0 : size - 1);
+  this->render(&guts, 0);
+  if (buffer != NULL && size != 0) {
+    buffer[std::min(guts.out.size, size - 1)] = '\0';
+    FBJS_STAT(render_bytes += guts.out.size);
+  }
+  return guts.out.size;
 }
 
-rope_t Node::render(render_guts_t* guts, int indentation) const {
-  return this->_childNodes.front()->render(guts, indentation);
+void Node::render(render_guts_t* guts, int indentation) const {
+  this->_childNodes.front()->render(guts, indentation);
 }
 
-rope_t Node::renderBlock(bool must, render_guts_t* guts, int indentation) const {
+void Node::renderBlock(bool must, render_guts_t* guts, int indentation) const {
   if (!must && !guts->pretty) {
-    rope_t ret;
     if (guts->sanelineno) {
-      this->renderLinenoCatchup(guts, ret);
+      this->renderLinenoCatchup(guts);
     }
-    ret += this->renderStatement(guts, indentation);
-    return ret;
+    this->renderStatement(guts, indentation);
   } else {
-    rope_t ret(guts->pretty ? " {" : "{");
-    ret += this->renderIndentedStatement(guts, indentation + 1);
+    guts->out += guts->pretty ? " {" : "{";
+    this->renderIndentedStatement(guts, indentation + 1);
     if (guts->pretty || guts->sanelineno) {
       bool newline;
       if (guts->sanelineno) {
-        newline = this->renderLinenoCatchup(guts, ret);
+        newline = this->renderLinenoCatchup(guts);
       } else {
-        ret += "\n";
+        guts->out += '\n';
         newline = true;
       }
       if (guts->pretty && newline) {
-        for (int i = 0; i < indentation; ++i) {
-          ret += "  ";
-        }
+        this->renderIndentation(guts, indentation);
       }
     }
-    ret += "}";
-    return ret;
+    guts->out += '}';
   }
 }
 
-rope_t Node::renderIndentedStatement(render_guts_t* guts, int indentation) const {
+void Node::renderIndentedStatement(render_guts_t* guts, int indentation) const {
   if (guts->pretty || guts->sanelineno) {
-    rope_t ret;
     bool newline = false;
     if (guts->sanelineno) {
-      newline = this->renderLinenoCatchup(guts, ret);
+      newline = this->renderLinenoCatchup(guts);
     } else {
       if (guts->lineno == 2) {
-        ret += "\n";
+        guts->out += '\n';
         newline = true;
       } else {
         // Use lineno property to keep track of whether or not we're on the first line,
@@ -143,40 +300,118 @@ rope_t Node::renderIndentedStatement(render_guts_t* guts, int indentation) const
       }
     }
     if (guts->pretty && newline) {
-      for (int i = 0; i < indentation; ++i) {
-        ret += "  ";
-      }
+      this->renderIndentation(guts, indentation);
     }
-    return ret + this->renderStatement(guts, indentation);
-  } else {
-    return this->renderStatement(guts, indentation);
   }
+  this->renderStatement(guts, indentation);
 }
 
-rope_t Node::renderStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation);
+void Node::renderStatement(render_guts_t* guts, int indentation) const {
+  this->render(guts, indentation);
 }
 
-rope_t Node::renderImplodeChildren(render_guts_t* guts, int indentation, const char* glue) const {
-  rope_t ret;
+void Node::renderImplodeChildren(render_guts_t* guts, int indentation, const char* glue, int precedence /* = PRECEDENCE_COMMA */) const {
   node_list_t::const_iterator i = this->_childNodes.begin();
   while (i != this->_childNodes.end()) {
     if (*i != NULL) {
-      ret += (*i)->render(guts, indentation);
+      this->renderOperand(guts, indentation, *i, precedence);
     }
     i++;
     if (i != this->_childNodes.end()) {
-      ret += glue;
+      guts->out += glue;
     }
   }
-  return ret;
 }
 
-bool Node::renderLinenoCatchup(render_guts_t* guts, rope_t &rope) const {
+static const Node* unparenthesize(const Node* node) {
+  while (typeid(*node) == typeid(NodeParenthetical)) {
+    node = node->childNodes().front();
+  }
+  return node;
+}
+
+static int precedenceOf(const Node* node) {
+  const NodeExpression* expression = dynamic_cast<const NodeExpression*>(node);
+  return expression == NULL ? PRECEDENCE_PRIMARY : expression->precedence();
+}
+
+static bool isMemberExpression(const Node* node) {
+  return typeid(*node) == typeid(NodeStaticMemberExpression) || typeid(*node) == typeid(NodeDynamicMemberExpression);
+}
+
+//
+// a.b is a member expression unless `a` has a call in it; that matters to `new`. Member expressions
+// are always PRECEDENCE_CALL or tighter, which is all a chain ever asks of its operand, so
+// renderChain() doesn't need to work this out for them.
+static int memberPrecedence(const Node* object) {
+  object = unparenthesize(object);
+  while (isMemberExpression(object)) {
+    object = unparenthesize(object->childNodes().front());
+  }
+  return precedenceOf(object) == PRECEDENCE_CALL ? PRECEDENCE_CALL : PRECEDENCE_MEMBER;
+}
+
+//
+// Renders a subexpression in a position which only takes expressions of `precedence` or tighter.
+// With RENDER_MINIMAL_PARENS the source's parentheses are dropped and only the ones the grammar
+// needs are written, otherwise this is just render().
+void Node::renderOperand(render_guts_t* guts, int indentation, const Node* operand, int precedence) const {
+  if (!guts->minparens) {
+    operand->render(guts, indentation);
+    return;
+  }
+  operand = unparenthesize(operand);
+  if (precedenceOf(operand) < precedence) {
+    bool noin = guts->noin;
+    guts->noin = false;
+    guts->out += '(';
+    operand->render(guts, indentation);
+    guts->out += ')';
+    guts->noin = noin;
+  } else {
+    operand->render(guts, indentation);
+  }
+}
+
+//
+// The spine goes down as long as each first child is itself a chain which would be rendered without
+// parentheses. The operand at the bottom is rendered as usual, then every tail on the way back up.
+void Node::renderChain(render_guts_t* guts, int indentation) const {
+  vector<const Node*> spine(1, this);
+  int precedence;
+  const Node* operand = this->chainOperand(guts, &precedence);
+  for (;;) {
+    const Node* next = guts->minparens ? unparenthesize(operand) : operand;
+    int next_precedence;
+    const Node* next_operand = next->chainOperand(guts, &next_precedence);
+    if (next_operand == NULL || (guts->minparens && !isMemberExpression(next) && precedenceOf(next) < precedence)) {
+      break;
+    }
+    spine.push_back(next);
+    operand = next_operand;
+    precedence = next_precedence;
+  }
+  spine.back()->renderOperand(guts, indentation, operand, precedence);
+  for (vector<const Node*>::reverse_iterator ii = spine.rbegin(); ii != spine.rend(); ++ii) {
+    (*ii)->renderChainTail(guts, indentation);
+  }
+}
+
+const Node* Node::chainOperand(const render_guts_t* guts, int* precedence) const {
+  return NULL;
+}
+
+void Node::renderChainTail(render_guts_t* guts, int indentation) const {}
+
+void Node::renderIndentation(render_guts_t* guts, int indentation) const {
+  guts->out.fill(indentation * 2, ' ');
+}
+
+bool Node::renderLinenoCatchup(render_guts_t* guts) const {
   if (!this->lineno() || guts->lineno >= this->lineno()) {
     return false;
   }
-  rope += rope_t(this->lineno() - guts->lineno, '\n');
+  guts->out.fill(this->lineno() - guts->lineno, '\n');
   guts->lineno = this->lineno();
   return true;
 }
@@ -185,91 +420,99 @@ unsigned int Node::lineno() const {
   return this->_lineno;
 }
 
+//
+// Iterative like clone(), comparing pairs of nodes off a stack
 bool Node::operator== (const Node &that) const {
-  if (typeid(*this) != typeid(that)) {
-    return false;
-  }
-  node_list_t::iterator jj = that.childNodes().begin();
-  for (node_list_t::iterator ii = this->childNodes().begin(); ii != this->childNodes().end(); ++ii) {
-    if (**jj != **ii) {
-      return false;
-    }
-    if (++jj == that.childNodes().end()) {
-      if (++ii != this->childNodes().end()) {
+  node_stack_t<pair<const Node*, const Node*> > pending;
+  pending.push(make_pair(this, &that));
+  while (!pending.empty()) {
+    const Node* left = pending.back().first;
+    const Node* right = pending.back().second;
+    pending.pop();
+    if (left == NULL || right == NULL) {
+      if (left != right) {
         return false;
       }
-      break;
+      continue;
+    }
+    if (typeid(*left) != typeid(*right) || !left->shallowEquals(*right)) {
+      return false;
+    }
+    node_list_t::const_iterator ii = left->_childNodes.begin();
+    node_list_t::const_iterator jj = right->_childNodes.begin();
+    for (; ii != left->_childNodes.end() && jj != right->_childNodes.end(); ++ii, ++jj) {
+      pending.push(make_pair(*ii, *jj));
+    }
+    if (ii != left->_childNodes.end() || jj != right->_childNodes.end()) {
+      return false;
     }
   }
   return true;
 }
 
+bool Node::shallowEquals(const Node &that) const {
+  return true;
+}
+
 bool Node::operator!= (const Node &that) const {
   return !(*this == that);
 }
 
 //
 // NodeProgram: a javascript program
-NodeProgram::NodeProgram() : Node(1) {}
-Node* NodeProgram::clone(Node* node) const {
-  return Node::clone(new NodeProgram());
+NodeProgram::NodeProgram() : Node(1), _peak(0) {}
+Node* NodeProgram::shallowClone() const {
+  return new NodeProgram();
 }
 
 //
 // NodeStatementList: a list of statements
 NodeStatementList::NodeStatementList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeStatementList::clone(Node* node) const {
-  return Node::clone(new NodeStatementList());
+Node* NodeStatementList::shallowClone() const {
+  return new NodeStatementList();
 }
 
-rope_t NodeStatementList::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeStatementList::render(render_guts_t* guts, int indentation) const {
   for (node_list_t::const_iterator i = this->_childNodes.begin(); i != this->_childNodes.end(); ++i) {
     if (*i != NULL) {
-      ret += (*i)->renderIndentedStatement(guts, indentation);
+      (*i)->renderIndentedStatement(guts, indentation);
     }
   }
-  return ret;
 }
 
-rope_t NodeStatementList::renderBlock(bool must, render_guts_t* guts, int indentation) const {
+void NodeStatementList::renderBlock(bool must, render_guts_t* guts, int indentation) const {
   if (!must && this->empty()) {
-    return rope_t(";");
+    guts->out += ';';
   } else if (!must && !guts->pretty && this->_childNodes.front() == this->_childNodes.back()) {
-    rope_t ret;
     if (guts->sanelineno) {
-      this->renderLinenoCatchup(guts, ret);
+      this->renderLinenoCatchup(guts);
     }
-    ret += this->_childNodes.front()->renderBlock(must, guts, indentation);
-    return ret;
+    this->_childNodes.front()->renderBlock(must, guts, indentation);
   } else {
-    rope_t ret(guts->pretty ? " {" : "{");
-    ret += this->renderIndentedStatement(guts, indentation + 1);
+    guts->out += guts->pretty ? " {" : "{";
+    this->renderIndentedStatement(guts, indentation + 1);
     if (guts->pretty || guts->sanelineno) {
       bool newline;
       if (guts->sanelineno) {
-        newline = this->renderLinenoCatchup(guts, ret);
+        newline = this->renderLinenoCatchup(guts);
       } else {
-        ret += "\n";
+        guts->out += '\n';
         newline = true;
       }
       if (guts->pretty && newline) {
-        for (int i = 0; i < indentation; ++i) {
-          ret += "  ";
-        }
+        this->renderIndentation(guts, indentation);
       }
     }
-    ret += "}";
-    return ret;
+    guts->out += '}';
   }
 }
 
-rope_t NodeStatementList::renderIndentedStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation);
+void NodeStatementList::renderIndentedStatement(render_guts_t* guts, int indentation) const {
+  this->render(guts, indentation);
 }
 
-rope_t NodeStatementList::renderStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation);
+void NodeStatementList::renderStatement(render_guts_t* guts, int indentation) const {
+  this->render(guts, indentation);
 }
 
 //
@@ -280,140 +523,173 @@ bool NodeExpression::isValidlVal() const {
   return false;
 }
 
-rope_t NodeExpression::renderStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation) + ";";
+void NodeExpression::renderStatement(render_guts_t* guts, int indentation) const {
+  guts->statement = guts->out.size;
+  this->render(guts, indentation);
+  guts->out += ';';
 }
 
 bool NodeExpression::compare(bool val) const {
   return false;
 }
 
+int NodeExpression::precedence() const {
+  return PRECEDENCE_PRIMARY;
+}
+
 //
 // NodeNumericLiteral: it's a number. like 5. or 3.
 NodeNumericLiteral::NodeNumericLiteral(double value, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value) {}
 
-Node* NodeNumericLiteral::clone(Node* node) const {
+Node* NodeNumericLiteral::shallowClone() const {
   return new NodeNumericLiteral(this->value);
 }
 
-rope_t NodeNumericLiteral::render(render_guts_t* guts, int indentation) const {
+// dtoa() keeps its Bigint freelist in statics unless it's built with MULTIPLE_THREADS and lock hooks,
+// and this is its only caller
+static pthread_mutex_t g_fmt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void NodeNumericLiteral::render(render_guts_t* guts, int indentation) const {
   char buf[32];
+  pthread_mutex_lock(&g_fmt_mutex);
   g_fmt(buf, this->value);
-  return rope_t(buf);
+  pthread_mutex_unlock(&g_fmt_mutex);
+  guts->out += buf;
 }
 
 bool NodeNumericLiteral::compare(bool val) const {
-  return val ? this->value != 0 : this->value == 0;
+  // NaN is falsy, and it's also the only value which isn't equal to itself
+  return val ? this->value != 0 && this->value == this->value : this->value == 0 || this->value != this->value;
 }
 
-bool NodeNumericLiteral::operator== (const Node &that) const {
-  const NodeNumericLiteral* thatLiteral = dynamic_cast<const NodeNumericLiteral*>(&that);
-  return thatLiteral == NULL ? false : this->value == thatLiteral->value;
+bool NodeNumericLiteral::shallowEquals(const Node &that) const {
+  const NodeNumericLiteral* thatLiteral = static_cast<const NodeNumericLiteral*>(&that);
+  return this->value == thatLiteral->value;
 }
 
 //
 // NodeStringLiteral: "Hello."
-NodeStringLiteral::NodeStringLiteral(const string &value, bool quoted, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), quoted(quoted) {}
+NodeStringLiteral::NodeStringLiteral(const string &value, bool quoted, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), quoted(quoted) {
+  FBJS_STAT(string_bytes += value.size());
+  MemoryTracker::allocate(this->stringSize());
+}
 
-Node* NodeStringLiteral::clone(Node* node) const {
+NodeStringLiteral::~NodeStringLiteral() {
+  MemoryTracker::release(this->stringSize());
+}
+
+size_t NodeStringLiteral::stringSize() const {
+  return heapSize(this->value);
+}
+
+Node* NodeStringLiteral::shallowClone() const {
   return new NodeStringLiteral(this->value, this->quoted);
 }
 
-rope_t NodeStringLiteral::render(render_guts_t* guts, int indentation) const {
+void NodeStringLiteral::render(render_guts_t* guts, int indentation) const {
   if (this->quoted) {
-    return rope_t(this->value.c_str());
-  } else {
-    const char *val = this->value.c_str();
-    size_t len = 0;
-    for (const char* ii = val; *ii; ++ii) {
-      if (*ii < 32) {
-        switch (*ii) {
-          case '\'': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
-            len += 2;
-            break;
-          default:
-            len += 4;
-        }
-      } else {
-        ++len;
-      }
+    guts->out += this->value;
+    return;
+  }
+
+  // Copy runs of plain characters at once and escape the rest
+  const char* val = this->value.data();
+  const char* end = val + this->value.size();
+  const char* run = val;
+  guts->out += '"';
+  for (; val != end; ++val) {
+    unsigned char ch = *val;
+    if (ch >= 32 && ch != '"' && ch != '\\') {
+      continue;
     }
-    if (len == this->value.size()) {
-    return rope_t("\"") + this->value.c_str() + "\"";
-    } else {
-      char *new_str = new char[len + 1];
-      char *ii = new_str;
-      new_str[len] = 0;
-      for (; *val; ++val) {
-        if (*val == '\'') {
-          sprintf(ii, "\\'");
-          ii += 2;
-        } else if (*val == '\\') {
-          sprintf(ii, "\\'");
-          ii += 2;
-        } else if (*val == '\b') {
-          sprintf(ii, "\\b");
-          ii += 2;
-        } else if (*val == '\f') {
-          sprintf(ii, "\\f");
-          ii += 2;
-        } else if (*val == '\n') {
-          sprintf(ii, "\\n");
-          ii += 2;
-        } else if (*val == '\r') {
-          sprintf(ii, "\\r");
-          ii += 2;
-        } else if (*val == '\t') {
-          sprintf(ii, "\\t");
-          ii += 2;
-        } else if (*val < 32) {
-          sprintf(ii, "\\x%02x", *val);
-          ii += 4;
-        } else {
-          *ii = *val;
-          ++ii;
-        }
-      }
-      rope_t ret("\"");
-      ret += new_str;
-      ret += "\"";
-      delete[] new_str;
-      return ret;
+    guts->out.append(run, val - run);
+    run = val + 1;
+    switch (ch) {
+      case '"':
+        guts->out += "\\\"";
+        break;
+      case '\\':
+        guts->out += "\\\\";
+        break;
+      case '\b':
+        guts->out += "\\b";
+        break;
+      case '\f':
+        guts->out += "\\f";
+        break;
+      case '\n':
+        guts->out += "\\n";
+        break;
+      case '\r':
+        guts->out += "\\r";
+        break;
+      case '\t':
+        guts->out += "\\t";
+        break;
+      default:
+        char buf[5];
+        sprintf(buf, "\\x%02x", ch);
+        guts->out.append(buf, 4);
     }
   }
+  guts->out.append(run, val - run);
+  guts->out += '"';
+}
+
+bool NodeStringLiteral::compare(bool val) const {
+  // Escapes always decode to at least one character, so only "" is falsy
+  return val ? !this->unquoted_value().empty() : this->unquoted_value().empty();
 }
 
-bool NodeStringLiteral::operator== (const Node &that) const {
-  const NodeStringLiteral* thatLiteral = dynamic_cast<const NodeStringLiteral*>(&that);
-  return thatLiteral == NULL ? false : this->value == thatLiteral->value;
+bool NodeStringLiteral::shallowEquals(const Node &that) const {
+  const NodeStringLiteral* thatLiteral = static_cast<const NodeStringLiteral*>(&that);
+  return this->value == thatLiteral->value;
 }
 
 //
 // NodeRegexLiteral: /foo|bar/
-NodeRegexLiteral::NodeRegexLiteral(const string &value, const string &flags, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), flags(flags) {}
+NodeRegexLiteral::NodeRegexLiteral(const string &value, const string &flags, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), flags(flags) {
+  FBJS_STAT(string_bytes += value.size() + flags.size());
+  MemoryTracker::allocate(this->stringSize());
+}
 
-Node* NodeRegexLiteral::clone(Node* node) const {
+NodeRegexLiteral::~NodeRegexLiteral() {
+  MemoryTracker::release(this->stringSize());
+}
+
+size_t NodeRegexLiteral::stringSize() const {
+  return heapSize(this->value) + heapSize(this->flags);
+}
+
+Node* NodeRegexLiteral::shallowClone() const {
   return new NodeRegexLiteral(this->value, this->flags);
 }
 
-rope_t NodeRegexLiteral::render(render_guts_t* guts, int indentation) const {
-  return rope_t("/") + this->value.c_str() + "/" + this->flags.c_str();
+void NodeRegexLiteral::render(render_guts_t* guts, int indentation) const {
+  guts->out += '/';
+  guts->out += this->value;
+  guts->out += '/';
+  guts->out += this->flags;
 }
 
-bool NodeRegexLiteral::operator== (const Node &that) const {
-  const NodeRegexLiteral* thatLiteral = dynamic_cast<const NodeRegexLiteral*>(&that);
-  return thatLiteral == NULL ? false : this->value == thatLiteral->value && this->flags == thatLiteral->flags;
+bool NodeRegexLiteral::compare(bool val) const {
+  return val;
+}
+
+bool NodeRegexLiteral::shallowEquals(const Node &that) const {
+  const NodeRegexLiteral* thatLiteral = static_cast<const NodeRegexLiteral*>(&that);
+  return this->value == thatLiteral->value && this->flags == thatLiteral->flags;
 }
 
 //
 // NodeBooleanLiteral: true or false
 NodeBooleanLiteral::NodeBooleanLiteral(bool value, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value) {}
 
-rope_t NodeBooleanLiteral::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->value ? "true" : "false");
+void NodeBooleanLiteral::render(render_guts_t* guts, int indentation) const {
+  guts->out += this->value ? "true" : "false";
 }
 
-Node* NodeBooleanLiteral::clone(Node* node) const {
+Node* NodeBooleanLiteral::shallowClone() const {
   return new NodeBooleanLiteral(this->value);
 }
 
@@ -421,65 +697,90 @@ bool NodeBooleanLiteral::compare(bool val) const {
   return val == this->value;
 }
 
-bool NodeBooleanLiteral::operator== (const Node &that) const {
-  const NodeBooleanLiteral* thatLiteral = dynamic_cast<const NodeBooleanLiteral*>(&that);
-  return thatLiteral == NULL ? false : this->value == thatLiteral->value;
+bool NodeBooleanLiteral::shallowEquals(const Node &that) const {
+  const NodeBooleanLiteral* thatLiteral = static_cast<const NodeBooleanLiteral*>(&that);
+  return this->value == thatLiteral->value;
 }
 
 //
 // NodeNullLiteral: null
 NodeNullLiteral::NodeNullLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeNullLiteral::clone(Node* node) const {
-  return Node::clone(new NodeNullLiteral());
+Node* NodeNullLiteral::shallowClone() const {
+  return new NodeNullLiteral();
+}
+
+void NodeNullLiteral::render(render_guts_t* guts, int indentation) const {
+  guts->out += "null";
 }
 
-rope_t NodeNullLiteral::render(render_guts_t* guts, int indentation) const {
-  return rope_t("null");
+bool NodeNullLiteral::compare(bool val) const {
+  return !val;
 }
 
 //
 // NodeThis: this
 NodeThis::NodeThis(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeThis::clone(Node* node) const {
-  return Node::clone(new NodeThis());
+Node* NodeThis::shallowClone() const {
+  return new NodeThis();
 }
 
-rope_t NodeThis::render(render_guts_t* guts, int indentation) const {
-  return rope_t("this");
+void NodeThis::render(render_guts_t* guts, int indentation) const {
+  guts->out += "this";
 }
 
 //
 // NodeEmptyExpression
 NodeEmptyExpression::NodeEmptyExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeEmptyExpression::clone(Node* node) const {
-  return Node::clone(new NodeEmptyExpression());
+Node* NodeEmptyExpression::shallowClone() const {
+  return new NodeEmptyExpression();
 }
 
-rope_t NodeEmptyExpression::render(render_guts_t* guts, int indentation) const {
-  return rope_t();
+void NodeEmptyExpression::render(render_guts_t* guts, int indentation) const {
 }
 
-rope_t NodeEmptyExpression::renderBlock(bool must, render_guts_t* guts, int indentation) const {
-  return rope_t(";");
+void NodeEmptyExpression::renderBlock(bool must, render_guts_t* guts, int indentation) const {
+  guts->out += ';';
 }
 
 //
 // NodeOperator: expression <op> expression
 NodeOperator::NodeOperator(node_operator_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
 
-Node* NodeOperator::clone(Node* node) const {
-  return Node::clone(new NodeOperator(this->op));
+Node* NodeOperator::shallowClone() const {
+  return new NodeOperator(this->op);
 }
 
-rope_t NodeOperator::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeOperator::render(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
+  if (this->op == IN && guts->noin) {
+    // `for (a in b;;)` would be read as a for-in loop
+    guts->noin = false;
+    ret += '(';
+    this->render(guts, indentation);
+    ret += ')';
+    guts->noin = true;
+    return;
+  }
+  this->renderChain(guts, indentation);
+}
+
+const Node* NodeOperator::chainOperand(const render_guts_t* guts, int* precedence) const {
+  if (this->op == IN && guts->noin) {
+    return NULL;
+  }
+  *precedence = this->precedence();
+  return this->_childNodes.front();
+}
+
+void NodeOperator::renderChainTail(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
+  int precedence = this->precedence();
   bool padding = true;
-  ret += this->_childNodes.front()->render(guts, indentation);
   if (guts->pretty) {
     padding = false;
     if (this->op != COMMA) {
-    ret += " ";
-  }
+      ret += ' ';
+    }
   }
   switch (this->op) {
     case COMMA:
@@ -579,43 +880,97 @@ rope_t NodeOperator::render(render_guts_t* guts, int indentation) const {
       break;
   }
   if (!padding) {
-    ret += " ";
+    ret += ' ';
+  } else if (this->op == PLUS || this->op == MINUS) {
+    // a - -b and a + ++b would otherwise be read as a decrement and an increment
+    ret.space_if = this->op == PLUS ? '+' : '-';
   }
-  ret += this->_childNodes.back()->render(guts, indentation);
-  return ret;
+  // Everything here is left-associative so the right operand has to bind tighter
+  this->renderOperand(guts, indentation, this->_childNodes.back(), precedence + 1);
+}
+
+int NodeOperator::precedence() const {
+  switch (this->op) {
+    case COMMA:
+      return PRECEDENCE_COMMA;
+    case OR:
+      return PRECEDENCE_OR;
+    case AND:
+      return PRECEDENCE_AND;
+    case BIT_OR:
+      return PRECEDENCE_BIT_OR;
+    case BIT_XOR:
+      return PRECEDENCE_BIT_XOR;
+    case BIT_AND:
+      return PRECEDENCE_BIT_AND;
+    case EQUAL:
+    case NOT_EQUAL:
+    case STRICT_EQUAL:
+    case STRICT_NOT_EQUAL:
+      return PRECEDENCE_EQUALITY;
+    case LESS_THAN_EQUAL:
+    case GREATER_THAN_EQUAL:
+    case LESS_THAN:
+    case GREATER_THAN:
+    case IN:
+    case INSTANCEOF:
+      return PRECEDENCE_RELATIONAL;
+    case LSHIFT:
+    case RSHIFT:
+    case RSHIFT3:
+      return PRECEDENCE_SHIFT;
+    case PLUS:
+    case MINUS:
+      return PRECEDENCE_ADDITIVE;
+    case DIV:
+    case MULT:
+    case MOD:
+      return PRECEDENCE_MULTIPLICATIVE;
+  }
+  return PRECEDENCE_PRIMARY;
 }
 
-bool NodeOperator::operator== (const Node &that) const {
-  return Node::operator==(that) && this->op == static_cast<const NodeOperator*>(&that)->op;
+bool NodeOperator::shallowEquals(const Node &that) const {
+  return this->op == static_cast<const NodeOperator&>(that).op;
 }
 
 //
 // NodeConditionalExpression: true ? yes() : no()
 NodeConditionalExpression::NodeConditionalExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeConditionalExpression::clone(Node* node) const {
-  return Node::clone(new NodeConditionalExpression());
+Node* NodeConditionalExpression::shallowClone() const {
+  return new NodeConditionalExpression();
 }
 
-rope_t NodeConditionalExpression::render(render_guts_t* guts, int indentation) const {
+void NodeConditionalExpression::render(render_guts_t* guts, int indentation) const {
   node_list_t::const_iterator node = this->_childNodes.begin();
-  rope_t ret((*node)->render(guts, indentation));
-  ret += rope_t(guts->pretty ? " ? " : "?") +
-    (*++node)->render(guts, indentation) +
-    (guts->pretty ? " : " : ":");
-  ret += (*++node)->render(guts, indentation);
-  return ret;
+  this->renderOperand(guts, indentation, *node, PRECEDENCE_OR);
+  guts->out += guts->pretty ? " ? " : "?";
+  this->renderOperand(guts, indentation, *++node, PRECEDENCE_ASSIGNMENT);
+  guts->out += guts->pretty ? " : " : ":";
+  this->renderOperand(guts, indentation, *++node, PRECEDENCE_ASSIGNMENT);
+}
+
+int NodeConditionalExpression::precedence() const {
+  return PRECEDENCE_CONDITIONAL;
 }
 
 //
 // NodeParenthetical: an expression in ()'s. This is actually implicit in the AST, but we also make it an explicit
-// node. Otherwise, the renderer would have to be aware of operator precedence which would be cumbersome.
+// node so the default renderer doesn't need to know about precedence. RENDER_MINIMAL_PARENS ignores these and
+// uses renderOperand() instead.
 NodeParenthetical::NodeParenthetical(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeParenthetical::clone(Node* node) const {
-  return Node::clone(new NodeParenthetical());
+Node* NodeParenthetical::shallowClone() const {
+  return new NodeParenthetical();
 }
 
-rope_t NodeParenthetical::render(render_guts_t* guts, int indentation) const {
-  return rope_t("(") + this->_childNodes.front()->render(guts, indentation) + ")";
+void NodeParenthetical::render(render_guts_t* guts, int indentation) const {
+  if (guts->minparens) {
+    this->_childNodes.front()->render(guts, indentation);
+    return;
+  }
+  guts->out += '(';
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += ')';
 }
 
 bool NodeParenthetical::isValidlVal() const {
@@ -630,15 +985,15 @@ bool NodeParenthetical::compare(bool val) const {
 // NodeAssignment: identifier = expression
 NodeAssignment::NodeAssignment(node_assignment_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
 
-Node* NodeAssignment::clone(Node* node) const {
-  return Node::clone(new NodeAssignment(this->op));
+Node* NodeAssignment::shallowClone() const {
+  return new NodeAssignment(this->op);
 }
 
-rope_t NodeAssignment::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
-  ret += this->_childNodes.front()->render(guts, indentation);
+void NodeAssignment::render(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
+  this->renderOperand(guts, indentation, this->_childNodes.front(), PRECEDENCE_CALL);
   if (guts->pretty) {
-    ret += " ";
+    ret += ' ';
   }
   switch (this->op) {
     case ASSIGN:
@@ -690,26 +1045,29 @@ rope_t NodeAssignment::render(render_guts_t* guts, int indentation) const {
       break;
   }
   if (guts->pretty) {
-    ret += " ";
+    ret += ' ';
   }
-  ret += this->_childNodes.back()->render(guts, indentation);
-  return ret;
+  this->renderOperand(guts, indentation, this->_childNodes.back(), PRECEDENCE_ASSIGNMENT);
 }
 
-bool NodeAssignment::operator== (const Node &that) const {
-  return Node::operator==(that) && this->op == static_cast<const NodeAssignment*>(&that)->op;
+int NodeAssignment::precedence() const {
+  return PRECEDENCE_ASSIGNMENT;
+}
+
+bool NodeAssignment::shallowEquals(const Node &that) const {
+  return this->op == static_cast<const NodeAssignment&>(that).op;
 }
 
 //
 // NodeUnary
 NodeUnary::NodeUnary(node_unary_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
 
-Node* NodeUnary::clone(Node* node) const {
-  return Node::clone(new NodeUnary(this->op));
+Node* NodeUnary::shallowClone() const {
+  return new NodeUnary(this->op);
 }
 
-rope_t NodeUnary::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeUnary::render(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
   bool need_space = false;
   switch(this->op) {
     case DELETE:
@@ -743,52 +1101,85 @@ rope_t NodeUnary::render(render_guts_t* guts, int indentation) const {
       ret += "!";
       break;
   }
-  if (need_space && dynamic_cast<NodeParenthetical*>(this->_childNodes.front()) == NULL) {
-    ret += " ";
+  if (need_space && guts->minparens) {
+    ret.space_unless = "(";
+  } else if (need_space && dynamic_cast<NodeParenthetical*>(this->_childNodes.front()) == NULL) {
+    ret += ' ';
+  } else if (this->op == PLUS_UNARY || this->op == MINUS_UNARY) {
+    // - -a is not the same as --a
+    ret.space_if = this->op == PLUS_UNARY ? '+' : '-';
   }
-  ret += this->_childNodes.front()->render(guts, indentation);
-  return ret;
+  this->renderOperand(guts, indentation, this->_childNodes.front(), PRECEDENCE_UNARY);
 }
 
-bool NodeUnary::operator== (const Node &that) const {
-  return Node::operator==(that) && this->op == static_cast<const NodeUnary*>(&that)->op;
+int NodeUnary::precedence() const {
+  return PRECEDENCE_UNARY;
+}
+
+bool NodeUnary::compare(bool val) const {
+  switch (this->op) {
+    case NOT_UNARY:
+      return static_cast<NodeExpression*>(this->_childNodes.front())->compare(!val);
+    case VOID:
+      return !val;
+    default:
+      return false;
+  }
+}
+
+bool NodeUnary::shallowEquals(const Node &that) const {
+  return this->op == static_cast<const NodeUnary&>(that).op;
 }
 
 //
 // NodePostfix
 NodePostfix::NodePostfix(node_postfix_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
 
-Node* NodePostfix::clone(Node* node) const {
-  return Node::clone(new NodePostfix(this->op));
+Node* NodePostfix::shallowClone() const {
+  return new NodePostfix(this->op);
 }
 
-rope_t NodePostfix::render(render_guts_t* guts, int indentation) const {
-  rope_t ret(this->_childNodes.front()->render(guts, indentation));
+void NodePostfix::render(render_guts_t* guts, int indentation) const {
+  this->renderOperand(guts, indentation, this->_childNodes.front(), PRECEDENCE_CALL);
   switch (this->op) {
     case INCR_POSTFIX:
-      ret += "++";
+      guts->out += "++";
       break;
     case DECR_POSTFIX:
-      ret += "--";
+      guts->out += "--";
       break;
   }
-  return ret;
 }
 
-bool NodePostfix::operator== (const Node &that) const {
-  return Node::operator==(that) && this->op == static_cast<const NodePostfix*>(&that)->op;
+int NodePostfix::precedence() const {
+  return PRECEDENCE_POSTFIX;
+}
+
+bool NodePostfix::shallowEquals(const Node &that) const {
+  return this->op == static_cast<const NodePostfix&>(that).op;
 }
 
 //
 // NodeIdentifier
-NodeIdentifier::NodeIdentifier(const string &name, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), _name(name) {}
+NodeIdentifier::NodeIdentifier(const string &name, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), _name(name) {
+  FBJS_STAT(string_bytes += name.size());
+  MemoryTracker::allocate(this->stringSize());
+}
+
+NodeIdentifier::~NodeIdentifier() {
+  MemoryTracker::release(this->stringSize());
+}
+
+size_t NodeIdentifier::stringSize() const {
+  return heapSize(this->_name);
+}
 
-Node* NodeIdentifier::clone(Node* node) const {
-  return Node::clone(new NodeIdentifier(this->_name));
+Node* NodeIdentifier::shallowClone() const {
+  return new NodeIdentifier(this->_name);
 }
 
-rope_t NodeIdentifier::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_name.c_str());
+void NodeIdentifier::render(render_guts_t* guts, int indentation) const {
+  guts->out += this->_name;
 }
 
 const string& NodeIdentifier::name() const {
@@ -800,101 +1191,171 @@ bool NodeIdentifier::isValidlVal() const {
 }
 
 void NodeIdentifier::rename(const string &str) {
+  FBJS_STAT(string_bytes += str.size());
+  size_t before = this->stringSize();
   this->_name = str;
+  MemoryTracker::resize(before, this->stringSize());
 }
 
-bool NodeIdentifier::operator== (const Node &that) const {
-  const NodeIdentifier* thatIdentifier = dynamic_cast<const NodeIdentifier*>(&that);
-  return thatIdentifier == NULL ? false : this->_name == thatIdentifier->_name;
+bool NodeIdentifier::shallowEquals(const Node &that) const {
+  const NodeIdentifier* thatIdentifier = static_cast<const NodeIdentifier*>(&that);
+  return this->_name == thatIdentifier->_name;
 }
 
 //
 // NodeArgList: list of expressions for a function call or definition
 NodeArgList::NodeArgList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeArgList::clone(Node* node) const {
-  return Node::clone(new NodeArgList());
-}
+Node* NodeArgList::shallowClone() const {
+  return new NodeArgList();
+}
+
+void NodeArgList::render(render_guts_t* guts, int indentation) const {
+  bool noin = guts->noin;
+  guts->noin = false;
+  guts->out += '(';
+  this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",", PRECEDENCE_ASSIGNMENT);
+  guts->out += ')';
+  guts->noin = noin;
+}
+
+#ifdef FBJS_TRACING
+namespace {
+
+  //
+  // With TRACE_FUNCTIONS, each function that isn't inside another one is traced while it renders.
+  // Lambdas only have a name if they were given one.
+  class function_trace_t {
+    private:
+      render_guts_t* guts;
+      TraceEvent event;
+
+    public:
+      function_trace_t(render_guts_t* guts, const Node* function) : guts(guts) {
+        if (guts->functions++ == 0 && Tracer::tracing(TRACE_FUNCTIONS)) {
+          const NodeIdentifier* name = dynamic_cast<const NodeIdentifier*>(function->childNodes().front());
+          char line[32];
+          snprintf(line, sizeof(line), "line %u", function->lineno());
+          event.start(name == NULL ? "function" : "function " + name->name(), line);
+        }
+      }
 
-rope_t NodeArgList::render(render_guts_t* guts, int indentation) const {
-  return rope_t("(") + this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",") + ")";
+      ~function_trace_t() {
+        --guts->functions;
+      }
+  };
 }
+#define FBJS_TRACE_FUNCTION(guts, function) function_trace_t fbjs_trace_function(guts, function)
+#else
+#define FBJS_TRACE_FUNCTION(guts, function)
+#endif
 
 //
 // NodeFunctionDeclaration: brings a function into scope
 NodeFunctionDeclaration::NodeFunctionDeclaration(const unsigned int lineno /* = 0 */) : Node(lineno) {}
 
-Node* NodeFunctionDeclaration::clone(Node* node) const {
-  return Node::clone(new NodeFunctionDeclaration());
+Node* NodeFunctionDeclaration::shallowClone() const {
+  return new NodeFunctionDeclaration();
 }
 
-rope_t NodeFunctionDeclaration::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeFunctionDeclaration::render(render_guts_t* guts, int indentation) const {
+  FBJS_TRACE_FUNCTION(guts, this);
   node_list_t::const_iterator node = this->_childNodes.begin();
 
-  ret += rope_t("function ") + (*node)->render(guts, indentation);
-  ret += (*++node)->render(guts, indentation);
-  ret += (*++node)->renderBlock(true, guts, indentation);
-  return ret;
+  guts->out += "function ";
+  (*node)->render(guts, indentation);
+  (*++node)->render(guts, indentation);
+  (*++node)->renderBlock(true, guts, indentation);
 }
 
 //
 // NodeFunctionExpression: returns a function
 NodeFunctionExpression::NodeFunctionExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeFunctionExpression::clone(Node* node) const {
-  return Node::clone(new NodeFunctionExpression());
+Node* NodeFunctionExpression::shallowClone() const {
+  return new NodeFunctionExpression();
 }
 
-rope_t NodeFunctionExpression::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeFunctionExpression::render(render_guts_t* guts, int indentation) const {
+  FBJS_TRACE_FUNCTION(guts, this);
   node_list_t::const_iterator node = this->_childNodes.begin();
 
-  ret += "function";
+  // A statement that starts with `function` is a declaration
+  bool wrap = guts->minparens && guts->out.size == guts->statement;
+  bool noin = guts->noin;
+  guts->noin = false;
+  if (wrap) {
+    guts->out += '(';
+  }
+  guts->out += "function";
   if (*node != NULL) {
-    ret += rope_t(" ") + (*node)->render(guts, indentation);
+    guts->out += ' ';
+    (*node)->render(guts, indentation);
   }
-  ret += (*++node)->render(guts, indentation);
-  ret += (*++node)->renderBlock(true, guts, indentation);
-  return ret;
+  (*++node)->render(guts, indentation);
+  (*++node)->renderBlock(true, guts, indentation);
+  if (wrap) {
+    guts->out += ')';
+  }
+  guts->noin = noin;
 }
 
 //
 // NodeFunctionCall: foo(1). note: this does not cover new foo(1);
 NodeFunctionCall::NodeFunctionCall(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeFunctionCall::clone(Node* node) const {
-  return Node::clone(new NodeFunctionCall());
+Node* NodeFunctionCall::shallowClone() const {
+  return new NodeFunctionCall();
+}
+
+void NodeFunctionCall::render(render_guts_t* guts, int indentation) const {
+  this->renderChain(guts, indentation);
+}
+
+const Node* NodeFunctionCall::chainOperand(const render_guts_t* guts, int* precedence) const {
+  *precedence = PRECEDENCE_CALL;
+  return this->_childNodes.front();
+}
+
+void NodeFunctionCall::renderChainTail(render_guts_t* guts, int indentation) const {
+  this->_childNodes.back()->render(guts, indentation);
 }
 
-rope_t NodeFunctionCall::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_childNodes.front()->render(guts, indentation)) + this->_childNodes.back()->render(guts, indentation);
+int NodeFunctionCall::precedence() const {
+  return PRECEDENCE_CALL;
 }
 
 //
 // NodeFunctionConstructor: new foo(1)
 NodeFunctionConstructor::NodeFunctionConstructor(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeFunctionConstructor::clone(Node* node) const {
-  return Node::clone(new NodeFunctionConstructor());
+Node* NodeFunctionConstructor::shallowClone() const {
+  return new NodeFunctionConstructor();
+}
+
+void NodeFunctionConstructor::render(render_guts_t* guts, int indentation) const {
+  guts->out += "new ";
+  // `new a()()` calls the result of `new a()`, so a callee with a call in it needs parens
+  this->renderOperand(guts, indentation, this->_childNodes.front(), PRECEDENCE_MEMBER);
+  this->_childNodes.back()->render(guts, indentation);
 }
 
-rope_t NodeFunctionConstructor::render(render_guts_t* guts, int indentation) const {
-  return rope_t("new ") + this->_childNodes.front()->render(guts, indentation) + this->_childNodes.back()->render(guts, indentation);
+int NodeFunctionConstructor::precedence() const {
+  return PRECEDENCE_MEMBER;
 }
 
 //
 // NodeIf: if (true) { honk(dazzle); };
 NodeIf::NodeIf(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeIf::clone(Node* node) const {
-  return Node::clone(new NodeIf());
+Node* NodeIf::shallowClone() const {
+  return new NodeIf();
 }
 
-rope_t NodeIf::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeIf::render(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
 
   // Render the conditional expression
   node_list_t::const_iterator node = this->_childNodes.begin();
   ret += guts->pretty ? "if (" : "if(";
-  ret += (*node)->render(guts, indentation);
-  ret += ")";
+  (*node)->render(guts, indentation);
+  ret += ')';
 
   // Currently we need braces if it has else statement
   // TODO: braces are not needed if no nested-if statement.
@@ -903,7 +1364,7 @@ rope_t NodeIf::render(render_guts_t* guts, int indentation) const {
 
   bool needBraces = guts->pretty || ifBlock->childNodes().empty()
                     || elseBlock != NULL;
-  ret += ifBlock->renderBlock(needBraces, guts, indentation);
+  ifBlock->renderBlock(needBraces, guts, indentation);
 
   // Render else
   if (elseBlock != NULL) {
@@ -912,69 +1373,63 @@ rope_t NodeIf::render(render_guts_t* guts, int indentation) const {
     // Special-case for rendering else if's
     if (typeid(*elseBlock) == typeid(NodeIf)) {
       if (guts->sanelineno) {
-        elseBlock->renderLinenoCatchup(guts, ret);
+        elseBlock->renderLinenoCatchup(guts);
       }
-      ret += " ";
-      ret += elseBlock->render(guts, indentation);
+      ret += ' ';
+      elseBlock->render(guts, indentation);
     } else {
-      rope_t block = elseBlock->renderBlock(false, guts, indentation);
-      if (block[0] != '{' && block[0] != ' ') {
-        ret += " ";
-      }
-      ret += block;
+      ret.space_unless = "{ ";
+      elseBlock->renderBlock(false, guts, indentation);
     }
   }
-  return ret;
 }
 
 //
 // NodeWith: with (foo) { bar(); };
 NodeWith::NodeWith(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeWith::clone(Node* node) const {
-  return Node::clone(new NodeWith());
+Node* NodeWith::shallowClone() const {
+  return new NodeWith();
 }
 
-rope_t NodeWith::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeWith::render(render_guts_t* guts, int indentation) const {
   node_list_t::const_iterator node = this->_childNodes.begin();
-  ret += guts->pretty ? "with (" : "with(";
-  ret += (*node)->render(guts, indentation);
-  ret += ")";
-  ret += (*++node)->renderBlock(false, guts, indentation);
-  return ret;
+  guts->out += guts->pretty ? "with (" : "with(";
+  (*node)->render(guts, indentation);
+  guts->out += ')';
+  (*++node)->renderBlock(false, guts, indentation);
 }
 
 //
 // NodeTry
 NodeTry::NodeTry(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeTry::clone(Node* node) const {
-  return Node::clone(new NodeTry());
+Node* NodeTry::shallowClone() const {
+  return new NodeTry();
 }
 
-rope_t NodeTry::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeTry::render(render_guts_t* guts, int indentation) const {
   node_list_t::const_iterator node = this->_childNodes.begin();
-  ret += "try";
-  ret += (*node)->renderBlock(true, guts, indentation);
+  guts->out += "try";
+  (*node)->renderBlock(true, guts, indentation);
   if (*++node != NULL) {
-    ret += (guts->pretty ? " catch (" : "catch(");
-    ret += (*node)->render(guts, indentation) + ")";
-    ret += (*++node)->renderBlock(true, guts, indentation);
+    guts->out += (guts->pretty ? " catch (" : "catch(");
+    (*node)->render(guts, indentation);
+    guts->out += ')';
+    (*++node)->renderBlock(true, guts, indentation);
   } else {
     node++;
   }
   if (*++node != NULL) {
-    ret += (guts->pretty ? " finally" : "finally");
-    ret += (*node)->renderBlock(true, guts, indentation);
+    guts->out += (guts->pretty ? " finally" : "finally");
+    (*node)->renderBlock(true, guts, indentation);
   }
-  return ret;
 }
 
 //
 // NodeStatement
 NodeStatement::NodeStatement(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-rope_t NodeStatement::renderStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation) + ";";
+void NodeStatement::renderStatement(render_guts_t* guts, int indentation) const {
+  this->render(guts, indentation);
+  guts->out += ';';
 }
 
 //
@@ -982,12 +1437,12 @@ rope_t NodeStatement::renderStatement(render_guts_t* guts, int indentation) cons
 // the rewriter doesn't really need anything from the nodes
 NodeStatementWithExpression::NodeStatementWithExpression(node_statement_with_expression_t statement, const unsigned int lineno /* = 0 */) : NodeStatement(lineno), statement(statement) {}
 
-Node* NodeStatementWithExpression::clone(Node* node) const {
-  return Node::clone(new NodeStatementWithExpression(this->statement));
+Node* NodeStatementWithExpression::shallowClone() const {
+  return new NodeStatementWithExpression(this->statement);
 }
 
-rope_t NodeStatementWithExpression::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+void NodeStatementWithExpression::render(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
   switch (this->statement) {
     case THROW:
       ret += "throw";
@@ -1006,83 +1461,91 @@ rope_t NodeStatementWithExpression::render(render_guts_t* guts, int indentation)
       break;
   }
   if (this->_childNodes.back() != NULL) {
-    ret += " ";
-    ret += this->_childNodes.front()->render(guts, indentation);
+    ret += ' ';
+    this->_childNodes.front()->render(guts, indentation);
   }
-  return ret;
 }
 
-bool NodeStatementWithExpression::operator== (const Node &that) const {
-  return Node::operator==(that) && this->statement == static_cast<const NodeStatementWithExpression*>(&that)->statement;
+bool NodeStatementWithExpression::shallowEquals(const Node &that) const {
+  return this->statement == static_cast<const NodeStatementWithExpression&>(that).statement;
 }
 
 //
 // NodeLabel
 NodeLabel::NodeLabel(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeLabel::clone(Node* node) const {
-  return Node::clone(new NodeLabel());
+Node* NodeLabel::shallowClone() const {
+  return new NodeLabel();
 }
 
-rope_t NodeLabel::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_childNodes.front()->render(guts, indentation)) + (guts->pretty ? ": " : ":") + this->_childNodes.back()->render(guts, indentation);
+void NodeLabel::render(render_guts_t* guts, int indentation) const {
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += guts->pretty ? ": " : ":";
+  guts->statement = guts->out.size;
+  this->_childNodes.back()->render(guts, indentation);
 }
 
-rope_t NodeLabel::renderStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation) + ";";
+void NodeLabel::renderStatement(render_guts_t* guts, int indentation) const {
+  this->render(guts, indentation);
+  guts->out += ';';
 }
 
 //
 // NodeSwitch
 NodeSwitch::NodeSwitch(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeSwitch::clone(Node* node) const {
-  return Node::clone(new NodeSwitch());
+Node* NodeSwitch::shallowClone() const {
+  return new NodeSwitch();
 }
 
-rope_t NodeSwitch::render(render_guts_t* guts, int indentation) const {
-  return rope_t("switch(") + this->_childNodes.front()->render(guts, indentation) + ")" +
-    // Render this with extra indentation, and then in NodeCaseClause we drop lower by 1.
-    this->_childNodes.back()->renderBlock(true, guts, indentation + 1);
+void NodeSwitch::render(render_guts_t* guts, int indentation) const {
+  guts->out += "switch(";
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += ')';
+  // Render this with extra indentation, and then in NodeCaseClause we drop lower by 1.
+  this->_childNodes.back()->renderBlock(true, guts, indentation + 1);
 }
 
 //
 // NodeCaseClause: case: bar();
 NodeCaseClause::NodeCaseClause(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeCaseClause::clone(Node* node) const {
-  return Node::clone(new NodeCaseClause());
+Node* NodeCaseClause::shallowClone() const {
+  return new NodeCaseClause();
 }
 
-rope_t NodeCaseClause::render(render_guts_t* guts, int indentation) const {
-  return rope_t("case ") + this->_childNodes.front()->render(guts, indentation) + ":";
+void NodeCaseClause::render(render_guts_t* guts, int indentation) const {
+  guts->out += "case ";
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += ':';
 }
 
-rope_t NodeCaseClause::renderStatement(render_guts_t* guts, int indentation) const {
-  return this->render(guts, indentation);
+void NodeCaseClause::renderStatement(render_guts_t* guts, int indentation) const {
+  this->render(guts, indentation);
 }
 
-rope_t NodeCaseClause::renderIndentedStatement(render_guts_t* guts, int indentation) const {
-  return Node::renderIndentedStatement(guts, indentation - 1);
+void NodeCaseClause::renderIndentedStatement(render_guts_t* guts, int indentation) const {
+  Node::renderIndentedStatement(guts, indentation - 1);
 }
 
 //
 // NodeDefaultClause: default: foo();
 NodeDefaultClause::NodeDefaultClause(const unsigned int lineno /* = 0 */) : NodeCaseClause(lineno) {}
-Node* NodeDefaultClause::clone(Node* node) const {
-  return Node::clone(new NodeDefaultClause());
+Node* NodeDefaultClause::shallowClone() const {
+  return new NodeDefaultClause();
 }
 
-rope_t NodeDefaultClause::render(render_guts_t* guts, int indentation) const {
-  return rope_t("default:");
+void NodeDefaultClause::render(render_guts_t* guts, int indentation) const {
+  guts->out += "default:";
 }
 
 //
 // NodeVarDeclaration: a list of identifiers with optional assignments
 NodeVarDeclaration::NodeVarDeclaration(bool iterator /* = false */, const unsigned int lineno /* = 0 */) : NodeStatement(lineno), _iterator(iterator) {}
-Node* NodeVarDeclaration::clone(Node* node) const {
-  return Node::clone(new NodeVarDeclaration());
+Node* NodeVarDeclaration::shallowClone() const {
+  return new NodeVarDeclaration();
 }
 
-rope_t NodeVarDeclaration::render(render_guts_t* guts, int indentation) const {
-  return rope_t("var ") + this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",");
+void NodeVarDeclaration::render(render_guts_t* guts, int indentation) const {
+  guts->out += "var ";
+  this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",");
 }
 
 bool NodeVarDeclaration::iterator() const {
@@ -1097,60 +1560,98 @@ Node* NodeVarDeclaration::setIterator(bool iterator) {
 //
 // NodeTypehint: a variable declaration with a typehint
 NodeTypehint::NodeTypehint(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeTypehint::clone(Node* node) const {
-  return Node::clone(new NodeTypehint());
+Node* NodeTypehint::shallowClone() const {
+  return new NodeTypehint();
 }
 
-rope_t NodeTypehint::render(render_guts_t* guts, int indentation) const {
-  rope_t ret =
-    this->_childNodes.front()->render(guts, indentation) + ":" +
-    this->_childNodes.back()->render(guts, indentation);
-  return ret;
+void NodeTypehint::render(render_guts_t* guts, int indentation) const {
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += ':';
+  this->_childNodes.back()->render(guts, indentation);
 }
 
 //
 // NodeObjectLiteral
 NodeObjectLiteral::NodeObjectLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeObjectLiteral::clone(Node* node) const {
-  return Node::clone(new NodeObjectLiteral());
+Node* NodeObjectLiteral::shallowClone() const {
+  return new NodeObjectLiteral();
 }
 
-rope_t NodeObjectLiteral::render(render_guts_t* guts, int indentation) const {
-  return rope_t("{") + this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",") + "}";
+void NodeObjectLiteral::render(render_guts_t* guts, int indentation) const {
+  // A statement that starts with `{` is a block
+  bool wrap = guts->minparens && guts->out.size == guts->statement;
+  bool noin = guts->noin;
+  guts->noin = false;
+  guts->out += wrap ? "({" : "{";
+  this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",");
+  guts->out += wrap ? "})" : "}";
+  guts->noin = noin;
 }
 
 //
 // NodeObjectLiteralProperty
 NodeObjectLiteralProperty::NodeObjectLiteralProperty(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeObjectLiteralProperty::clone(Node* node) const {
-  return Node::clone(new NodeObjectLiteralProperty());
+Node* NodeObjectLiteralProperty::shallowClone() const {
+  return new NodeObjectLiteralProperty();
 }
 
-rope_t NodeObjectLiteralProperty::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_childNodes.front()->render(guts, indentation)) + (guts->pretty ? ": " : ":") +
-    this->_childNodes.back()->render(guts, indentation);
+void NodeObjectLiteralProperty::render(render_guts_t* guts, int indentation) const {
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += guts->pretty ? ": " : ":";
+  this->renderOperand(guts, indentation, this->_childNodes.back(), PRECEDENCE_ASSIGNMENT);
 }
 
 //
 // NodeArrayLiteral
 NodeArrayLiteral::NodeArrayLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-Node* NodeArrayLiteral::clone(Node* node) const {
-  return Node::clone(new NodeArrayLiteral());
+Node* NodeArrayLiteral::shallowClone() const {
+  return new NodeArrayLiteral();
 }
 
-rope_t NodeArrayLiteral::render(render_guts_t* guts, int indentation) const {
-  return rope_t("[") + this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",") + "]";
+void NodeArrayLiteral::render(render_guts_t* guts, int indentation) const {
+  bool noin = guts->noin;
+  guts->noin = false;
+  guts->out += '[';
+  this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",", PRECEDENCE_ASSIGNMENT);
+  guts->out += ']';
+  guts->noin = noin;
 }
 
 //
 // NodeStaticMemberExpression: object access via foo.bar
 NodeStaticMemberExpression::NodeStaticMemberExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
-rope_t NodeStaticMemberExpression::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_childNodes.front()->render(guts, indentation)) + "." + this->_childNodes.back()->render(guts, indentation);
+void NodeStaticMemberExpression::render(render_guts_t* guts, int indentation) const {
+  int precedence;
+  if (this->chainOperand(guts, &precedence) == NULL) {
+    // 1.foo is a syntax error
+    guts->out += '(';
+    this->_childNodes.front()->render(guts, indentation);
+    guts->out += ')';
+    this->renderChainTail(guts, indentation);
+  } else {
+    this->renderChain(guts, indentation);
+  }
 }
 
-Node* NodeStaticMemberExpression::clone(Node* node) const {
-  return Node::clone(new NodeStaticMemberExpression());
+const Node* NodeStaticMemberExpression::chainOperand(const render_guts_t* guts, int* precedence) const {
+  if (guts->minparens && dynamic_cast<const NodeNumericLiteral*>(unparenthesize(this->_childNodes.front()))) {
+    return NULL;
+  }
+  *precedence = PRECEDENCE_CALL;
+  return this->_childNodes.front();
+}
+
+void NodeStaticMemberExpression::renderChainTail(render_guts_t* guts, int indentation) const {
+  guts->out += '.';
+  this->_childNodes.back()->render(guts, indentation);
+}
+
+int NodeStaticMemberExpression::precedence() const {
+  return memberPrecedence(this->_childNodes.front());
+}
+
+Node* NodeStaticMemberExpression::shallowClone() const {
+  return new NodeStaticMemberExpression();
 }
 
 bool NodeStaticMemberExpression::isValidlVal() const {
@@ -1161,13 +1662,30 @@ bool NodeStaticMemberExpression::isValidlVal() const {
 // NodeDynamicMemberExpression: object access via foo['bar']
 NodeDynamicMemberExpression::NodeDynamicMemberExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeDynamicMemberExpression::clone(Node* node) const {
-  return Node::clone(new NodeDynamicMemberExpression());
+Node* NodeDynamicMemberExpression::shallowClone() const {
+  return new NodeDynamicMemberExpression();
+}
+
+void NodeDynamicMemberExpression::render(render_guts_t* guts, int indentation) const {
+  this->renderChain(guts, indentation);
+}
+
+const Node* NodeDynamicMemberExpression::chainOperand(const render_guts_t* guts, int* precedence) const {
+  *precedence = PRECEDENCE_CALL;
+  return this->_childNodes.front();
+}
+
+void NodeDynamicMemberExpression::renderChainTail(render_guts_t* guts, int indentation) const {
+  bool noin = guts->noin;
+  guts->noin = false;
+  guts->out += '[';
+  this->_childNodes.back()->render(guts, indentation);
+  guts->out += ']';
+  guts->noin = noin;
 }
 
-rope_t NodeDynamicMemberExpression::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_childNodes.front()->render(guts, indentation)) +
-    "[" + this->_childNodes.back()->render(guts, indentation) + "]";
+int NodeDynamicMemberExpression::precedence() const {
+  return memberPrecedence(this->_childNodes.front());
 }
 
 bool NodeDynamicMemberExpression::isValidlVal() const {
@@ -1177,110 +1695,133 @@ bool NodeDynamicMemberExpression::isValidlVal() const {
 //
 // NodeForLoop: only for(;;); loops, not for in
 NodeForLoop::NodeForLoop(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeForLoop::clone(Node* node) const {
-  return Node::clone(new NodeForLoop());
+Node* NodeForLoop::shallowClone() const {
+  return new NodeForLoop();
 }
 
-rope_t NodeForLoop::render(render_guts_t* guts, int indentation) const {
+void NodeForLoop::render(render_guts_t* guts, int indentation) const {
   node_list_t::const_iterator node = this->_childNodes.begin();
-  rope_t ret(guts->pretty ? "for (" : "for(");
-  ret += (*node)->render(guts, indentation) + (guts->pretty ? "; " : ";");
-  ret += (*++node)->render(guts, indentation) + (guts->pretty ? "; " : ";");
-  ret += (*++node)->render(guts, indentation) + ")";
-  ret += (*++node)->renderBlock(false, guts, indentation);
-  return ret;
+  guts->out += guts->pretty ? "for (" : "for(";
+  guts->noin = guts->minparens;
+  (*node)->render(guts, indentation);
+  guts->noin = false;
+  guts->out += guts->pretty ? "; " : ";";
+  (*++node)->render(guts, indentation);
+  guts->out += guts->pretty ? "; " : ";";
+  (*++node)->render(guts, indentation);
+  guts->out += ')';
+  (*++node)->renderBlock(false, guts, indentation);
 }
 
 //
 // NodeForIn
 NodeForIn::NodeForIn(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeForIn::clone(Node* node) const {
-  return Node::clone(new NodeForIn());
+Node* NodeForIn::shallowClone() const {
+  return new NodeForIn();
 }
 
-rope_t NodeForIn::render(render_guts_t* guts, int indentation) const {
+void NodeForIn::render(render_guts_t* guts, int indentation) const {
   node_list_t::const_iterator node = this->_childNodes.begin();
-  rope_t ret(guts->pretty ? "for (" : "for(");
-  ret += (*node)->render(guts, indentation) + " in ";
-  ret += (*++node)->render(guts, indentation) + ")";
-  ret += (*++node)->renderBlock(false, guts, indentation);
-  return ret;
+  guts->out += guts->pretty ? "for (" : "for(";
+  guts->noin = guts->minparens;
+  this->renderOperand(guts, indentation, *node, PRECEDENCE_CALL);
+  guts->noin = false;
+  guts->out += " in ";
+  (*++node)->render(guts, indentation);
+  guts->out += ')';
+  (*++node)->renderBlock(false, guts, indentation);
 }
 
 //
 // NodeForEachIn
 NodeForEachIn::NodeForEachIn(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeForEachIn::clone(Node* node) const {
-  return Node::clone(new NodeForEachIn());
+Node* NodeForEachIn::shallowClone() const {
+  return new NodeForEachIn();
 }
 
-rope_t NodeForEachIn::render(render_guts_t* guts, int indentation) const {
+void NodeForEachIn::render(render_guts_t* guts, int indentation) const {
   node_list_t::const_iterator node = this->_childNodes.begin();
-  rope_t ret(guts->pretty ? "for each (" : "for each(");
-  ret += (*node)->render(guts, indentation) + " in ";
-  ret += (*++node)->render(guts, indentation) + ")";
-  ret += (*++node)->renderBlock(false, guts, indentation);
-  return ret;
+  guts->out += guts->pretty ? "for each (" : "for each(";
+  guts->noin = guts->minparens;
+  this->renderOperand(guts, indentation, *node, PRECEDENCE_CALL);
+  guts->noin = false;
+  guts->out += " in ";
+  (*++node)->render(guts, indentation);
+  guts->out += ')';
+  (*++node)->renderBlock(false, guts, indentation);
 }
 
 //
 // NodeWhile
 NodeWhile::NodeWhile(const unsigned int lineno /* = 0 */) : Node(lineno) {}
-Node* NodeWhile::clone(Node* node) const {
-  return Node::clone(new NodeWhile());
+Node* NodeWhile::shallowClone() const {
+  return new NodeWhile();
 }
 
-rope_t NodeWhile::render(render_guts_t* guts, int indentation) const {
-  return rope_t(guts->pretty ? "while (" : "while(") +
-    this->_childNodes.front()->render(guts, indentation) + ")" +
-    this->_childNodes.back()->renderBlock(false, guts, indentation);
+void NodeWhile::render(render_guts_t* guts, int indentation) const {
+  guts->out += guts->pretty ? "while (" : "while(";
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += ')';
+  this->_childNodes.back()->renderBlock(false, guts, indentation);
 }
 
 //
 // NodeDoWhile
 NodeDoWhile::NodeDoWhile(const unsigned int lineno /* = 0 */) : NodeStatement(lineno) {}
-Node* NodeDoWhile::clone(Node* node) const {
-  return Node::clone(new NodeDoWhile());
+Node* NodeDoWhile::shallowClone() const {
+  return new NodeDoWhile();
 }
 
-rope_t NodeDoWhile::render(render_guts_t* guts, int indentation) const {
-  rope_t ret("do");
+void NodeDoWhile::render(render_guts_t* guts, int indentation) const {
+  guts->out += "do";
   // Technically this shouldn't be renderBlock(true, ...) but requiring braces makes it easier to render it all...
-  ret += this->_childNodes.front()->renderBlock(true, guts, indentation);
+  this->_childNodes.front()->renderBlock(true, guts, indentation);
   if (guts->sanelineno) {
-    this->_childNodes.back()->renderLinenoCatchup(guts, ret);
+    this->_childNodes.back()->renderLinenoCatchup(guts);
   }
-  ret += (guts->pretty ? " while (" : "while(") ;
-  ret += this->_childNodes.back()->render(guts, indentation) + ")";
-  return ret;
+  guts->out += guts->pretty ? " while (" : "while(";
+  this->_childNodes.back()->render(guts, indentation);
+  guts->out += ')';
 }
 
 //
 // NodeXMLDefaultNamespace
 NodeXMLDefaultNamespace::NodeXMLDefaultNamespace(const unsigned int lineno /* = 0 */) : NodeStatement(lineno) {}
 
-Node* NodeXMLDefaultNamespace::clone(Node* node) const {
-  return Node::clone(new NodeXMLDefaultNamespace());
+Node* NodeXMLDefaultNamespace::shallowClone() const {
+  return new NodeXMLDefaultNamespace();
 }
 
-rope_t NodeXMLDefaultNamespace::render(render_guts_t* guts, int indentation) const {
-  return rope_t("default xml namespace = ") + this->_childNodes.front()->render(guts, indentation);
+void NodeXMLDefaultNamespace::render(render_guts_t* guts, int indentation) const {
+  guts->out += "default xml namespace = ";
+  this->_childNodes.front()->render(guts, indentation);
 }
 
 //
 // NodeXMLName
-NodeXMLName::NodeXMLName(const string &ns, const string &name, const unsigned int lineno /* = 0 */) : Node(lineno), _ns(ns), _name(name) {}
+NodeXMLName::NodeXMLName(const string &ns, const string &name, const unsigned int lineno /* = 0 */) : Node(lineno), _ns(ns), _name(name) {
+  FBJS_STAT(string_bytes += ns.size() + name.size());
+  MemoryTracker::allocate(this->stringSize());
+}
 
-Node* NodeXMLName::clone(Node* node) const {
-  return Node::clone(new NodeXMLName(this->_ns, this->_name));
+NodeXMLName::~NodeXMLName() {
+  MemoryTracker::release(this->stringSize());
 }
 
-rope_t NodeXMLName::render(render_guts_t* guts, int indentation) const {
-  if (this->_ns.empty()) {
-    return rope_t(this->_name.c_str());
-  } else {
-    return rope_t(this->_ns.c_str()) + rope_t(":") + rope_t(this->_name.c_str());
+size_t NodeXMLName::stringSize() const {
+  return heapSize(this->_ns) + heapSize(this->_name);
+}
+
+Node* NodeXMLName::shallowClone() const {
+  return new NodeXMLName(this->_ns, this->_name);
+}
+
+void NodeXMLName::render(render_guts_t* guts, int indentation) const {
+  if (!this->_ns.empty()) {
+    guts->out += this->_ns;
+    guts->out += ':';
   }
+  guts->out += this->_name;
 }
 
 const string NodeXMLName::ns() const {
@@ -1295,60 +1836,70 @@ const string NodeXMLName::name() const {
 // NodeXMLElement
 NodeXMLElement::NodeXMLElement(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeXMLElement::clone(Node* node) const {
-  return Node::clone(new NodeXMLElement());
+Node* NodeXMLElement::shallowClone() const {
+  return new NodeXMLElement();
 }
 
-rope_t NodeXMLElement::render(render_guts_t* guts, int indentation) const {
-  rope_t ret("<");
+void NodeXMLElement::render(render_guts_t* guts, int indentation) const {
+  render_buffer_t& ret = guts->out;
+  ret += '<';
   node_list_t::const_iterator ii = this->_childNodes.begin();
   if (*ii != NULL) {
-    ret += (*ii)->render(guts, indentation);
+    (*ii)->render(guts, indentation);
   } else {
     // xml list
     ii++;
-    ret += ">";
-    ret += (*++ii)->render(guts, indentation);
+    ret += '>';
+    (*++ii)->render(guts, indentation);
     ret += "</>";
-    return ret;
+    return;
   }
   ++ii;
   if (!(*ii)->empty()) {
-    ret += " ";
-    ret += (*ii)->render(guts, indentation);
+    ret += ' ';
+    (*ii)->render(guts, indentation);
   }
   ++ii;
   if (!(*ii)->empty()) {
-    ret += ">";
-    ret += (*ii)->render(guts, indentation);
+    ret += '>';
+    (*ii)->render(guts, indentation);
     ret += "</";
-    ret += (*++ii)->render(guts, indentation);
-    ret += ">";
+    (*++ii)->render(guts, indentation);
+    ret += '>';
   } else {
     if ((*++ii) == NULL) {
       ret += "/>";
     } else {
       ret += "</";
-      ret += (*ii)->render(guts, indentation);
-      ret += ">";
+      (*ii)->render(guts, indentation);
+      ret += '>';
     }
   }
-  return ret;
 }
 
 //
 // NodeXMLComment
-NodeXMLComment::NodeXMLComment(const string &comment, const unsigned int lineno /* = 0 */) : Node(lineno), _comment(comment) {}
+NodeXMLComment::NodeXMLComment(const string &comment, const unsigned int lineno /* = 0 */) : Node(lineno), _comment(comment) {
+  FBJS_STAT(string_bytes += comment.size());
+  MemoryTracker::allocate(this->stringSize());
+}
 
-Node* NodeXMLComment::clone(Node* node) const {
-  return Node::clone(new NodeXMLComment(this->_comment));
+NodeXMLComment::~NodeXMLComment() {
+  MemoryTracker::release(this->stringSize());
 }
 
-rope_t NodeXMLComment::render(render_guts_t* guts, int indentation) const {
-  rope_t ret("<!--");
-  ret += rope_t(this->_comment.c_str());
-  ret += "-->";
-  return ret;
+size_t NodeXMLComment::stringSize() const {
+  return heapSize(this->_comment);
+}
+
+Node* NodeXMLComment::shallowClone() const {
+  return new NodeXMLComment(this->_comment);
+}
+
+void NodeXMLComment::render(render_guts_t* guts, int indentation) const {
+  guts->out += "<!--";
+  guts->out += this->_comment;
+  guts->out += "-->";
 }
 
 const string NodeXMLComment::comment() const {
@@ -1357,17 +1908,27 @@ const string NodeXMLComment::comment() const {
 
 //
 // NodeXMLPI
-NodeXMLPI::NodeXMLPI(const string &data, const unsigned int lineno /* = 0 */) : Node(lineno), _data(data) {}
+NodeXMLPI::NodeXMLPI(const string &data, const unsigned int lineno /* = 0 */) : Node(lineno), _data(data) {
+  FBJS_STAT(string_bytes += data.size());
+  MemoryTracker::allocate(this->stringSize());
+}
 
-Node* NodeXMLPI::clone(Node* node) const {
-  return Node::clone(new NodeXMLPI(this->_data));
+NodeXMLPI::~NodeXMLPI() {
+  MemoryTracker::release(this->stringSize());
 }
 
-rope_t NodeXMLPI::render(render_guts_t* guts, int indentation) const {
-  rope_t ret("<?");
-  ret += rope_t(this->_data.c_str());
-  ret += "?>";
-  return ret;
+size_t NodeXMLPI::stringSize() const {
+  return heapSize(this->_data);
+}
+
+Node* NodeXMLPI::shallowClone() const {
+  return new NodeXMLPI(this->_data);
+}
+
+void NodeXMLPI::render(render_guts_t* guts, int indentation) const {
+  guts->out += "<?";
+  guts->out += this->_data;
+  guts->out += "?>";
 }
 
 const string NodeXMLPI::data() const {
@@ -1378,30 +1939,67 @@ const string NodeXMLPI::data() const {
 // NodeXMLContentList
 NodeXMLContentList::NodeXMLContentList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
 
-Node* NodeXMLContentList::clone(Node* node) const {
-  return Node::clone(new NodeXMLContentList());
+Node* NodeXMLContentList::shallowClone() const {
+  return new NodeXMLContentList();
 }
 
-rope_t NodeXMLContentList::render(render_guts_t* guts, int indentation) const {
-  return this->renderImplodeChildren(guts, indentation, "");
+void NodeXMLContentList::render(render_guts_t* guts, int indentation) const {
+  this->renderImplodeChildren(guts, indentation, "");
 }
 
 //
 // NodeXMLTextData
 NodeXMLTextData::NodeXMLTextData(const unsigned int lineno /* = 0 */) : Node(lineno), whitespace(true) {}
 
-Node* NodeXMLTextData::clone(Node* node) const {
+NodeXMLTextData::~NodeXMLTextData() {
+  MemoryTracker::release(this->stringSize());
+}
+
+size_t NodeXMLTextData::stringSize() const {
+  return heapSize(this->_data);
+}
+
+Node* NodeXMLTextData::shallowClone() const {
   NodeXMLTextData* new_node = new NodeXMLTextData();
-  new_node->appendData(this->_data, this->whitespace);
-  return Node::clone(new_node);
+  new_node->_data = this->_data;
+  new_node->whitespace = this->whitespace;
+  FBJS_STAT(string_bytes += this->_data.size());
+  MemoryTracker::allocate(new_node->stringSize());
+  return new_node;
 }
 
-rope_t NodeXMLTextData::render(render_guts_t* guts, int indentation) const {
-  return this->_data;
+void NodeXMLTextData::render(render_guts_t* guts, int indentation) const {
+  guts->out += this->_data;
 }
 
 void NodeXMLTextData::appendData(rope_t str, bool isWhitespace /* = false */) {
+  FBJS_STAT(string_bytes += str.size());
+  size_t before = this->stringSize();
+  this->_data.append(str.begin(), str.end());
+  MemoryTracker::resize(before, this->stringSize());
+  if (!isWhitespace) {
+    this->whitespace = false;
+  }
+}
+
+//
+// The parser appends text one token at a time, so this goes straight into a flat buffer rather
+// than building up a rope.
+void NodeXMLTextData::appendData(const char* str, bool isWhitespace /* = false */) {
+  FBJS_STAT(string_bytes += strlen(str));
+  size_t before = this->stringSize();
   this->_data += str;
+  MemoryTracker::resize(before, this->stringSize());
+  if (!isWhitespace) {
+    this->whitespace = false;
+  }
+}
+
+void NodeXMLTextData::appendData(char ch, bool isWhitespace /* = false */) {
+  FBJS_STAT(string_bytes++);
+  size_t before = this->stringSize();
+  this->_data += ch;
+  MemoryTracker::resize(before, this->stringSize());
   if (!isWhitespace) {
     this->whitespace = false;
   }
@@ -1419,59 +2017,60 @@ const char* NodeXMLTextData::data() const {
 // NodeXMLEmbeddedExpression
 NodeXMLEmbeddedExpression::NodeXMLEmbeddedExpression(const unsigned int lineno /* = 0 */) : Node(lineno) {}
 
-Node* NodeXMLEmbeddedExpression::clone(Node* node) const {
-  return Node::clone(new NodeXMLEmbeddedExpression());
+Node* NodeXMLEmbeddedExpression::shallowClone() const {
+  return new NodeXMLEmbeddedExpression();
 }
 
-rope_t NodeXMLEmbeddedExpression::render(render_guts_t* guts, int indentation) const {
-  return rope_t("{") + this->_childNodes.front()->render(guts, indentation) + "}";
+void NodeXMLEmbeddedExpression::render(render_guts_t* guts, int indentation) const {
+  guts->out += '{';
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += '}';
 }
 
 //
 // NodeXMLAttributeList
 NodeXMLAttributeList::NodeXMLAttributeList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
 
-Node* NodeXMLAttributeList::clone(Node* node) const {
-  return Node::clone(new NodeXMLAttributeList());
+Node* NodeXMLAttributeList::shallowClone() const {
+  return new NodeXMLAttributeList();
 }
 
-rope_t NodeXMLAttributeList::render(render_guts_t* guts, int indentation) const {
-  return this->renderImplodeChildren(guts, indentation, " ");
+void NodeXMLAttributeList::render(render_guts_t* guts, int indentation) const {
+  this->renderImplodeChildren(guts, indentation, " ");
 }
 
 //
 // NodeXMLAttribute
 NodeXMLAttribute::NodeXMLAttribute(const unsigned int lineno /* = 0 */) : Node(lineno) {}
 
-Node* NodeXMLAttribute::clone(Node* node) const {
-  return Node::clone(new NodeXMLAttribute());
+Node* NodeXMLAttribute::shallowClone() const {
+  return new NodeXMLAttribute();
 }
 
-rope_t NodeXMLAttribute::render(render_guts_t* guts, int indentation) const {
-  rope_t ret = this->_childNodes.front()->render(guts, indentation);
-  ret += "=";
+void NodeXMLAttribute::render(render_guts_t* guts, int indentation) const {
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += '=';
   Node* val = this->_childNodes.back();
   if (typeid(*val) == typeid(NodeXMLTextData)) {
     // TODO: Escape value, <foo bar="&amp;" /> will render to <foo bar="&" />
-    ret += "\"";
-    ret += val->render(guts, indentation);
-    ret += "\"";
+    guts->out += '"';
+    val->render(guts, indentation);
+    guts->out += '"';
   } else {
-    ret += val->render(guts, indentation);
+    val->render(guts, indentation);
   }
-  return ret;
 }
 
 //
 // NodeWildcardIdentifier
 NodeWildcardIdentifier::NodeWildcardIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeWildcardIdentifier::clone(Node* node) const {
-  return Node::clone(new NodeWildcardIdentifier());
+Node* NodeWildcardIdentifier::shallowClone() const {
+  return new NodeWildcardIdentifier();
 }
 
-rope_t NodeWildcardIdentifier::render(render_guts_t* guts, int indentation) const {
-  return rope_t("*");
+void NodeWildcardIdentifier::render(render_guts_t* guts, int indentation) const {
+  guts->out += '*';
 }
 
 bool NodeWildcardIdentifier::isValidlVal() const {
@@ -1482,12 +2081,13 @@ bool NodeWildcardIdentifier::isValidlVal() const {
 // NodeStaticAttributeIdentifier
 NodeStaticAttributeIdentifier::NodeStaticAttributeIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeStaticAttributeIdentifier::clone(Node* node) const {
-  return Node::clone(new NodeStaticAttributeIdentifier());
+Node* NodeStaticAttributeIdentifier::shallowClone() const {
+  return new NodeStaticAttributeIdentifier();
 }
 
-rope_t NodeStaticAttributeIdentifier::render(render_guts_t* guts, int indentation) const {
-  return rope_t("@") + this->_childNodes.front()->render(guts, indentation);
+void NodeStaticAttributeIdentifier::render(render_guts_t* guts, int indentation) const {
+  guts->out += '@';
+  this->_childNodes.front()->render(guts, indentation);
 }
 
 bool NodeStaticAttributeIdentifier::isValidlVal() const {
@@ -1498,12 +2098,14 @@ bool NodeStaticAttributeIdentifier::isValidlVal() const {
 // NodeDynamicAttributeIdentifier
 NodeDynamicAttributeIdentifier::NodeDynamicAttributeIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeDynamicAttributeIdentifier::clone(Node* node) const {
-  return Node::clone(new NodeDynamicAttributeIdentifier());
+Node* NodeDynamicAttributeIdentifier::shallowClone() const {
+  return new NodeDynamicAttributeIdentifier();
 }
 
-rope_t NodeDynamicAttributeIdentifier::render(render_guts_t* guts, int indentation) const {
-  return rope_t("@[") + this->_childNodes.front()->render(guts, indentation) + "]";
+void NodeDynamicAttributeIdentifier::render(render_guts_t* guts, int indentation) const {
+  guts->out += "@[";
+  this->_childNodes.front()->render(guts, indentation);
+  guts->out += ']';
 }
 
 bool NodeDynamicAttributeIdentifier::isValidlVal() const {
@@ -1514,14 +2116,14 @@ bool NodeDynamicAttributeIdentifier::isValidlVal() const {
 // NodeStaticQualifiedIdentifier
 NodeStaticQualifiedIdentifier::NodeStaticQualifiedIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeStaticQualifiedIdentifier::clone(Node* node) const {
-  return Node::clone(new NodeStaticQualifiedIdentifier());
+Node* NodeStaticQualifiedIdentifier::shallowClone() const {
+  return new NodeStaticQualifiedIdentifier();
 }
 
-rope_t NodeStaticQualifiedIdentifier::render(render_guts_t* guts, int indentation) const {
-  return
-    this->_childNodes.front()->render(guts, indentation) + "::" +
-    this->_childNodes.back()->render(guts, indentation);
+void NodeStaticQualifiedIdentifier::render(render_guts_t* guts, int indentation) const {
+  this->renderOperand(guts, indentation, this->_childNodes.front(), PRECEDENCE_CALL);
+  guts->out += "::";
+  this->_childNodes.back()->render(guts, indentation);
 }
 
 bool NodeStaticQualifiedIdentifier::isValidlVal() const {
@@ -1532,14 +2134,15 @@ bool NodeStaticQualifiedIdentifier::isValidlVal() const {
 // NodeDynamicQualifiedIdentifier
 NodeDynamicQualifiedIdentifier::NodeDynamicQualifiedIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeDynamicQualifiedIdentifier::clone(Node* node) const {
-  return Node::clone(new NodeDynamicQualifiedIdentifier());
+Node* NodeDynamicQualifiedIdentifier::shallowClone() const {
+  return new NodeDynamicQualifiedIdentifier();
 }
 
-rope_t NodeDynamicQualifiedIdentifier::render(render_guts_t* guts, int indentation) const {
-  return
-    this->_childNodes.front()->render(guts, indentation) + "::[" +
-    this->_childNodes.back()->render(guts, indentation) + "]";
+void NodeDynamicQualifiedIdentifier::render(render_guts_t* guts, int indentation) const {
+  this->renderOperand(guts, indentation, this->_childNodes.front(), PRECEDENCE_CALL);
+  guts->out += "::[";
+  this->_childNodes.back()->render(guts, indentation);
+  guts->out += ']';
 }
 
 bool NodeDynamicQualifiedIdentifier::isValidlVal() const {
@@ -1550,14 +2153,23 @@ bool NodeDynamicQualifiedIdentifier::isValidlVal() const {
 // NodeFilteringPredicate
 NodeFilteringPredicate::NodeFilteringPredicate(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-Node* NodeFilteringPredicate::clone(Node* node) const {
-  return Node::clone(new NodeFilteringPredicate());
+Node* NodeFilteringPredicate::shallowClone() const {
+  return new NodeFilteringPredicate();
 }
 
-rope_t NodeFilteringPredicate::render(render_guts_t* guts, int indentation) const {
-  return
-    this->_childNodes.front()->render(guts, indentation) + ".(" +
-    this->_childNodes.back()->render(guts, indentation) + ")";
+void NodeFilteringPredicate::render(render_guts_t* guts, int indentation) const {
+  this->renderChain(guts, indentation);
+}
+
+const Node* NodeFilteringPredicate::chainOperand(const render_guts_t* guts, int* precedence) const {
+  *precedence = PRECEDENCE_CALL;
+  return this->_childNodes.front();
+}
+
+void NodeFilteringPredicate::renderChainTail(render_guts_t* guts, int indentation) const {
+  guts->out += ".(";
+  this->_childNodes.back()->render(guts, indentation);
+  guts->out += ')';
 }
 
 bool NodeFilteringPredicate::isValidlVal() const {
@@ -1568,10 +2180,20 @@ bool NodeFilteringPredicate::isValidlVal() const {
 // NodeDescendantExpression
 NodeDescendantExpression::NodeDescendantExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
 
-rope_t NodeDescendantExpression::render(render_guts_t* guts, int indentation) const {
-  return rope_t(this->_childNodes.front()->render(guts, indentation)) + ".." + this->_childNodes.back()->render(guts, indentation);
+void NodeDescendantExpression::render(render_guts_t* guts, int indentation) const {
+  this->renderChain(guts, indentation);
+}
+
+const Node* NodeDescendantExpression::chainOperand(const render_guts_t* guts, int* precedence) const {
+  *precedence = PRECEDENCE_CALL;
+  return this->_childNodes.front();
+}
+
+void NodeDescendantExpression::renderChainTail(render_guts_t* guts, int indentation) const {
+  guts->out += "..";
+  this->_childNodes.back()->render(guts, indentation);
 }
 
-Node* NodeDescendantExpression::clone(Node* node) const {
-  return Node::clone(new NodeDescendantExpression());
+Node* NodeDescendantExpression::shallowClone() const {
+  return new NodeDescendantExpression();
 }
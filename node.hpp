@@ -21,14 +21,21 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
 #include <list>
+#include <vector>
 #include <memory>
 #include <ext/rope>
+#include "memory.hpp"
 
 #define NODE_WALKER_ACCEPT_DECL virtual void accept(class NodeWalker& walker)
 typedef __gnu_cxx::rope<char> rope_t;
+struct fbjs_parse_extra;
+struct fbjs_push_state;
 
 namespace fbjs {
   class Node;
@@ -37,17 +44,149 @@ namespace fbjs {
     RENDER_NONE = 0,
     RENDER_PRETTY = 1,
     RENDER_MAINTAIN_LINENO = 2,
+    RENDER_MINIMAL_PARENS = 4,
+  };
+
+  //
+  // Expression precedence from loosest to tightest, following the %left/%right table in parser.yy.
+  // RENDER_MINIMAL_PARENS uses this to decide where parentheses are needed.
+  enum node_precedence_t {
+    PRECEDENCE_COMMA,
+    PRECEDENCE_ASSIGNMENT,
+    PRECEDENCE_CONDITIONAL,
+    PRECEDENCE_OR,
+    PRECEDENCE_AND,
+    PRECEDENCE_BIT_OR,
+    PRECEDENCE_BIT_XOR,
+    PRECEDENCE_BIT_AND,
+    PRECEDENCE_EQUALITY,
+    PRECEDENCE_RELATIONAL,
+    PRECEDENCE_SHIFT,
+    PRECEDENCE_ADDITIVE,
+    PRECEDENCE_MULTIPLICATIVE,
+    PRECEDENCE_UNARY,
+    PRECEDENCE_POSTFIX,
+    PRECEDENCE_CALL, // foo(), and member expressions with a call in them
+    PRECEDENCE_MEMBER, // foo.bar, new foo()
+    PRECEDENCE_PRIMARY,
   };
   enum node_parse_enum {
     PARSE_NONE = 0,
     PARSE_TYPEHINT = 1,
     PARSE_OBJECT_LITERAL_ELISON = 2,
     PARSE_E4X = 4,
+    PARSE_RECOVER = 8,
+    PARSE_DESCENT = 16, // hand-written parser instead of bison, see descent.cpp
+  };
+
+  enum budget_limit_enum {
+    BUDGET_NONE = 0,
+    BUDGET_TOKENS,
+    BUDGET_NODES,
+    BUDGET_DEPTH,
+    BUDGET_BYTES,
+    BUDGET_DEADLINE,
+    BUDGET_CANCELLED,
   };
+
+  //
+  // parse_budget_t: limits for one parse. The scanner checks them at every token, and a parse that
+  // runs over stops there and throws ParseBudgetException, freeing whatever it had built. Zero means
+  // no limit. A budget isn't changed by parsing, so one can be shared by any number of parses, and
+  // cancel() can be called from any thread while they run.
+  //
+  //   parse_budget_t budget;
+  //   budget.max_depth = 1000;
+  //   budget.setTimeout(0.5);
+  //   NodeProgram program(code, PARSE_NONE, 20, &budget);
+  struct parse_budget_t {
+    size_t max_tokens;
+    size_t max_nodes; // nodes allocated, including any the parser throws away
+    size_t max_depth; // parentheses, brackets and braces open at once
+    size_t max_bytes; // heap held by the tree, as MemoryTracker counts it
+    timespec deadline; // CLOCK_MONOTONIC, checked every few dozen tokens
+    int cancelled; // through cancel() and isCancelled(), which are atomic
+
+    parse_budget_t() : max_tokens(0), max_nodes(0), max_depth(0), max_bytes(0), cancelled(0) {
+      deadline.tv_sec = 0;
+      deadline.tv_nsec = 0;
+    }
+
+    // Sets the deadline this many seconds from now
+    void setTimeout(double seconds);
+
+    void cancel() {
+      __atomic_store_n(&cancelled, 1, __ATOMIC_RELAXED);
+    }
+
+    bool isCancelled() const {
+      return __atomic_load_n(&cancelled, __ATOMIC_RELAXED) != 0;
+    }
+  };
+
+  //
+  // render_buffer_t: where render output goes. Rendering runs once with no buffer to measure the
+  // output and then again to write it, so a whole program renders into one allocation. Writes past
+  // `capacity` are cut off where it ends but still counted in `size`.
+  struct render_buffer_t {
+    char* data;
+    size_t size;
+    size_t capacity;
+    char space_if; // write a space first if the next character is this one
+    const char* space_unless; // write a space first unless the next character is one of these
+
+    render_buffer_t(char* data = NULL, size_t capacity = 0) :
+      data(data), size(0), capacity(capacity), space_if(0), space_unless(NULL) {}
+
+    void append(const char* str, size_t len) {
+      if (len == 0) {
+        return;
+      }
+      if (space_if || space_unless) {
+        bool space = space_if ? str[0] == space_if : strchr(space_unless, str[0]) == NULL;
+        space_if = 0;
+        space_unless = NULL;
+        if (space) {
+          append(" ", 1);
+        }
+      }
+      if (size < capacity) {
+        memcpy(data + size, str, std::min(len, capacity - size));
+      }
+      size += len;
+    }
+
+    void fill(size_t len, char ch) {
+      for (size_t ii = 0; ii < len; ++ii) {
+        append(&ch, 1);
+      }
+    }
+
+    render_buffer_t& operator+= (const char* str) {
+      append(str, strlen(str));
+      return *this;
+    }
+
+    render_buffer_t& operator+= (const std::string& str) {
+      append(str.data(), str.size());
+      return *this;
+    }
+
+    render_buffer_t& operator+= (char ch) {
+      append(&ch, 1);
+      return *this;
+    }
+  };
+
   struct render_guts_t {
     unsigned int lineno;
     bool pretty;
     bool sanelineno;
+    bool minparens;
+    bool noin; // inside a for-loop initializer, where `in` has to be parenthesized
+    size_t statement; // output offset of the current expression statement
+    unsigned int functions; // depth of functions being rendered, for tracing
+    render_buffer_t out;
   };
 
   //
@@ -55,20 +194,57 @@ namespace fbjs {
   class Node {
     protected:
       node_list_t _childNodes;
-      rope_t renderImplodeChildren(render_guts_t* guts, int indentation, const char* glue) const;
-      unsigned int _lineno;
+      void renderImplodeChildren(render_guts_t* guts, int indentation, const char* glue, int precedence = PRECEDENCE_COMMA) const;
+      void renderOperand(render_guts_t* guts, int indentation, const Node* operand, int precedence) const;
+      void renderIndentation(render_guts_t* guts, int indentation) const;
+
+      // Expressions which render as their first child and then something after it (a + b, a.b, a[b],
+      // a(b)) nest to the left as deep as the input goes, so renderChain() renders them by walking
+      // down that left spine rather than recursing. chainOperand() returns the first child and the
+      // precedence it's rendered at, or NULL if the node renders some other way in this state;
+      // renderChainTail() renders the rest.
+      void renderChain(render_guts_t* guts, int indentation) const;
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
+
+      // Bit-fields so subclasses can still use the rest of the word after them
+      unsigned int _lineno : 31;
+      unsigned int _from_resource : 1; // allocated from a MemoryResource, see operator new
 
     public:
       NODE_WALKER_ACCEPT_DECL;
       Node(const unsigned int lineno = 0);
       virtual ~Node();
-      virtual Node* clone(Node* node = NULL) const;
+
+      // Nodes come from the thread's MemoryResource, if there is one, and are counted by its
+      // MemoryTracker
+      static void* operator new(size_t size);
+      static void operator delete(void* ptr, size_t size);
+
+      // Copies the whole subtree. Subclasses only copy their own fields, in shallowClone().
+      //
+      // clone(Node*) and operator== used to be virtual, and subclasses overrode them to copy or
+      // compare their children themselves. That recursed once per level, so they aren't any more.
+      // An old clone(Node*) override no longer compiles, since it can't call Node::clone(node); an
+      // old operator== override still does, but is never called through a Node. Move the copying
+      // of a subclass's own fields into shallowClone() and the comparing into shallowEquals().
+      Node* clone() const;
+      virtual Node* shallowClone() const;
 
       bool empty() const;
       unsigned int lineno() const;
       void setLineno(const unsigned int lineno) { _lineno = lineno; }
-      virtual bool operator== (const Node&) const;
-      virtual bool operator!= (const Node&) const;
+
+      // Compares whole subtrees, ignoring line numbers. Subclasses only compare their own fields, in
+      // shallowEquals(), which is only called with a node of the same type.
+      bool operator== (const Node&) const;
+      bool operator!= (const Node&) const;
+      virtual bool shallowEquals(const Node&) const;
+
+      // Heap bytes held by the whole subtree, see memory.hpp. Subclasses with strings report them in
+      // stringSize().
+      memory_usage_t memoryUsage() const;
+      virtual size_t stringSize() const;
 
       node_list_t& childNodes() const;
       Node* appendChild(Node* node);
@@ -79,22 +255,128 @@ namespace fbjs {
 
       rope_t render(node_render_enum opts = RENDER_NONE) const;
       rope_t render(int opts) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderBlock(bool must, render_guts_t* guts, int indentation) const;
-      virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderIndentedStatement(render_guts_t* guts, int indentation) const;
-      bool renderLinenoCatchup(render_guts_t* guts, rope_t &rope) const;
+      std::string renderString(int opts = RENDER_NONE) const;
+      size_t renderSize(int opts = RENDER_NONE) const;
+
+      // Renders into a caller's buffer, snprintf style: writes at most `size - 1` bytes and a NUL,
+      // and returns the length of the whole output. The output was cut short if that's >= `size`.
+      size_t render(char* buffer, size_t size, int opts = RENDER_NONE) const;
+
+      // Each node appends its output to guts->out. These used to return a rope_t, as did
+      // renderImplodeChildren(), and renderLinenoCatchup() took the rope to append to; a subclass
+      // still overriding them that way no longer compiles.
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual void renderBlock(bool must, render_guts_t* guts, int indentation) const;
+      virtual void renderStatement(render_guts_t* guts, int indentation) const;
+      virtual void renderIndentedStatement(render_guts_t* guts, int indentation) const;
+      bool renderLinenoCatchup(render_guts_t* guts) const;
   };
 
   //
   // NodeProgram
   class NodeProgram: public Node {
+    protected:
+      size_t _peak; // most heap the tree held while it was parsed
+      friend class Parser;
+      friend class PushParser;
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeProgram();
-      NodeProgram(const char* code, node_parse_enum opts = PARSE_NONE);
-      NodeProgram(FILE* file, node_parse_enum opts = PARSE_NONE);
-      virtual Node* clone(Node* node = NULL) const;
+      NodeProgram(const char* code, node_parse_enum opts = PARSE_NONE, size_t max_errors = 20, const parse_budget_t* budget = NULL);
+      NodeProgram(FILE* file, node_parse_enum opts = PARSE_NONE, size_t max_errors = 20, const parse_budget_t* budget = NULL);
+      virtual Node* shallowClone() const;
+
+      // Node::memoryUsage() plus the peak during parsing
+      memory_usage_t memoryUsage() const;
+  };
+
+  //
+  // Parser: parses any number of programs with one scanner. The NodeProgram constructors create and
+  // destroy a scanner every time, which is most of the cost of parsing a small snippet.
+  //
+  //   Parser parser(PARSE_E4X);
+  //   std::auto_ptr<NodeProgram> program(parser.parse("a = 1;"));
+  //
+  // Parse errors throw ParseException, and running over a budget ParseBudgetException, just like
+  // NodeProgram. A Parser is not thread-safe, use one per thread.
+  //
+  // A Parser given a MemoryResource installs it around every parse, as a MemoryResourceScope would,
+  // so the trees it returns come from it whatever thread they're parsed on.
+  //
+  // Node::render() and NodeWalker recurse once per level of the tree, so both parsers fail with
+  // "memory exhausted" past about a thousand levels of brackets or other nesting with bison, or
+  // five hundred with PARSE_DESCENT (fewer for statements, which take more than one). Parsing, and
+  // rendering or walking any tree they return, then fits in a 256KB stack in an optimized build.
+  // Left-associative chains like a+b+c, a.b.c and a()() don't count: rendering, cloning, comparing
+  // and freeing them doesn't recurse, but a NodeWalker does.
+  class Parser {
+    protected:
+      fbjs_parse_extra* extra;
+      void* scanner;
+      MemoryResource* resource;
+      std::vector<char> input; // flex scans in place and needs two trailing NUL's
+      void reset();
+      void finish();
+
+    private:
+      Parser(const Parser&);
+      Parser& operator= (const Parser&);
+
+    public:
+      Parser(node_parse_enum opts = PARSE_NONE, size_t max_errors = 20, MemoryResource* resource = NULL);
+      ~Parser();
+      NodeProgram* parse(const char* code, const parse_budget_t* budget = NULL);
+      NodeProgram* parse(const char* code, size_t length, const parse_budget_t* budget = NULL);
+      NodeProgram* parse(FILE* file, const parse_budget_t* budget = NULL);
+
+      // Splits a big program between top-level statements and parses the pieces on up to `threads`
+      // threads, 0 for one per CPU. The tree is the same as parse() makes. See parallel.hpp.
+      NodeProgram* parseParallel(const char* code, size_t length, size_t threads = 0,
+        const parse_budget_t* budget = NULL);
+  };
+
+  //
+  // PushParser: parses a program as it arrives, for code read from a socket or a pipe. Each feed()
+  // scans and parses as far as the last bracket, `,` or `;` it has been given (see prescan.hpp) and
+  // keeps only what comes after it, so there's little left to do by finish(). What's kept is the
+  // longest run of code without one of those, which is usually short, but a single token like a
+  // big string literal, or a long expression like `a + b + c ...`, is held whole until it ends.
+  //
+  //   PushParser parser(PARSE_E4X);
+  //   while ((got = read(fd, buf, sizeof(buf))) > 0) {
+  //     parser.feed(buf, got);
+  //   }
+  //   std::auto_ptr<NodeProgram> program(parser.finish());
+  //
+  // The parser can then be fed the next program. A syntax error, or running over the budget, throws
+  // from whichever call finds it, as ParseException or ParseBudgetException, and the next feed()
+  // starts a new program. The tree is the same as Parser::parse() makes, but always with the bison
+  // grammar; PARSE_DESCENT is ignored. Not thread-safe, and if there's a MemoryResourceScope every
+  // feed() and finish() of a program has to be inside it, unless the parser was given the resource
+  // itself.
+  class PushParser {
+    protected:
+      fbjs_parse_extra* extra;
+      void* scanner;
+      fbjs_push_state* push;
+      MemoryResource* resource;
+      void start();
+      int scan(size_t length);
+      void abandon();
+      void fail();
+
+    private:
+      PushParser(const PushParser&);
+      PushParser& operator= (const PushParser&);
+
+    public:
+      // `budget` is used for every program, and is only looked at while they're parsed, so its
+      // deadline can be set again for each one
+      PushParser(node_parse_enum opts = PARSE_NONE, size_t max_errors = 20, const parse_budget_t* budget = NULL,
+        MemoryResource* resource = NULL);
+      ~PushParser();
+      void feed(const char* code, size_t length);
+      NodeProgram* finish();
   };
 
   //
@@ -103,11 +385,11 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStatementList(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderBlock(bool must, render_guts_t* guts, int indentation) const;
-      virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderIndentedStatement(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual void renderBlock(bool must, render_guts_t* guts, int indentation) const;
+      virtual void renderStatement(render_guts_t* guts, int indentation) const;
+      virtual void renderIndentedStatement(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -117,9 +399,10 @@ namespace fbjs {
       NODE_WALKER_ACCEPT_DECL;
       NodeExpression(const unsigned int lineno = 0);
       virtual bool isValidlVal() const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const = 0;
-      virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
+      virtual void render(render_guts_t* guts, int indentation) const = 0;
+      virtual void renderStatement(render_guts_t* guts, int indentation) const;
       virtual bool compare(bool val) const;
+      virtual int precedence() const;
   };
 
   //
@@ -130,10 +413,11 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeNumericLiteral(double value, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      double number() const { return value; };
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool compare(bool val) const;
-      virtual bool operator== (const Node&) const;
+      virtual bool shallowEquals(const Node&) const;
   };
 
   //
@@ -145,14 +429,19 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStringLiteral(const std::string& value, bool quoted, const unsigned int lineno = 0);
+      virtual ~NodeStringLiteral();
       std::string unquoted_value() const {
         if (!quoted) return value;
         return value.substr(1, value.size() - 2);
       }
+      bool isQuoted() const { return quoted; };
+      char quote() const { return quoted ? value[0] : '"'; };
 
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual bool operator== (const Node&) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual bool compare(bool val) const;
+      virtual bool shallowEquals(const Node&) const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -164,9 +453,12 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeRegexLiteral(const std::string& value, const std::string& flags, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual bool operator== (const Node&) const;
+      virtual ~NodeRegexLiteral();
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual bool compare(bool val) const;
+      virtual bool shallowEquals(const Node&) const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -177,10 +469,10 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeBooleanLiteral(bool value, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool compare(bool val) const;
-      virtual bool operator== (const Node&) const;
+      virtual bool shallowEquals(const Node&) const;
   };
 
   //
@@ -189,8 +481,9 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeNullLiteral(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual bool compare(bool val) const;
   };
 
   //
@@ -199,8 +492,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeThis(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -209,9 +502,9 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeEmptyExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderBlock(bool must, render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual void renderBlock(bool must, render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -232,10 +525,14 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeOperator(node_operator_t op, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
       const node_operator_t operatorType() const { return op; };
-      virtual bool operator== (const Node&) const;
+      virtual bool shallowEquals(const Node&) const;
+    protected:
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -244,8 +541,9 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeConditionalExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
   };
 
   //
@@ -254,8 +552,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeParenthetical(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
       virtual bool compare(bool val) const;
   };
@@ -274,10 +572,11 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeAssignment(node_assignment_t op, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
       const node_assignment_t operatorType() const { return op; };
-      virtual bool operator== (const Node&) const;
+      virtual bool shallowEquals(const Node&) const;
   };
 
   //
@@ -294,10 +593,12 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeUnary(node_unary_t op, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
       const node_unary_t operatorType() const { return op; };
-      virtual bool operator== (const Node&) const;
+      virtual bool compare(bool val) const;
+      virtual bool shallowEquals(const Node&) const;
   };
 
   //
@@ -311,9 +612,11 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodePostfix(node_postfix_t op, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual bool operator== (const Node&) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
+      const node_postfix_t operatorType() const { return op; };
+      virtual bool shallowEquals(const Node&) const;
   };
 
   //
@@ -324,12 +627,14 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeIdentifier(const std::string& name, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual ~NodeIdentifier();
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       const std::string& name() const;
       virtual bool isValidlVal() const;
       void rename(const std::string &str);
-      virtual bool operator== (const Node&) const;
+      virtual bool shallowEquals(const Node&) const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -338,8 +643,12 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeFunctionCall(const unsigned int lineno = 0);
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual Node* clone(Node* node = NULL) const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
+      virtual Node* shallowClone() const;
+    protected:
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -348,8 +657,9 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeFunctionConstructor(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
   };
 
   //
@@ -358,8 +668,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeObjectLiteral(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -368,8 +678,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeArrayLiteral(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -378,9 +688,13 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStaticMemberExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
       virtual bool isValidlVal() const;
+    protected:
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -389,9 +703,13 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeDynamicMemberExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual int precedence() const;
       virtual bool isValidlVal() const;
+    protected:
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -400,8 +718,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStatement(const unsigned int lineno = 0);
-      virtual rope_t render(render_guts_t* guts, int indentation) const = 0;
-      virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
+      virtual void render(render_guts_t* guts, int indentation) const = 0;
+      virtual void renderStatement(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -415,9 +733,10 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStatementWithExpression(node_statement_with_expression_t statement, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual bool operator== (const Node&) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      const node_statement_with_expression_t statementType() const { return statement; };
+      virtual bool shallowEquals(const Node&) const;
   };
 
   //
@@ -428,8 +747,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeVarDeclaration(bool iterator = false, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       bool iterator() const; // TODO: kill this
       Node* setIterator(bool iterator);
   };
@@ -440,8 +759,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeTypehint(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -450,8 +769,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeFunctionDeclaration(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -460,8 +779,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeFunctionExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -470,8 +789,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeArgList(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -480,8 +799,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeIf(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -490,8 +809,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeWith(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -500,8 +819,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeTry(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -510,9 +829,9 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeLabel(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual void renderStatement(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -521,10 +840,10 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeCaseClause(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
-      virtual rope_t renderIndentedStatement(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+      virtual void renderStatement(render_guts_t* guts, int indentation) const;
+      virtual void renderIndentedStatement(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -533,8 +852,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeSwitch(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -543,8 +862,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeDefaultClause(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -553,8 +872,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeObjectLiteralProperty(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -563,8 +882,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeForLoop(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -573,8 +892,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeForIn(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -583,8 +902,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeForEachIn(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -593,8 +912,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeWhile(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -603,8 +922,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeDoWhile(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -614,8 +933,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLDefaultNamespace(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -628,10 +947,12 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLName(const std::string &ns, const std::string &name, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual ~NodeXMLName();
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual const std::string ns() const;
       virtual const std::string name() const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -645,8 +966,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLElement(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -658,9 +979,11 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLComment(const std::string &comment, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual ~NodeXMLComment();
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual const std::string comment() const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -672,9 +995,11 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLPI(const std::string &data, const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual ~NodeXMLPI();
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual const std::string data() const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -684,8 +1009,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLContentList(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -693,16 +1018,20 @@ namespace fbjs {
   // children: none
   class NodeXMLTextData: public Node {
     protected:
-      rope_t _data;
+      std::string _data;
       bool whitespace;
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLTextData(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual ~NodeXMLTextData();
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual void appendData(rope_t str, bool isWhitespace = false);
+      void appendData(const char* str, bool isWhitespace = false);
+      void appendData(char ch, bool isWhitespace = false);
       virtual bool isWhitespace() const;
       const char* data() const;
+      virtual size_t stringSize() const;
   };
 
   //
@@ -712,8 +1041,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLEmbeddedExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -723,8 +1052,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLAttributeList(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -734,8 +1063,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeXMLAttribute(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -745,8 +1074,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeWildcardIdentifier(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
   };
 
@@ -757,8 +1086,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStaticAttributeIdentifier(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
   };
 
@@ -769,8 +1098,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeDynamicAttributeIdentifier(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
   };
 
@@ -781,8 +1110,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeStaticQualifiedIdentifier(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
   };
 
@@ -793,8 +1122,8 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeDynamicQualifiedIdentifier(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
   };
 
@@ -805,9 +1134,12 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeFilteringPredicate(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
       virtual bool isValidlVal() const;
+    protected:
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -816,18 +1148,33 @@ namespace fbjs {
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeDescendantExpression(const unsigned int lineno = 0);
-      virtual Node* clone(Node* node = NULL) const;
-      virtual rope_t render(render_guts_t* guts, int indentation) const;
+      virtual Node* shallowClone() const;
+      virtual void render(render_guts_t* guts, int indentation) const;
+    protected:
+      virtual const Node* chainOperand(const render_guts_t* guts, int* precedence) const;
+      virtual void renderChainTail(render_guts_t* guts, int indentation) const;
   };
 
   //
   // Parser exception
+  struct parse_error_t {
+    std::string message;
+    int lineno;
+  };
+
   class ParseException: public std::runtime_error {
     private:
       mutable std::string wut;
       int lineno;
+      std::vector<parse_error_t> _errors;
     public:
-      ParseException(const std::string& what_arg, const int lineno) : std::runtime_error(what_arg), lineno(lineno) {}
+      ParseException(const std::string& what_arg, const int lineno) : std::runtime_error(what_arg), lineno(lineno) {
+        parse_error_t error = { what_arg, lineno };
+        _errors.push_back(error);
+      }
+      // what() describes the first error; all of them are in errors()
+      ParseException(const std::vector<parse_error_t>& errors) :
+        std::runtime_error(errors.front().message), lineno(errors.front().lineno), _errors(errors) {}
       ~ParseException() throw() {}
       const char* what() const throw() {
         if (wut.empty()) {
@@ -838,5 +1185,26 @@ namespace fbjs {
         }
         return wut.c_str();
       }
+      const std::vector<parse_error_t>& errors() const {
+        return _errors;
+      }
+  };
+
+  //
+  // ParseBudgetException: the parse ran over its parse_budget_t or was cancelled. It isn't a
+  // ParseException because the program may well be valid.
+  class ParseBudgetException: public std::runtime_error {
+    private:
+      budget_limit_enum _limit;
+      int _lineno;
+    public:
+      ParseBudgetException(budget_limit_enum limit, int lineno);
+      ~ParseBudgetException() throw() {}
+      budget_limit_enum limit() const {
+        return _limit;
+      }
+      int lineno() const {
+        return _lineno;
+      }
   };
 }
@@ -0,0 +1,168 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include <exception>
+#include <memory>
+#include <vector>
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "prescan.hpp"
+using namespace std;
+using namespace fbjs;
+
+vector<split_point_t> fbjs::findSplitPoints(const char* code, size_t length, size_t segments,
+    node_parse_enum opts /* = PARSE_NONE */) {
+  vector<split_point_t> points;
+  if (segments < 2) {
+    return points;
+  }
+  prescan_t scanner(code, length, opts);
+  size_t next = length / segments; // where the next split should be
+  while (points.size() < segments - 1) {
+    prescan_enum ret = scanner.next();
+    if (ret == PRESCAN_STOP) {
+      break;
+    } else if (ret == PRESCAN_SEMICOLON && scanner.depth == 0 && (size_t)(scanner.pos - code) >= next &&
+        scanner.canStartAt(scanner.pos)) {
+      split_point_t point;
+      point.offset = scanner.pos - code;
+      point.newlines = scanner.newlines;
+      points.push_back(point);
+      next = length / segments * (points.size() + 1);
+    }
+  }
+  return points;
+}
+
+//
+// Parser::parseParallel
+namespace {
+
+  struct segment_t {
+    const char* code;
+    size_t length;
+    unsigned int newlines;
+    node_parse_enum opts;
+    size_t max_errors;
+    const parse_budget_t* budget;
+    NodeProgram* program;
+    bool failed;
+  };
+
+  // Each piece was parsed as though it started on line 1
+  void offsetLines(Node* root, unsigned int newlines) {
+    vector<Node*> pending(1, root);
+    while (!pending.empty()) {
+      Node* node = pending.back();
+      pending.pop_back();
+      if (node == NULL) {
+        continue;
+      }
+      if (node->lineno() != 0) {
+        node->setLineno(node->lineno() + newlines);
+      }
+      pending.insert(pending.end(), node->childNodes().begin(), node->childNodes().end());
+    }
+  }
+
+  void* parseSegment(void* arg) {
+    segment_t* segment = static_cast<segment_t*>(arg);
+    try {
+      Parser parser(segment->opts, segment->max_errors);
+      segment->program = parser.parse(segment->code, segment->length, segment->budget);
+      offsetLines(segment->program, segment->newlines);
+    } catch (exception&) {
+      segment->failed = true;
+    }
+    return NULL;
+  }
+}
+
+//
+// The first piece is parsed with this parser on this thread, the rest each with their own. Limits on
+// tokens, nodes and memory are for the whole program and can't be checked piece by piece, so a budget
+// with any of them, like a MemoryResource (which needn't be thread-safe), means one thread.
+NodeProgram* Parser::parseParallel(const char* code, size_t length, size_t threads /* = 0 */,
+    const parse_budget_t* budget /* = NULL */) {
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  size_t segments = min(threads, length / PARALLEL_MIN_SEGMENT);
+  if (segments < 2 || resource != NULL || MemoryResource::current() != NULL ||
+      (budget != NULL && (budget->max_tokens || budget->max_nodes || budget->max_bytes))) {
+    return parse(code, length, budget);
+  }
+  vector<split_point_t> points = findSplitPoints(code, length, segments, extra->opts);
+  if (points.empty()) {
+    return parse(code, length, budget);
+  }
+
+  vector<segment_t> pieces(points.size() + 1);
+  for (size_t ii = 0; ii < pieces.size(); ++ii) {
+    size_t start = ii == 0 ? 0 : points[ii - 1].offset;
+    size_t stop = ii == points.size() ? length : points[ii].offset;
+    pieces[ii].code = code + start;
+    pieces[ii].length = stop - start;
+    pieces[ii].newlines = ii == 0 ? 0 : points[ii - 1].newlines;
+    pieces[ii].opts = extra->opts;
+    pieces[ii].max_errors = extra->max_errors;
+    pieces[ii].budget = budget;
+    pieces[ii].program = NULL;
+    pieces[ii].failed = false;
+  }
+  vector<pthread_t> workers(pieces.size());
+  vector<bool> started(pieces.size(), false);
+  for (size_t ii = 1; ii < pieces.size(); ++ii) {
+    started[ii] = pthread_create(&workers[ii], NULL, parseSegment, &pieces[ii]) == 0;
+  }
+  try {
+    pieces[0].program = parse(pieces[0].code, pieces[0].length, budget);
+  } catch (exception&) {
+    pieces[0].failed = true;
+  }
+  bool failed = pieces[0].failed;
+  for (size_t ii = 1; ii < pieces.size(); ++ii) {
+    if (started[ii]) {
+      pthread_join(workers[ii], NULL);
+    } else {
+      parseSegment(&pieces[ii]);
+    }
+    failed = failed || pieces[ii].failed;
+  }
+  if (failed) {
+    for (size_t ii = 0; ii < pieces.size(); ++ii) {
+      delete pieces[ii].program;
+    }
+    return parse(code, length, budget);
+  }
+
+  // Every program has one statement list, see `program` in parser.yy
+  auto_ptr<NodeProgram> program(pieces[0].program);
+  Node* statements = program->childNodes().front();
+  for (size_t ii = 1; ii < pieces.size(); ++ii) {
+    node_list_t& more = pieces[ii].program->childNodes().front()->childNodes();
+    statements->childNodes().splice(statements->childNodes().end(), more);
+    program->_peak += pieces[ii].program->_peak;
+    delete pieces[ii].program;
+  }
+  return program.release();
+}
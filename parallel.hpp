@@ -0,0 +1,53 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include "node.hpp"
+
+//
+// Parsing one big program on several threads. A bundle made by concatenating modules is mostly a
+// long run of top-level statements, and a program split between two of them parses to the two
+// halves of the same statement list. findSplitPoints() finds such places without parsing, with the
+// pre-scan in prescan.hpp: a `;` with no brackets open. Parser::parseParallel() parses the pieces at
+// once and splices their statements together:
+//
+//   Parser parser;
+//   std::auto_ptr<NodeProgram> program(parser.parseParallel(code.data(), code.size()));
+//
+// The pre-scan is a guess at what the scanner will do, not a parse. If it guesses wrong, a piece
+// fails to parse on its own and the whole program is parsed again on one thread, so the tree (and any
+// ParseException) is always the one Parser::parse() gives. A program which is one big statement, like
+// a bundle wrapped in a single function call, has nowhere to split and is parsed on one thread.
+namespace fbjs {
+
+  // Pieces smaller than this aren't worth a thread
+  const size_t PARALLEL_MIN_SEGMENT = 256 * 1024;
+
+  struct split_point_t {
+    size_t offset; // just after a top-level `;`
+    unsigned int newlines; // before `offset`, so the piece after it starts on line newlines + 1
+  };
+
+  // Up to `segments` - 1 split points, in order, as near as it can get to dividing the code into
+  // `segments` equal pieces. PARSE_E4X in `opts` makes it look for XML literals.
+  std::vector<split_point_t> findSplitPoints(const char* code, size_t length, size_t segments,
+    node_parse_enum opts = PARSE_NONE);
+}
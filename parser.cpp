@@ -18,25 +18,228 @@
 * @author Marcel Laverdet 
 */
 
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
 #include "node.hpp"
 #include "parser.hpp"
+#include "prescan.hpp"
+#include "trace.hpp"
 #ifdef DEBUG_BISON
 extern int yydebug;
 #endif
 using namespace std;
 using namespace fbjs;
 
+void fbjs_reset_parser(fbjs_parse_extra* extra) {
+  extra->errors.clear();
+  extra->terminated = false;
+  extra->lineno = 1;
+  extra->last_tok = 0;
+  extra->last_tok_xml = false;
+  extra->last_paren_tok = 0;
+  extra->last_curly_tok = 0;
+  extra->virtual_semicolon_last_state = 0;
+  extra->tokens = 0;
+  extra->depth = 0;
+  extra->exhausted = BUDGET_NONE;
+  extra->exhausted_lineno = 0;
+  extra->partial = false;
+  extra->base_nodes = 0;
+  extra->base_bytes = 0;
+  while (!extra->paren_stack.empty()) {
+    extra->paren_stack.pop();
+  }
+  while (!extra->curly_stack.empty()) {
+    extra->curly_stack.pop();
+  }
+  while (!extra->pre_xml_stack.empty()) {
+    extra->pre_xml_stack.pop();
+  }
+}
+
+//
+// Token text goes from the scanner to the parser, which frees it as soon as it's been copied into a
+// node. That all happens inside one parse and so inside one MemoryResourceScope, if there is one, and
+// the text comes from its resource with its size in front. `length` doesn't count the NUL.
+char* fbjs_alloc_text(size_t length) {
+  MemoryResource* resource = MemoryResource::current();
+  if (resource == NULL) {
+    char* text = static_cast<char*>(malloc(length + 1));
+    if (text == NULL) {
+      throw bad_alloc();
+    }
+    return text;
+  }
+  size_t* block = static_cast<size_t*>(resource->allocate(sizeof(size_t) + length + 1));
+  *block = sizeof(size_t) + length + 1;
+  return reinterpret_cast<char*>(block + 1);
+}
+
+char* fbjs_copy_text(const char* text, size_t length) {
+  char* copy = fbjs_alloc_text(length);
+  memcpy(copy, text, length);
+  copy[length] = 0;
+  return copy;
+}
+
+void fbjs_free_text(char* text) {
+  MemoryResource* resource = MemoryResource::current();
+  if (resource == NULL) {
+    free(text);
+  } else if (text != NULL) {
+    size_t* block = reinterpret_cast<size_t*>(text) - 1;
+    resource->deallocate(block, *block);
+  }
+}
+
+//
+// Copies a run of XML text, replacing the predefined entities. Entities are always longer than the
+// character they stand for so the result fits in a buffer of the same size.
+char* xml_decode_text(const char* text, size_t length) {
+  static const struct {
+    const char* entity;
+    size_t length;
+    char ch;
+  } entities[] = {
+    {"&amp;", 5, '&'}, {"&lt;", 4, '<'}, {"&gt;", 4, '>'}, {"&apos;", 6, '\''}, {"&quot;", 6, '"'},
+  };
+  char* ret = fbjs_alloc_text(length);
+  char* out = ret;
+  const char* end = text + length;
+  while (text < end) {
+    const char* entity = static_cast<const char*>(memchr(text, '&', end - text));
+    if (entity == NULL) {
+      entity = end;
+    }
+    memcpy(out, text, entity - text);
+    out += entity - text;
+    text = entity;
+    if (text < end) {
+      // The scanner only matches well-formed entities
+      for (size_t ii = 0; ii < sizeof(entities) / sizeof(entities[0]); ++ii) {
+        if (strncmp(text, entities[ii].entity, entities[ii].length) == 0) {
+          *out++ = entities[ii].ch;
+          text += entities[ii].length;
+          break;
+        }
+      }
+    }
+  }
+  *out = 0;
+  return ret;
+}
+
+//
+// Budgets
+void parse_budget_t::setTimeout(double seconds) {
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += (time_t)seconds;
+  deadline.tv_nsec += (long)((seconds - (time_t)seconds) * 1e9);
+  if (deadline.tv_nsec >= 1000000000) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= 1000000000;
+  }
+}
+
+namespace {
+  string budgetMessage(budget_limit_enum limit, int lineno) {
+    static const char* const reasons[] = {
+      "no limit", "too many tokens", "too many nodes", "nested too deeply", "too much memory",
+      "out of time", "cancelled",
+    };
+    stringstream message;
+    message << "Parse stopped on line " << lineno << ": " << reasons[limit];
+    return message.str();
+  }
+}
+
+ParseBudgetException::ParseBudgetException(budget_limit_enum limit, int lineno) :
+  std::runtime_error(budgetMessage(limit, lineno)), _limit(limit), _lineno(lineno) {}
+
+//
+// Called by both scanners for every token when there's a budget. Running over it stops the scanner
+// like a fatal syntax error does, and the parser unwinds and frees what it built the same way. The
+// clock is only read every 64 tokens.
+void fbjs_check_budget(void* yyscanner, int tok) {
+  fbjs_parse_extra* extra = yyget_extra(yyscanner);
+  const parse_budget_t* budget = extra->budget;
+  if (extra->terminated) {
+    return;
+  }
+  switch (tok) {
+    case t_LCURLY:
+    case t_LPAREN:
+    case t_LBRACKET:
+      ++extra->depth;
+      break;
+    case t_RCURLY:
+    case t_RPAREN:
+    case t_RBRACKET:
+      if (extra->depth) {
+        --extra->depth;
+      }
+      break;
+  }
+  ++extra->tokens;
+
+  MemoryTracker* tracker = MemoryTracker::current();
+  budget_limit_enum limit = BUDGET_NONE;
+  if (budget->isCancelled()) {
+    limit = BUDGET_CANCELLED;
+  } else if (budget->max_tokens && extra->tokens > budget->max_tokens) {
+    limit = BUDGET_TOKENS;
+  } else if (budget->max_depth && extra->depth > budget->max_depth) {
+    limit = BUDGET_DEPTH;
+  } else if (budget->max_nodes && tracker != NULL && extra->base_nodes + tracker->nodes() > budget->max_nodes) {
+    limit = BUDGET_NODES;
+  } else if (budget->max_bytes && tracker != NULL && extra->base_bytes + tracker->live() > budget->max_bytes) {
+    limit = BUDGET_BYTES;
+  } else if (budget->deadline.tv_sec && (extra->tokens & 63) == 0) {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > budget->deadline.tv_sec ||
+        (now.tv_sec == budget->deadline.tv_sec && now.tv_nsec >= budget->deadline.tv_nsec)) {
+      limit = BUDGET_DEADLINE;
+    }
+  }
+  if (limit != BUDGET_NONE) {
+    extra->exhausted = limit;
+    extra->exhausted_lineno = yyget_lloc(yyscanner)->first_line;
+    extra->terminated = true;
+  }
+}
+
+//
+// Runs whichever parser the options ask for over the scanner's input. Returns the most heap the tree
+// held at once along the way, for NodeProgram::memoryUsage(). That's the nodes, links and strings
+// under `root` and any the parser made and threw away, but not the scanner's buffers or bison's
+// stacks.
+size_t fbjs_run_parser(fbjs_parse_extra* extra, void* scanner, NodeProgram* root) {
+  MemoryTracker tracker;
+  {
+    FBJS_STAT_PHASE("parse");
+    FBJS_TRACE_EVENT("parse");
+    if (extra->opts & PARSE_DESCENT) {
+      fbjs_descent_parse(scanner, root);
+    } else {
+      yyparse(scanner, root);
+    }
+  }
+  FBJS_STAT(countTree(root));
+  return heapSize(sizeof(NodeProgram)) + tracker.peak(); // the root was allocated before the tracker
+}
+
 void* fbjs_init_parser(fbjs_parse_extra* extra) {
 
   // Initialize the scanner.
   void* scanner;
   yylex_init_extra(extra, &scanner);
-  extra->error = NULL;
-  extra->error_line = 0;
-  extra->terminated = false;
-  extra->lineno = 1;
-  extra->last_tok = 0;
-  extra->last_paren_tok = 0;
+  extra->max_errors = 1;
+  extra->budget = NULL;
+  fbjs_reset_parser(extra);
 
   // Debug stuff
 #ifdef DEBUG_BISON
@@ -51,31 +254,283 @@ void* fbjs_init_parser(fbjs_parse_extra* extra) {
 
 void fbjs_cleanup_parser(fbjs_parse_extra* extra, void* scanner) {
   yylex_destroy(scanner);
-  if (extra->error != NULL) {
-    string error(extra->error);
-    free(extra->error);
-    throw ParseException(error, extra->error_line);
+  if (extra->exhausted != BUDGET_NONE) {
+    throw ParseBudgetException(extra->exhausted, extra->exhausted_lineno);
+  } else if (!extra->errors.empty()) {
+    throw ParseException(extra->errors);
   }
 }
 
 //
 // Parse from a file
-NodeProgram::NodeProgram(FILE* file, node_parse_enum opts /* = PARSE_NONE */) : Node(1) {
+NodeProgram::NodeProgram(FILE* file, node_parse_enum opts /* = PARSE_NONE */, size_t max_errors /* = 20 */,
+    const parse_budget_t* budget /* = NULL */) : Node(1) {
   fbjs_parse_extra extra;
   void* scanner = fbjs_init_parser(&extra);
   extra.opts = opts;
+  extra.max_errors = max_errors;
+  extra.budget = budget;
   yyrestart(file, scanner); // read from file
-  yyparse(scanner, this);
+  this->_peak = fbjs_run_parser(&extra, scanner, this);
   fbjs_cleanup_parser(&extra, scanner);
 }
 
 //
 // Parser from a string
-NodeProgram::NodeProgram(const char* str, node_parse_enum opts /* = PARSE_NONE */) : Node(1) {
+NodeProgram::NodeProgram(const char* str, node_parse_enum opts /* = PARSE_NONE */, size_t max_errors /* = 20 */,
+    const parse_budget_t* budget /* = NULL */) : Node(1) {
   fbjs_parse_extra extra;
   void* scanner = fbjs_init_parser(&extra);
   extra.opts = opts;
+  extra.max_errors = max_errors;
+  extra.budget = budget;
   yy_scan_string(str, scanner); // read from string
-  yyparse(scanner, this);
+  this->_peak = fbjs_run_parser(&extra, scanner, this);
   fbjs_cleanup_parser(&extra, scanner);
 }
+
+//
+// Parser
+Parser::Parser(node_parse_enum opts /* = PARSE_NONE */, size_t max_errors /* = 20 */,
+    MemoryResource* resource /* = NULL */) : resource(resource) {
+  extra = new fbjs_parse_extra;
+  scanner = fbjs_init_parser(extra);
+  extra->opts = opts;
+  extra->max_errors = max_errors;
+}
+
+Parser::~Parser() {
+  yylex_destroy(scanner);
+  delete extra;
+}
+
+void Parser::reset() {
+  fbjs_reset_parser(extra);
+  fbjs_reset_scanner(scanner);
+}
+
+void Parser::finish() {
+  extra->budget = NULL;
+  if (extra->exhausted != BUDGET_NONE) {
+    extra->errors.clear();
+    throw ParseBudgetException(extra->exhausted, extra->exhausted_lineno);
+  } else if (!extra->errors.empty()) {
+    vector<parse_error_t> errors;
+    errors.swap(extra->errors);
+    throw ParseException(errors);
+  }
+}
+
+NodeProgram* Parser::parse(const char* code, const parse_budget_t* budget /* = NULL */) {
+  return parse(code, strlen(code), budget);
+}
+
+NodeProgram* Parser::parse(const char* code, size_t length, const parse_budget_t* budget /* = NULL */) {
+  MemoryResourceScope scope(resource);
+  reset();
+  extra->budget = budget;
+
+  // Scan a reused copy of the input instead of having flex allocate one each time
+  input.assign(code, code + length);
+  input.push_back(0);
+  input.push_back(0);
+  void* buffer = yy_scan_buffer(&input[0], input.size(), scanner);
+  auto_ptr<NodeProgram> program(new NodeProgram());
+  program->setLineno(1);
+  program->_peak = fbjs_run_parser(extra, scanner, program.get());
+  yy_delete_buffer(buffer, scanner);
+  finish();
+  return program.release();
+}
+
+NodeProgram* Parser::parse(FILE* file, const parse_budget_t* budget /* = NULL */) {
+  MemoryResourceScope scope(resource);
+  reset();
+  extra->budget = budget;
+  yyrestart(file, scanner); // reuses the scanner's buffer after the first file
+  auto_ptr<NodeProgram> program(new NodeProgram());
+  program->setLineno(1);
+  program->_peak = fbjs_run_parser(extra, scanner, program.get());
+  finish();
+  return program.release();
+}
+
+//
+// PushParser
+struct fbjs_push_state {
+  yypstate* state;
+  YYLTYPE lloc; // the scanner keeps the line number here
+  auto_ptr<NodeProgram> program;
+  vector<char> pending; // fed but not scanned yet
+  prescan_t prescan; // where it stopped in `pending`, at `scanned`
+  size_t scanned;
+  const parse_budget_t* budget;
+  size_t live; // heap the tree holds so far, as MemoryTracker counts it
+  size_t peak;
+  bool started; // fed part of a program
+  bool parsing; // and bison is waiting for more of it
+
+  fbjs_push_state() :
+    state(NULL), prescan(NULL, 0), scanned(0), budget(NULL), live(0), peak(0), started(false), parsing(false) {}
+};
+
+PushParser::PushParser(node_parse_enum opts /* = PARSE_NONE */, size_t max_errors /* = 20 */,
+    const parse_budget_t* budget /* = NULL */, MemoryResource* resource /* = NULL */) : resource(resource) {
+  extra = new fbjs_parse_extra;
+  scanner = fbjs_init_parser(extra);
+  extra->opts = opts;
+  extra->max_errors = max_errors;
+  push = new fbjs_push_state;
+  push->budget = budget;
+}
+
+PushParser::~PushParser() {
+  MemoryResourceScope scope(resource);
+  abandon();
+  yylex_destroy(scanner);
+  delete push;
+  delete extra;
+}
+
+void PushParser::start() {
+  fbjs_reset_parser(extra);
+  fbjs_reset_scanner(scanner);
+  extra->budget = push->budget;
+  extra->partial = true;
+  push->state = yypstate_new();
+  if (push->state == NULL) {
+    throw bad_alloc();
+  }
+  push->lloc.first_line = push->lloc.last_line = 1;
+  push->lloc.first_column = push->lloc.last_column = 1;
+  push->program.reset(new NodeProgram());
+  push->program->setLineno(1);
+  push->prescan = prescan_t(NULL, 0, extra->opts, false);
+  push->scanned = 0;
+  push->live = 0;
+  push->peak = 0;
+  push->started = true;
+  push->parsing = true;
+}
+
+//
+// Scans and parses the first `length` bytes of `pending`. Returns YYPUSH_MORE until the parse is
+// over, which is when the scanner reaches the real end of the program or has been stopped.
+//
+// They're scanned where they are. The two NUL's flex needs go over the two bytes after them for as
+// long as it takes, and the bytes are put back after.
+int PushParser::scan(size_t length) {
+  vector<char>& pending = push->pending;
+  size_t fed = pending.size();
+  pending.resize(max(fed, length + 2));
+  char after[2] = {pending[length], pending[length + 1]};
+  pending[length] = pending[length + 1] = 0;
+  void* buffer = yy_scan_buffer(&pending[0], length + 2, scanner);
+  int status = YYPUSH_MORE;
+  MemoryTracker tracker;
+  {
+    FBJS_STAT_PHASE("parse");
+    FBJS_TRACE_EVENT("parse");
+    do {
+      YYSTYPE yylval;
+      int tok = yylex(&yylval, &push->lloc, scanner);
+      if (tok == 0 && extra->partial && !extra->terminated) {
+        break; // the end of this chunk
+      }
+      status = yypush_parse(push->state, tok, &yylval, &push->lloc, scanner, push->program.get());
+    } while (status == YYPUSH_MORE);
+  }
+  yy_delete_buffer(buffer, scanner);
+  push->parsing = status == YYPUSH_MORE;
+  pending[length] = after[0];
+  pending[length + 1] = after[1];
+  pending.resize(fed);
+  pending.erase(pending.begin(), pending.begin() + length);
+  push->peak = max(push->peak, push->live + tracker.peak());
+  push->live += tracker.live();
+  extra->base_nodes += tracker.nodes();
+  extra->base_bytes = push->live;
+  return status;
+}
+
+//
+// Stops a program part way through. Ending its input early makes bison unwind its stacks and free
+// everything on them, as it does for a syntax error.
+void PushParser::abandon() {
+  if (!push->started) {
+    return;
+  }
+  if (push->parsing) {
+    extra->terminated = true;
+    YYSTYPE yylval;
+    yypush_parse(push->state, 0, &yylval, &push->lloc, scanner, push->program.get());
+  }
+  yypstate_delete(push->state);
+  push->state = NULL;
+  push->program.reset();
+  push->pending.clear();
+  push->started = false;
+  push->parsing = false;
+}
+
+// Throws whatever stopped the parse
+void PushParser::fail() {
+  abandon();
+  extra->budget = NULL;
+  if (extra->exhausted != BUDGET_NONE) {
+    extra->errors.clear();
+    throw ParseBudgetException(extra->exhausted, extra->exhausted_lineno);
+  }
+  vector<parse_error_t> errors;
+  errors.swap(extra->errors);
+  throw ParseException(errors);
+}
+
+void PushParser::feed(const char* code, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  MemoryResourceScope scope(resource);
+  if (!push->started) {
+    start();
+  }
+
+  // Scan up to the last bracket, ',' or ';' so far, which is sure to be the end of a token
+  push->pending.insert(push->pending.end(), code, code + length);
+  const char* begin = &push->pending[0];
+  push->prescan.pos = begin + push->scanned;
+  push->prescan.end = begin + push->pending.size();
+  size_t cut = 0;
+  for (;;) {
+    prescan_enum ret = push->prescan.next();
+    if (ret == PRESCAN_SEMICOLON || ret == PRESCAN_PUNCTUATOR) {
+      cut = push->prescan.pos - begin;
+    } else if (ret != PRESCAN_TOKEN) {
+      break;
+    }
+  }
+  push->scanned = push->prescan.pos - begin - cut;
+  if (cut && scan(cut) != YYPUSH_MORE) {
+    fail();
+  }
+}
+
+NodeProgram* PushParser::finish() {
+  MemoryResourceScope scope(resource);
+  if (!push->started) {
+    start();
+  }
+  extra->partial = false;
+  if (scan(push->pending.size()) != 0 || !extra->errors.empty() || extra->exhausted != BUDGET_NONE) {
+    fail();
+  }
+  yypstate_delete(push->state);
+  push->state = NULL;
+  push->started = false;
+  push->parsing = false;
+  extra->budget = NULL;
+  auto_ptr<NodeProgram> program(push->program);
+  program->_peak = heapSize(sizeof(NodeProgram)) + push->peak; // the root was allocated before the trackers
+  FBJS_STAT(countTree(program.get()));
+  return program.release();
+}
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stack>
+#include <vector>
 
 //#define DEBUG_FLEX
 //#define DEBUG_BISON
@@ -30,6 +31,7 @@
 #define YY_USER_INIT yylloc->first_line = 1
 
 #include "node.hpp"
+#include "stats.hpp"
 
 #ifdef NOT_FBMAKE
 #include "parser.yacc.hpp"
@@ -38,8 +40,8 @@
 #include "libfbjs/parser.yy.h"
 #endif
 struct fbjs_parse_extra {
-  char* error;
-  int error_line;
+  std::vector<fbjs::parse_error_t> errors;
+  size_t max_errors; // only used with PARSE_RECOVER
   bool terminated;
   std::stack<int> paren_stack;
   std::stack<int> curly_stack;
@@ -51,6 +53,14 @@ struct fbjs_parse_extra {
   int last_curly_tok;
   int lineno;
   fbjs::node_parse_enum opts;
+  const fbjs::parse_budget_t* budget; // NULL for none
+  size_t tokens; // only counted with a budget, as is depth
+  size_t depth;
+  fbjs::budget_limit_enum exhausted;
+  int exhausted_lineno;
+  bool partial; // a PushParser has more input to come, so the end of this input isn't the end
+  size_t base_nodes; // what a PushParser's earlier feeds allocated, for the budget
+  size_t base_bytes;
 };
 
 // Why the hell doesn't flex provide a header file?
@@ -63,8 +73,18 @@ YYLTYPE* yyget_lloc(void* yyscanner);
 void yyset_extra(YY_EXTRA_TYPE arbitrary_data, void* scanner);
 void yyset_debug(int bdebug, void* yyscanner);
 void yyrestart(FILE* input_file, void* yyscanner);
+void* fbjs_init_parser(fbjs_parse_extra* extra);
+void fbjs_reset_scanner(void* yyscanner);
+void fbjs_check_budget(void* yyscanner, int tok);
 int yyparse(void* yyscanner, fbjs::Node* root);
+void fbjs_descent_parse(void* yyscanner, fbjs::Node* root);
 const char* yytokname(int tok);
+char* xml_decode_text(const char* text, size_t length);
+char* fbjs_alloc_text(size_t length);
+char* fbjs_copy_text(const char* text, size_t length);
+void fbjs_free_text(char* text);
 #ifndef FLEX_SCANNER
 void* yy_scan_string(const char *yy_str, void* yyscanner);
+void* yy_scan_buffer(char* base, size_t size, void* yyscanner);
+void yy_delete_buffer(void* buffer, void* yyscanner);
 #endif
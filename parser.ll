@@ -22,7 +22,9 @@
 #include <string.h>
 
 #ifdef NOT_FBMAKE
+#include "keywords.hpp"
 #include "parser.hpp"
+#include "scan.hpp"
 #else
 /**
  * This is a temporary workaround a drawback of fbconfig/fbmake.
@@ -32,7 +34,9 @@
  * Another workaround without the following change is:
  *   fbmake dbg CXX_FLAGS=-I./libfbjs
  */
+#include "libfbjs/keywords.hpp"
 #include "libfbjs/parser.hpp"
+#include "libfbjs/scan.hpp"
 #endif
 
 using namespace fbjs;
@@ -66,6 +70,9 @@ using namespace fbjs;
     case XML_CDATA: \
       fprintf(stderr, "BEGIN(XML_CDATA)\n"); \
       break; \
+    case XML_TEXT: \
+      fprintf(stderr, "BEGIN(XML_TEXT)\n"); \
+      break; \
     default: \
       fprintf(stderr, "BEGIN(%d)\n", a); \
   } \
@@ -79,6 +86,10 @@ using namespace fbjs;
 
 int parsertok_(void*, int, bool = false);
 void terminate(void* yyscanner, const char* str);
+char* fbjs_input_begin(void* guts);
+char* fbjs_input_end(void* guts);
+void fbjs_input_skip(void* guts, const char* to);
+int fbjs_input(void* guts);
 %}
 
 %option noyywrap
@@ -94,12 +105,15 @@ void terminate(void* yyscanner, const char* str);
 %x XML
 %x XML_CDATA
 %x XML_PI
+%x XML_TEXT
 FBJSBEGIN(IDENTIFIER);
 
 /* ECMA-262 and ECMA-357 disagree on the definition of whitespace. Note: both
    macros omit \n. You must manually scan for \n and increment yylineno. */
 JS_WHITESPACE [ \t\x0b\x0c\xa0\r]*
 XML_WHITESPACE [ \t\r]*
+XML_TEXT [^:={}<>"'/& \t\r\n]
+XML_ENTITY "&"("amp"|"lt"|"gt"|"apos"|"quot")";"
 
 %%
 <NO_LINEBREAK>{
@@ -115,31 +129,49 @@ XML_WHITESPACE [ \t\r]*
 }
 <INITIAL,IDENTIFIER,DOT,VIRTUAL_SEMICOLON,NO_LINEBREAK>{
   /* start conditon is all, minus REGEX and XML */
-  "<!--".*  /* om nom nom */
-  "//".*    |
+  "<!--" |
+  "//" {
+    // Skip to the end of the line but leave the \n for the rule below
+    for (;;) {
+      char* end = fbjs_input_end(yyg);
+      char* eol = const_cast<char*>(scan_line_comment(fbjs_input_begin(yyg), end));
+      fbjs_input_skip(yyg, eol);
+      if (eol != end) {
+        break;
+      }
+      // End of flex's buffer; fbjs_input() reads more
+      int c = fbjs_input(yyg);
+      if (c == EOF) {
+        break;
+      } else if (c == '\n') {
+        unput('\n');
+        break;
+      }
+    }
+  }
   {JS_WHITESPACE}+ /* om nom nom */
   "/*" {
-    char c;
+    int c;
     bool newline = false;
     for (;;) {
-      while ((c = yyinput(yyscanner)) != '*' && c != EOF) {
-        if (c == '\n') {
-          ++yylloc->first_line;
-          newline = true;
-        }
+      unsigned int newlines = 0;
+      fbjs_input_skip(yyg, scan_block_comment(fbjs_input_begin(yyg), fbjs_input_end(yyg), newlines));
+      if (newlines) {
+        yylloc->first_line += newlines;
+        newline = true;
       }
+      c = fbjs_input(yyg);
       if (c == '*') {
-        while ((c = yyinput(yyscanner)) == '*');
+        while ((c = fbjs_input(yyg)) == '*');
         if (c == '/') {
           break;
-        } else if (c == '\n') {
-          ++yylloc->first_line;
-          newline = true;
         }
       }
-      if (c == EOF) {
+      if (c == '\n') {
+        ++yylloc->first_line;
+        newline = true;
+      } else if (c == EOF) {
         return 0;
-        break;
       }
     }
     // This is to properly interpret virtual semicolons, see section 7.4 of E262-3. Essentially, this should parse:
@@ -151,35 +183,33 @@ XML_WHITESPACE [ \t\r]*
     }
   }
 }
-<VIRTUAL_SEMICOLON,INITIAL,IDENTIFIER>{
-  "catch"  return parsertok(t_CATCH);
-  "finally"  return parsertok(t_FINALLY);
-  "in"  return parsertok(t_IN);
-  "instanceof"  return parsertok(t_INSTANCEOF);
-}
 <VIRTUAL_SEMICOLON>{
-  "else" {
-    if ((yyextra->last_tok == t_RPAREN && (yyextra->last_paren_tok == t_IF || yyextra->last_paren_tok == t_FOR || yyextra->last_paren_tok == t_WHILE)) ||
-        yyextra->last_tok == t_SEMICOLON || yyextra->last_tok == t_RCURLY) {
-      return parsertok(t_ELSE);
-    } else {
-      yyless(0);
-      FBJSBEGIN(INITIAL);
-      return t_VIRTUAL_SEMICOLON;
-    }
-  }
-  "while" {
-    if ((yyextra->last_tok == t_RPAREN && (yyextra->last_paren_tok == t_IF || yyextra->last_paren_tok == t_FOR || yyextra->last_paren_tok == t_WHILE)) ||
-        (yyextra->last_tok == t_RCURLY && yyextra->last_curly_tok == t_DO) ||
-        yyextra->last_tok == t_SEMICOLON || yyextra->last_tok == t_RCURLY) {
-      return parsertok(t_WHILE);
-    } else {
-      yyless(0);
-      FBJSBEGIN(INITIAL);
-      return t_VIRTUAL_SEMICOLON;
-    }
-  }
   [a-zA-Z$_0-9]+ {
+    const keyword_t* keyword = findKeyword(yytext, yyleng);
+    int tok = keyword ? keyword->token : 0;
+    if (tok == t_CATCH || tok == t_FINALLY || tok == t_IN || tok == t_INSTANCEOF) {
+      // These continue the statement on the previous line
+      return parsertok(tok);
+    } else if (tok == t_ELSE) {
+      if ((yyextra->last_tok == t_RPAREN && (yyextra->last_paren_tok == t_IF || yyextra->last_paren_tok == t_FOR || yyextra->last_paren_tok == t_WHILE)) ||
+          yyextra->last_tok == t_SEMICOLON || yyextra->last_tok == t_RCURLY) {
+        return parsertok(t_ELSE);
+      } else {
+        yyless(0);
+        FBJSBEGIN(INITIAL);
+        return t_VIRTUAL_SEMICOLON;
+      }
+    } else if (tok == t_WHILE) {
+      if ((yyextra->last_tok == t_RPAREN && (yyextra->last_paren_tok == t_IF || yyextra->last_paren_tok == t_FOR || yyextra->last_paren_tok == t_WHILE)) ||
+          (yyextra->last_tok == t_RCURLY && yyextra->last_curly_tok == t_DO) ||
+          yyextra->last_tok == t_SEMICOLON || yyextra->last_tok == t_RCURLY) {
+        return parsertok(t_WHILE);
+      } else {
+        yyless(0);
+        FBJSBEGIN(INITIAL);
+        return t_VIRTUAL_SEMICOLON;
+      }
+    }
     yyless(0);
     if (yyextra->last_tok == t_RPAREN &&
         (yyextra->last_paren_tok == t_IF || yyextra->last_paren_tok == t_DO || yyextra->last_paren_tok == t_FOR ||
@@ -199,10 +229,7 @@ XML_WHITESPACE [ \t\r]*
   }
 }
 <INITIAL,IDENTIFIER>{
-  "break"  return parsertok(t_BREAK);
-  "case"  return parsertok(t_CASE);
-  "continue"  return parsertok(t_CONTINUE);
-  "default"  return parsertok(t_DEFAULT);
+  /* Single keywords are classified by the identifier rule below */
   "default"({JS_WHITESPACE}|\n)+"xml"({JS_WHITESPACE}|\n)+"namespace" {
     while (*++yytext) {
       if (*yytext == '\n') {
@@ -211,10 +238,6 @@ XML_WHITESPACE [ \t\r]*
     }
     return parsertok(t_XML_DEFAULT_NAMESPACE);
   }
-  "delete"  return parsertok(t_DELETE);
-  "do"  return parsertok(t_DO);
-  "else"  return parsertok(t_ELSE);
-  "for"  return parsertok(t_FOR);
   "for"({JS_WHITESPACE}|\n)+"each" {
     while (*++yytext) {
       if (*yytext == '\n') {
@@ -223,23 +246,6 @@ XML_WHITESPACE [ \t\r]*
     }
     return parsertok(t_FOR_EACH);
   }
-  "function" return parsertok(t_FUNCTION);
-  "if"  return parsertok(t_IF);
-  "new"  return parsertok(t_NEW);
-  "return"  return parsertok(t_RETURN);
-  "switch"  return parsertok(t_SWITCH);
-  "this"  return parsertok(t_THIS);
-  "throw"  return parsertok(t_THROW);
-  "try"  return parsertok(t_TRY);
-  "typeof"  return parsertok(t_TYPEOF);
-  "var"  return parsertok(t_VAR);
-  "void"  return parsertok(t_VOID);
-  "while"  return parsertok(t_WHILE);
-  "with"  return parsertok(t_WITH);
-  "const" return parsertok(t_CONST);
-  "null"  return parsertok(t_NULL);
-  "false"  return parsertok(t_FALSE);
-  "true"  return parsertok(t_TRUE);
 }
 0x[a-fA-F0-9]+ {
   unsigned int val;
@@ -266,7 +272,13 @@ XML_WHITESPACE [ \t\r]*
   return parsertok(t_NUMBER);
 }
 <INITIAL,IDENTIFIER,DOT>[a-zA-Z$_][a-zA-Z$_0-9]* {
-  yylval->string = strdup(yytext);
+  if (YY_START != DOT) {
+    const keyword_t* keyword = findKeyword(yytext, yyleng);
+    if (keyword && keyword->token) {
+      return parsertok(keyword->token);
+    }
+  }
+  yylval->string = fbjs_copy_text(yytext, strlen(yytext));
   return parsertok(t_IDENTIFIER);
 }
 <DOT>{
@@ -278,20 +290,31 @@ XML_WHITESPACE [ \t\r]*
 }
 '|\" {
   std::string str = yytext;
-  char c;
-  while ((c = yyinput(yyscanner)) != EOF) {
+  int c;
+  for (;;) {
+    // Copy everything up to the next quote, backslash or line break at once
+    char* begin = fbjs_input_begin(yyg);
+    const char* stop = scan_string(begin, fbjs_input_end(yyg), yytext[0]);
+    str.append(begin, stop - begin);
+    fbjs_input_skip(yyg, stop);
+    if ((c = fbjs_input(yyg)) == EOF) {
+      break;
+    }
     str += c;
     if (c == yytext[0]) {
       break;
     } else if (c == '\\') {
-      c = yyinput(yyscanner);
+      c = fbjs_input(yyg);
       if (c == EOF) {
         yyless(0);
         break;
       } else if (c == '\r') {
         str.erase(--str.end());
-        c = yyinput(yyscanner);
-        if (c != '\n') {
+        ++yylloc->first_line;
+        c = fbjs_input(yyg);
+        if (c == EOF) {
+          break;
+        } else if (c != '\n') {
           str += c;
           if (c == yytext[0]) {
             break;
@@ -299,6 +322,7 @@ XML_WHITESPACE [ \t\r]*
         }
       } else if (c == '\n') {
         str.erase(--str.end());
+        ++yylloc->first_line;
       } else if (c == EOF) {
         yyless(0);
         break;
@@ -310,7 +334,7 @@ XML_WHITESPACE [ \t\r]*
       break;
     }
   }
-  yylval->string = strdup(str.c_str());
+  yylval->string = fbjs_copy_text(str.data(), str.size());
   return parsertok(t_STRING);
 }
 <IDENTIFIER>"/" FBJSBEGIN(REGEX);
@@ -322,13 +346,10 @@ XML_WHITESPACE [ \t\r]*
       --flag_pos;
     }
     // regex
-    yylval->string_duple[0] = (char*)malloc(flag_pos + 1);
-    memcpy(yylval->string_duple[0], yytext, flag_pos);
-    yylval->string_duple[0][flag_pos] = 0;
+    yylval->string_duple[0] = fbjs_copy_text(yytext, flag_pos);
 
     // flags
-    yylval->string_duple[1] = (char*)malloc(len - flag_pos);
-    memcpy(yylval->string_duple[1], yytext + flag_pos + 1, len - flag_pos);
+    yylval->string_duple[1] = fbjs_copy_text(yytext + flag_pos + 1, len - flag_pos - 1);
 
     return parsertok(t_REGEX);
   }
@@ -412,69 +433,70 @@ XML_WHITESPACE [ \t\r]*
 "@"    return parsertok(t_XML_ATTRIBUTE);
 ".."   return parsertok(t_XML_DESCENDENT);
 "::"   return parsertok(t_XML_QUALIFIER);
-<XML>{
-  [a-zA-Z_][a-zA-Z0-9.\-_]* {
-    yylval->string = strdup(yytext);
-    return parsertok(t_XML_NAME_FRAGMENT);
-  }
-  {XML_WHITESPACE}+ {
-    yylval->string = strdup(yytext);
-    return parsertok(t_XML_WHITESPACE);
-  }
-  \n {
-    ++yylloc->first_line;
-    yylval->string = strdup(yytext);
-    return parsertok(t_XML_WHITESPACE);
-  }
+<XML,XML_TEXT>{
   "<![CDATA[" {
+    yyextra->pre_xml_stack.push(YY_START);
     FBJSBEGIN(XML_CDATA);
   }
   "<!--"([^\-\n]+|-[^\-\n])+"-->" {
     yytext[yyleng - 3] = 0;
-    yylval->string = strdup(yytext + 4);
+    yylval->string = fbjs_copy_text(yytext + 4, strlen(yytext + 4));
     return t_XML_COMMENT;
   }
   "<?" {
+    yyextra->pre_xml_stack.push(YY_START);
     FBJSBEGIN(XML_PI);
   }
-  [^:={}<>"'/& \t\r\n]+ {
-    yylval->string = strdup(yytext);
-    return parsertok(t_XML_CDATA);
+  "{" return parsertok(t_LCURLY);
+  "<" return parsertok(t_LESS_THAN);
+  "</" {
+    // The closing tag
+    FBJSBEGIN(XML);
+    return parsertok(t_XML_LT_DIV);
   }
-  "&amp;" {
-    yylval->string = strdup("&");
-    return parsertok(t_XML_CDATA);
+  [ \t\r\n]+ {
+    for (char* ii = yytext; *ii; ++ii) {
+      if (*ii == '\n') {
+        ++yylloc->first_line;
+      }
+    }
+    yylval->string = fbjs_copy_text(yytext, strlen(yytext));
+    return parsertok(t_XML_WHITESPACE);
   }
-  "&lt;" {
-    yylval->string = strdup("<");
-    return parsertok(t_XML_CDATA);
+  "&" {
+    terminate(yyscanner, "invalid entity");
+    return 0;
   }
-  "&gt;" {
-    yylval->string = strdup(">");
+}
+<XML_TEXT>{
+  ([^<{&]|{XML_ENTITY})+ {
+    // Element content: all of it up to the next tag or embedded expression is one token
+    for (char* ii = yytext; ii < yytext + yyleng; ++ii) {
+      if (*ii == '\n') {
+        ++yylloc->first_line;
+      }
+    }
+    yylval->string = xml_decode_text(yytext, yyleng);
     return parsertok(t_XML_CDATA);
   }
-  "&apos;" {
-    yylval->string = strdup("'");
-    return parsertok(t_XML_CDATA);
+}
+<XML>{
+  [a-zA-Z_][a-zA-Z0-9.\-_]* {
+    yylval->string = fbjs_copy_text(yytext, strlen(yytext));
+    return parsertok(t_XML_NAME_FRAGMENT);
   }
-  "&quot;" {
-    yylval->string = strdup("\"");
+  ({XML_TEXT}|{XML_ENTITY})+ {
+    // One token for a whole run of text, entities included
+    yylval->string = xml_decode_text(yytext, yyleng);
     return parsertok(t_XML_CDATA);
   }
-  "&" {
-    terminate(yyscanner, "invalid entity");
-    return 0;
-  }
   ":" return parsertok(t_COLON);
   "=" return parsertok(t_ASSIGN);
-  "{" return parsertok(t_LCURLY);
   "}" return parsertok(t_RCURLY);
-  "<" return parsertok(t_LESS_THAN);
   ">" return parsertok_xml(t_GREATER_THAN);
   \" return parsertok(t_XML_QUOTE);
   \' return parsertok(t_XML_APOS);
   "/" return parsertok(t_DIV);
-  "</" return parsertok(t_XML_LT_DIV);
 }
 <XML_CDATA>{
   [^\]\n]+ {
@@ -490,8 +512,9 @@ XML_WHITESPACE [ \t\r]*
   "]]>" {
     /* 3 is length of "]]>" */
     yytext[yyleng - 3] = 0;
-    yylval->string = strdup(yytext);
-    FBJSBEGIN(XML);
+    yylval->string = fbjs_copy_text(yytext, strlen(yytext));
+    FBJSBEGIN(yyextra->pre_xml_stack.top());
+    yyextra->pre_xml_stack.pop();
     return t_XML_CDATA;
   }
 }
@@ -509,8 +532,9 @@ XML_WHITESPACE [ \t\r]*
   "?>" {
     /* 2 is length of "]]>" */
     yytext[yyleng - 2] = 0;
-    yylval->string = strdup(yytext);
-    FBJSBEGIN(XML);
+    yylval->string = fbjs_copy_text(yytext, strlen(yytext));
+    FBJSBEGIN(yyextra->pre_xml_stack.top());
+    yyextra->pre_xml_stack.pop();
     return t_XML_PI;
   }
 }
@@ -528,7 +552,10 @@ XML_WHITESPACE [ \t\r]*
   }
 }
 <<EOF>> {
-  if (yyextra->last_tok != t_VIRTUAL_SEMICOLON && yyextra->last_tok != t_SEMICOLON) {
+  if (yyextra->partial) {
+    // More to come, see PushParser
+    return 0;
+  } else if (yyextra->last_tok != t_VIRTUAL_SEMICOLON && yyextra->last_tok != t_SEMICOLON) {
     return parsertok(t_VIRTUAL_SEMICOLON);
   } else {
     return 0;
@@ -542,7 +569,7 @@ XML_WHITESPACE [ \t\r]*
 
 int parsertok_(void* guts, int tok, bool was_xml) {
   yyguts_t *yyg = (struct yyguts_t*)guts;
-  if (YY_START != XML) {
+  if (YY_START != XML && YY_START != XML_TEXT) {
   switch (tok) {
     case t_IDENTIFIER:
     case t_NUMBER:
@@ -577,6 +604,10 @@ int parsertok_(void* guts, int tok, bool was_xml) {
   }
   yyextra->last_tok = tok;
   yyextra->last_tok_xml = was_xml;
+  FBJS_STAT(token(tok));
+  if (yyextra->budget != NULL) {
+    fbjs_check_budget(guts, tok);
+  }
 #ifdef DEBUG_FLEX
   fprintf(stderr, "--> %s\n", yytokname(tok));
 #endif
@@ -595,6 +626,56 @@ void fbjs_push_xml_embedded_expression_state(void* guts) {
   FBJSBEGIN(IDENTIFIER);
 }
 
+//
+// Actions which skip over input in bulk work on flex's buffer directly. The character at the read
+// position is normally swapped out for a NUL which terminates yytext; fbjs_input_begin() puts it
+// back and fbjs_input_skip() moves the read position the same way yyinput() would. The buffer
+// ends at fbjs_input_end(), after which fbjs_input() has to be called to refill it.
+char* fbjs_input_begin(void* guts) {
+  yyguts_t *yyg = static_cast<yyguts_t*>(guts);
+  *yyg->yy_c_buf_p = yyg->yy_hold_char;
+  return yyg->yy_c_buf_p;
+}
+
+char* fbjs_input_end(void* guts) {
+  yyguts_t *yyg = static_cast<yyguts_t*>(guts);
+  return YY_CURRENT_BUFFER_LVALUE->yy_ch_buf + yyg->yy_n_chars;
+}
+
+void fbjs_input_skip(void* guts, const char* to) {
+  yyguts_t *yyg = static_cast<yyguts_t*>(guts);
+  yyg->yy_c_buf_p = const_cast<char*>(to);
+  yyg->yy_hold_char = *yyg->yy_c_buf_p;
+  *yyg->yy_c_buf_p = '\0';
+}
+
+//
+// yyinput() for the actions, which gives EOF at the end of the input whichever flex built it: 2.5
+// returns EOF there, but 2.6 returns 0, the same as for a NUL in the input. A buffer from
+// yy_scan_buffer() can't be refilled, and yyinput() at its end takes the token so far as a match
+// to finish first and restarts the scanner on yyin, which is stdin, so it isn't called there at
+// all. After a real end of file flex has emptied the buffer.
+int fbjs_input(void* guts) {
+  yyguts_t *yyg = static_cast<yyguts_t*>(guts);
+  if (!YY_CURRENT_BUFFER_LVALUE->yy_fill_buffer && yyg->yy_c_buf_p >= fbjs_input_end(guts)) {
+    return EOF;
+  }
+  int c = yyinput(guts);
+  return c == 0 && yyg->yy_n_chars == 0 ? EOF : c;
+}
+
+//
+// Puts a scanner back into its initial state so it can be reused by fbjs::Parser
+void fbjs_reset_scanner(void* guts) {
+  yyguts_t *yyg = static_cast<yyguts_t*>(guts);
+  BEGIN(INITIAL);
+}
+
+void fbjs_begin_xml_content(void* guts) {
+  yyguts_t *yyg = static_cast<yyguts_t*>(guts);
+  FBJSBEGIN(XML_TEXT);
+}
+
 void fbjs_pop_xml_state(void* guts) {
   yyguts_t *yyg = static_cast<yyguts_t*>(guts);
   FBJSBEGIN(yyextra->pre_xml_stack.top());
@@ -27,6 +27,14 @@
   #endif
 %}
 
+// The generated header declares yyparse() and the push parser's functions with the `root` parameter
+// below, so it has to know Node itself to be included on its own.
+%code requires {
+  namespace fbjs {
+    class Node;
+  }
+}
+
 %union {
   double number;
   char* string;
@@ -45,33 +53,66 @@
   #define require_support(flag, error) \
     if (!(yyget_extra(yyscanner)->opts & flag)) { \
       terminate(yyscanner, error); \
-      break; \
     }
 
+  // Bison works out a location for every reduction (and once for each error it recovers from), which
+  // makes this the one place to count them. Otherwise it's bison's own default.
+  #define YYLLOC_DEFAULT(Current, Rhs, N) \
+    do { \
+      FBJS_STAT(reductions++); \
+      if (N) { \
+        (Current).first_line = YYRHSLOC(Rhs, 1).first_line; \
+        (Current).first_column = YYRHSLOC(Rhs, 1).first_column; \
+        (Current).last_line = YYRHSLOC(Rhs, N).last_line; \
+        (Current).last_column = YYRHSLOC(Rhs, N).last_column; \
+      } else { \
+        (Current).first_line = (Current).last_line = YYRHSLOC(Rhs, 0).last_line; \
+        (Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+      } \
+    } while (0)
+
+  // Bison's stack holds a state or more for each level of nesting the tree will have, leaving out
+  // left-associative chains like a+b+c. Its default of 10000 lets through trees which take 2MB of
+  // stack to render or walk; this keeps them within 256KB (see Parser in node.hpp).
+  #define YYMAXDEPTH 1000
+
   void fbjs_push_xml_state(void* guts);
   void fbjs_push_xml_embedded_expression_state(void* guts);
+  void fbjs_begin_xml_content(void* guts);
   void fbjs_pop_xml_state(void* guts);
 
+  // Records a fatal error and stops the scanner, which ends the parse at the next token.
   void terminate(void* yyscanner, const char* str) {
     fbjs_parse_extra* extra = yyget_extra(yyscanner);
     if (!extra->terminated) {
       YYLTYPE* loc = yyget_lloc(yyscanner);
-      extra->error = strdup(str);
-      extra->error_line = loc->first_line;
+      parse_error_t error = { str, loc->first_line };
+      extra->errors.push_back(error);
       extra->terminated = true;
     }
   }
 
+  // Syntax errors, and semantic errors which still produce a valid node. With PARSE_RECOVER these
+  // are collected and the parser resyncs at the next statement, up to a limit.
   void yyerror(YYLTYPE* yyloc, void* yyscanner, void* node, const char* str) {
-    terminate(yyscanner, str);
+    fbjs_parse_extra* extra = yyget_extra(yyscanner);
+    if (extra->terminated) {
+      return;
+    } else if ((extra->opts & PARSE_RECOVER) && extra->errors.size() + 1 < extra->max_errors) {
+      parse_error_t error = { str, yyloc->first_line };
+      extra->errors.push_back(error);
+    } else {
+      terminate(yyscanner, str);
+    }
   }
 
 %}
 
 %locations
 %pure-parser
+%define api.push-pull both
 %parse-param { void* yyscanner }
-%parse-param { Node* root }
+%parse-param { fbjs::Node* root }
 %lex-param { void* yyscanner }
 %error-verbose
 
@@ -146,13 +187,20 @@
 %type<node> xml_tag_content xml_name xml_tag_name
 %type<node> xml_attribute_list_opt xml_attribute_list xml_attribute_value
 %type<node> xml_cdata_no_quote xml_cdata_no_apos xml_cdata_xml_content
-%type<string> xml_cdata_fragment xml_cdata_fragment_attr
+%type<string> xml_cdata_fragment
+%type<size> xml_cdata_char xml_cdata_char_attr
 %type<node> xml_embedded_expression
 %type<node> property_identifier attribute_identifier property_selector qualified_identifier wildcard_identifier
 
 // Errors
 %token t_UNTERMINATED_REGEX_LITERAL
 
+// Anything still on the stack when the parser gives up is freed here, so syntax errors don't leak
+%destructor { fbjs_free_text($$); } <string>
+%destructor { fbjs_free_text($$[0]); fbjs_free_text($$[1]); } <string_duple>
+%destructor { delete $$; } <node>
+%destructor { delete $$[0]; delete $$[1]; } <duple>
+
 %start program
 %%
 
@@ -193,6 +241,11 @@ statement_list:
 source_element:
     statement
 |   function_declaration
+|   error semicolon {
+      // Only reachable with PARSE_RECOVER, otherwise the scanner has already stopped
+      yyerrok;
+      $$ = new NodeEmptyExpression(yylineno);
+    }
 ;
 
 //
@@ -221,15 +274,15 @@ numeric_literal:
 regex_literal:
     t_REGEX {
       $$ = new NodeRegexLiteral($1[0], $1[1], yylineno);
-      free($1[0]);
-      free($1[1]);
+      fbjs_free_text($1[0]);
+      fbjs_free_text($1[1]);
     }
 ;
 
 string_literal:
     t_STRING {
       $$ = new NodeStringLiteral($1, true, yylineno);
-      free($1);
+      fbjs_free_text($1);
     }
 ;
 
@@ -317,7 +370,7 @@ property_name_and_value_list:
 identifier:
     t_IDENTIFIER {
       $$ = new NodeIdentifier($1, yylineno);
-      free($1);
+      fbjs_free_text($1);
     }
 ;
 
@@ -465,14 +518,12 @@ pre_in_expression:
       $$ = (new NodeUnary(INCR_UNARY, yylineno))->appendChild($2);
       if (!static_cast<NodeExpression*>($2)->isValidlVal()) {
         parsererror("invalid increment operand");
-        $$ = NULL;
       }
     }
 |   t_DECR pre_in_expression {
       $$ = (new NodeUnary(DECR_UNARY, yylineno))->appendChild($2);
       if (!static_cast<NodeExpression*>($2)->isValidlVal()) {
         parsererror("invalid decrement operand");
-        $$ = NULL;
       }
     }
 |   t_PLUS pre_in_expression {
@@ -574,10 +625,8 @@ assignment_expression:
 |   left_hand_side_expression assignment_operator assignment_expression {
       if (!static_cast<NodeExpression*>($1)->isValidlVal()) {
         parsererror("invalid assignment left-hand side");
-        $$ = NULL;
-      } else {
-        $$ = (new NodeAssignment($2, yylineno))->appendChild($1)->appendChild($3);
       }
+      $$ = (new NodeAssignment($2, yylineno))->appendChild($1)->appendChild($3);
     }
 ;
 
@@ -655,10 +704,8 @@ assignment_expression_no_in:
 |   left_hand_side_expression assignment_operator assignment_expression_no_in {
       if (!static_cast<NodeExpression*>($1)->isValidlVal()) {
         parsererror("invalid assignment left-hand side");
-        $$ = NULL;
-      } else {
-        $$ = (new NodeAssignment($2, yylineno))->appendChild($1)->appendChild($3);
       }
+      $$ = (new NodeAssignment($2, yylineno))->appendChild($1)->appendChild($3);
     }
 ;
 
@@ -739,14 +786,12 @@ pre_in_expression_no_statement:
       $$ = (new NodeUnary(INCR_UNARY, yylineno))->appendChild($2);
       if (!static_cast<NodeExpression*>($2)->isValidlVal()) {
         parsererror("invalid increment operand");
-        $$ = NULL;
       }
     }
 |   t_DECR pre_in_expression {
       $$ = (new NodeUnary(DECR_UNARY, yylineno))->appendChild($2);
       if (!static_cast<NodeExpression*>($2)->isValidlVal()) {
         parsererror("invalid decrement operand");
-        $$ = NULL;
       }
     }
 |   t_PLUS pre_in_expression {
@@ -848,10 +893,8 @@ assignment_expression_no_statement:
 |   left_hand_side_expression_no_statement assignment_operator assignment_expression {
       if (!static_cast<NodeExpression*>($1)->isValidlVal()) {
         parsererror("invalid assignment left-hand side");
-        $$ = NULL;
-      } else {
-        $$ = (new NodeAssignment($2, yylineno))->appendChild($1)->appendChild($3);
       }
+      $$ = (new NodeAssignment($2, yylineno))->appendChild($1)->appendChild($3);
     }
 ;
 
@@ -901,7 +944,7 @@ variable_declaration_list:
       $$ = (new NodeVarDeclaration(false, yylineno))->appendChild($1);
     }
 |   variable_declaration_list t_COMMA variable_declaration {
-      $$->appendChild($3);
+      $$ = $1->appendChild($3);
     }
 ;
 
@@ -931,7 +974,7 @@ variable_declaration_list_no_in:
       $$ = (new NodeVarDeclaration(false, yylineno))->appendChild($1);
     }
 |   variable_declaration_list_no_in t_COMMA variable_declaration_no_in {
-      $$->appendChild($3);
+      $$ = $1->appendChild($3);
     }
 ;
 
@@ -1186,10 +1229,10 @@ primary_expression_no_statement:
 
 xml_literal:
     xml_element
-|   xml_lt t_GREATER_THAN xml_element_content t_XML_LT_DIV t_GREATER_THAN {
+|   xml_lt t_GREATER_THAN { fbjs_begin_xml_content(yyscanner); } xml_element_content t_XML_LT_DIV t_GREATER_THAN {
         fbjs_pop_xml_state(yyscanner);
         $$ = (new NodeXMLElement(yylineno))
-          ->appendChild(NULL)->appendChild(NULL)->appendChild($3)->appendChild(NULL);
+          ->appendChild(NULL)->appendChild(NULL)->appendChild($4)->appendChild(NULL);
     }
 ;
 
@@ -1198,9 +1241,9 @@ xml_element:
       fbjs_pop_xml_state(yyscanner);
       $$ = $1->appendChild(new NodeXMLContentList(yylineno))->appendChild(NULL);
     }
-|   xml_tag_content t_GREATER_THAN xml_element_content t_XML_LT_DIV xml_tag_name xml_ws_opt t_GREATER_THAN {
+|   xml_tag_content t_GREATER_THAN { fbjs_begin_xml_content(yyscanner); } xml_element_content t_XML_LT_DIV xml_tag_name xml_ws_opt t_GREATER_THAN {
       fbjs_pop_xml_state(yyscanner);
-      $$ = $1->appendChild($3)->appendChild($5);
+      $$ = $1->appendChild($4)->appendChild($6);
     }
 ;
 
@@ -1219,9 +1262,12 @@ xml_lt:
 xml_name:
     t_XML_NAME_FRAGMENT {
       $$ = new NodeXMLName("", $1, yylineno);
+      fbjs_free_text($1);
     }
 |   t_XML_NAME_FRAGMENT t_COLON t_XML_NAME_FRAGMENT {
       $$ = new NodeXMLName($1, $3, yylineno);
+      fbjs_free_text($1);
+      fbjs_free_text($3);
     }
 ;
 
@@ -1250,11 +1296,11 @@ xml_element_content_tag:
 |   xml_embedded_expression
 |   t_XML_COMMENT {
       $$ = new NodeXMLComment($1, yylineno);
-      free($1);
+      fbjs_free_text($1);
     }
 |   t_XML_PI {
       $$ = new NodeXMLPI($1, yylineno);
-      free($1);
+      fbjs_free_text($1);
     }
 ;
 
@@ -1268,8 +1314,12 @@ xml_attribute_list_opt:
 xml_attribute_list:
     t_XML_WHITESPACE {
       $$ = new NodeXMLAttributeList(yylineno);
+      fbjs_free_text($1);
+    }
+|   xml_attribute_list t_XML_WHITESPACE {
+      $$ = $1;
+      fbjs_free_text($2);
     }
-|   xml_attribute_list t_XML_WHITESPACE
 |   xml_attribute_list xml_name t_ASSIGN xml_attribute_value {
       $$ = $1->appendChild((new NodeXMLAttribute(yylineno))->appendChild($2)->appendChild($4));
     }
@@ -1291,14 +1341,23 @@ xml_cdata_no_quote:
     /* empty */ {
       $$ = new NodeXMLTextData();
     }
-|   xml_cdata_no_quote xml_cdata_fragment_attr {
+|   xml_cdata_no_quote xml_cdata_fragment {
+      $$ = $1;
+      static_cast<NodeXMLTextData*>($$)->appendData($2);
+      fbjs_free_text($2);
+    }
+|   xml_cdata_no_quote t_XML_WHITESPACE {
       $$ = $1;
       static_cast<NodeXMLTextData*>($$)->appendData($2);
-      free($2);
+      fbjs_free_text($2);
+    }
+|   xml_cdata_no_quote xml_cdata_char_attr {
+      $$ = $1;
+      static_cast<NodeXMLTextData*>($$)->appendData((char)$2);
     }
 |   xml_cdata_no_quote t_XML_APOS {
       $$ = $1;
-      static_cast<NodeXMLTextData*>($$)->appendData("'");
+      static_cast<NodeXMLTextData*>($$)->appendData('\'');
     }
 ;
 
@@ -1306,87 +1365,86 @@ xml_cdata_no_apos:
     /* empty */ {
       $$ = new NodeXMLTextData();
     }
-|   xml_cdata_no_apos xml_cdata_fragment_attr {
+|   xml_cdata_no_apos xml_cdata_fragment {
+      $$ = $1;
+      static_cast<NodeXMLTextData*>($$)->appendData($2);
+      fbjs_free_text($2);
+    }
+|   xml_cdata_no_apos t_XML_WHITESPACE {
       $$ = $1;
       static_cast<NodeXMLTextData*>($$)->appendData($2);
-      free($2);
+      fbjs_free_text($2);
+    }
+|   xml_cdata_no_apos xml_cdata_char_attr {
+      $$ = $1;
+      static_cast<NodeXMLTextData*>($$)->appendData((char)$2);
     }
 |   xml_cdata_no_apos t_XML_QUOTE {
       $$ = $1;
-      static_cast<NodeXMLTextData*>($$)->appendData("\"");
+      static_cast<NodeXMLTextData*>($$)->appendData('"');
     }
 ;
 
+/* The scanner gives a whole run of element content as one token. CDATA sections are tokens of their
+   own, which join the text around them. */
 xml_cdata_xml_content:
-    xml_cdata_fragment {
+    t_XML_CDATA {
       $$ = new NodeXMLTextData(yylineno);
       static_cast<NodeXMLTextData*>($$)->appendData($1);
-      free($1);
-    }
-|   t_XML_APOS {
-      $$ = new NodeXMLTextData(yylineno);
-      static_cast<NodeXMLTextData*>($$)->appendData("'");
-    }
-|   t_XML_QUOTE {
-      $$ = new NodeXMLTextData(yylineno);
-      static_cast<NodeXMLTextData*>($$)->appendData("\"");
+      fbjs_free_text($1);
     }
 |   t_XML_WHITESPACE {
       $$ = new NodeXMLTextData(yylineno);
       static_cast<NodeXMLTextData*>($$)->appendData($1, true);
-      free($1);
+      fbjs_free_text($1);
     }
-|   xml_cdata_xml_content xml_cdata_fragment {
+|   xml_cdata_xml_content t_XML_CDATA {
       $$ = $1;
       static_cast<NodeXMLTextData*>($$)->appendData($2);
-      free($2);
-    }
-|   xml_cdata_xml_content t_XML_APOS {
-      $$ = $1;
-      static_cast<NodeXMLTextData*>($$)->appendData("'");
-    }
-|   xml_cdata_xml_content t_XML_QUOTE {
-      $$ = $1;
-      static_cast<NodeXMLTextData*>($$)->appendData("\"");
+      fbjs_free_text($2);
     }
 |   xml_cdata_xml_content t_XML_WHITESPACE {
       $$ = $1;
       static_cast<NodeXMLTextData*>($$)->appendData($2, true);
-      free($2);
+      fbjs_free_text($2);
     }
 ;
 
 xml_cdata_fragment:
-/*  Does not include: t_LESS_THAN, t_XML_APOS, t_XML_QUOTE, t_LCURLY, t_XML_WHITESPACE */
     t_XML_CDATA
 |   t_XML_NAME_FRAGMENT
-|   t_COLON {
-      $$ = strdup(":");
+;
+
+/* Punctuation which is plain text in an attribute value. These are passed as characters so they can
+   be appended without allocating. */
+xml_cdata_char:
+/*  Does not include: t_LESS_THAN, t_XML_APOS, t_XML_QUOTE, t_LCURLY, t_XML_WHITESPACE */
+    t_COLON {
+      $$ = ':';
     }
 |   t_ASSIGN {
-      $$ = strdup("=");
+      $$ = '=';
     }
 |   t_RCURLY {
-      $$ = strdup("}");
+      $$ = '}';
     }
 |   t_GREATER_THAN {
-      $$ = strdup(">");
+      $$ = '>';
     }
 |   t_DIV {
-      $$ = strdup("/");
+      $$ = '/';
     }
 ;
 
-xml_cdata_fragment_attr:
+xml_cdata_char_attr:
 /*  Does not include: t_XML_APOS, t_XML_QUOTE */
-    xml_cdata_fragment
+    xml_cdata_char
 |   t_LESS_THAN {
-      $$ = strdup("<");
+      $$ = '<';
     }
 |   t_LCURLY {
-      $$ = strdup("{");
+      $$ = '{';
     }
-|   t_XML_WHITESPACE
 ;
 
 xml_embedded_expression:
@@ -1398,7 +1456,9 @@ xml_embedded_expression:
 
 xml_ws_opt:
     /* empty */
-|   t_XML_WHITESPACE
+|   t_XML_WHITESPACE {
+      fbjs_free_text($1);
+    }
 ;
 
 //
@@ -0,0 +1,86 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "node.hpp"
+using namespace fbjs;
+
+//
+// Measures per-call latency of parsing a small snippet, which is dominated by setup cost rather
+// than by the scanner or the grammar.
+//
+//   parser_bench [iterations] [file]
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char* name, double elapsed, int iterations) {
+  printf("%-12s %10.3f us/parse\n", name, elapsed * 1e6 / iterations);
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+  std::string code = "var a = b.c(1, 'd') + e[f];";
+  if (argc > 2) {
+    FILE* file = fopen(argv[2], "r");
+    if (file == NULL) {
+      perror(argv[2]);
+      return 1;
+    }
+    code.clear();
+    char buf[4096];
+    size_t read;
+    while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+      code.append(buf, read);
+    }
+    fclose(file);
+  }
+
+  try {
+    double start = now();
+    for (int ii = 0; ii < iterations; ++ii) {
+      delete new NodeProgram(code.c_str());
+    }
+    report("NodeProgram", now() - start, iterations);
+
+    Parser parser;
+    start = now();
+    for (int ii = 0; ii < iterations; ++ii) {
+      delete parser.parse(code.c_str(), code.size());
+    }
+    report("Parser", now() - start, iterations);
+
+    Parser descent(PARSE_DESCENT);
+    start = now();
+    for (int ii = 0; ii < iterations; ++ii) {
+      delete descent.parse(code.c_str(), code.size());
+    }
+    report("Descent", now() - start, iterations);
+  } catch (ParseException& ex) {
+    fprintf(stderr, "%s\n", ex.what());
+    return 1;
+  }
+  return 0;
+}
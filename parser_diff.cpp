@@ -0,0 +1,155 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "node.hpp"
+using namespace std;
+using namespace fbjs;
+
+//
+// Parses each file with the bison grammar and with PARSE_DESCENT under several sets of options and
+// checks they agree: the same tree by Node::operator==, the same line number on every node, or the
+// same syntax errors. Descent's errors don't say what was expected, so bison's are only compared up
+// to ", expecting". Prints each difference and exits non-zero if there were any. Nesting past
+// either parser's depth limit fails differently in each (see descent.cpp) and shows up here too.
+//
+//   parser_diff file...
+
+namespace {
+
+  const node_parse_enum option_sets[] = {
+    PARSE_NONE,
+    PARSE_E4X,
+    static_cast<node_parse_enum>(PARSE_TYPEHINT | PARSE_OBJECT_LITERAL_ELISON),
+    static_cast<node_parse_enum>(PARSE_E4X | PARSE_RECOVER),
+  };
+
+  struct outcome_t {
+    auto_ptr<NodeProgram> program;
+    vector<parse_error_t> errors;
+  };
+
+  void parse(const string& code, node_parse_enum opts, outcome_t& outcome) {
+    Parser parser(opts);
+    try {
+      outcome.program.reset(parser.parse(code.data(), code.size()));
+    } catch (ParseException& ex) {
+      outcome.errors = ex.errors();
+    } catch (ParseBudgetException& ex) {
+      parse_error_t error = { ex.what(), 0 };
+      outcome.errors.push_back(error);
+    }
+  }
+
+  string withoutExpected(const string& message) {
+    return message.substr(0, message.find(", expecting"));
+  }
+
+  // The first node whose line numbers differ, or NULL. The trees must already be equal.
+  const Node* linenoDifference(const Node* left, const Node* right) {
+    vector<pair<const Node*, const Node*> > pending(1, make_pair(left, right));
+    while (!pending.empty()) {
+      left = pending.back().first;
+      right = pending.back().second;
+      pending.pop_back();
+      if (left == NULL) {
+        continue;
+      } else if (left->lineno() != right->lineno()) {
+        return left;
+      }
+      node_list_t::const_iterator ii = left->childNodes().begin();
+      node_list_t::const_iterator jj = right->childNodes().begin();
+      for (; ii != left->childNodes().end(); ++ii, ++jj) {
+        pending.push_back(make_pair(*ii, *jj));
+      }
+    }
+    return NULL;
+  }
+
+  bool compare(const char* path, const string& code, node_parse_enum opts) {
+    outcome_t bison, descent;
+    parse(code, opts, bison);
+    parse(code, static_cast<node_parse_enum>(opts | PARSE_DESCENT), descent);
+    if (bison.program.get() && descent.program.get()) {
+      if (*bison.program != *descent.program) {
+        printf("%s (options %d): trees differ\n", path, opts);
+        return false;
+      }
+      const Node* node = linenoDifference(bison.program.get(), descent.program.get());
+      if (node != NULL) {
+        printf("%s (options %d): line numbers differ from line %u\n", path, opts, node->lineno());
+        return false;
+      }
+      return true;
+    } else if (bison.program.get() || descent.program.get()) {
+      const vector<parse_error_t>& errors = bison.program.get() ? descent.errors : bison.errors;
+      printf("%s (options %d): only %s failed, line %d: %s\n", path, opts,
+        bison.program.get() ? "descent" : "bison", errors.front().lineno, errors.front().message.c_str());
+      return false;
+    }
+    bool same = bison.errors.size() == descent.errors.size();
+    for (size_t ii = 0; same && ii < bison.errors.size(); ++ii) {
+      same = bison.errors[ii].lineno == descent.errors[ii].lineno &&
+        withoutExpected(bison.errors[ii].message) == descent.errors[ii].message;
+    }
+    if (!same) {
+      printf("%s (options %d): errors differ\n", path, opts);
+      for (size_t ii = 0; ii < bison.errors.size(); ++ii) {
+        printf("  bison line %d: %s\n", bison.errors[ii].lineno, bison.errors[ii].message.c_str());
+      }
+      for (size_t ii = 0; ii < descent.errors.size(); ++ii) {
+        printf("  descent line %d: %s\n", descent.errors[ii].lineno, descent.errors[ii].message.c_str());
+      }
+    }
+    return same;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s file...\n", argv[0]);
+    return 1;
+  }
+  size_t differences = 0;
+  for (int ii = 1; ii < argc; ++ii) {
+    FILE* file = fopen(argv[ii], "r");
+    if (file == NULL) {
+      perror(argv[ii]);
+      return 1;
+    }
+    string code;
+    char buf[4096];
+    size_t read;
+    while ((read = fread(buf, 1, sizeof(buf), file)) > 0) {
+      code.append(buf, read);
+    }
+    fclose(file);
+    for (size_t jj = 0; jj < sizeof(option_sets) / sizeof(option_sets[0]); ++jj) {
+      if (!compare(argv[ii], code, option_sets[jj])) {
+        ++differences;
+      }
+    }
+  }
+  printf("%d files, %lu differences\n", argc - 1, (unsigned long)differences);
+  return differences ? 1 : 0;
+}
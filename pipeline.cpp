@@ -0,0 +1,264 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include "pipeline.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "walker.hpp"
+using namespace std;
+using namespace fbjs;
+
+#define NODE_PASS_DISPATCH(TYPE) \
+  virtual void visit(TYPE& node) { \
+    if (entering) { \
+      pass->enter(node); \
+    } else { \
+      pass->leave(node); \
+    } \
+  }
+
+namespace {
+
+  //
+  // Node::accept() is the only double dispatch nodes have, so a pass's hooks are reached through a
+  // NodeWalker whose visit() overloads call them. It never visits children itself.
+  class NodePassDispatcher: public NodeWalker {
+    protected:
+      NodePass* pass;
+      bool entering;
+
+    public:
+      NodePassDispatcher(NodePass* pass, bool entering) : pass(pass), entering(entering) {}
+      virtual NodeWalker* clone() const {
+        return new NodePassDispatcher(*this);
+      }
+
+      NODE_PASS_DISPATCH(Node);
+      NODE_PASS_DISPATCH(NodeProgram);
+      NODE_PASS_DISPATCH(NodeStatementList);
+      NODE_PASS_DISPATCH(NodeExpression);
+      NODE_PASS_DISPATCH(NodeNumericLiteral);
+      NODE_PASS_DISPATCH(NodeStringLiteral);
+      NODE_PASS_DISPATCH(NodeRegexLiteral);
+      NODE_PASS_DISPATCH(NodeBooleanLiteral);
+      NODE_PASS_DISPATCH(NodeNullLiteral);
+      NODE_PASS_DISPATCH(NodeThis);
+      NODE_PASS_DISPATCH(NodeEmptyExpression);
+      NODE_PASS_DISPATCH(NodeOperator);
+      NODE_PASS_DISPATCH(NodeConditionalExpression);
+      NODE_PASS_DISPATCH(NodeParenthetical);
+      NODE_PASS_DISPATCH(NodeAssignment);
+      NODE_PASS_DISPATCH(NodeUnary);
+      NODE_PASS_DISPATCH(NodePostfix);
+      NODE_PASS_DISPATCH(NodeIdentifier);
+      NODE_PASS_DISPATCH(NodeFunctionCall);
+      NODE_PASS_DISPATCH(NodeFunctionConstructor);
+      NODE_PASS_DISPATCH(NodeObjectLiteral);
+      NODE_PASS_DISPATCH(NodeArrayLiteral);
+      NODE_PASS_DISPATCH(NodeStaticMemberExpression);
+      NODE_PASS_DISPATCH(NodeDynamicMemberExpression);
+      NODE_PASS_DISPATCH(NodeStatement);
+      NODE_PASS_DISPATCH(NodeStatementWithExpression);
+      NODE_PASS_DISPATCH(NodeVarDeclaration);
+      NODE_PASS_DISPATCH(NodeTypehint);
+      NODE_PASS_DISPATCH(NodeFunctionDeclaration);
+      NODE_PASS_DISPATCH(NodeFunctionExpression);
+      NODE_PASS_DISPATCH(NodeArgList);
+      NODE_PASS_DISPATCH(NodeIf);
+      NODE_PASS_DISPATCH(NodeWith);
+      NODE_PASS_DISPATCH(NodeTry);
+      NODE_PASS_DISPATCH(NodeLabel);
+      NODE_PASS_DISPATCH(NodeCaseClause);
+      NODE_PASS_DISPATCH(NodeSwitch);
+      NODE_PASS_DISPATCH(NodeDefaultClause);
+      NODE_PASS_DISPATCH(NodeObjectLiteralProperty);
+      NODE_PASS_DISPATCH(NodeForLoop);
+      NODE_PASS_DISPATCH(NodeForIn);
+      NODE_PASS_DISPATCH(NodeForEachIn);
+      NODE_PASS_DISPATCH(NodeWhile);
+      NODE_PASS_DISPATCH(NodeDoWhile);
+      NODE_PASS_DISPATCH(NodeXMLDefaultNamespace);
+      NODE_PASS_DISPATCH(NodeXMLName);
+      NODE_PASS_DISPATCH(NodeXMLElement);
+      NODE_PASS_DISPATCH(NodeXMLComment);
+      NODE_PASS_DISPATCH(NodeXMLPI);
+      NODE_PASS_DISPATCH(NodeXMLContentList);
+      NODE_PASS_DISPATCH(NodeXMLTextData);
+      NODE_PASS_DISPATCH(NodeXMLEmbeddedExpression);
+      NODE_PASS_DISPATCH(NodeXMLAttributeList);
+      NODE_PASS_DISPATCH(NodeXMLAttribute);
+      NODE_PASS_DISPATCH(NodeWildcardIdentifier);
+      NODE_PASS_DISPATCH(NodeStaticAttributeIdentifier);
+      NODE_PASS_DISPATCH(NodeDynamicAttributeIdentifier);
+      NODE_PASS_DISPATCH(NodeStaticQualifiedIdentifier);
+      NODE_PASS_DISPATCH(NodeDynamicQualifiedIdentifier);
+      NODE_PASS_DISPATCH(NodeFilteringPredicate);
+      NODE_PASS_DISPATCH(NodeDescendantExpression);
+  };
+}
+
+NodePipeline::~NodePipeline() {
+  for (vector<pass_list_t>::iterator ii = phases.begin(); ii != phases.end(); ++ii) {
+    for (pass_list_t::iterator jj = ii->begin(); jj != ii->end(); ++jj) {
+      delete *jj;
+    }
+  }
+}
+
+NodePipeline& NodePipeline::add(NodePass* pass) {
+  phases.back().push_back(pass);
+  return *this;
+}
+
+NodePipeline& NodePipeline::phase() {
+  if (!phases.back().empty()) {
+    phases.push_back(pass_list_t());
+  }
+  return *this;
+}
+
+Node* NodePipeline::run(Node* root) {
+  FBJS_STAT_PHASE("pipeline");
+  FBJS_TRACE_EVENT("pipeline");
+  for (vector<pass_list_t>::iterator ii = phases.begin(); ii != phases.end() && root != NULL; ++ii) {
+    if (!ii->empty() && !visit(root, *ii)) {
+      root = NULL;
+    }
+  }
+  return root;
+}
+
+//
+// Calls one hook and applies its replace() or remove(). Returns false if the node was removed;
+// otherwise `node` is what's now in its slot, which may be NULL.
+bool NodePipeline::dispatch(NodePass* pass, Node*& node, Node* parent, bool enter) {
+  pass->_node = node;
+  pass->_parent = parent;
+  pass->_remove = false;
+  pass->_skip_delete = false;
+  NodePassDispatcher dispatcher(pass, enter);
+  node->accept(dispatcher);
+  if (pass->_remove) {
+    if (!pass->_skip_delete) {
+      delete node;
+    }
+    node = NULL;
+    return false;
+  } else if (pass->_node != node) {
+    if (!pass->_skip_delete) {
+      delete node;
+    }
+    node = pass->_node;
+  }
+  return true;
+}
+
+//
+// Runs a phase's enter() hooks on one node, leaving whatever should take its place in `node`. Unless
+// it was removed or replaced with NULL its children are next, so a frame for it goes on the stack.
+// Returns false if the node was removed.
+bool NodePipeline::enter(Node*& node, Node* parent, const pass_list_t& passes, deque<frame_t>& stack) {
+  FBJS_STAT(walker_visits++);
+  bool skipped = false;
+  for (pass_list_t::const_iterator ii = passes.begin(); ii != passes.end(); ++ii) {
+    (*ii)->_skip_children = false;
+    if (!dispatch(*ii, node, parent, true)) {
+      return false;
+    } else if (node == NULL) {
+      return true;
+    }
+    skipped = skipped || (*ii)->_skip_children;
+  }
+
+  stack.push_back(frame_t());
+  frame_t& frame = stack.back();
+  frame.node = &node;
+  frame.parent = parent;
+  frame.passes = &passes;
+  frame.children = &passes;
+  frame.child = node->childNodes().begin();
+
+  // Only allocate a new list when a pass opts out of this subtree
+  if (skipped) {
+    for (pass_list_t::const_iterator ii = passes.begin(); ii != passes.end(); ++ii) {
+      if (!(*ii)->_skip_children) {
+        frame.filtered.push_back(*ii);
+      }
+    }
+    frame.children = &frame.filtered;
+  }
+  return true;
+}
+
+bool NodePipeline::leave(Node*& node, Node* parent, const pass_list_t& passes) {
+  for (pass_list_t::const_iterator ii = passes.begin(); ii != passes.end(); ++ii) {
+    if (!dispatch(*ii, node, parent, false)) {
+      return false;
+    } else if (node == NULL) {
+      return true;
+    }
+  }
+  return true;
+}
+
+//
+// Visits a tree with every pass of a phase, leaving whatever should take its place in `root`.
+// Returns false if the root was removed. Nodes waiting on their children are kept on a stack instead
+// of recursing, so the depth of the tree doesn't matter.
+bool NodePipeline::visit(Node*& root, const pass_list_t& passes) {
+  deque<frame_t> stack;
+  if (!enter(root, NULL, passes, stack)) {
+    return false;
+  }
+  while (!stack.empty()) {
+    frame_t& frame = stack.back();
+    Node* node = *frame.node;
+    node_list_t& list = node->childNodes();
+
+    // Descend into the next child
+    if (!frame.children->empty() && frame.child != list.end()) {
+      size_t depth = stack.size();
+      if (*frame.child == NULL) {
+        ++frame.child;
+      } else if (!enter(*frame.child, node, *frame.children, stack)) {
+        node->removeChild(frame.child++);
+      } else if (stack.size() == depth) {
+        ++frame.child;
+      }
+      continue;
+    }
+
+    // All of its children are done
+    Node** slot = frame.node;
+    Node* parent = frame.parent;
+    const pass_list_t& node_passes = *frame.passes;
+    stack.pop_back();
+    bool kept = leave(*slot, parent, node_passes);
+    if (stack.empty()) {
+      return kept;
+    }
+    frame_t& parent_frame = stack.back();
+    if (kept) {
+      ++parent_frame.child;
+    } else {
+      parent->removeChild(parent_frame.child++);
+    }
+  }
+  return true;
+}
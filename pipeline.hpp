@@ -0,0 +1,190 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <deque>
+#include <vector>
+#include "node.hpp"
+
+#define NODE_PASS_HOOKS_IMPL(TYPE, FALLBACK) \
+  virtual void enter(TYPE& node) { \
+    enter(static_cast<FALLBACK&>(node)); \
+  } \
+  virtual void leave(TYPE& node) { \
+    leave(static_cast<FALLBACK&>(node)); \
+  }
+
+namespace fbjs {
+
+  //
+  // NodePass: one stage of a NodePipeline. Unlike a NodeWalker a pass doesn't drive the traversal,
+  // so several of them can share one walk. enter() is called before a node's children are visited
+  // and leave() after; both may replace() or remove() the node. Like NodeWalker::visit() there's an
+  // overload of each for every node class which falls back to the one for its base class, so a pass
+  // only overrides the ones for the nodes it cares about.
+  class NodePass {
+    friend class NodePipeline;
+    private:
+      Node* _node;
+      Node* _parent;
+      bool _remove;
+      bool _skip_delete;
+      bool _skip_children;
+
+    public:
+      NodePass() : _node(NULL), _parent(NULL), _remove(false), _skip_delete(false), _skip_children(false) {}
+      virtual ~NodePass() {}
+
+      virtual void enter(Node& node) {}
+      virtual void leave(Node& node) {}
+      NODE_PASS_HOOKS_IMPL(NodeProgram, Node);
+      NODE_PASS_HOOKS_IMPL(NodeStatementList, Node);
+      NODE_PASS_HOOKS_IMPL(NodeExpression, Node);
+      NODE_PASS_HOOKS_IMPL(NodeNumericLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeStringLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeRegexLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeBooleanLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeNullLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeThis, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeEmptyExpression, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeOperator, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeConditionalExpression, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeParenthetical, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeAssignment, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeUnary, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodePostfix, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeIdentifier, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeFunctionCall, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeFunctionConstructor, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeObjectLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeArrayLiteral, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeStaticMemberExpression, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeDynamicMemberExpression, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeStatement, Node);
+      NODE_PASS_HOOKS_IMPL(NodeStatementWithExpression, NodeStatement);
+      NODE_PASS_HOOKS_IMPL(NodeVarDeclaration, NodeStatement);
+      NODE_PASS_HOOKS_IMPL(NodeTypehint, Node);
+      NODE_PASS_HOOKS_IMPL(NodeFunctionDeclaration, Node);
+      NODE_PASS_HOOKS_IMPL(NodeFunctionExpression, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeArgList, Node);
+      NODE_PASS_HOOKS_IMPL(NodeIf, Node);
+      NODE_PASS_HOOKS_IMPL(NodeWith, Node);
+      NODE_PASS_HOOKS_IMPL(NodeTry, Node);
+      NODE_PASS_HOOKS_IMPL(NodeLabel, Node);
+      NODE_PASS_HOOKS_IMPL(NodeCaseClause, Node);
+      NODE_PASS_HOOKS_IMPL(NodeSwitch, Node);
+      NODE_PASS_HOOKS_IMPL(NodeDefaultClause, NodeCaseClause);
+      NODE_PASS_HOOKS_IMPL(NodeObjectLiteralProperty, Node);
+      NODE_PASS_HOOKS_IMPL(NodeForLoop, Node);
+      NODE_PASS_HOOKS_IMPL(NodeForIn, Node);
+      NODE_PASS_HOOKS_IMPL(NodeForEachIn, Node);
+      NODE_PASS_HOOKS_IMPL(NodeWhile, Node);
+      NODE_PASS_HOOKS_IMPL(NodeDoWhile, NodeStatement);
+      NODE_PASS_HOOKS_IMPL(NodeXMLDefaultNamespace, NodeStatement);
+      NODE_PASS_HOOKS_IMPL(NodeXMLName, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLElement, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeXMLComment, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLPI, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLContentList, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLTextData, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLEmbeddedExpression, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLAttributeList, Node);
+      NODE_PASS_HOOKS_IMPL(NodeXMLAttribute, Node);
+      NODE_PASS_HOOKS_IMPL(NodeWildcardIdentifier, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeStaticAttributeIdentifier, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeDynamicAttributeIdentifier, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeStaticQualifiedIdentifier, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeDynamicQualifiedIdentifier, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeFilteringPredicate, NodeExpression);
+      NODE_PASS_HOOKS_IMPL(NodeDescendantExpression, NodeExpression);
+
+    protected:
+      Node* node() const {
+        return _node;
+      }
+
+      // NULL for the root
+      Node* parentNode() const {
+        return _parent;
+      }
+
+      void replace(Node* new_node, bool skip_delete = false) {
+        if (new_node && _node) {
+          new_node->setLineno(_node->lineno());
+        }
+        _node = new_node;
+        _remove = false;
+        _skip_delete = skip_delete;
+      }
+
+      void remove(bool skip_delete = false) {
+        _remove = true;
+        _skip_delete = skip_delete;
+      }
+
+      // Called from enter(), this pass won't see the node's children. Other passes still do.
+      void skipChildren() {
+        _skip_children = true;
+      }
+  };
+
+  //
+  // NodePipeline: runs a list of NodePass'es over a tree in as few walks as possible.
+  //
+  //   NodePipeline pipeline;
+  //   pipeline.add(new A).add(new B).phase().add(new C);
+  //   root = pipeline.run(root);
+  //
+  // Passes in the same phase share a single walk and their hooks are called in the order they were
+  // added at every node; each one sees the changes made by those before it. A pass which depends on
+  // another one having seen the whole tree goes into a later phase. The pipeline owns its passes.
+  class NodePipeline {
+    protected:
+      typedef std::vector<NodePass*> pass_list_t;
+      std::vector<pass_list_t> phases;
+
+      // A node whose children are being visited
+      struct frame_t {
+        Node** node; // its slot in the parent's child list
+        Node* parent;
+        const pass_list_t* passes;
+        const pass_list_t* children; // passes which didn't skip this subtree
+        pass_list_t filtered;
+        node_list_t::iterator child;
+      };
+
+      bool dispatch(NodePass* pass, Node*& node, Node* parent, bool enter);
+      bool enter(Node*& node, Node* parent, const pass_list_t& passes, std::deque<frame_t>& stack);
+      bool leave(Node*& node, Node* parent, const pass_list_t& passes);
+      bool visit(Node*& root, const pass_list_t& passes);
+
+    private:
+      NodePipeline(const NodePipeline&);
+      NodePipeline& operator= (const NodePipeline&);
+
+    public:
+      NodePipeline() : phases(1) {}
+      ~NodePipeline();
+      NodePipeline& add(NodePass* pass);
+      NodePipeline& phase();
+
+      // Returns the new root, which is NULL if a pass removed it
+      Node* run(Node* root);
+  };
+}
@@ -0,0 +1,362 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <string.h>
+#include "prescan.hpp"
+#include "keywords.hpp"
+#include "parser.hpp"
+#include "scan.hpp"
+using namespace fbjs;
+
+namespace {
+
+  bool isIdentifierStart(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '$' || ch == '_';
+  }
+
+  bool isIdentifierPart(char ch) {
+    return isIdentifierStart(ch) || (ch >= '0' && ch <= '9');
+  }
+
+  bool isSpace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '\v' || ch == '\f';
+  }
+
+  bool isWord(const char* pos, const char* end, const char* word) {
+    size_t length = strlen(word);
+    return (size_t)(end - pos) >= length && memcmp(pos, word, length) == 0 &&
+      (pos + length == end || !isIdentifierPart(pos[length]));
+  }
+}
+
+//
+// A token which runs into `end` might go on past it unless the code is final, so it's only skipped
+// once there's more. A ';', ',' or bracket can't be the start of anything longer.
+prescan_enum prescan_t::next() {
+  if (pos >= end) {
+    return final ? PRESCAN_STOP : PRESCAN_MORE;
+  }
+  prescan_t before = *this;
+  prescan_enum ret = skip();
+  if (!final && pos >= end && ret != PRESCAN_SEMICOLON && ret != PRESCAN_PUNCTUATOR) {
+    *this = before;
+    return PRESCAN_MORE;
+  } else if (ret == PRESCAN_STOP) {
+    *this = before;
+  }
+  return ret;
+}
+
+bool prescan_t::canStartAt(const char* ii) const {
+  while (ii < end && isSpace(*ii)) {
+    ++ii;
+  }
+  if (ii < end && *ii == '/') {
+    return ii + 1 < end && (ii[1] == '/' || ii[1] == '*');
+  }
+  return !isWord(ii, end, "else") && !isWord(ii, end, "while");
+}
+
+prescan_enum prescan_t::skip() {
+  char ch = *pos;
+  if (isSpace(ch)) {
+    for (; pos < end && isSpace(*pos); ++pos) {
+      if (*pos == '\n') {
+        ++newlines;
+      }
+    }
+    return PRESCAN_TOKEN;
+  } else if (ch == '<' && !final && end - pos < 4) {
+    pos = end; // could be "<!--"
+    return PRESCAN_STOP;
+  } else if ((ch == '/' && pos + 1 < end && pos[1] == '/') ||
+      (ch == '<' && end - pos >= 4 && memcmp(pos, "<!--", 4) == 0)) {
+    pos = scan_line_comment(pos, end);
+    return PRESCAN_TOKEN;
+  } else if (ch == '/' && pos + 1 < end && pos[1] == '*') {
+    return skipBlockComment() ? PRESCAN_TOKEN : PRESCAN_STOP;
+  }
+
+  bool ok = true;
+  bool was_dot = false;
+  prescan_enum ret = PRESCAN_TOKEN;
+  if (ch == '/') {
+    if (operand) {
+      ok = skipRegex();
+      operand = false;
+    } else {
+      ++pos;
+      operand = true;
+    }
+  } else if (ch == '<' && operand && e4x) {
+    ok = skipXml();
+    operand = false;
+  } else if (ch == '"' || ch == '\'') {
+    ok = skipString();
+    operand = false;
+  } else if (isIdentifierStart(ch)) {
+    skipWord();
+  } else if ((ch >= '0' && ch <= '9') || (ch == '.' && pos + 1 < end && pos[1] >= '0' && pos[1] <= '9')) {
+    skipNumber();
+  } else {
+    ++pos;
+    switch (ch) {
+      case '(':
+      case '[':
+      case '{':
+        ++depth;
+        operand = true;
+        ret = PRESCAN_PUNCTUATOR;
+        break;
+      case ')':
+      case ']':
+      case '}':
+        if (depth == 0) {
+          return PRESCAN_STOP; // unbalanced, the parse will fail anyway
+        }
+        --depth;
+        operand = ch == '}';
+        ret = PRESCAN_PUNCTUATOR;
+        break;
+      case '.':
+        was_dot = true;
+        operand = true;
+        break;
+      case '+':
+      case '-':
+        if (pos < end && *pos == ch) {
+          ++pos;
+          operand = false;
+        } else {
+          operand = true;
+        }
+        break;
+      case ';':
+        operand = true;
+        ret = PRESCAN_SEMICOLON;
+        break;
+      case ',':
+        operand = true;
+        ret = PRESCAN_PUNCTUATOR;
+        break;
+      default:
+        operand = true;
+        break;
+    }
+  }
+  dot = was_dot;
+  return ok ? ret : PRESCAN_STOP;
+}
+
+void prescan_t::countNewlines(const char* from, const char* to) {
+  while ((from = static_cast<const char*>(memchr(from, '\n', to - from))) != NULL) {
+    ++newlines;
+    ++from;
+  }
+}
+
+// Moves past `terminator`, or to `end` if there isn't one
+bool prescan_t::skipPast(const char* terminator) {
+  size_t length = strlen(terminator);
+  for (const char* ii = pos; ii + length <= end; ++ii) {
+    if (memcmp(ii, terminator, length) == 0) {
+      countNewlines(pos, ii);
+      pos = ii + length;
+      return true;
+    }
+  }
+  pos = end;
+  return false;
+}
+
+bool prescan_t::skipBlockComment() {
+  pos += 2;
+  for (;;) {
+    pos = scan_block_comment(pos, end, newlines);
+    if (pos == end) {
+      return false;
+    }
+    ++pos;
+    if (pos < end && *pos == '/') {
+      ++pos;
+      return true;
+    }
+  }
+}
+
+bool prescan_t::skipString() {
+  char quote = *pos++;
+  for (;;) {
+    pos = scan_string(pos, end, quote);
+    if (pos == end || *pos == '\n' || *pos == '\r') {
+      return false;
+    } else if (*pos == quote) {
+      ++pos;
+      return true;
+    }
+    // A backslash, which can escape a line break
+    if (++pos < end) {
+      if (*pos == '\n') {
+        ++newlines;
+      }
+      ++pos;
+    }
+  }
+}
+
+// The same pattern as the scanner's REGEX rule
+bool prescan_t::skipRegex() {
+  bool in_class = false;
+  for (++pos; pos < end; ++pos) {
+    if (*pos == '\\') {
+      if (++pos == end || *pos == '\n') {
+        return false;
+      }
+    } else if (*pos == '\n') {
+      return false;
+    } else if (in_class) {
+      in_class = *pos != ']';
+    } else if (*pos == '[') {
+      in_class = true;
+    } else if (*pos == '/') {
+      for (++pos; pos < end && ((*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z')); ++pos);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Embedded expressions in an XML literal. Only counts braces, which is enough unless there's an
+// unmatched one in a string.
+bool prescan_t::skipBraces() {
+  size_t open = 0;
+  for (; pos < end; ++pos) {
+    if (*pos == '{') {
+      ++open;
+    } else if (*pos == '}' && --open == 0) {
+      ++pos;
+      return true;
+    } else if (*pos == '\n') {
+      ++newlines;
+    }
+  }
+  return false;
+}
+
+// An XML element or list, from its '<' to the end of the element it opens
+bool prescan_t::skipXml() {
+  size_t elements = 0;
+  while (pos < end) {
+    if (*pos == '{') {
+      if (!skipBraces()) {
+        return false;
+      }
+    } else if (*pos != '<') {
+      if (*pos == '\n') {
+        ++newlines;
+      }
+      ++pos;
+    } else if (end - pos >= 4 && memcmp(pos, "<!--", 4) == 0) {
+      if (!skipPast("-->")) {
+        return false;
+      }
+    } else if (end - pos >= 9 && memcmp(pos, "<![CDATA[", 9) == 0) {
+      if (!skipPast("]]>")) {
+        return false;
+      }
+    } else if (end - pos >= 2 && memcmp(pos, "<?", 2) == 0) {
+      if (!skipPast("?>")) {
+        return false;
+      }
+    } else if (end - pos >= 2 && memcmp(pos, "</", 2) == 0) {
+      if (!skipPast(">") || elements == 0) {
+        return false;
+      }
+      if (--elements == 0) {
+        return true;
+      }
+    } else {
+      // A start tag, up to its '>'
+      bool empty = false;
+      for (++pos; pos < end && *pos != '>';) {
+        if (*pos == '"' || *pos == '\'') {
+          char quote[2] = {*pos++, 0};
+          if (!skipPast(quote)) {
+            return false;
+          }
+        } else if (*pos == '{') {
+          if (!skipBraces()) {
+            return false;
+          }
+        } else {
+          if (*pos == '\n') {
+            ++newlines;
+          }
+          empty = *pos == '/';
+          ++pos;
+        }
+      }
+      if (pos == end) {
+        return false;
+      }
+      ++pos;
+      if (!empty) {
+        ++elements;
+      } else if (elements == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void prescan_t::skipWord() {
+  const char* start = pos;
+  while (pos < end && isIdentifierPart(*pos)) {
+    ++pos;
+  }
+  if (dot) {
+    operand = false;
+    return;
+  }
+  const keyword_t* keyword = findKeyword(start, pos - start);
+  if (keyword == NULL || keyword->token == 0) {
+    operand = false;
+    return;
+  }
+  switch (keyword->token) {
+    case t_THIS:
+    case t_TRUE:
+    case t_FALSE:
+    case t_NULL:
+      operand = false;
+      break;
+    default:
+      operand = true;
+      break;
+  }
+}
+
+// Numbers don't need to be read exactly, only not mistaken for anything else
+void prescan_t::skipNumber() {
+  while (pos < end && (isIdentifierPart(*pos) || *pos == '.')) {
+    ++pos;
+  }
+  operand = false;
+}
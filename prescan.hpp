@@ -0,0 +1,76 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include "node.hpp"
+
+//
+// A quick pass over code which finds where tokens start and end without scanning them. It skips
+// strings, comments, regular expressions and (with PARSE_E4X) XML literals by the same rules as the
+// scanner, and keeps count of open brackets. Parser::parseParallel() uses it to find top-level
+// statements to split at, and PushParser to find where the input it has been given so far can be
+// scanned up to.
+//
+// It's a guess at what the scanner will do, not a parse: a '/' or '<' is taken to start a regex or
+// XML literal when the token before it is one after which the scanner would do the same.
+namespace fbjs {
+
+  enum prescan_enum {
+    PRESCAN_TOKEN, // skipped a token, whitespace or a comment
+    PRESCAN_SEMICOLON, // skipped a ';'
+    PRESCAN_PUNCTUATOR, // skipped a bracket or ',', which like ';' is never part of a longer token
+    PRESCAN_MORE, // the next token might go past `end`; nothing was skipped
+    PRESCAN_STOP, // at `end`, or the code is something the scanner would reject
+  };
+
+  struct prescan_t {
+    const char* pos;
+    const char* end;
+    bool e4x;
+    bool final; // there's no more code after `end`, so a token ends there rather than maybe going on
+    unsigned int newlines; // before `pos`
+    size_t depth; // ( [ { open
+    bool operand; // an operand can come next, so '/' starts a regex and '<' an XML literal
+    bool dot; // just after '.', where a keyword is a property name
+
+    prescan_t(const char* code, size_t length, node_parse_enum opts = PARSE_NONE, bool final = true) :
+      pos(code), end(code + length), e4x(opts & PARSE_E4X), final(final), newlines(0), depth(0),
+      operand(true), dot(false) {}
+
+    // Moves past the next token
+    prescan_enum next();
+
+    // Whether the code after a ';' could be the start of a program: not the `else` or `while` that
+    // continues the statement before it, or a regex, which the scanner doesn't expect first thing.
+    bool canStartAt(const char* pos) const;
+
+    protected:
+      prescan_enum skip();
+      void countNewlines(const char* from, const char* to);
+      bool skipPast(const char* terminator);
+      bool skipBlockComment();
+      bool skipString();
+      bool skipRegex();
+      bool skipBraces();
+      bool skipXml();
+      void skipWord();
+      void skipNumber();
+  };
+}
@@ -0,0 +1,447 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#include "query.hpp"
+using namespace std;
+using namespace fbjs;
+
+namespace {
+  template<class T>
+  bool isKind(const Node* node) {
+    return dynamic_cast<const T*>(node) != NULL;
+  }
+
+  struct query_kind_t {
+    const char* name;
+    bool (*test)(const Node*);
+  };
+
+#define QUERY_KIND(TYPE) { #TYPE, &isKind<Node ## TYPE> }
+  const query_kind_t kinds[] = {
+    QUERY_KIND(Program),
+    QUERY_KIND(StatementList),
+    QUERY_KIND(Expression),
+    QUERY_KIND(NumericLiteral),
+    QUERY_KIND(StringLiteral),
+    QUERY_KIND(RegexLiteral),
+    QUERY_KIND(BooleanLiteral),
+    QUERY_KIND(NullLiteral),
+    QUERY_KIND(This),
+    QUERY_KIND(EmptyExpression),
+    QUERY_KIND(Operator),
+    QUERY_KIND(ConditionalExpression),
+    QUERY_KIND(Parenthetical),
+    QUERY_KIND(Assignment),
+    QUERY_KIND(Unary),
+    QUERY_KIND(Postfix),
+    QUERY_KIND(Identifier),
+    QUERY_KIND(FunctionCall),
+    QUERY_KIND(FunctionConstructor),
+    QUERY_KIND(ObjectLiteral),
+    QUERY_KIND(ArrayLiteral),
+    QUERY_KIND(StaticMemberExpression),
+    QUERY_KIND(DynamicMemberExpression),
+    QUERY_KIND(Statement),
+    QUERY_KIND(StatementWithExpression),
+    QUERY_KIND(VarDeclaration),
+    QUERY_KIND(Typehint),
+    QUERY_KIND(FunctionDeclaration),
+    QUERY_KIND(FunctionExpression),
+    QUERY_KIND(ArgList),
+    QUERY_KIND(If),
+    QUERY_KIND(With),
+    QUERY_KIND(Try),
+    QUERY_KIND(Label),
+    QUERY_KIND(CaseClause),
+    QUERY_KIND(Switch),
+    QUERY_KIND(DefaultClause),
+    QUERY_KIND(ObjectLiteralProperty),
+    QUERY_KIND(ForLoop),
+    QUERY_KIND(ForIn),
+    QUERY_KIND(ForEachIn),
+    QUERY_KIND(While),
+    QUERY_KIND(DoWhile),
+    QUERY_KIND(XMLDefaultNamespace),
+    QUERY_KIND(XMLName),
+    QUERY_KIND(XMLElement),
+    QUERY_KIND(XMLComment),
+    QUERY_KIND(XMLPI),
+    QUERY_KIND(XMLContentList),
+    QUERY_KIND(XMLTextData),
+    QUERY_KIND(XMLEmbeddedExpression),
+    QUERY_KIND(XMLAttributeList),
+    QUERY_KIND(XMLAttribute),
+    QUERY_KIND(WildcardIdentifier),
+    QUERY_KIND(StaticAttributeIdentifier),
+    QUERY_KIND(DynamicAttributeIdentifier),
+    QUERY_KIND(StaticQualifiedIdentifier),
+    QUERY_KIND(DynamicQualifiedIdentifier),
+    QUERY_KIND(FilteringPredicate),
+    QUERY_KIND(DescendantExpression),
+    { NULL, NULL }
+  };
+#undef QUERY_KIND
+
+  // Indexed by the enums in node.hpp
+  const char* operators[] = {
+    ",", ">>>", ">>", "<<", "|", "^", "&", "+", "-", "/", "*", "%",
+    "||", "&&",
+    "==", "!=", "===", "!==", "<=", ">=", "<", ">",
+    "in", "instanceof"
+  };
+  const char* assignments[] = {
+    "=", "*=", "/=", "%=", "+=", "-=", "<<=", ">>=", ">>>=", "&=", "^=", "|="
+  };
+  const char* unary_operators[] = {
+    "delete", "void", "typeof", "++", "--", "+", "-", "~", "!"
+  };
+  const char* postfix_operators[] = {
+    "++", "--"
+  };
+
+  const char* operatorName(const Node* node) {
+    if (const NodeOperator* op = dynamic_cast<const NodeOperator*>(node)) {
+      return operators[op->operatorType()];
+    } else if (const NodeAssignment* op = dynamic_cast<const NodeAssignment*>(node)) {
+      return assignments[op->operatorType()];
+    } else if (const NodeUnary* op = dynamic_cast<const NodeUnary*>(node)) {
+      return unary_operators[op->operatorType()];
+    } else if (const NodePostfix* op = dynamic_cast<const NodePostfix*>(node)) {
+      return postfix_operators[op->operatorType()];
+    }
+    return NULL;
+  }
+
+  bool isNameChar(char ch) {
+    return isalnum(ch) || ch == '_' || ch == '$' || ch == '-';
+  }
+
+  void skipSpace(const string& selector, size_t& pos) {
+    while (pos < selector.size() && isspace(selector[pos])) {
+      ++pos;
+    }
+  }
+
+  string parseName(const string& selector, size_t& pos) {
+    size_t start = pos;
+    while (pos < selector.size() && isNameChar(selector[pos])) {
+      ++pos;
+    }
+    if (start == pos) {
+      throw QueryException("expected a name", pos);
+    }
+    return selector.substr(start, pos - start);
+  }
+
+  void expect(const string& selector, size_t& pos, char ch) {
+    skipSpace(selector, pos);
+    if (pos >= selector.size() || selector[pos] != ch) {
+      throw QueryException(string("expected '") + ch + "'", pos);
+    }
+    ++pos;
+  }
+
+  // Attribute values are either quoted or run until the closing ]
+  string parseValue(const string& selector, size_t& pos) {
+    skipSpace(selector, pos);
+    if (pos < selector.size() && (selector[pos] == '"' || selector[pos] == '\'')) {
+      char quote = selector[pos++];
+      size_t end = selector.find(quote, pos);
+      if (end == string::npos) {
+        throw QueryException("unterminated string", pos);
+      }
+      string value = selector.substr(pos, end - pos);
+      pos = end + 1;
+      return value;
+    }
+    size_t end = selector.find(']', pos);
+    if (end == string::npos) {
+      throw QueryException("expected ']'", selector.size());
+    }
+    while (end > pos && isspace(selector[end - 1])) {
+      --end;
+    }
+    string value = selector.substr(pos, end - pos);
+    pos = end;
+    return value;
+  }
+}
+
+size_t Query::parseCompound(const string& selector, size_t& pos) {
+  compound_t compound;
+  compound.kind = NULL;
+  if (pos < selector.size() && selector[pos] == '*') {
+    ++pos;
+  } else {
+    size_t start = pos;
+    string name = parseName(selector, pos);
+    const query_kind_t* kind;
+    for (kind = kinds; kind->name != NULL && name != kind->name; ++kind);
+    if (kind->name == NULL) {
+      throw QueryException("unknown node kind '" + name + "'", start);
+    }
+    compound.kind = kind->test;
+  }
+
+  while (pos < selector.size() && (selector[pos] == '[' || selector[pos] == ':')) {
+    filter_t filter;
+    filter.n = 0;
+    size_t start = pos;
+    if (selector[pos++] == '[') {
+      skipSpace(selector, pos);
+      string attribute = parseName(selector, pos);
+      if (attribute == "name") {
+        filter.type = FILTER_NAME;
+      } else if (attribute == "op") {
+        filter.type = FILTER_OP;
+      } else if (attribute == "value") {
+        filter.type = FILTER_VALUE;
+      } else {
+        throw QueryException("unknown attribute '" + attribute + "'", start + 1);
+      }
+      expect(selector, pos, '=');
+      filter.value = parseValue(selector, pos);
+      expect(selector, pos, ']');
+    } else {
+      string pseudo = parseName(selector, pos);
+      if (pseudo == "first-child") {
+        filter.type = FILTER_NTH_CHILD;
+        filter.n = 1;
+      } else if (pseudo == "last-child") {
+        filter.type = FILTER_LAST_CHILD;
+      } else if (pseudo == "nth-child") {
+        filter.type = FILTER_NTH_CHILD;
+        expect(selector, pos, '(');
+        skipSpace(selector, pos);
+        while (pos < selector.size() && isdigit(selector[pos])) {
+          filter.n = filter.n * 10 + (selector[pos++] - '0');
+        }
+        if (filter.n == 0) {
+          throw QueryException("expected a position", pos);
+        }
+        expect(selector, pos, ')');
+      } else if (pseudo == "has") {
+        filter.type = FILTER_HAS;
+        expect(selector, pos, '(');
+        expect(selector, pos, '>');
+        skipSpace(selector, pos);
+        filter.n = parseCompound(selector, pos);
+        expect(selector, pos, ')');
+      } else {
+        throw QueryException("unknown pseudo-class '" + pseudo + "'", start);
+      }
+    }
+    compound.filters.push_back(filter);
+  }
+  compounds.push_back(compound);
+  return compounds.size() - 1;
+}
+
+size_t Query::add(const string& selector) {
+  size_t pos = 0;
+  size_t first = states.size();
+  size_t first_compound = compounds.size();
+  bool descendant = true; // the first compound can match anywhere
+  try {
+    skipSpace(selector, pos);
+    while (true) {
+      state_t state;
+      state.selector = selectors;
+      state.descendant = descendant;
+      state.last = false;
+      state.compound = parseCompound(selector, pos);
+      states.push_back(state);
+
+      size_t start = pos;
+      skipSpace(selector, pos);
+      if (pos == selector.size()) {
+        break;
+      } else if (selector[pos] == '>') {
+        descendant = false;
+        ++pos;
+        skipSpace(selector, pos);
+      } else if (pos != start) {
+        descendant = true;
+      } else {
+        throw QueryException(string("unexpected '") + selector[pos] + "'", pos);
+      }
+    }
+  } catch (...) {
+    states.resize(first);
+    compounds.resize(first_compound);
+    throw;
+  }
+  states.back().last = true;
+  initial.push_back(first);
+  return selectors++;
+}
+
+bool Query::matches(const compound_t& compound, const Node* node, size_t position, size_t siblings) const {
+  if (compound.kind != NULL && !compound.kind(node)) {
+    return false;
+  }
+  for (vector<filter_t>::const_iterator ii = compound.filters.begin(); ii != compound.filters.end(); ++ii) {
+    switch (ii->type) {
+      case FILTER_NAME: {
+        const NodeIdentifier* identifier = dynamic_cast<const NodeIdentifier*>(node);
+        if (identifier == NULL || identifier->name() != ii->value) {
+          return false;
+        }
+        break;
+      }
+
+      case FILTER_OP: {
+        const char* op = operatorName(node);
+        if (op == NULL || ii->value != op) {
+          return false;
+        }
+        break;
+      }
+
+      case FILTER_VALUE:
+        if (const NodeStringLiteral* string = dynamic_cast<const NodeStringLiteral*>(node)) {
+          if (string->unquoted_value() != ii->value) {
+            return false;
+          }
+        } else if (dynamic_cast<const NodeNumericLiteral*>(node) || dynamic_cast<const NodeBooleanLiteral*>(node)) {
+          if (node->renderString(RENDER_NONE) != ii->value) {
+            return false;
+          }
+        } else {
+          return false;
+        }
+        break;
+
+      case FILTER_NTH_CHILD:
+        if (position != ii->n) {
+          return false;
+        }
+        break;
+
+      case FILTER_LAST_CHILD:
+        if (position != siblings) {
+          return false;
+        }
+        break;
+
+      case FILTER_HAS: {
+        const compound_t& child = compounds[ii->n];
+        size_t jj_position = 0;
+        bool found = false;
+        for (node_list_t::const_iterator jj = node->childNodes().begin(); jj != node->childNodes().end(); ++jj) {
+          ++jj_position;
+          if (*jj != NULL && matches(child, *jj, jj_position, node->childNodes().size())) {
+            found = true;
+            break;
+          }
+        }
+        if (!found) {
+          return false;
+        }
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+//
+// One step of the automaton. `active` holds the states which may match `node`; whatever matches
+// advances to the next compound of its selector, and descendant states stay active in the subtree
+// regardless. `next` gets the states for the node's children.
+void Query::advance(Node* node, size_t position, size_t siblings, const vector<size_t>& active,
+    vector<size_t>& next, vector<query_match_t>& matches) const {
+  next.clear();
+  next.reserve(active.size() + 4);
+  for (vector<size_t>::const_iterator ii = active.begin(); ii != active.end(); ++ii) {
+    const state_t& state = states[*ii];
+    if (state.descendant) {
+      next.push_back(*ii);
+    }
+    if (this->matches(compounds[state.compound], node, position, siblings)) {
+      if (state.last) {
+        query_match_t match = { state.selector, node };
+        matches.push_back(match);
+      } else {
+        next.push_back(*ii + 1);
+      }
+    }
+  }
+
+  // The same state can be reached along more than one path, e.g. `If If` inside three nested ifs
+  sort(next.begin(), next.end());
+  next.erase(unique(next.begin(), next.end()), next.end());
+}
+
+namespace {
+
+  // A node whose children are still to be matched, and the states active for them
+  struct match_frame_t {
+    node_list_t::iterator child;
+    node_list_t::iterator end;
+    size_t position;
+    size_t siblings;
+    vector<size_t> active;
+  };
+
+  void pushFrame(vector<match_frame_t>& pending, Node* node, vector<size_t>& active) {
+    match_frame_t frame;
+    frame.child = node->childNodes().begin();
+    frame.end = node->childNodes().end();
+    frame.position = 0;
+    frame.siblings = node->childNodes().size();
+    pending.push_back(frame);
+    pending.back().active.swap(active);
+  }
+}
+
+//
+// Walks the tree with an explicit stack, so deep trees don't recurse. Subtrees where no state is
+// active are skipped.
+vector<query_match_t> Query::match(Node* root) const {
+  vector<query_match_t> matches;
+  if (root == NULL || initial.empty()) {
+    return matches;
+  }
+  vector<match_frame_t> pending;
+  vector<size_t> next;
+  advance(root, 1, 1, initial, next, matches);
+  if (!next.empty()) {
+    pushFrame(pending, root, next);
+  }
+  while (!pending.empty()) {
+    match_frame_t& frame = pending.back();
+    if (frame.child == frame.end) {
+      pending.pop_back();
+      continue;
+    }
+    Node* node = *frame.child++;
+    ++frame.position;
+    if (node != NULL) {
+      advance(node, frame.position, frame.siblings, frame.active, next, matches);
+      if (!next.empty()) {
+        pushFrame(pending, node, next);
+      }
+    }
+  }
+  return matches;
+}
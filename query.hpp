@@ -0,0 +1,114 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "node.hpp"
+
+namespace fbjs {
+
+  struct query_match_t {
+    size_t selector; // id returned from Query::add()
+    Node* node;
+  };
+
+  //
+  // Query: a set of selectors compiled into one automaton and matched against a tree in a single
+  // walk.
+  //
+  //   Query query;
+  //   size_t require = query.add("FunctionCall:has(> Identifier:first-child[name=require])");
+  //   std::vector<query_match_t> matches = query.match(root);
+  //
+  // The selector language is a subset of CSS:
+  //
+  //   selector    := compound (combinator compound)*
+  //   combinator  := ' ' (descendant) | '>' (child)
+  //   compound    := (kind | '*') filter*
+  //   filter      := '[' attribute '=' value ']' | ':first-child' | ':last-child' |
+  //                  ':nth-child(' n ')' | ':has(> ' compound ')'
+  //
+  // Kinds are node class names without the "Node" prefix and match subclasses as well, so
+  // `Expression` matches any expression. Attributes are `name` (identifiers), `op` (operators as
+  // they're written in source) and `value` (string, numeric and boolean literals); values may be
+  // quoted. Child positions count from 1 and include empty slots, e.g. the missing `else` of an if.
+  class Query {
+    protected:
+      enum filter_type_t {
+        FILTER_NAME,
+        FILTER_OP,
+        FILTER_VALUE,
+        FILTER_NTH_CHILD,
+        FILTER_LAST_CHILD,
+        FILTER_HAS,
+      };
+
+      struct filter_t {
+        filter_type_t type;
+        std::string value;
+        size_t n; // nth-child position, or has() compound
+      };
+
+      struct compound_t {
+        bool (*kind)(const Node*); // NULL for `*`
+        std::vector<filter_t> filters;
+      };
+
+      // One state per compound of each selector. A state which is reached through a descendant
+      // combinator stays active for the whole subtree, otherwise only for the next level down.
+      struct state_t {
+        size_t selector;
+        size_t compound;
+        bool descendant;
+        bool last;
+      };
+
+      std::vector<compound_t> compounds;
+      std::vector<state_t> states;
+      std::vector<size_t> initial;
+      size_t selectors;
+
+      size_t parseCompound(const std::string& selector, size_t& pos);
+      bool matches(const compound_t& compound, const Node* node, size_t position, size_t siblings) const;
+      void advance(Node* node, size_t position, size_t siblings, const std::vector<size_t>& active,
+        std::vector<size_t>& next, std::vector<query_match_t>& matches) const;
+
+    public:
+      Query() : selectors(0) {}
+
+      // Compiles a selector and returns its id. Throws QueryException on syntax errors.
+      size_t add(const std::string& selector);
+
+      // Returns every (selector, node) match in document order
+      std::vector<query_match_t> match(Node* root) const;
+  };
+
+  //
+  // Selector syntax error
+  class QueryException: public std::runtime_error {
+    private:
+      size_t pos;
+    public:
+      QueryException(const std::string& what_arg, const size_t pos) : std::runtime_error(what_arg), pos(pos) {}
+      size_t position() const { return pos; }
+  };
+}
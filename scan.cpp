@@ -0,0 +1,115 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include "scan.hpp"
+#if !defined(FBJS_NO_SIMD) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#define FBJS_SIMD 1
+#endif
+using namespace fbjs;
+
+#ifdef FBJS_SIMD
+//
+// One block of input and a bitmask of the bytes which matched, lowest address in the lowest bit
+#ifdef __AVX2__
+typedef __m256i block_t;
+static const size_t block_size = 32;
+static inline block_t load(const char* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+static inline block_t match(block_t block, char ch) {
+  return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(ch));
+}
+static inline block_t either(block_t a, block_t b) {
+  return _mm256_or_si256(a, b);
+}
+static inline unsigned int mask(block_t block) {
+  return _mm256_movemask_epi8(block);
+}
+#else
+typedef __m128i block_t;
+static const size_t block_size = 16;
+static inline block_t load(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+static inline block_t match(block_t block, char ch) {
+  return _mm_cmpeq_epi8(block, _mm_set1_epi8(ch));
+}
+static inline block_t either(block_t a, block_t b) {
+  return _mm_or_si128(a, b);
+}
+static inline unsigned int mask(block_t block) {
+  return _mm_movemask_epi8(block);
+}
+#endif
+#endif
+
+const char* fbjs::scan_block_comment(const char* begin, const char* end, unsigned int& newlines) {
+  const char* ii = begin;
+#ifdef FBJS_SIMD
+  for (; end - ii >= (ptrdiff_t)block_size; ii += block_size) {
+    block_t block = load(ii);
+    unsigned int stop = mask(match(block, '*'));
+    unsigned int lines = mask(match(block, '\n'));
+    if (stop) {
+      // Only count the newlines before the '*'
+      newlines += __builtin_popcount(lines & ((1u << __builtin_ctz(stop)) - 1));
+      return ii + __builtin_ctz(stop);
+    }
+    newlines += __builtin_popcount(lines);
+  }
+#endif
+  for (; ii != end && *ii != '*'; ++ii) {
+    if (*ii == '\n') {
+      ++newlines;
+    }
+  }
+  return ii;
+}
+
+const char* fbjs::scan_line_comment(const char* begin, const char* end) {
+  const char* ii = begin;
+#ifdef FBJS_SIMD
+  for (; end - ii >= (ptrdiff_t)block_size; ii += block_size) {
+    unsigned int stop = mask(match(load(ii), '\n'));
+    if (stop) {
+      return ii + __builtin_ctz(stop);
+    }
+  }
+#endif
+  for (; ii != end && *ii != '\n'; ++ii);
+  return ii;
+}
+
+const char* fbjs::scan_string(const char* begin, const char* end, char quote) {
+  const char* ii = begin;
+#ifdef FBJS_SIMD
+  for (; end - ii >= (ptrdiff_t)block_size; ii += block_size) {
+    block_t block = load(ii);
+    unsigned int stop = mask(either(
+      either(match(block, quote), match(block, '\\')),
+      either(match(block, '\n'), match(block, '\r'))));
+    if (stop) {
+      return ii + __builtin_ctz(stop);
+    }
+  }
+#endif
+  for (; ii != end && *ii != quote && *ii != '\\' && *ii != '\n' && *ii != '\r'; ++ii);
+  return ii;
+}
@@ -0,0 +1,40 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+
+//
+// Bulk skip loops for the scanner's comment and string actions, which would otherwise pull input
+// one character at a time through yyinput(). Each one returns a pointer to the first character in
+// [begin, end) that the action has to look at, or `end`.
+//
+// These use AVX2 when the compiler targets it, SSE2 otherwise, and plain loops on other platforms
+// or when FBJS_NO_SIMD is defined.
+namespace fbjs {
+
+  // Stops at '*'. Adds the number of '\n's skipped to `newlines`.
+  const char* scan_block_comment(const char* begin, const char* end, unsigned int& newlines);
+
+  // Stops at '\n'
+  const char* scan_line_comment(const char* begin, const char* end);
+
+  // Stops at `quote`, '\\', '\n' or '\r'
+  const char* scan_string(const char* begin, const char* end, char quote);
+}
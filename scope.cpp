@@ -0,0 +1,407 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include "scope.hpp"
+#include "walker.hpp"
+using namespace std;
+using namespace fbjs;
+
+const size_t ScopeIndex::npos = (size_t)-1;
+
+//
+// ScopeIndex::Builder: creates scopes and declarations, and records every variable reference.
+// References are resolved afterwards because declarations are hoisted.
+//
+// It's a NodeWalker only for the visit() overloads. Rather than recursing into children, visit()
+// pushes what's left to do onto `pending`, so the depth of the tree doesn't touch the call stack.
+// Tasks come off the stack in the order the old recursive walk would have reached them, which keeps
+// scopes, symbols and references numbered the same way.
+class ScopeIndex::Builder: public NodeWalker {
+  protected:
+    enum task_type_t {
+      TASK_VISIT,
+      TASK_VAR, // one declarator of a `var`, then its initializer
+      TASK_CATCH, // the catch scope of a NodeTry, once the try block is done
+      TASK_WITH, // the scope of a `with` or .(), once the object is done
+    };
+
+    struct task_t {
+      task_type_t type;
+      Node* node;
+      scope_id_t scope;
+    };
+
+    ScopeIndex* index;
+    scope_id_t scope; // of the task being run
+    vector<task_t> pending;
+
+  public:
+    Builder(ScopeIndex* index, scope_id_t scope) : index(index), scope(scope) {}
+    virtual NodeWalker* clone() const {
+      return new Builder(*this);
+    }
+
+    void build(Node* root) {
+      push(TASK_VISIT, root, scope);
+      while (!pending.empty()) {
+        task_t task = pending.back();
+        pending.pop_back();
+        scope = task.scope;
+        switch (task.type) {
+          case TASK_VISIT:
+            task.node->accept(*this);
+            break;
+          case TASK_VAR:
+            runVar(task.node);
+            break;
+          case TASK_CATCH:
+            runCatch(task.node);
+            break;
+          case TASK_WITH:
+            push(TASK_VISIT, task.node->childNodes().back(), index->pushScope(SCOPE_WITH, task.node, scope));
+            break;
+        }
+      }
+    }
+
+  protected:
+    void push(task_type_t type, Node* node, scope_id_t target) {
+      if (node != NULL) {
+        task_t task = {type, node, target};
+        pending.push_back(task);
+      }
+    }
+
+    // Children are visited first to last, so they go on the stack last to first
+    void pushChildren(Node& node) {
+      for (node_list_t::reverse_iterator ii = node.childNodes().rbegin(); ii != node.childNodes().rend(); ++ii) {
+        push(TASK_VISIT, *ii, scope);
+      }
+    }
+
+    void declare(scope_id_t target, Node* node, symbol_type_t type) {
+      // Typehinted declaration; the first child is the name, the second is a type
+      if (dynamic_cast<NodeTypehint*>(node) != NULL) {
+        node = node->childNodes().front();
+      }
+      NodeIdentifier* identifier = dynamic_cast<NodeIdentifier*>(node);
+      if (identifier != NULL) {
+        symbol_id_t shadowed = target == scope ? npos : index->lookup(scope, identifier->name());
+        symbol_id_t symbol = index->declare(target, identifier, type);
+
+        // The declaration site is resolved just like any other reference. This matters for
+        // `catch (e) { var e = 1; }` where the initializer writes to the catch variable. The
+        // function's `e` then has no declaration site of its own, so it has to keep the catch
+        // variable's name.
+        index->reference(scope, identifier, true);
+        if (shadowed != npos && shadowed != symbol && index->symbols[shadowed].type == SYMBOL_CATCH) {
+          index->symbols[shadowed].hoisted = symbol;
+        }
+      }
+    }
+
+    void runVar(Node* declarator) {
+      scope_id_t function = index->scopes[scope].function;
+      NodeAssignment* assignment = dynamic_cast<NodeAssignment*>(declarator);
+      if (assignment == NULL) {
+        declare(function, declarator, SYMBOL_VAR);
+      } else {
+        declare(function, assignment->childNodes().front(), SYMBOL_VAR);
+        push(TASK_VISIT, assignment->childNodes().back(), scope);
+      }
+    }
+
+    void runCatch(Node* node) {
+      node_list_t::iterator ii = ++node->childNodes().begin();
+      scope = index->pushScope(SCOPE_CATCH, node, scope);
+      declare(scope, *ii, SYMBOL_CATCH);
+      push(TASK_VISIT, *++ii, scope);
+    }
+
+    // Visit only the expression half of a member-ish node; the property name is not a variable.
+    void visitObjectOnly(Node& node) {
+      node_list_t::iterator ii = node.childNodes().begin();
+      Node* object = *ii++;
+      if (ii != node.childNodes().end() && dynamic_cast<NodeIdentifier*>(*ii) == NULL) {
+        push(TASK_VISIT, *ii, scope);
+      }
+      push(TASK_VISIT, object, scope);
+    }
+
+    void visitFunction(Node& node, scope_id_t function) {
+      scope = function;
+      node_list_t::iterator ii = node.childNodes().begin();
+      if (*ii != NULL && typeid(node) == typeid(NodeFunctionExpression)) {
+        // Named function expressions can see their own name
+        declare(function, *ii, SYMBOL_FUNCTION);
+      }
+      ++ii;
+      for (node_list_t::iterator jj = (*ii)->childNodes().begin(); jj != (*ii)->childNodes().end(); ++jj) {
+        declare(function, *jj, SYMBOL_PARAMETER);
+      }
+      push(TASK_VISIT, *++ii, function);
+    }
+
+    void visitWith(Node& node) {
+      push(TASK_WITH, &node, scope);
+      push(TASK_VISIT, node.childNodes().front(), scope);
+    }
+
+  public:
+    virtual void visit(Node& node) {
+      pushChildren(node);
+    }
+
+    virtual void visit(NodeIdentifier& node) {
+      index->reference(scope, &node, false);
+    }
+
+    virtual void visit(NodeFunctionDeclaration& node) {
+      declare(index->scopes[scope].function, node.childNodes().front(), SYMBOL_FUNCTION);
+      visitFunction(node, index->pushScope(SCOPE_FUNCTION, &node, scope));
+    }
+
+    virtual void visit(NodeFunctionExpression& node) {
+      visitFunction(node, index->pushScope(SCOPE_FUNCTION, &node, scope));
+    }
+
+    virtual void visit(NodeVarDeclaration& node) {
+      for (node_list_t::reverse_iterator ii = node.childNodes().rbegin(); ii != node.childNodes().rend(); ++ii) {
+        push(TASK_VAR, *ii, scope);
+      }
+    }
+
+    virtual void visit(NodeTry& node) {
+      node_list_t::iterator ii = node.childNodes().begin();
+      Node* block = *ii++;
+      Node* identifier = *ii++;
+      push(TASK_VISIT, *++ii, scope);
+      if (identifier != NULL) {
+        push(TASK_CATCH, &node, scope);
+      }
+      push(TASK_VISIT, block, scope);
+    }
+
+    virtual void visit(NodeWith& node) {
+      visitWith(node);
+    }
+
+    virtual void visit(NodeFilteringPredicate& node) {
+      // Unqualified names inside .() resolve against the XML list first, just like `with`
+      visitWith(node);
+    }
+
+    virtual void visit(NodeStatementWithExpression& node) {
+      if (node.statementType() == RETURN || node.statementType() == THROW) {
+        pushChildren(node);
+      }
+    }
+
+    virtual void visit(NodeLabel& node) {
+      push(TASK_VISIT, node.childNodes().back(), scope);
+    }
+
+    virtual void visit(NodeObjectLiteralProperty& node) {
+      push(TASK_VISIT, node.childNodes().back(), scope);
+    }
+
+    virtual void visit(NodeTypehint& node) {}
+
+    virtual void visit(NodeStaticMemberExpression& node) {
+      visitObjectOnly(node);
+    }
+
+    virtual void visit(NodeDescendantExpression& node) {
+      visitObjectOnly(node);
+    }
+
+    virtual void visit(NodeStaticQualifiedIdentifier& node) {
+      // ns::name, only `ns` is a variable
+      push(TASK_VISIT, node.childNodes().front(), scope);
+    }
+
+    virtual void visit(NodeStaticAttributeIdentifier& node) {
+      if (dynamic_cast<NodeIdentifier*>(node.childNodes().front()) == NULL) {
+        pushChildren(node);
+      }
+    }
+};
+
+ScopeIndex::ScopeIndex(Node* root) {
+  Builder(this, pushScope(SCOPE_GLOBAL, NULL, npos)).build(root);
+  link();
+}
+
+ScopeIndex::scope_id_t ScopeIndex::pushScope(scope_type_t type, Node* node, scope_id_t parent) {
+  scope_t scope;
+  scope.type = type;
+  scope.node = node;
+  scope.parent = parent;
+  scope.function = type == SCOPE_FUNCTION || type == SCOPE_GLOBAL ? scopes.size() : scopes[parent].function;
+  scope.eval = false;
+  scope.dynamic = type == SCOPE_WITH;
+  scopes.push_back(scope);
+  declared.resize(scopes.size());
+  if (node != NULL) {
+    node_scopes[node] = scopes.size() - 1;
+  }
+  return scopes.size() - 1;
+}
+
+ScopeIndex::symbol_id_t ScopeIndex::declare(scope_id_t scope, NodeIdentifier* identifier, symbol_type_t type) {
+  tr1::unordered_map<string, symbol_id_t>::iterator ii = declared[scope].find(identifier->name());
+  if (ii != declared[scope].end()) {
+    // `function f() {}` wins over `var f`, but only the first declaration site is recorded
+    if (type == SYMBOL_FUNCTION) {
+      symbols[ii->second].type = type;
+    }
+    return ii->second;
+  }
+  symbol_t symbol;
+  symbol.name = identifier->name();
+  symbol.type = type;
+  symbol.scope = scope;
+  symbol.declaration = identifier;
+  symbol.hoisted = npos;
+  symbols.push_back(symbol);
+  declared[scope][symbol.name] = symbols.size() - 1;
+  return symbols.size() - 1;
+}
+
+ScopeIndex::ref_id_t ScopeIndex::reference(scope_id_t scope, NodeIdentifier* identifier, bool declaration) {
+  if (identifier->name() == "eval") {
+    scopes[scope].eval = true;
+    scopes[scope].dynamic = true;
+  }
+  ref_t ref;
+  ref.node = identifier;
+  ref.scope = scope;
+  ref.symbol = npos;
+  ref.declaration = declaration;
+  ref.dynamic = false;
+  refs.push_back(ref);
+  node_refs[identifier] = refs.size() - 1;
+  return refs.size() - 1;
+}
+
+//
+// Resolves references and builds the adjacency lists once the whole tree has been seen.
+void ScopeIndex::link() {
+  // eval() and with can see every enclosing scope
+  for (size_t ii = scopes.size() - 1; ii > 0; --ii) {
+    if (scopes[ii].dynamic) {
+      scopes[scopes[ii].parent].dynamic = true;
+    }
+  }
+
+  for (vector<ref_t>::iterator ii = refs.begin(); ii != refs.end(); ++ii) {
+    const string& name = ii->node->name();
+    for (scope_id_t scope = ii->scope; scope != npos; scope = scopes[scope].parent) {
+      if (scopes[scope].type == SCOPE_WITH) {
+        ii->dynamic = true;
+        continue;
+      }
+      tr1::unordered_map<string, symbol_id_t>::const_iterator symbol = declared[scope].find(name);
+      if (symbol != declared[scope].end()) {
+        ii->symbol = symbol->second;
+        break;
+      }
+    }
+  }
+
+  scope_symbol_offsets.assign(scopes.size() + 1, 0);
+  for (vector<symbol_t>::iterator ii = symbols.begin(); ii != symbols.end(); ++ii) {
+    ++scope_symbol_offsets[ii->scope + 1];
+  }
+  symbol_ref_offsets.assign(symbols.size() + 1, 0);
+  for (vector<ref_t>::iterator ii = refs.begin(); ii != refs.end(); ++ii) {
+    if (ii->symbol != npos) {
+      ++symbol_ref_offsets[ii->symbol + 1];
+    }
+  }
+  for (size_t ii = 1; ii < scope_symbol_offsets.size(); ++ii) {
+    scope_symbol_offsets[ii] += scope_symbol_offsets[ii - 1];
+  }
+  for (size_t ii = 1; ii < symbol_ref_offsets.size(); ++ii) {
+    symbol_ref_offsets[ii] += symbol_ref_offsets[ii - 1];
+  }
+
+  // Fill each bucket in id order
+  vector<size_t> next(scope_symbol_offsets.begin(), scope_symbol_offsets.end() - 1);
+  scope_symbols.resize(symbols.size());
+  for (symbol_id_t ii = 0; ii < symbols.size(); ++ii) {
+    scope_symbols[next[symbols[ii].scope]++] = ii;
+  }
+  next.assign(symbol_ref_offsets.begin(), symbol_ref_offsets.end() - 1);
+  symbol_refs.resize(symbol_ref_offsets.back());
+  for (ref_id_t ii = 0; ii < refs.size(); ++ii) {
+    if (refs[ii].symbol == npos) {
+      unresolved.push_back(ii);
+    } else {
+      symbol_refs[next[refs[ii].symbol]++] = ii;
+    }
+  }
+}
+
+ScopeIndex::id_range_t ScopeIndex::range(const vector<size_t>& offsets, const vector<size_t>& ids, size_t n) {
+  if (ids.empty()) {
+    return id_range_t(NULL, NULL);
+  }
+  return id_range_t(&ids[0] + offsets[n], &ids[0] + offsets[n + 1]);
+}
+
+ScopeIndex::id_range_t ScopeIndex::symbolsOf(scope_id_t scope) const {
+  return range(scope_symbol_offsets, scope_symbols, scope);
+}
+
+ScopeIndex::id_range_t ScopeIndex::refsOf(symbol_id_t symbol) const {
+  return range(symbol_ref_offsets, symbol_refs, symbol);
+}
+
+ScopeIndex::id_range_t ScopeIndex::unresolvedRefs() const {
+  if (unresolved.empty()) {
+    return id_range_t(NULL, NULL);
+  }
+  return id_range_t(&unresolved[0], &unresolved[0] + unresolved.size());
+}
+
+ScopeIndex::ref_id_t ScopeIndex::refOf(const Node* node) const {
+  tr1::unordered_map<const Node*, ref_id_t>::const_iterator ii = node_refs.find(node);
+  return ii == node_refs.end() ? npos : ii->second;
+}
+
+ScopeIndex::scope_id_t ScopeIndex::scopeOf(const Node* node) const {
+  tr1::unordered_map<const Node*, scope_id_t>::const_iterator ii = node_scopes.find(node);
+  return ii == node_scopes.end() ? npos : ii->second;
+}
+
+ScopeIndex::symbol_id_t ScopeIndex::resolve(const Node* node) const {
+  ref_id_t ref = refOf(node);
+  return ref == npos ? npos : refs[ref].symbol;
+}
+
+ScopeIndex::symbol_id_t ScopeIndex::lookup(scope_id_t scope, const string& name) const {
+  for (; scope != npos; scope = scopes[scope].parent) {
+    tr1::unordered_map<string, symbol_id_t>::const_iterator ii = declared[scope].find(name);
+    if (ii != declared[scope].end()) {
+      return ii->second;
+    }
+  }
+  return npos;
+}
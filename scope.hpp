@@ -0,0 +1,145 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <tr1/unordered_map>
+#include "node.hpp"
+
+namespace fbjs {
+
+  //
+  // ScopeIndex: scopes, declarations and the resolution of every variable reference in a tree,
+  // built in a single walk.
+  //
+  //   ScopeIndex index(root);
+  //   ScopeIndex::symbol_id_t symbol = index.resolve(identifier);
+  //
+  // Scopes, symbols and references are numbered in the order they are found and stored in flat
+  // arrays. Scope 0 is the global scope and parents always come before their children. The index
+  // points into the tree, so it's invalidated by adding or removing nodes; renaming identifiers in
+  // place is fine.
+  class ScopeIndex {
+    public:
+      typedef size_t scope_id_t;
+      typedef size_t symbol_id_t;
+      typedef size_t ref_id_t;
+      typedef std::pair<const size_t*, const size_t*> id_range_t;
+      static const size_t npos;
+
+      enum scope_type_t {
+        SCOPE_GLOBAL,
+        SCOPE_FUNCTION,
+        SCOPE_CATCH,
+        SCOPE_WITH, // `with` statements and E4X filtering predicates
+      };
+
+      enum symbol_type_t {
+        SYMBOL_VAR,
+        SYMBOL_FUNCTION,
+        SYMBOL_PARAMETER,
+        SYMBOL_CATCH,
+      };
+
+      struct scope_t {
+        scope_type_t type;
+        Node* node; // NULL for the global scope
+        scope_id_t parent; // npos for the global scope
+        scope_id_t function; // where `var` and function declarations are hoisted to
+        bool eval; // eval is referenced directly in this scope
+        bool dynamic; // names in this scope may be looked up at runtime via eval or with
+      };
+
+      struct symbol_t {
+        std::string name;
+        symbol_type_t type;
+        scope_id_t scope;
+        NodeIdentifier* declaration; // first declaration
+        symbol_id_t hoisted; // catch parameters: a `var` or function of the same name declared inside the catch, or npos
+      };
+
+      struct ref_t {
+        NodeIdentifier* node;
+        scope_id_t scope; // innermost scope containing the reference
+        symbol_id_t symbol; // npos for globals
+        bool declaration; // the identifier is a declaration site
+        bool dynamic; // there's a `with` between here and the declaration
+      };
+
+    protected:
+      class Builder;
+      std::vector<scope_t> scopes;
+      std::vector<symbol_t> symbols;
+      std::vector<ref_t> refs;
+      std::vector<std::tr1::unordered_map<std::string, symbol_id_t> > declared; // per scope
+
+      // Compressed adjacency lists: the ids for scope n are ids[offsets[n]] to ids[offsets[n + 1]]
+      std::vector<size_t> scope_symbol_offsets, scope_symbols;
+      std::vector<size_t> symbol_ref_offsets, symbol_refs;
+      std::vector<ref_id_t> unresolved;
+
+      std::tr1::unordered_map<const Node*, ref_id_t> node_refs;
+      std::tr1::unordered_map<const Node*, scope_id_t> node_scopes;
+
+    private:
+      ScopeIndex(const ScopeIndex&);
+      ScopeIndex& operator= (const ScopeIndex&);
+
+    protected:
+      scope_id_t pushScope(scope_type_t type, Node* node, scope_id_t parent);
+      symbol_id_t declare(scope_id_t scope, NodeIdentifier* identifier, symbol_type_t type);
+      ref_id_t reference(scope_id_t scope, NodeIdentifier* identifier, bool declaration);
+      void link();
+      static id_range_t range(const std::vector<size_t>& offsets, const std::vector<size_t>& ids, size_t n);
+
+    public:
+      ScopeIndex(Node* root);
+
+      size_t scopeCount() const { return scopes.size(); };
+      size_t symbolCount() const { return symbols.size(); };
+      size_t refCount() const { return refs.size(); };
+      const scope_t& scope(scope_id_t id) const { return scopes[id]; };
+      const symbol_t& symbol(symbol_id_t id) const { return symbols[id]; };
+      const ref_t& ref(ref_id_t id) const { return refs[id]; };
+
+      // Symbols declared directly in a scope, in declaration order
+      id_range_t symbolsOf(scope_id_t scope) const;
+
+      // Every reference to a symbol, including its declarations
+      id_range_t refsOf(symbol_id_t symbol) const;
+
+      // References which don't resolve to any declaration, i.e. implicit globals
+      id_range_t unresolvedRefs() const;
+
+      // Returns npos if the node isn't a variable reference (property names, labels, etc)
+      ref_id_t refOf(const Node* node) const;
+
+      // Returns npos if the node doesn't create a scope
+      scope_id_t scopeOf(const Node* node) const;
+
+      // Returns npos for globals and nodes which aren't variable references
+      symbol_id_t resolve(const Node* node) const;
+
+      // Resolves `name` as if it were referenced from `scope`
+      symbol_id_t lookup(scope_id_t scope, const std::string& name) const;
+  };
+}
@@ -0,0 +1,198 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "stats.hpp"
+#include "parser.hpp"
+using namespace std;
+using namespace fbjs;
+
+__thread stats_t* stats_t::_current = NULL;
+
+stats_t::stats_t() : reductions(0), nodes_allocated(0), string_bytes(0), render_bytes(0), walker_visits(0) {
+  memset(tokens, 0, sizeof(tokens));
+}
+
+void stats_t::token(int tok) {
+  if (tok >= 0 && (size_t)tok < max_tokens) {
+    ++tokens[tok];
+  }
+}
+
+//
+// Node types can only be told apart once they're constructed, so parsed trees are tallied after the
+// fact instead.
+void stats_t::countTree(const Node* root) {
+  map<const type_info*, size_t> counts;
+  vector<const Node*> pending(1, root);
+  while (!pending.empty()) {
+    const Node* node = pending.back();
+    pending.pop_back();
+    if (node != NULL) {
+      ++counts[&typeid(*node)];
+      pending.insert(pending.end(), node->childNodes().begin(), node->childNodes().end());
+    }
+  }
+  for (map<const type_info*, size_t>::iterator ii = counts.begin(); ii != counts.end(); ++ii) {
+    nodes[typeName(*ii->first)] += ii->second;
+  }
+}
+
+string stats_t::typeName(const type_info& type) {
+  int status;
+  char* demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+  string name(demangled == NULL ? type.name() : demangled);
+  free(demangled);
+  if (name.compare(0, 6, "fbjs::") == 0) {
+    name.erase(0, 6);
+  }
+  return name;
+}
+
+string fbjs::jsonString(const string& str) {
+  string ret("\"");
+  for (string::const_iterator ii = str.begin(); ii != str.end(); ++ii) {
+    if (*ii == '"' || *ii == '\\') {
+      ret += '\\';
+      ret += *ii;
+    } else if ((unsigned char)*ii < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", *ii);
+      ret += buf;
+    } else {
+      ret += *ii;
+    }
+  }
+  return ret + '"';
+}
+
+namespace {
+
+  string jsonNumber(size_t value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)value);
+    return buf;
+  }
+
+  string jsonNumber(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", value);
+    return buf;
+  }
+
+  // Single characters are their own token, everything else is named by bison
+  string tokenName(int tok) {
+    if (tok < 256) {
+      return string("'") + (char)tok + "'";
+    }
+    const char* name = yytokname(tok);
+    size_t length = strlen(name);
+    if (length > 1 && name[0] == '"') {
+      return string(name + 1, length - 2);
+    }
+    return name;
+  }
+
+  void jsonCounts(string& out, const char* key, const map<string, size_t>& counts) {
+    out += "  ";
+    out += jsonString(key) + ": {";
+    for (map<string, size_t>::const_iterator ii = counts.begin(); ii != counts.end(); ++ii) {
+      out += ii == counts.begin() ? "\n    " : ",\n    ";
+      out += jsonString(ii->first) + ": " + jsonNumber(ii->second);
+    }
+    out += counts.empty() ? "},\n" : "\n  },\n";
+  }
+}
+
+string stats_t::json() const {
+  map<string, size_t> token_counts;
+  for (size_t ii = 1; ii < max_tokens; ++ii) {
+    if (tokens[ii] != 0) {
+      token_counts[tokenName(ii)] = tokens[ii];
+    }
+  }
+
+  string out("{\n");
+  jsonCounts(out, "tokens", token_counts);
+  out += "  \"reductions\": " + jsonNumber(reductions) + ",\n";
+  out += "  \"nodes_allocated\": " + jsonNumber(nodes_allocated) + ",\n";
+  jsonCounts(out, "nodes", nodes);
+  out += "  \"string_bytes\": " + jsonNumber(string_bytes) + ",\n";
+  out += "  \"render_bytes\": " + jsonNumber(render_bytes) + ",\n";
+  out += "  \"walker_visits\": " + jsonNumber(walker_visits) + ",\n";
+  out += "  \"phases\": {";
+  for (map<string, phase_t>::const_iterator ii = phases.begin(); ii != phases.end(); ++ii) {
+    out += ii == phases.begin() ? "\n    " : ",\n    ";
+    out += jsonString(ii->first) + ": {\"calls\": " + jsonNumber(ii->second.calls) +
+      ", \"wall_ms\": " + jsonNumber(ii->second.wall * 1000) +
+      ", \"cpu_ms\": " + jsonNumber(ii->second.cpu * 1000) + "}";
+  }
+  out += phases.empty() ? "}\n}\n" : "\n  }\n}\n";
+  return out;
+}
+
+//
+// StatsScope
+StatsScope::StatsScope(stats_t& stats) : previous(stats_t::_current) {
+  stats_t::_current = &stats;
+}
+
+StatsScope::~StatsScope() {
+  stats_t::_current = previous;
+}
+
+//
+// StatsPhase
+StatsPhase::StatsPhase(const char* name) : phase(NULL) {
+  if (stats_t::current() != NULL) {
+    start(name);
+  }
+}
+
+StatsPhase::StatsPhase(const type_info& type) : phase(NULL) {
+  if (stats_t::current() != NULL) {
+    start(stats_t::typeName(type));
+  }
+}
+
+void StatsPhase::start(const string& name) {
+  phase = &stats_t::current()->phases[name];
+  clock_gettime(CLOCK_MONOTONIC, &wall);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+}
+
+namespace {
+  double elapsed(clockid_t clock, const timespec& since) {
+    timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - since.tv_sec) + (now.tv_nsec - since.tv_nsec) / 1e9;
+  }
+}
+
+StatsPhase::~StatsPhase() {
+  if (phase != NULL) {
+    ++phase->calls;
+    phase->wall += elapsed(CLOCK_MONOTONIC, wall);
+    phase->cpu += elapsed(CLOCK_THREAD_CPUTIME_ID, cpu);
+  }
+}
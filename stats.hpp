@@ -0,0 +1,129 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <stddef.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <typeinfo>
+
+//
+// Opt-in counters for what parsing, walking and rendering cost. The library only collects them
+// when it's built with FBJS_STATS defined (`make STATS=1`); otherwise FBJS_STAT() and
+// FBJS_STAT_PHASE() expand to nothing and a stats_t just stays empty. With it, they're collected
+// for whichever stats_t the current thread has installed with a StatsScope:
+//
+//   stats_t stats;
+//   {
+//     StatsScope scope(stats);
+//     NodeProgram program(code);
+//     program.renderString();
+//   }
+//   fputs(stats.json().c_str(), stderr);
+namespace fbjs {
+  class Node;
+
+  struct stats_t {
+    struct phase_t {
+      size_t calls;
+      double wall; // seconds
+      double cpu; // seconds of this thread's CPU time
+
+      phase_t() : calls(0), wall(0), cpu(0) {}
+    };
+
+    static const size_t max_tokens = 512;
+
+    size_t tokens[max_tokens]; // tokens lexed, by token number
+    size_t reductions; // bison only, plus one per error it recovers from
+    size_t nodes_allocated; // every node constructed, parsed or not
+    std::map<std::string, size_t> nodes; // nodes in the trees parsed, by type
+    size_t string_bytes; // identifiers, strings, regexes and XML text copied into nodes
+    size_t render_bytes; // output written by render(), not counting the measuring pass
+    size_t walker_visits; // nodes visited by NodeWalker and NodePipeline
+    std::map<std::string, phase_t> phases; // "parse", "render", "pipeline" and each walker class
+
+    stats_t();
+
+    void token(int tok);
+    void countTree(const Node* root);
+    std::string json() const;
+
+    // The stats_t installed for this thread, if any
+    static stats_t* current() {
+      return _current;
+    }
+
+    // Class names for phases and `nodes`, without the fbjs:: namespace
+    static std::string typeName(const std::type_info& type);
+
+    private:
+      static __thread stats_t* _current;
+      friend class StatsScope;
+  };
+
+  // Quotes a string for JSON output
+  std::string jsonString(const std::string& str);
+
+  //
+  // StatsScope: installs a stats_t for the current thread until it goes out of scope. Scopes nest;
+  // the previous stats_t is put back afterwards.
+  class StatsScope {
+    private:
+      stats_t* previous;
+      StatsScope(const StatsScope&);
+      StatsScope& operator=(const StatsScope&);
+
+    public:
+      StatsScope(stats_t& stats);
+      ~StatsScope();
+  };
+
+  //
+  // StatsPhase: adds the wall and CPU time of its lifetime to a phase of the installed stats_t.
+  // Phases can nest (a walker run from inside another one), in which case their times overlap.
+  class StatsPhase {
+    private:
+      stats_t::phase_t* phase;
+      timespec wall;
+      timespec cpu;
+      StatsPhase(const StatsPhase&);
+      StatsPhase& operator=(const StatsPhase&);
+      void start(const std::string& name);
+
+    public:
+      StatsPhase(const char* name);
+      StatsPhase(const std::type_info& type);
+      ~StatsPhase();
+  };
+}
+
+#ifdef FBJS_STATS
+#define FBJS_STAT(expr) \
+  do { \
+    if (fbjs::stats_t* fbjs_stats = fbjs::stats_t::current()) { \
+      fbjs_stats->expr; \
+    } \
+  } while (0)
+#define FBJS_STAT_PHASE(name) fbjs::StatsPhase fbjs_stats_phase(name)
+#else
+#define FBJS_STAT(expr) do {} while (0)
+#define FBJS_STAT_PHASE(name)
+#endif
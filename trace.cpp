@@ -0,0 +1,173 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "stats.hpp"
+#include "trace.hpp"
+#ifdef FBJS_USDT
+#include <sys/sdt.h>
+#endif
+using namespace std;
+using namespace fbjs;
+
+namespace {
+  double now() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+  }
+
+  int thread_id() {
+    static __thread int tid = 0;
+    if (tid == 0) {
+      tid = syscall(SYS_gettid);
+    }
+    return tid;
+  }
+}
+
+//
+// Tracer
+Tracer* Tracer::_current = NULL;
+
+Tracer::Tracer(size_t capacity /* = 0 */, int opts /* = TRACE_NONE */) : capacity(capacity), next(0), _dropped(0), _opts(opts) {
+  pthread_mutex_init(&mutex, NULL);
+}
+
+Tracer::~Tracer() {
+  pthread_mutex_destroy(&mutex);
+}
+
+//
+// Probes fire whether or not anyone is listening, so with them built in every event starts
+bool Tracer::tracing(int opts /* = TRACE_NONE */) {
+#ifdef FBJS_USDT
+  return true;
+#else
+  return _current != NULL && (_current->_opts & opts) == opts;
+#endif
+}
+
+size_t Tracer::dropped() const {
+  pthread_mutex_lock(&mutex);
+  size_t dropped = _dropped;
+  pthread_mutex_unlock(&mutex);
+  return dropped;
+}
+
+void Tracer::record(const trace_event_t& event) {
+  pthread_mutex_lock(&mutex);
+  if (capacity == 0 || events.size() < capacity) {
+    events.push_back(event);
+  } else {
+    events[next] = event;
+    next = (next + 1) % capacity;
+    ++_dropped;
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+string Tracer::json() const {
+  char buf[128];
+  string out("{\"traceEvents\": [");
+  pthread_mutex_lock(&mutex);
+  for (size_t ii = 0; ii < events.size(); ++ii) {
+    const trace_event_t& event = events[(next + ii) % events.size()];
+    out += ii == 0 ? "\n  " : ",\n  ";
+    out += "{\"name\": " + jsonString(event.name) + ", \"cat\": \"fbjs\", \"ph\": \"X\"";
+    snprintf(buf, sizeof(buf), ", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d",
+      event.start, event.duration, (int)getpid(), event.tid);
+    out += buf;
+    if (!event.detail.empty()) {
+      out += ", \"args\": {\"detail\": " + jsonString(event.detail) + "}";
+    }
+    out += "}";
+  }
+  pthread_mutex_unlock(&mutex);
+  out += "\n]}\n";
+  return out;
+}
+
+bool Tracer::write(const char* path) const {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  string out(json());
+  bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+  return fclose(file) == 0 && ok;
+}
+
+//
+// TraceScope
+TraceScope::TraceScope(Tracer& tracer) : previous(Tracer::_current) {
+  Tracer::_current = &tracer;
+}
+
+TraceScope::~TraceScope() {
+  Tracer::_current = previous;
+}
+
+//
+// TraceEvent
+TraceEvent::TraceEvent() : started(false) {}
+
+TraceEvent::TraceEvent(const char* name, const string& detail /* = string() */) : started(false) {
+  if (Tracer::tracing()) {
+    start(name, detail);
+  }
+}
+
+TraceEvent::TraceEvent(const type_info& walker) : started(false) {
+  if (Tracer::tracing()) {
+    start(stats_t::typeName(walker));
+  }
+}
+
+void TraceEvent::start(const string& name, const string& detail /* = string() */) {
+  this->started = true;
+  this->name = name;
+  this->detail = detail;
+#ifdef FBJS_USDT
+  DTRACE_PROBE2(fbjs, event__start, this->name.c_str(), this->detail.c_str());
+#endif
+  this->start_time = now();
+}
+
+TraceEvent::~TraceEvent() {
+  if (!started) {
+    return;
+  }
+  double end = now();
+#ifdef FBJS_USDT
+  DTRACE_PROBE2(fbjs, event__end, name.c_str(), detail.c_str());
+#endif
+  if (Tracer* tracer = Tracer::current()) {
+    trace_event_t event;
+    event.name = name;
+    event.detail = detail;
+    event.start = start_time;
+    event.duration = end - start_time;
+    event.tid = thread_id();
+    tracer->record(event);
+  }
+}
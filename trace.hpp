@@ -0,0 +1,140 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#pragma once
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+//
+// Timeline tracing for the same points stats.hpp times: each parse, NodeWalker::walk(), NodePipeline
+// run and render pass, and optionally each top-level function as it renders. Built with FBJS_TRACE
+// (`make TRACE=1`) these are recorded as Chrome Trace Event JSON by whichever Tracer is installed;
+// built with FBJS_USDT (`make USDT=1`, needs <sys/sdt.h>) they also fire fbjs:event__start and
+// fbjs:event__end probes, with the event's name and detail, for perf or bpftrace. Without either
+// flag FBJS_TRACE_EVENT() expands to nothing.
+//
+// Callers can wrap their own work in a TraceEvent too, which is the way to tell files apart:
+//
+//   Tracer tracer(100000);
+//   TraceScope scope(tracer);
+//   for (...) {
+//     TraceEvent event("file", path);
+//     ...
+//   }
+//   tracer.write("trace.json");
+namespace fbjs {
+
+  enum trace_enum {
+    TRACE_NONE = 0,
+    TRACE_FUNCTIONS = 1, // an event for each top-level function rendered
+  };
+
+  struct trace_event_t {
+    std::string name;
+    std::string detail;
+    double start; // microseconds
+    double duration;
+    int tid;
+  };
+
+  //
+  // Tracer: keeps the events which finish while it's installed. With a capacity it's a ring buffer
+  // of the newest ones; otherwise it keeps everything. Safe to record into from several threads.
+  class Tracer {
+    private:
+      std::vector<trace_event_t> events;
+      size_t capacity;
+      size_t next; // where the next event goes once the ring is full
+      size_t _dropped;
+      int _opts;
+      mutable pthread_mutex_t mutex;
+      static Tracer* _current;
+      friend class TraceScope;
+      Tracer(const Tracer&);
+      Tracer& operator=(const Tracer&);
+
+    public:
+      Tracer(size_t capacity = 0, int opts = TRACE_NONE);
+      ~Tracer();
+
+      int opts() const {
+        return _opts;
+      }
+
+      // Events pushed out of the ring buffer so far
+      size_t dropped() const;
+
+      void record(const trace_event_t& event);
+      std::string json() const;
+      bool write(const char* path) const;
+
+      // The installed tracer, if any. This is process-wide so that every thread's events end up in
+      // one timeline; install it before starting them.
+      static Tracer* current() {
+        return _current;
+      }
+
+      // Whether to start an event, given the trace_enum options it depends on. Always true when
+      // probes are built in.
+      static bool tracing(int opts = TRACE_NONE);
+  };
+
+  //
+  // TraceScope: installs a Tracer until it goes out of scope
+  class TraceScope {
+    private:
+      Tracer* previous;
+      TraceScope(const TraceScope&);
+      TraceScope& operator=(const TraceScope&);
+
+    public:
+      TraceScope(Tracer& tracer);
+      ~TraceScope();
+  };
+
+  //
+  // TraceEvent: one event, from construction to destruction. An event that isn't started by its
+  // constructor can be started later, which is how optional events are traced.
+  class TraceEvent {
+    private:
+      bool started;
+      std::string name;
+      std::string detail;
+      double start_time;
+      TraceEvent(const TraceEvent&);
+      TraceEvent& operator=(const TraceEvent&);
+
+    public:
+      TraceEvent();
+      TraceEvent(const char* name, const std::string& detail = std::string());
+      TraceEvent(const std::type_info& walker);
+      ~TraceEvent();
+      void start(const std::string& name, const std::string& detail = std::string());
+  };
+}
+
+#if defined(FBJS_TRACE) || defined(FBJS_USDT)
+#define FBJS_TRACING
+#define FBJS_TRACE_EVENT(name) fbjs::TraceEvent fbjs_trace_event(name)
+#else
+#define FBJS_TRACE_EVENT(name)
+#endif
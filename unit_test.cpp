@@ -0,0 +1,360 @@
+/**
+* Copyright (c) 2008-2009 Facebook
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* See accompanying file LICENSE.txt.
+*
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include "node.hpp"
+#include "folder.hpp"
+#include "mangler.hpp"
+#include "pipeline.hpp"
+#include "walker.hpp"
+using namespace std;
+using namespace fbjs;
+
+//
+// Small regression tests for the library, each one a function which returns false and prints what
+// went wrong on failure. `make check` builds and runs them.
+//
+//   unit_test
+
+namespace {
+
+  string render(const Node* root) {
+    return root->renderString(RENDER_MINIMAL_PARENS);
+  }
+
+  bool expect(const char* what, const string& actual, const string& expected) {
+    if (actual == expected) {
+      return true;
+    }
+    printf("%s:\n  expected: %s\n  actual:   %s\n", what, expected.c_str(), actual.c_str());
+    return false;
+  }
+
+  string mangled(const string& code) {
+    auto_ptr<NodeProgram> root(Parser().parse(code.data(), code.size()));
+    mangleIdentifiers(root.get());
+    return render(root.get());
+  }
+
+  string folded(const string& code) {
+    NodePipeline pipeline;
+    pipeline.add(new ConstantFolder);
+    auto_ptr<Node> root(pipeline.run(Parser().parse(code.data(), code.size())));
+    return render(root.get());
+  }
+
+  bool testFoldKeepsReferences() {
+    // Dropping the 0 would pass obj as `this`, make a direct eval, or delete x
+    struct { const char* code; const char* expected; } cases[] = {
+      { "(0, obj.method)();", "(0,obj.method)();" },
+      { "(0, obj[\"m\"])(1);", "(0,obj[\"m\"])(1);" },
+      { "(0, eval)(\"x\");", "(0,eval)(\"x\");" },
+      { "(1 && obj.m)();", "(1&&obj.m)();" },
+      { "(0 || obj.m)();", "(0||obj.m)();" },
+      { "(1 ? obj.m : 2)();", "(1?obj.m:2)();" },
+      { "(0, (1, obj.m))();", "(1,obj.m)();" },
+      { "delete (0, x);", "delete(0,x);" },
+      { "typeof (0, x);", "typeof(0,x);" },
+      { "(0, f)();", "f();" },
+      { "x = (0, obj.m);", "x=obj.m;" },
+      { "(0, obj.m)() + (0, obj.m);", "(0,obj.m)()+obj.m;" },
+    };
+    bool ok = true;
+    for (size_t ii = 0; ii < sizeof(cases) / sizeof(cases[0]); ++ii) {
+      ok = expect(cases[ii].code, folded(cases[ii].code), cases[ii].expected) && ok;
+    }
+    return ok;
+  }
+
+  bool testFoldNumberToString() {
+    struct { const char* code; const char* expected; } cases[] = {
+      { "\"x\" + 1152921504606846976;", "\"x1152921504606847000\";" },
+      { "\"x\" + 9007199254740992;", "\"x9007199254740992\";" },
+      { "\"x\" + 123456789012345680000;", "\"x123456789012345680000\";" },
+      { "\"x\" + 1e21;", "\"x1e+21\";" },
+      { "\"x\" + 1.5e300;", "\"x1.5e+300\";" },
+      { "\"x\" + 0.1;", "\"x0.1\";" },
+      { "\"x\" + 123.456;", "\"x123.456\";" },
+      { "\"x\" + 0.3333333333333333;", "\"x0.3333333333333333\";" },
+      { "\"x\" + 0.000001;", "\"x0.000001\";" },
+      { "\"x\" + 1.5e-7;", "\"x1.5e-7\";" },
+      { "\"x\" + 5e-324;", "\"x5e-324\";" },
+      { "\"x\" + -2.5;", "\"x-2.5\";" },
+      { "\"x\" + -0;", "\"x0\";" },
+    };
+    bool ok = true;
+    for (size_t ii = 0; ii < sizeof(cases) / sizeof(cases[0]); ++ii) {
+      ok = expect(cases[ii].code, folded(cases[ii].code), cases[ii].expected) && ok;
+    }
+    return ok;
+  }
+
+  bool testRenderTruncates() {
+    auto_ptr<NodeProgram> root(Parser().parse("function g(){return 1}", 22));
+    string whole = root->renderString();
+    bool ok = true;
+    for (size_t size = 0; size <= whole.size() + 1; ++size) {
+      char buf[64];
+      memset(buf, '#', sizeof(buf));
+      size_t length = root->render(size ? buf : NULL, size);
+      if (length != whole.size()) {
+        printf("render into %lu bytes returned %lu, not %lu\n", (unsigned long)size, (unsigned long)length, (unsigned long)whole.size());
+        ok = false;
+      } else if (size != 0) {
+        ok = expect("render into a short buffer", string(buf, strlen(buf)), whole.substr(0, size - 1)) && ok;
+        if (buf[size] != '#') {
+          printf("render into %lu bytes wrote past the end\n", (unsigned long)size);
+          ok = false;
+        }
+      }
+    }
+    return ok;
+  }
+
+  class CountingWalker: public NodeWalker {
+    protected:
+      size_t* count;
+    public:
+      CountingWalker(size_t* count) : count(count) {}
+      virtual NodeWalker* clone() const {
+        return new CountingWalker(count);
+      }
+      virtual void visit(Node& node) {
+        ++*count;
+        visitChildren();
+      }
+  };
+
+  string nested(const char* open, const char* middle, const char* close, size_t depth) {
+    string code;
+    for (size_t ii = 0; ii < depth; ++ii) {
+      code += open;
+    }
+    code += middle;
+    for (size_t ii = 0; ii < depth; ++ii) {
+      code += close;
+    }
+    return code;
+  }
+
+  bool parses(const string& code, node_parse_enum opts) {
+    try {
+      delete Parser(opts).parse(code.data(), code.size());
+      return true;
+    } catch (ParseException& ex) {
+      return false;
+    }
+  }
+
+  //
+  // Finds the deepest nesting of each shape each parser takes, on a 256KB stack, and renders, walks,
+  // folds and mangles it there. Running out of stack crashes the test.
+  struct deep_shape_t {
+    const char* open;
+    const char* middle;
+    const char* close;
+  };
+
+  const deep_shape_t deep_shapes[] = {
+    { "[", "1", "]" },
+    { "(", "1", ")" },
+    { "!", "1", "" },
+    { "-(", "1", ")" },
+    { "!(", "1", ")" },
+    { "(a,", "1", ")" },
+    { "a+(", "1", ")" },
+    { "f(", "1", ")" },
+    { "a.b(", "1", ")" },
+    { "a[", "1", "]" },
+    { "{a:", "1", "}" },
+    { "{", "", "}" },
+    { "do ", ";", "while(a);" },
+    { "try{", "", "}finally{}" },
+    { "if(a);else ", ";", "" },
+    { "switch(a){case 1:", "", "}" },
+    { "function f(){", "", "}" },
+    { "(function(){", "", "})();" },
+    { "[function(){return ", "1", "}]" },
+  };
+
+  const node_parse_enum deep_parsers[] = { PARSE_NONE, PARSE_DESCENT };
+
+  void* deepNesting(void* ok_) {
+    bool* ok = static_cast<bool*>(ok_);
+    for (size_t ii = 0; ii < sizeof(deep_shapes) / sizeof(deep_shapes[0]); ++ii) {
+      const deep_shape_t& shape = deep_shapes[ii];
+      for (size_t jj = 0; jj < sizeof(deep_parsers) / sizeof(deep_parsers[0]); ++jj) {
+        size_t low = 1, high = 1;
+        while (parses(nested(shape.open, shape.middle, shape.close, high), deep_parsers[jj])) {
+          low = high;
+          high *= 2;
+          if (high > 100000) {
+            printf("%s%s%s nests without limit (options %d)\n", shape.open, shape.middle, shape.close, deep_parsers[jj]);
+            *ok = false;
+            return NULL;
+          }
+        }
+        while (high - low > 1) {
+          size_t middle = (low + high) / 2;
+          (parses(nested(shape.open, shape.middle, shape.close, middle), deep_parsers[jj]) ? low : high) = middle;
+        }
+        string code = nested(shape.open, shape.middle, shape.close, low);
+        auto_ptr<Node> root(Parser(deep_parsers[jj]).parse(code.data(), code.size()));
+        root->renderString();
+        root->renderString(RENDER_PRETTY | RENDER_MAINTAIN_LINENO);
+        auto_ptr<Node> copy(root->clone());
+        if (*copy != *root) {
+          printf("%s%s%s: clone differs\n", shape.open, shape.middle, shape.close);
+          *ok = false;
+        }
+        size_t count = 0;
+        CountingWalker(&count).walk(root.get());
+        mangleIdentifiers(copy.get());
+        NodePipeline pipeline;
+        pipeline.add(new ConstantFolder);
+        root.reset(pipeline.run(root.release()));
+      }
+    }
+    return NULL;
+  }
+
+  bool testDeepNestingSmallStack() {
+    bool ok = true;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, deepNesting, &ok) != 0) {
+      perror("pthread_create");
+      return false;
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    return ok;
+  }
+
+  bool testMangleCatchRedeclaration() {
+    // The function's `err` is declared through the catch variable, so they must share a name
+    return expect("var redeclaring a catch parameter",
+        mangled("function g(){ var x1=1; try{ throw 1 }catch(err){var err=2;} return err + x1 + x1 + x1; }"),
+        "function g(){var a=1;try{throw 1;}catch(b){var b=2;}return b+a+a+a;}") &
+      expect("function redeclaring a catch parameter",
+        mangled("function g(){ try{}catch(e){function e(){}} return e; }"),
+        "function g(){try{}catch(a){function a(){}}return a;}");
+  }
+
+  class CountingResource: public MemoryResource {
+    public:
+      size_t live;
+      size_t allocations;
+      CountingResource() : live(0), allocations(0) {}
+      virtual void* allocate(size_t size) {
+        live += size;
+        ++allocations;
+        return ::operator new(size);
+      }
+      virtual void deallocate(void* ptr, size_t size) {
+        live -= size;
+        ::operator delete(ptr);
+      }
+  };
+
+  bool testParserResource() {
+    // Given to the parser rather than installed for the thread
+    CountingResource resource;
+    bool ok = true;
+    {
+      auto_ptr<NodeProgram> parsed(Parser(PARSE_NONE, 20, &resource).parse("a = [1, 'b'];", 13));
+      PushParser push(PARSE_NONE, 20, NULL, &resource);
+      push.feed("f(x", 3);
+      push.feed(");", 2);
+      auto_ptr<NodeProgram> pushed(push.finish());
+      push.feed("g(", 2); // left for the destructor to free
+      ok = expect("parse from a resource", render(parsed.get()), "a=[1,'b'];") &
+        expect("push parse from a resource", render(pushed.get()), "f(x);");
+      if (resource.live < 2 * sizeof(NodeProgram) || MemoryResource::current() != NULL) {
+        printf("the parsers didn't allocate from their resource\n");
+        ok = false;
+      }
+    }
+    if (resource.live != 0) {
+      printf("%lu bytes left in the resource\n", (unsigned long)resource.live);
+      ok = false;
+    }
+    return ok;
+  }
+
+  bool testXMLTextAllocations() {
+    // Nodes and token text come from the resource, so a text node costs the same however long it is
+    const node_parse_enum parsers[] = { PARSE_E4X, static_cast<node_parse_enum>(PARSE_E4X | PARSE_DESCENT) };
+    const string line = "Some text, with: a=b / c > d 'single' \"double\" } &amp; &lt;entities&gt;\n";
+    bool ok = true;
+    for (size_t ii = 0; ii < sizeof(parsers) / sizeof(parsers[0]); ++ii) {
+      size_t allocations[2];
+      for (size_t jj = 0; jj < 2; ++jj) {
+        string code = "x = <a>";
+        for (size_t kk = 0; kk < (jj ? 1000 : 1); ++kk) {
+          code += line;
+        }
+        code += "</a>;";
+        CountingResource resource;
+        delete Parser(parsers[ii], 20, &resource).parse(code.data(), code.size());
+        allocations[jj] = resource.allocations;
+      }
+      if (allocations[0] != allocations[1]) {
+        printf("XML text of 1 line took %lu allocations, of 1000 lines %lu (options %d)\n",
+          (unsigned long)allocations[0], (unsigned long)allocations[1], parsers[ii]);
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  typedef bool (*test_t)();
+  struct test_entry_t {
+    const char* name;
+    test_t test;
+  };
+
+  const test_entry_t tests[] = {
+    { "mangle catch redeclaration", testMangleCatchRedeclaration },
+    { "fold keeps references", testFoldKeepsReferences },
+    { "fold number to string", testFoldNumberToString },
+    { "render truncates", testRenderTruncates },
+    { "deep nesting on a small stack", testDeepNestingSmallStack },
+    { "parser resource", testParserResource },
+    { "XML text allocations", testXMLTextAllocations },
+  };
+}
+
+int main(int argc, char* argv[]) {
+  size_t failures = 0, count = sizeof(tests) / sizeof(tests[0]);
+  for (size_t ii = 0; ii < count; ++ii) {
+    if (!tests[ii].test()) {
+      printf("FAILED %s\n", tests[ii].name);
+      ++failures;
+    }
+  }
+  printf("%lu tests, %lu failures\n", (unsigned long)count, (unsigned long)failures);
+  return failures ? 1 : 0;
+}
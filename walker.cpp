@@ -19,8 +19,57 @@
 */
 
 #include "walker.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 using namespace fbjs;
 
+//
+// NodeWalker: these live here rather than in the header so that whether they're counted and traced
+// depends on how the library was built, not on whoever includes it.
+Node* NodeWalker::walk(Node* root) {
+  FBJS_STAT_PHASE(typeid(*this));
+  FBJS_TRACE_EVENT(typeid(*this));
+  replaceAndVisit(root);
+  return _node;
+}
+
+void NodeWalker::replaceAndVisit(Node* new_node) {
+  FBJS_STAT(walker_visits++);
+  replace(new_node);
+  if (new_node == NULL) {
+    visit();
+  } else {
+    new_node->accept(*this);
+  }
+  if (new_node != _node && new_node) {
+    delete new_node;
+  }
+}
+
+NodeWalker::ptr NodeWalker::visitChild(node_list_t::iterator ii) {
+  FBJS_STAT(walker_visits++);
+  ptr walker(clone());
+  walker->_parent = this;
+  walker->_node = *ii;
+  if (*ii == NULL) {
+    walker->visit();
+  } else {
+    (*ii)->accept(*walker);
+  }
+  if (walker->_remove) {
+    Node* old_node = _node->removeChild(ii);
+    if (!walker->_skip_delete) {
+      delete old_node;
+    }
+  } else if (*ii != walker->_node) {
+    Node* old_node = _node->replaceChild(walker->_node, ii);
+    if (!walker->_skip_delete && old_node) {
+      delete old_node;
+    }
+  }
+  return walker;
+}
+
 void Node::accept(NodeWalker& walker) {
   walker.visit(*this);
 }
@@ -15,6 +15,13 @@
   }
 
 namespace fbjs {
+
+  //
+  // NodeWalker: visits a tree through visit() overloads which decide when to visitChildren(). That
+  // recurses once per level of the tree. The parsers cap nesting so that fits in 256KB of stack (see
+  // Parser), but not the length of left-associative chains, and a long enough `a+a+...` chain still
+  // runs out of stack. Work which fits in enter() and leave() hooks can be a NodePass instead, and
+  // NodePipeline walks without recursing; that's what ConstantFolder does.
   class NodeWalker {
     private:
       NodeWalker* _parent;
@@ -32,10 +39,7 @@ namespace fbjs {
         _skip_delete(false) {};
       virtual ~NodeWalker() {};
       virtual NodeWalker* clone() const = 0;
-      virtual Node* walk(Node* root) {
-        replaceAndVisit(root);
-        return _node;
-      }
+      virtual Node* walk(Node* root);
 
       NodeWalker* parent() const {
         return _parent;
@@ -77,17 +81,7 @@ namespace fbjs {
         _skip_delete = skip_delete;
       }
 
-      void replaceAndVisit(Node* new_node) {
-        replace(new_node);
-        if (new_node == NULL) {
-          visit();
-        } else {
-          new_node->accept(*this);
-        }
-        if (new_node != _node && new_node) {
-          delete new_node;
-        }
-      }
+      void replaceAndVisit(Node* new_node);
 
       std::auto_ptr<ptr_vector> visitChildren() {
         ptr_vector ret;
@@ -98,27 +92,7 @@ namespace fbjs {
         return ret.release();
       }
 
-      ptr visitChild(node_list_t::iterator ii) {
-        ptr walker(clone());
-        walker->_parent = this;
-        walker->_node = *ii;
-        if (*ii == NULL) {
-          visit();
-        } else {
-          (*ii)->accept(*walker);
-        }
-        if (_remove) {
-          if (!_skip_delete) {
-            delete _node->removeChild(ii);
-          }
-        } else if (*ii != walker->_node) {
-          Node* old_node = _node->replaceChild(walker->_node, ii);
-          if (!_skip_delete && old_node) {
-            delete old_node;
-          }
-        }
-        return walker;
-      }
+      ptr visitChild(node_list_t::iterator ii);
 
     public:
       virtual void visit() {}